@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file async_coder.cc
+ * @brief asynchronous front-end running Encode and Decode jobs on a pool of
+ *        coding threads, so I/O threads never run the coding math
+ */
+
+#include "common/async_coder.h"
+#include <string.h>
+#include <sys/time.h>
+#include "common/numa_util.h"
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+CodingJob::CodingJob() {
+    type = kEncode;
+    coder = NULL;
+    erased = NULL;
+    data_ptrs = NULL;
+    coding_ptrs = NULL;
+    size = 0;
+    callback = NULL;
+    node = kAnyNode;
+    m_node = 0;
+    m_submit_us = 0;
+    m_start_us = 0;
+    m_finish_us = 0;
+    m_done = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+CodingJob::~CodingJob() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void CodingJob::Wait() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_done) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+AsyncCoder::AsyncCoder(int num_threads, int max_pending_jobs) {
+    assert(num_threads > 0);
+    assert(max_pending_jobs > 0);
+
+    m_num_threads = num_threads;
+    m_num_nodes = NumaGetNodeCount();
+    if (m_num_nodes > num_threads) {
+        m_num_nodes = num_threads;
+    }
+    m_max_pending_jobs = max_pending_jobs;
+    m_args = new WorkerArg[num_threads];
+    m_threads = new pthread_t[num_threads];
+    m_started = new bool[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        m_args[i].coder = this;
+        m_args[i].index = i;
+        m_started[i] = false;
+    }
+    m_has_work = new pthread_cond_t[m_num_nodes];
+    m_queues = new std::deque<CodingJob *>[m_num_nodes];
+    m_node_stats = new AsyncCoderNodeStats[m_num_nodes];
+    for (int i = 0; i < m_num_nodes; i++) {
+        pthread_cond_init(&m_has_work[i], NULL);
+        memset(&m_node_stats[i], 0, sizeof(m_node_stats[i]));
+    }
+
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_not_full, NULL);
+    m_running = false;
+    m_stopping = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+AsyncCoder::~AsyncCoder() {
+    Stop();
+    delete[] m_args;
+    delete[] m_threads;
+    delete[] m_started;
+    for (int i = 0; i < m_num_nodes; i++) {
+        pthread_cond_destroy(&m_has_work[i]);
+    }
+    delete[] m_has_work;
+    delete[] m_queues;
+    delete[] m_node_stats;
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_not_full);
+}
+
+int AsyncCoder::Start() {
+    pthread_mutex_lock(&m_mutex);
+    if (m_running || m_stopping) {
+        pthread_mutex_unlock(&m_mutex);
+        return -1;
+    }
+    m_running = true;
+    pthread_mutex_unlock(&m_mutex);
+
+    // jobs of a node are only run by its threads, all of them are needed
+    for (int i = 0; i < m_num_threads; i++) {
+        m_started[i] = (pthread_create(&m_threads[i], NULL, _WorkerThread, &m_args[i]) == 0);
+        if (!m_started[i]) {
+            Stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void AsyncCoder::Stop() {
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = true;
+    bool running = m_running;
+    m_running = false;
+    for (int i = 0; i < m_num_nodes; i++) {
+        pthread_cond_broadcast(&m_has_work[i]);
+    }
+    pthread_cond_broadcast(&m_not_full);
+    pthread_mutex_unlock(&m_mutex);
+    if (!running) {
+        return;
+    }
+
+    // the threads leave once the queues are empty
+    for (int i = 0; i < m_num_threads; i++) {
+        if (m_started[i]) {
+            pthread_join(m_threads[i], NULL);
+            m_started[i] = false;
+        }
+    }
+}
+
+void AsyncCoder::_Enqueue(CodingJob *job) {
+    job->m_done = false;
+    job->m_submit_us = _NowUs();
+    int node = (job->node < 0) ? NumaGetCurrentNode() : job->node;
+    node %= m_num_nodes;
+    job->m_node = node;
+
+    // m_mutex is held by the caller, a thread checks the queue of its node
+    // under it before sleeping so the signal can not be lost
+    m_queues[node].push_back(job);
+    m_stats.num_submitted++;
+    m_stats.num_pending++;
+    pthread_cond_signal(&m_has_work[node]);
+}
+
+int AsyncCoder::Submit(CodingJob *job) {
+    assert(job != NULL && job->coder != NULL);
+    pthread_mutex_lock(&m_mutex);
+    while (!m_stopping && m_stats.num_pending >= m_max_pending_jobs) {
+        pthread_cond_wait(&m_not_full, &m_mutex);
+    }
+    if (m_stopping) {
+        pthread_mutex_unlock(&m_mutex);
+        return -1;
+    }
+    _Enqueue(job);
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+int AsyncCoder::TrySubmit(CodingJob *job) {
+    assert(job != NULL && job->coder != NULL);
+    pthread_mutex_lock(&m_mutex);
+    if (m_stopping || m_stats.num_pending >= m_max_pending_jobs) {
+        if (!m_stopping) {
+            m_stats.num_rejected++;
+        }
+        pthread_mutex_unlock(&m_mutex);
+        return -1;
+    }
+    _Enqueue(job);
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+void *AsyncCoder::_WorkerThread(void *arg) {
+    WorkerArg *worker = static_cast<WorkerArg *>(arg);
+    worker->coder->_RunWorker(worker->index);
+    return NULL;
+}
+
+void AsyncCoder::_RunWorker(int index) {
+    int node = index % m_num_nodes;
+    if (m_num_nodes > 1) {
+        NumaRunOnNode(node);
+    }
+    while (true) {
+        pthread_mutex_lock(&m_mutex);
+        while (m_queues[node].empty() && !m_stopping) {
+            pthread_cond_wait(&m_has_work[node], &m_mutex);
+        }
+        if (m_queues[node].empty()) {
+            pthread_mutex_unlock(&m_mutex);
+            break;
+        }
+        CodingJob *job = m_queues[node].front();
+        m_queues[node].pop_front();
+        pthread_mutex_unlock(&m_mutex);
+        _RunJob(job);
+    }
+}
+
+void AsyncCoder::_RunJob(CodingJob *job) {
+    job->m_start_us = _NowUs();
+    if (job->type == CodingJob::kEncode) {
+        job->coder->Encode(job->data_ptrs, job->coding_ptrs, job->size);
+    } else {
+        job->coder->Decode(job->erased, job->data_ptrs, job->coding_ptrs, job->size);
+    }
+    job->m_finish_us = _NowUs();
+
+    int64_t queue_us = job->queue_us();
+    int64_t run_us = job->run_us();
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_completed++;
+    m_stats.num_pending--;
+    m_stats.total_queue_us += queue_us;
+    m_stats.total_run_us += run_us;
+    if (queue_us > m_stats.max_queue_us) {
+        m_stats.max_queue_us = queue_us;
+    }
+    if (run_us > m_stats.max_run_us) {
+        m_stats.max_run_us = run_us;
+    }
+    AsyncCoderNodeStats *node_stats = &m_node_stats[job->m_node];
+    node_stats->num_completed++;
+    node_stats->num_bytes += static_cast<int64_t>(job->size) * job->coder->num_data_parts();
+    node_stats->run_us += run_us;
+    pthread_cond_signal(&m_not_full);
+    pthread_mutex_unlock(&m_mutex);
+
+    // the job may be gone once the submitter learns it is done
+    CodingJobCallback *callback = job->callback;
+    if (callback != NULL) {
+        job->m_done = true;
+        callback->OnJobDone(job);
+    } else {
+        pthread_mutex_lock(&job->m_mutex);
+        job->m_done = true;
+        pthread_cond_broadcast(&job->m_cond);
+        pthread_mutex_unlock(&job->m_mutex);
+    }
+}
+
+void AsyncCoder::GetStats(AsyncCoderStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void AsyncCoder::GetNodeStats(int node, AsyncCoderNodeStats *stats) const {
+    assert(node >= 0 && node < m_num_nodes);
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_node_stats[node];
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/async_coder.h
+ * @brief asynchronous front-end running Encode and Decode jobs on a pool of
+ *        coding threads, so I/O threads never run the coding math
+ */
+
+#ifndef INF_DS_RBS_COMMON_ASYNC_CODER_H_
+#define INF_DS_RBS_COMMON_ASYNC_CODER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include "common/cauchy_rscode.h"
+
+class CodingJob;
+
+/**
+ * @brief told when a job has run
+ */
+class CodingJobCallback {
+public:
+    virtual ~CodingJobCallback() {}
+
+    /**
+     * @brief called on the coding thread once the job has run, the job may
+     *        be deleted or resubmitted from here
+     */
+    virtual void OnJobDone(CodingJob *job) = 0;
+};
+
+/**
+ * @brief one Encode or Decode call. The buffers must stay valid until the
+ *        job is done. Without a callback the submitter waits with Wait.
+ */
+class CodingJob {
+public:
+    enum Type {
+        kEncode,
+        kDecode
+    };
+
+    static const int kAnyNode = -1;
+
+    CodingJob();
+
+    ~CodingJob();
+
+    /**
+     * @brief wait until the job has run
+     */
+    void Wait();
+
+    bool IsDone() const {
+        return m_done;
+    }
+
+    // queue wait and run time of the last run, in microseconds
+    int64_t queue_us() const {
+        return m_start_us - m_submit_us;
+    }
+    int64_t run_us() const {
+        return m_finish_us - m_start_us;
+    }
+
+    Type type;
+    CauchyRSCoder *coder;
+    bool *erased;                   ///< erased parts of a decode job
+    char **data_ptrs;
+    char **coding_ptrs;
+    int size;
+    CodingJobCallback *callback;    ///< NULL to Wait for the job
+    int node;                       ///< NUMA node of the buffers, by default
+                                    ///< kAnyNode: the node of the submitter
+
+private:
+    friend class AsyncCoder;
+
+    int64_t m_submit_us;
+    int64_t m_start_us;
+    int64_t m_finish_us;
+    int m_node;                     ///< node the job is queued to
+    volatile bool m_done;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+};
+
+struct AsyncCoderNodeStats {
+    uint64_t num_completed;         ///< jobs run on the node
+    int64_t num_bytes;              ///< bytes of data parts coded on the node
+    int64_t run_us;                 ///< sum of the run time of the jobs
+};
+
+struct AsyncCoderStats {
+    uint64_t num_submitted;         ///< jobs accepted
+    uint64_t num_rejected;          ///< TrySubmit calls refused for a full queue
+    uint64_t num_completed;         ///< jobs run
+    int num_pending;                ///< jobs queued or running
+    int64_t total_queue_us;         ///< sum of the queue wait of completed jobs
+    int64_t max_queue_us;
+    int64_t total_run_us;           ///< sum of the run time of completed jobs
+    int64_t max_run_us;
+};
+
+/**
+ * @brief Pool of coding threads with one job queue per NUMA node. The
+ *        threads are spread over the nodes and bound to them, a job runs on
+ *        the node of its buffers: it is queued to that node and only the
+ *        threads of the node take it, in submission order. At
+ *        most max_pending_jobs jobs are queued or running: Submit then blocks
+ *        and TrySubmit fails, which pushes back on the I/O threads instead of
+ *        growing the queues.
+ */
+class AsyncCoder {
+public:
+    AsyncCoder(int num_threads, int max_pending_jobs);
+
+    /**
+     * @brief Stop
+     */
+    ~AsyncCoder();
+
+    /**
+     * @brief start the coding threads, jobs submitted before wait for them
+     *
+     * @return 0 on success, -1 if some thread can not be started, the coder
+     *         is stopped then
+     */
+    int Start();
+
+    /**
+     * @brief run the jobs already submitted and stop the coding threads,
+     *        jobs submitted afterwards are refused. Jobs of a coder never
+     *        started are not run.
+     */
+    void Stop();
+
+    /**
+     * @brief queue a job, blocking while max_pending_jobs jobs are pending
+     *
+     * @return 0 on success, -1 if the coder is stopped
+     */
+    int Submit(CodingJob *job);
+
+    /**
+     * @brief queue a job if less than max_pending_jobs jobs are pending
+     *
+     * @return 0 on success, -1 if the queue is full or the coder is stopped
+     */
+    int TrySubmit(CodingJob *job);
+
+    void GetStats(AsyncCoderStats *stats) const;
+
+    /**
+     * @brief number of nodes the threads are spread over, at most the number
+     *        of threads
+     */
+    int num_nodes() const {
+        return m_num_nodes;
+    }
+
+    void GetNodeStats(int node, AsyncCoderNodeStats *stats) const;
+
+private:
+    struct WorkerArg {
+        AsyncCoder *coder;
+        int index;
+    };
+
+    static void *_WorkerThread(void *arg);
+
+    void _RunWorker(int index);
+
+    void _Enqueue(CodingJob *job);
+
+    void _RunJob(CodingJob *job);
+
+    int m_num_threads;              ///< number of coding threads, thread i
+                                    ///< runs on node i % m_num_nodes
+    int m_num_nodes;                ///< number of nodes with threads
+    int m_max_pending_jobs;         ///< limit of queued and running jobs
+    WorkerArg *m_args;
+    pthread_t *m_threads;
+    bool *m_started;                ///< whether thread i runs
+
+    mutable pthread_mutex_t m_mutex;    ///< protects the members below
+    pthread_cond_t *m_has_work;     ///< per node, signaled when a job is queued
+                                    ///< to the node or on stop
+    pthread_cond_t m_not_full;      ///< signaled when a pending job completes
+    std::deque<CodingJob *> *m_queues;  ///< per node, jobs not yet taken
+    bool m_running;                 ///< threads started and not stopped
+    bool m_stopping;                ///< Stop called
+    AsyncCoderStats m_stats;
+    AsyncCoderNodeStats *m_node_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_ASYNC_CODER_H_
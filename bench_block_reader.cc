@@ -0,0 +1,106 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Sequential scan throughput of BlockReader in 64 KB reads with prefetch
+// windows up to 0, 2, 8 and 16 stripes, on LocalPartServer with a 1 ms
+// part latency, run without arguments.
+
+#include "common/block_reader.h"
+#include "common/cauchy_rs_stream_encoder.h"
+#include "common/local_part_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+namespace {
+
+const int kDataParts = 6;
+const int kCodeParts = 3;
+const int kSliceSize = 4 * kCodingUnitSize;
+const int kNumStripes = 48;
+const int kReadSize = 64 << 10;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+class StripePutter : public StripeListener {
+public:
+    explicit StripePutter(PartHandle *handle) : m_handle(handle) {}
+
+    virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs, int size) {
+        PartsRequest put;
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            Part part;
+            part.offset = part_offset;
+            part.length = size;
+            part.data = (i < kDataParts) ? data_ptrs[i] : coding_ptrs[i - kDataParts];
+            put.server_addrs[i] = i;
+            put.todo_parts[i] = part;
+        }
+        m_handle->PutParts(&put);
+        put.Wait();
+    }
+
+private:
+    PartHandle *m_handle;
+};
+
+}  // namespace
+
+int main()
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 1000;
+    server_options.bytes_per_us = 2000;
+    std::map<int, int64_t> server_addrs;
+    for (int i = 0; i < kDataParts + kCodeParts; i++) {
+        servers.AddServer(i, server_options);
+        server_addrs[i] = i;
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+    CauchyRSCoder coder(kDataParts, kCodeParts);
+
+    std::vector<char> data(static_cast<size_t>(kNumStripes) * kDataParts * kSliceSize);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+    StripePutter putter(&handle);
+    CauchyRSStreamEncoder encoder(&coder, kSliceSize, &putter);
+    encoder.Append(&data[0], data.size());
+    encoder.Finish();
+
+    const int windows[] = {0, 2, 8, 16};
+    std::vector<char> buf(kReadSize);
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        BlockReaderOptions options;
+        options.slice_size = kSliceSize;
+        options.max_window = windows[w];
+        options.max_cached_sets = windows[w] + 2;
+        BlockReader reader(&coder, &handle, 0, server_addrs, data.size(), options);
+        int64_t start_us = NowUs();
+        for (size_t offset = 0; offset < data.size(); offset += kReadSize) {
+            if (reader.Read(offset, kReadSize, &buf[0]) != 0) {
+                fprintf(stderr, "read at %zu failed\n", offset);
+                return 1;
+            }
+        }
+        int64_t elapsed_us = NowUs() - start_us;
+        BlockReaderStats stats;
+        reader.GetStats(&stats);
+        printf("window up to %2d: %7.1f MB/s, %6.1f us per read, %3llu stripes prefetched,"
+               " %3llu waited for, %3llu on demand\n",
+               windows[w], static_cast<double>(data.size()) / elapsed_us,
+               static_cast<double>(elapsed_us) / stats.num_reads,
+               static_cast<unsigned long long>(stats.num_prefetches),
+               static_cast<unsigned long long>(stats.num_stripe_waits),
+               static_cast<unsigned long long>(stats.num_stripe_misses));
+    }
+    servers.Stop();
+    return 0;
+}
@@ -0,0 +1,277 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Throughput benchmarks of CauchyRSCoder, run without arguments.
+
+#include "common/cauchy_rscode.h"
+#include "common/crc32c.h"
+#include "common/stripe_buffer_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const int kPartSize = 4 << 20;
+const int kRounds = 20;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// MB of data parts processed per second
+double Throughput(int k, int size, int rounds, int64_t elapsed_us)
+{
+    return static_cast<double>(k) * size * rounds / elapsed_us;
+}
+
+// part buffers come from a huge page backed pool, as in the service
+StripeBuffers *AllocParts(StripeBufferPool *pool, int k, int size)
+{
+    StripeBuffers *buffers = pool->Acquire();
+    for (int i = 0; i < k; i++) {
+        for (int j = 0; j < size; j++) {
+            buffers->data_ptrs[i][j] = random();
+        }
+    }
+    return buffers;
+}
+
+// one lost data part: xor fast path of Decode against the general schedule
+void BenchSingleDataPartDecode(int k, int m)
+{
+    CauchyRSCoder coder(k, m);
+    StripeBufferPool pool(k, m, kPartSize, 0, true);
+    StripeBuffers *buffers = AllocParts(&pool, k, kPartSize);
+    char **data_ptrs = buffers->data_ptrs;
+    char **code_ptrs = buffers->coding_ptrs;
+    coder.Encode(data_ptrs, code_ptrs, kPartSize);
+
+    bool erased[k + m];
+    memset(erased, 0, sizeof(erased));
+    erased[k / 2] = true;
+
+    int64_t start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder.Decode(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t xor_us = NowUs() - start;
+
+    start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder._DecodeWithSchedule(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t schedule_us = NowUs() - start;
+
+    printf("single data part decode %2d+%d: xor %8.1f MB/s, schedule %8.1f MB/s\n",
+           k, m, Throughput(k, kPartSize, kRounds, xor_us),
+           Throughput(k, kPartSize, kRounds, schedule_us));
+    pool.Release(buffers);
+}
+
+// m <= 2: xor and combine plan kernels against the general schedule
+void BenchSmallParityKernels(int k, int m)
+{
+    CauchyRSCoder coder(k, m);
+    StripeBufferPool pool(k, m, kPartSize, 0, true);
+    StripeBuffers *buffers = AllocParts(&pool, k, kPartSize);
+    char **data_ptrs = buffers->data_ptrs;
+    char **code_ptrs = buffers->coding_ptrs;
+
+    int64_t start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder.Encode(data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t kernel_us = NowUs() - start;
+
+    start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder._EncodeWithSchedule(data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t schedule_us = NowUs() - start;
+    printf("encode %2d+%d: kernel %8.1f MB/s, schedule %8.1f MB/s\n",
+           k, m, Throughput(k, kPartSize, kRounds, kernel_us),
+           Throughput(k, kPartSize, kRounds, schedule_us));
+
+    // lose the first m data parts, coding part 0 is used for decoding
+    bool erased[k + m];
+    memset(erased, 0, sizeof(erased));
+    for (int i = 0; i < m; i++) {
+        erased[i] = true;
+    }
+
+    start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder.Decode(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    kernel_us = NowUs() - start;
+
+    start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder._DecodeWithSchedule(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    schedule_us = NowUs() - start;
+    printf("decode %2d+%d, %d data parts lost: kernel %8.1f MB/s, schedule %8.1f MB/s\n",
+           k, m, m, Throughput(k, kPartSize, kRounds, kernel_us),
+           Throughput(k, kPartSize, kRounds, schedule_us));
+    pool.Release(buffers);
+}
+
+// m data parts lost: Decode, which runs out of a per thread scratch, against
+// the general schedule which allocates its operations on every call
+void BenchDecode(int k, int m)
+{
+    CauchyRSCoder coder(k, m);
+    StripeBufferPool pool(k, m, kPartSize, 0, true);
+    StripeBuffers *buffers = AllocParts(&pool, k, kPartSize);
+    char **data_ptrs = buffers->data_ptrs;
+    char **code_ptrs = buffers->coding_ptrs;
+    coder.Encode(data_ptrs, code_ptrs, kPartSize);
+
+    bool erased[k + m];
+    memset(erased, 0, sizeof(erased));
+    for (int i = 0; i < m; i++) {
+        erased[i] = true;
+    }
+
+    int64_t start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder.Decode(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t decode_us = NowUs() - start;
+
+    start = NowUs();
+    for (int i = 0; i < kRounds; i++) {
+        coder._DecodeWithSchedule(erased, data_ptrs, code_ptrs, kPartSize);
+    }
+    int64_t schedule_us = NowUs() - start;
+    printf("decode %2d+%d, %d data parts lost: decode %8.1f MB/s, schedule %8.1f MB/s\n",
+           k, m, m, Throughput(k, kPartSize, kRounds, decode_us),
+           Throughput(k, kPartSize, kRounds, schedule_us));
+    pool.Release(buffers);
+}
+
+// many one coding unit stripes, as for small objects: per object cost of the
+// schedule and of Encode calls against EncodeBatch of growing batch sizes
+void BenchEncodeBatch(int k, int m)
+{
+    const int num_stripes = 256;
+    CauchyRSCoder coder(k, m);
+    StripeBufferPool pool(k, m, num_stripes * kCodingUnitSize, 0, true);
+    StripeBuffers *buffers = AllocParts(&pool, k, num_stripes * kCodingUnitSize);
+    EncodeStripe stripes[num_stripes];
+    for (int s = 0; s < num_stripes; s++) {
+        stripes[s].data_ptrs = new char*[k + m];
+        stripes[s].coding_ptrs = stripes[s].data_ptrs + k;
+        for (int i = 0; i < k + m; i++) {
+            stripes[s].data_ptrs[i] = buffers->data_ptrs[i] + s * kCodingUnitSize;
+        }
+        stripes[s].size = kCodingUnitSize;
+    }
+
+    int64_t start = NowUs();
+    for (int r = 0; r < kRounds; r++) {
+        for (int s = 0; s < num_stripes; s++) {
+            coder._EncodeWithSchedule(stripes[s].data_ptrs, stripes[s].coding_ptrs,
+                                      kCodingUnitSize);
+        }
+    }
+    int64_t elapsed_us = NowUs() - start;
+    printf("encode %2d+%d objects of %d KB: schedule %6.2f us/object",
+           k, m, k * kCodingUnitSize >> 10,
+           static_cast<double>(elapsed_us) / (kRounds * num_stripes));
+
+    start = NowUs();
+    for (int r = 0; r < kRounds; r++) {
+        for (int s = 0; s < num_stripes; s++) {
+            coder.Encode(stripes[s].data_ptrs, stripes[s].coding_ptrs, kCodingUnitSize);
+        }
+    }
+    elapsed_us = NowUs() - start;
+    printf(", single %6.2f", static_cast<double>(elapsed_us) / (kRounds * num_stripes));
+
+    int batch_sizes[] = { 4, 16, 64 };
+    for (int b = 0; b < 3; b++) {
+        start = NowUs();
+        for (int r = 0; r < kRounds; r++) {
+            for (int s = 0; s < num_stripes; s += batch_sizes[b]) {
+                coder.EncodeBatch(stripes + s, batch_sizes[b]);
+            }
+        }
+        elapsed_us = NowUs() - start;
+        printf(", batch %2d %6.2f", batch_sizes[b],
+               static_cast<double>(elapsed_us) / (kRounds * num_stripes));
+    }
+    printf("\n");
+
+    for (int s = 0; s < num_stripes; s++) {
+        delete[] stripes[s].data_ptrs;
+    }
+    pool.Release(buffers);
+}
+
+// Encode then CRC32C of every packet in a second sweep, against the fused
+// Encode computing the checksums in the same pass
+void BenchEncodeChecksums(int k, int m)
+{
+    CauchyRSCoder coder(k, m);
+    StripeBufferPool pool(k, m, kPartSize, 0, true);
+    StripeBuffers *buffers = AllocParts(&pool, k, kPartSize);
+    char **data_ptrs = buffers->data_ptrs;
+    char **code_ptrs = buffers->coding_ptrs;
+    const int num_part_packets = kPartSize / kPacketSize;
+    uint32_t *checksums = new uint32_t[(k + m) * num_part_packets];
+
+    int64_t start = NowUs();
+    for (int r = 0; r < kRounds; r++) {
+        coder.Encode(data_ptrs, code_ptrs, kPartSize);
+        for (int i = 0; i < k + m; i++) {
+            char *ptr = (i < k) ? data_ptrs[i] : code_ptrs[i - k];
+            for (int j = 0; j < num_part_packets; j++) {
+                checksums[i * num_part_packets + j] = Crc32c(ptr + j * kPacketSize, kPacketSize);
+            }
+        }
+    }
+    int64_t two_pass_us = NowUs() - start;
+
+    start = NowUs();
+    for (int r = 0; r < kRounds; r++) {
+        coder.Encode(data_ptrs, code_ptrs, kPartSize, checksums);
+    }
+    int64_t fused_us = NowUs() - start;
+    printf("encode %2d+%d with checksums: two pass %8.1f MB/s, fused %8.1f MB/s\n",
+           k, m, Throughput(k, kPartSize, kRounds, two_pass_us),
+           Throughput(k, kPartSize, kRounds, fused_us));
+    delete[] checksums;
+    pool.Release(buffers);
+}
+
+}  // namespace
+
+int main()
+{
+    int profiles[][2] = { { 6, 3 }, { 8, 4 }, { 12, 4 } };
+    for (int i = 0; i < 3; i++) {
+        BenchSingleDataPartDecode(profiles[i][0], profiles[i][1]);
+    }
+    for (int i = 0; i < 3; i++) {
+        BenchDecode(profiles[i][0], profiles[i][1]);
+    }
+
+    int small_parity_profiles[][2] = { { 4, 1 }, { 8, 1 }, { 4, 2 }, { 8, 2 }, { 12, 2 } };
+    for (int i = 0; i < 5; i++) {
+        BenchSmallParityKernels(small_parity_profiles[i][0], small_parity_profiles[i][1]);
+    }
+
+    int batch_profiles[][2] = { { 4, 2 }, { 8, 4 }, { 12, 4 } };
+    for (int i = 0; i < 3; i++) {
+        BenchEncodeBatch(batch_profiles[i][0], batch_profiles[i][1]);
+    }
+    for (int i = 0; i < 3; i++) {
+        BenchEncodeChecksums(profiles[i][0], profiles[i][1]);
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Degraded stripe reads of a few popular blocks while a data server is down,
+// with and without a DecodedUnitCache, on LocalPartServer, run without
+// arguments.
+
+#include "common/decoded_unit_cache.h"
+#include "common/local_part_server.h"
+#include "common/part_handle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+namespace {
+
+const int kDataParts = 6;
+const int kCodeParts = 3;
+const int kPartSize = 4 * kCodingUnitSize;
+const int kNumBlocks = 64;
+const int kNumReads = 4000;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+void Bench(const char *name, DecodedUnitCache *cache)
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 100;
+    std::map<int, int64_t> server_addrs;
+    for (int i = 0; i < kDataParts + kCodeParts; i++) {
+        servers.AddServer(i, server_options);
+        server_addrs[i] = i;
+    }
+    PartHandleOptions options;
+    options.decoded_cache = cache;
+    PartHandle handle(&servers, options);
+    CauchyRSCoder coder(kDataParts, kCodeParts);
+
+    char *parts[kDataParts + kCodeParts];
+    for (int i = 0; i < kDataParts + kCodeParts; i++) {
+        parts[i] = new char[kPartSize];
+        for (int j = 0; j < kPartSize; j++) {
+            parts[i][j] = random();
+        }
+    }
+    coder.Encode(parts, parts + kDataParts, kPartSize);
+    for (int b = 0; b < kNumBlocks; b++) {
+        PartsRequest put;
+        put.block_id = b;
+        put.server_addrs = server_addrs;
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            Part part;
+            part.offset = 0;
+            part.length = kPartSize;
+            part.data = parts[i];
+            put.todo_parts[i] = part;
+        }
+        handle.PutParts(&put);
+        put.Wait();
+    }
+    servers.SetFailing(0, true);
+
+    // a quarter of the reads go to one block, the others spread evenly
+    int64_t start_us = NowUs();
+    for (int r = 0; r < kNumReads; r++) {
+        StripeGetRequest get;
+        get.block_id = (random() % 4 == 0) ? 0 : random() % kNumBlocks;
+        get.coder = &coder;
+        get.server_addrs = server_addrs;
+        get.offset = random() % 4 * kCodingUnitSize;
+        get.length = kCodingUnitSize;
+        get.data_ptrs = parts;
+        get.coding_ptrs = parts + kDataParts;
+        handle.GetStripe(&get);
+        get.Wait();
+    }
+    int64_t elapsed_us = NowUs() - start_us;
+
+    StripeGetStats stats;
+    handle.GetStripeStats(&stats);
+    printf("%-12s %7.1f us per read, %5llu decoded, %5llu from the cache",
+           name, static_cast<double>(elapsed_us) / kNumReads,
+           static_cast<unsigned long long>(stats.num_decoded),
+           static_cast<unsigned long long>(stats.num_cached));
+    if (cache != NULL) {
+        DecodedUnitCacheStats cache_stats;
+        cache->GetStats(&cache_stats);
+        printf(", hit rate %5.1f%%, %6.1f MB saved",
+               100.0 * cache_stats.num_hits / cache_stats.num_lookups,
+               cache_stats.bytes_saved / 1e6);
+    }
+    printf("\n");
+    servers.Stop();
+    for (int i = 0; i < kDataParts + kCodeParts; i++) {
+        delete[] parts[i];
+    }
+}
+
+}  // namespace
+
+int main()
+{
+    Bench("no cache", NULL);
+    DecodedUnitCache small(32 * kDataParts * kCodingUnitSize);
+    Bench("32 rows", &small);
+    DecodedUnitCache large(kNumBlocks * 4 * kDataParts * kCodingUnitSize);
+    Bench("all rows", &large);
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// IOPS and latency of FilePartStore puts and gets through io_uring and the
+// thread pool, with aligned and unaligned part buffers, run without
+// arguments in a temporary directory.
+
+#include "common/file_part_store.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const int kPartSize = 64 << 10;
+const int kNumParts = 1024;
+const int kNumGets = 8192;
+const int kDepth = 32;
+
+// keeps kDepth requests in flight, a finished request starts the next
+class ClosedLoop : public PartTransportCallback {
+public:
+    ClosedLoop(FilePartStore *store, PartRequest::Type type, int num_requests, char *buffers)
+        : m_store(store), m_type(type), m_num_requests(num_requests), m_num_started(0),
+          m_num_done(0), m_buffers(buffers) {
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+        memset(m_requests, 0, sizeof(m_requests));
+    }
+
+    ~ClosedLoop() {
+        pthread_mutex_destroy(&m_mutex);
+        pthread_cond_destroy(&m_cond);
+    }
+
+    void Run() {
+        for (int i = 0; i < kDepth; i++) {
+            m_requests[i].part.data = m_buffers + static_cast<size_t>(i) * (kPartSize + kDirectIoAlignment);
+            pthread_mutex_lock(&m_mutex);
+            int index = m_num_started++;
+            pthread_mutex_unlock(&m_mutex);
+            _Start(&m_requests[i], index);
+        }
+        pthread_mutex_lock(&m_mutex);
+        while (m_num_done < m_num_requests) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    virtual void OnPartDone(PartRequest *request, int status) {
+        if (status != 0) {
+            fprintf(stderr, "part %lld failed\n", static_cast<long long>(request->block_id));
+        }
+        pthread_mutex_lock(&m_mutex);
+        m_num_done++;
+        int index = m_num_started;
+        bool more = (index < m_num_requests);
+        if (more) {
+            m_num_started++;
+        }
+        pthread_cond_signal(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+        if (more) {
+            _Start(request, index);
+        }
+    }
+
+private:
+    void _Start(PartRequest *request, int index) {
+        request->type = m_type;
+        request->block_id = (m_type == PartRequest::kPut) ? index : random() % kNumParts;
+        request->server_addr = 0;
+        request->part.offset = 0;
+        request->part.length = kPartSize;
+        if (m_type == PartRequest::kPut) {
+            m_store->PutPart(request, this);
+        } else {
+            m_store->GetPart(request, this);
+        }
+    }
+
+    FilePartStore *m_store;
+    PartRequest::Type m_type;
+    int m_num_requests;
+    int m_num_started;
+    int m_num_done;
+    char *m_buffers;
+    PartRequest m_requests[kDepth];
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+};
+
+void Print(const char *name, const char *op, uint64_t num, int64_t bytes,
+           int64_t elapsed_us, const LatencyHistogram &latency)
+{
+    printf("%-26s %s %8.0f IOPS %7.1f MB/s, latency p50 < %5lld us p99 < %6lld us\n",
+           name, op, num * 1e6 / elapsed_us, static_cast<double>(bytes) / elapsed_us,
+           static_cast<long long>(latency.Percentile(50)),
+           static_cast<long long>(latency.Percentile(99)));
+}
+
+void Bench(const char *name, const FilePartStoreOptions &options, bool aligned, const char *root)
+{
+    std::string dir = std::string(root) + "/" + name;
+    for (size_t i = 0; i < dir.size(); i++) {
+        if (dir[i] == ' ' || dir[i] == ',') {
+            dir[i] = '_';
+        }
+    }
+    mkdir(dir.c_str(), 0755);
+    FilePartStore store(options);
+    if (store.Start() != 0) {
+        printf("%-26s can not start\n", name);
+        return;
+    }
+    store.AddServer(0, dir);
+
+    void *region = NULL;
+    size_t size = static_cast<size_t>(kDepth) * (kPartSize + kDirectIoAlignment);
+    if (posix_memalign(&region, kDirectIoAlignment, size) != 0) {
+        return;
+    }
+    char *buffers = static_cast<char *>(region) + (aligned ? 0 : 64);
+    for (size_t i = 0; i < size - 64; i++) {
+        buffers[i] = random();
+    }
+
+    FilePartStoreStats puts;
+    ClosedLoop put_loop(&store, PartRequest::kPut, kNumParts, buffers);
+    put_loop.Run();
+    store.GetStats(&puts);
+    Print(name, "put", puts.num_writes, puts.bytes_written, puts.elapsed_us, puts.write_latency);
+
+    ClosedLoop get_loop(&store, PartRequest::kGet, kNumGets, buffers);
+    get_loop.Run();
+    FilePartStoreStats gets;
+    store.GetStats(&gets);
+    Print(name, "get", gets.num_reads, gets.bytes_read, gets.elapsed_us - puts.elapsed_us,
+          gets.read_latency);
+    store.Stop();
+    free(region);
+}
+
+}  // namespace
+
+int main()
+{
+    char root[] = "/tmp/bench_file_part_store.XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    FilePartStoreOptions uring;
+    FilePartStoreOptions buffered;
+    buffered.use_direct_io = false;
+    FilePartStoreOptions pool;
+    pool.use_io_uring = false;
+    FilePartStoreOptions pool_buffered = pool;
+    pool_buffered.use_direct_io = false;
+
+    Bench("io_uring direct", uring, true, root);
+    Bench("io_uring direct, bounced", uring, false, root);
+    Bench("io_uring buffered", buffered, true, root);
+    Bench("threads direct", pool, true, root);
+    Bench("threads direct, bounced", pool, false, root);
+    Bench("threads buffered", pool_buffered, true, root);
+
+    std::string command = std::string("rm -rf ") + root;
+    return system(command.c_str());
+}
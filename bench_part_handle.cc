@@ -0,0 +1,217 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Put throughput and latency, and stripe read latency with a slow server, of
+// PartHandle against LocalPartServer, run without arguments.
+
+#include "common/cauchy_rscode.h"
+#include "common/local_part_server.h"
+#include "common/part_handle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+const int kNumParts = 12;
+const int kPartSize = 256 << 10;
+const int kNumBlocks = 2000;
+const int kConcurrentBlocks = 32;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// keeps kConcurrentBlocks blocks in flight, a finished block puts the next
+class ClosedLoop : public PartsRequestCallback {
+public:
+    ClosedLoop(PartHandle *handle, char *data) : m_handle(handle), m_data(data) {
+        pthread_mutex_init(&m_mutex, NULL);
+        m_num_started = 0;
+        m_requests = new PartsRequest[kConcurrentBlocks];
+        m_start_us = new int64_t[kConcurrentBlocks];
+    }
+
+    ~ClosedLoop() {
+        delete[] m_requests;
+        delete[] m_start_us;
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    void Run() {
+        for (int i = 0; i < kConcurrentBlocks; i++) {
+            m_requests[i].callback = this;
+            for (int p = 0; p < kNumParts; p++) {
+                Part part;
+                part.length = kPartSize;
+                part.offset = 0;
+                part.data = m_data + p * kPartSize;
+                m_requests[i].server_addrs[p] = p;
+                m_requests[i].todo_parts[p] = part;
+            }
+            _Put(&m_requests[i]);
+        }
+        while (true) {
+            pthread_mutex_lock(&m_mutex);
+            bool done = (m_latencies.size() == static_cast<size_t>(kNumBlocks));
+            pthread_mutex_unlock(&m_mutex);
+            if (done) {
+                break;
+            }
+            usleep(1000);
+        }
+    }
+
+    virtual void OnPartsDone(PartsRequest *request) {
+        int index = request - m_requests;
+        pthread_mutex_lock(&m_mutex);
+        m_latencies.push_back(NowUs() - m_start_us[index]);
+        bool more = (m_num_started < kNumBlocks);
+        pthread_mutex_unlock(&m_mutex);
+        if (more) {
+            _Put(request);
+        }
+    }
+
+    std::vector<int64_t> m_latencies;
+
+private:
+    void _Put(PartsRequest *request) {
+        pthread_mutex_lock(&m_mutex);
+        request->block_id = m_num_started++;
+        m_start_us[request - m_requests] = NowUs();
+        pthread_mutex_unlock(&m_mutex);
+        m_handle->PutParts(request);
+    }
+
+    PartHandle *m_handle;
+    char *m_data;
+    pthread_mutex_t m_mutex;
+    int m_num_started;
+    PartsRequest *m_requests;
+    int64_t *m_start_us;
+};
+
+void BenchPut(const char *name, const PartHandleOptions &options, char *data)
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.num_workers = 2;
+    server_options.base_latency_us = 200;
+    server_options.bytes_per_us = 1000;
+    server_options.keep_data = false;
+    for (int p = 0; p < kNumParts; p++) {
+        servers.AddServer(p, server_options);
+    }
+    PartHandle handle(&servers, options);
+    ClosedLoop loop(&handle, data);
+
+    int64_t start = NowUs();
+    loop.Run();
+    int64_t elapsed_us = NowUs() - start;
+
+    std::vector<int64_t> &latencies = loop.m_latencies;
+    std::sort(latencies.begin(), latencies.end());
+    PartServerStats stats;
+    handle.GetServerStats(0, &stats);
+    printf("put %-12s %8.1f MB/s, block latency p50 %6.2f ms p99 %6.2f ms, window %2d\n",
+           name, static_cast<double>(kNumBlocks) * kNumParts * kPartSize / elapsed_us,
+           latencies[latencies.size() / 2] / 1000.0,
+           latencies[latencies.size() * 99 / 100] / 1000.0, stats.window);
+}
+
+// 8 + 4 stripe reads, one after the other, while one data part server is
+// slower than the others by slow_us
+void BenchGet(const char *name, int num_extra_parts, int hedge_delay_us, int slow_us)
+{
+    const int k = 8;
+    const int m = 4;
+    const int num_gets = 300;
+    CauchyRSCoder coder(k, m);
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.num_workers = 2;
+    server_options.base_latency_us = 200;
+    server_options.bytes_per_us = 1000;
+    for (int p = 0; p < k + m; p++) {
+        servers.AddServer(p, server_options);
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+
+    std::vector<char> buf((k + m) * kPartSize);
+    char *ptrs[k + m];
+    PartsRequest put;
+    for (int p = 0; p < k + m; p++) {
+        ptrs[p] = &buf[p * kPartSize];
+        Part part;
+        part.length = kPartSize;
+        part.offset = 0;
+        part.data = ptrs[p];
+        put.server_addrs[p] = p;
+        put.todo_parts[p] = part;
+    }
+    coder.Encode(ptrs, ptrs + k, kPartSize);
+    handle.PutParts(&put);
+    put.Wait();
+    servers.SetExtraLatency(3, slow_us);
+
+    std::vector<int64_t> latencies;
+    for (int i = 0; i < num_gets; i++) {
+        StripeGetRequest request;
+        request.coder = &coder;
+        request.server_addrs = put.server_addrs;
+        request.length = kPartSize;
+        request.data_ptrs = ptrs;
+        request.coding_ptrs = ptrs + k;
+        request.num_extra_parts = num_extra_parts;
+        request.hedge_delay_us = hedge_delay_us;
+        int64_t start = NowUs();
+        handle.GetStripe(&request);
+        request.Wait();
+        latencies.push_back(NowUs() - start);
+    }
+    servers.Stop();
+
+    std::sort(latencies.begin(), latencies.end());
+    StripeGetStats stats;
+    handle.GetStripeStats(&stats);
+    printf("get %-22s p50 %6.2f ms p99 %6.2f ms, hedged %3llu won %3llu\n", name,
+           latencies[latencies.size() / 2] / 1000.0,
+           latencies[latencies.size() * 99 / 100] / 1000.0,
+           static_cast<unsigned long long>(stats.num_hedged),
+           static_cast<unsigned long long>(stats.num_hedge_wins));
+}
+
+}  // namespace
+
+int main()
+{
+    std::vector<char> data(kNumParts * kPartSize);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+
+    int windows[] = { 1, 2, 8, 32 };
+    for (int i = 0; i < 4; i++) {
+        PartHandleOptions options;
+        options.initial_window = windows[i];
+        options.min_window = windows[i];
+        options.max_window = windows[i];
+        char name[32];
+        snprintf(name, sizeof(name), "window %d", windows[i]);
+        BenchPut(name, options, &data[0]);
+    }
+    BenchPut("adaptive", PartHandleOptions(), &data[0]);
+
+    BenchGet("plain, no slow server", 0, 0, 0);
+    BenchGet("plain", 0, 0, 5000);
+    BenchGet("1 extra at once", 1, 0, 5000);
+    BenchGet("2 extra after 1 ms", 2, 1000, 5000);
+    return 0;
+}
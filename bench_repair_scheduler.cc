@@ -0,0 +1,133 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Repair of blocks of a lost server by RepairScheduler, uncapped and under a
+// cap shared with foreground traffic, printing progress and ETA as it goes,
+// on LocalPartServer, run without arguments.
+
+#include "common/repair_scheduler.h"
+#include "common/local_part_server.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const int kDataParts = 6;
+const int kCodeParts = 3;
+const int kNumParts = kDataParts + kCodeParts;
+const int kPartSize = kCodingUnitSize;
+const int kNumBlocks = 384;
+const int64_t kTarget = 100;
+
+struct ForegroundArgs {
+    RepairScheduler *scheduler;
+    int64_t bytes_per_sec;
+    volatile bool stop;
+};
+
+// reports foreground traffic every 10 ms
+void *ForegroundThread(void *arg)
+{
+    ForegroundArgs *args = static_cast<ForegroundArgs *>(arg);
+    while (!args->stop) {
+        args->scheduler->ReportForeground(args->bytes_per_sec / 100);
+        usleep(10000);
+    }
+    return NULL;
+}
+
+void Bench(const char *name, PartHandle *handle, CauchyRSCoder *coder,
+           int64_t max_bytes_per_sec, int64_t foreground_bytes_per_sec)
+{
+    RepairSchedulerOptions options;
+    options.max_bytes_per_sec = max_bytes_per_sec;
+    options.min_bytes_per_sec = 8 << 20;
+    RepairScheduler scheduler(coder, handle, options);
+    for (int b = 0; b < kNumBlocks; b++) {
+        // server 0 is lost, and a second server for every eighth block
+        LostBlock block;
+        block.block_id = b;
+        block.part_size = kPartSize;
+        int second = (b % 8 == 0) ? 1 + b / 8 % (kNumParts - 1) : -1;
+        for (int i = 0; i < kNumParts; i++) {
+            if (i == 0 || i == second) {
+                block.target_addrs[i] = kTarget + i;
+            } else {
+                block.server_addrs[i] = i;
+            }
+        }
+        scheduler.AddBlock(block);
+    }
+
+    ForegroundArgs args;
+    args.scheduler = &scheduler;
+    args.bytes_per_sec = foreground_bytes_per_sec;
+    args.stop = false;
+    pthread_t foreground;
+    pthread_create(&foreground, NULL, ForegroundThread, &args);
+    scheduler.Start();
+    RepairProgress progress;
+    do {
+        usleep(500000);
+        scheduler.GetProgress(&progress);
+        printf("%-22s %4llu / %4llu blocks, %6.1f MB/s, foreground %6.1f MB/s, ETA %5.2f s\n",
+               name, static_cast<unsigned long long>(progress.num_repaired),
+               static_cast<unsigned long long>(progress.num_blocks),
+               (progress.bytes_read + progress.bytes_written) / 1.0 / progress.elapsed_us,
+               progress.foreground_bytes_per_sec / 1e6, progress.eta_us / 1e6);
+    } while (progress.num_repaired + progress.num_failed < progress.num_blocks);
+    args.stop = true;
+    pthread_join(foreground, NULL);
+    printf("%-22s %llu schedules for %llu blocks, %llu failed\n", name,
+           static_cast<unsigned long long>(progress.num_patterns),
+           static_cast<unsigned long long>(progress.num_blocks),
+           static_cast<unsigned long long>(progress.num_failed));
+}
+
+}  // namespace
+
+int main()
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 200;
+    for (int i = 0; i < kNumParts; i++) {
+        servers.AddServer(i, server_options);
+        servers.AddServer(kTarget + i, server_options);
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+    CauchyRSCoder coder(kDataParts, kCodeParts);
+
+    std::vector<char> buf(kNumParts * kPartSize);
+    char *ptrs[kNumParts];
+    for (int i = 0; i < kNumParts; i++) {
+        ptrs[i] = &buf[i * kPartSize];
+    }
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = random();
+    }
+    coder.Encode(ptrs, ptrs + kDataParts, kPartSize);
+    for (int b = 0; b < kNumBlocks; b++) {
+        PartsRequest put;
+        put.block_id = b;
+        for (int i = 0; i < kNumParts; i++) {
+            Part part;
+            part.offset = 0;
+            part.length = kPartSize;
+            part.data = ptrs[i];
+            put.server_addrs[i] = i;
+            put.todo_parts[i] = part;
+        }
+        handle.PutParts(&put);
+        put.Wait();
+    }
+
+    Bench("uncapped", &handle, &coder, 0, 0);
+    Bench("capped 32 MB/s", &handle, &coder, 32 << 20, 0);
+    Bench("capped, 20 MB/s fg", &handle, &coder, 32 << 20, 20 << 20);
+    servers.Stop();
+    return 0;
+}
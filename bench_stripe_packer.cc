@@ -0,0 +1,93 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Bytes put and get throughput of small objects packed by StripePacker,
+// against a stripe of their own per object padded to whole coding units,
+// run without arguments on LocalPartServer.
+
+#include "common/stripe_packer.h"
+#include "common/local_part_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+namespace {
+
+const int kDataParts = 6;
+const int kCodeParts = 3;
+const int kNumObjects = 20000;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+void Bench(int max_object_size)
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.num_workers = 4;
+    server_options.base_latency_us = 20;
+    server_options.keep_data = true;
+    std::map<int, int64_t> server_addrs;
+    for (int i = 0; i < kDataParts + kCodeParts; i++) {
+        servers.AddServer(i, server_options);
+        server_addrs[i] = i;
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+    CauchyRSCoder coder(kDataParts, kCodeParts);
+    StripePacker *packer = new StripePacker(&coder, &handle, server_addrs, StripePackerOptions());
+
+    std::vector<char> data(max_object_size);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+    std::vector<SmallPutRequest> requests(kNumObjects);
+    int64_t padded_bytes = 0;
+    int64_t start_us = NowUs();
+    for (int i = 0; i < kNumObjects; i++) {
+        requests[i].data = &data[0];
+        requests[i].length = 1 + random() % max_object_size;
+        packer->Put(&requests[i]);
+        // a stripe of its own has every data part a whole number of units
+        int part_size = (requests[i].length + kDataParts - 1) / kDataParts;
+        part_size = (part_size + kCodingUnitSize - 1) / kCodingUnitSize * kCodingUnitSize;
+        padded_bytes += static_cast<int64_t>(part_size) * kDataParts;
+    }
+    packer->Flush();
+    for (int i = 0; i < kNumObjects; i++) {
+        requests[i].Wait();
+    }
+    int64_t put_us = NowUs() - start_us;
+
+    start_us = NowUs();
+    for (int i = 0; i < kNumObjects; i++) {
+        packer->Get(requests[i].location, &data[0]);
+    }
+    int64_t get_us = NowUs() - start_us;
+
+    StripePackerStats stats;
+    packer->GetStats(&stats);
+    printf("objects up to %6d bytes: packed %6.1f MB in %4llu stripes, %5.1f%% padding,"
+           " own stripes %5.1f%% padding, put %7.0f objects/s get %7.0f objects/s\n",
+           max_object_size, stats.object_bytes / 1e6,
+           static_cast<unsigned long long>(stats.num_stripes),
+           100.0 * (stats.stripe_bytes - stats.object_bytes) / stats.stripe_bytes,
+           100.0 * (padded_bytes - stats.object_bytes) / padded_bytes,
+           kNumObjects * 1e6 / put_us, kNumObjects * 1e6 / get_us);
+    delete packer;
+    servers.Stop();
+}
+
+}  // namespace
+
+int main()
+{
+    Bench(512);
+    Bench(4096);
+    Bench(kCodingUnitSize);
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+//
+// Migration of 6 MB blocks from 6+3 to 12+4 on LocalPartServer: a Get of the
+// whole block then a Put of it, against Transcoder with and without verify
+// and 1 to 8 blocks at a time, with the throughput, IO amplification and
+// memory held, run without arguments.
+
+#include "common/transcoder.h"
+#include "common/cauchy_rs_stream_encoder.h"
+#include "common/local_part_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+namespace {
+
+const int kOldData = 6;
+const int kOldCode = 3;
+const int kNewData = 12;
+const int kNewCode = 4;
+const int kSliceSize = 4 * kCodingUnitSize;
+const int kBlockSize = kOldData * 8 * kSliceSize;
+const int kNumBlocks = 12;
+const int64_t kOldBase = 0;
+const int64_t kNewBase = 100;
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+class StripePutter : public StripeListener {
+public:
+    StripePutter(PartHandle *handle, int64_t block_id, int num_data_parts, int num_parts,
+                 int64_t server_base)
+        : bytes_written(0), m_handle(handle), m_block_id(block_id),
+          m_num_data_parts(num_data_parts), m_num_parts(num_parts), m_server_base(server_base) {}
+
+    virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs, int size) {
+        PartsRequest put;
+        put.block_id = m_block_id;
+        for (int i = 0; i < m_num_parts; i++) {
+            Part part;
+            part.offset = part_offset;
+            part.length = size;
+            part.data = (i < m_num_data_parts) ? data_ptrs[i] : coding_ptrs[i - m_num_data_parts];
+            put.server_addrs[i] = m_server_base + i;
+            put.todo_parts[i] = part;
+        }
+        m_handle->PutParts(&put);
+        put.Wait();
+        bytes_written += static_cast<int64_t>(m_num_parts) * size;
+    }
+
+    int64_t bytes_written;
+
+private:
+    PartHandle *m_handle;
+    int64_t m_block_id;
+    int m_num_data_parts;
+    int m_num_parts;
+    int64_t m_server_base;
+};
+
+// read the k old data parts whole, lay the block out again and put it
+void GetThenPut(PartHandle *handle, CauchyRSCoder *new_coder)
+{
+    int64_t stripe_size = static_cast<int64_t>(kOldData) * kSliceSize;
+    int part_size = kBlockSize / kOldData;
+    int64_t bytes_read = 0;
+    int64_t bytes_written = 0;
+    int64_t start_us = NowUs();
+    for (int b = 0; b < kNumBlocks; b++) {
+        std::vector<char> parts(static_cast<size_t>(kOldData) * part_size);
+        PartsRequest get;
+        get.block_id = b;
+        for (int i = 0; i < kOldData; i++) {
+            Part part;
+            part.offset = 0;
+            part.length = part_size;
+            part.data = &parts[i * part_size];
+            get.server_addrs[i] = kOldBase + i;
+            get.todo_parts[i] = part;
+        }
+        handle->GetParts(&get);
+        get.Wait();
+        bytes_read += static_cast<int64_t>(kOldData) * part_size;
+        std::vector<char> block(kBlockSize);
+        for (int64_t s = 0; s < kBlockSize / stripe_size; s++) {
+            for (int i = 0; i < kOldData; i++) {
+                memcpy(&block[s * stripe_size + i * kSliceSize],
+                       &parts[i * part_size + s * kSliceSize], kSliceSize);
+            }
+        }
+        StripePutter putter(handle, b, kNewData, kNewData + kNewCode, kNewBase);
+        CauchyRSStreamEncoder encoder(new_coder, kSliceSize, &putter);
+        encoder.Append(&block[0], kBlockSize);
+        encoder.Finish();
+        bytes_written += putter.bytes_written;
+    }
+    int64_t elapsed_us = NowUs() - start_us;
+    printf("%-22s %7.1f MB/s  IO x%.2f  %6d KB held\n", "get then put",
+           static_cast<double>(kNumBlocks) * kBlockSize / elapsed_us,
+           static_cast<double>(bytes_read + bytes_written) / kNumBlocks / kBlockSize,
+           (kOldData * part_size + kBlockSize + (kNewData + kNewCode) * kSliceSize) >> 10);
+}
+
+void Transcode(PartHandle *handle, CauchyRSCoder *old_coder, CauchyRSCoder *new_coder,
+               bool verify, int num_concurrent)
+{
+    TranscoderOptions options;
+    options.num_concurrent = num_concurrent;
+    options.old_slice_size = kSliceSize;
+    options.new_slice_size = kSliceSize;
+    options.verify = verify;
+    Transcoder transcoder(old_coder, new_coder, handle, options);
+    for (int b = 0; b < kNumBlocks; b++) {
+        TranscodeBlock block;
+        block.block_id = b;
+        block.block_size = kBlockSize;
+        for (int i = 0; i < kOldData + kOldCode; i++) {
+            block.old_server_addrs[i] = kOldBase + i;
+        }
+        for (int i = 0; i < kNewData + kNewCode; i++) {
+            block.new_server_addrs[i] = kNewBase + i;
+        }
+        transcoder.AddBlock(block);
+    }
+    transcoder.Start();
+    transcoder.WaitIdle();
+    TranscoderStats stats;
+    transcoder.GetStats(&stats);
+    char name[64];
+    snprintf(name, sizeof(name), "transcode %s x%d", verify ? "verify" : "no verify",
+             num_concurrent);
+    printf("%-22s %7.1f MB/s  IO x%.2f  %6d KB held  %llu failed\n", name,
+           static_cast<double>(stats.bytes_transcoded) / stats.elapsed_us,
+           static_cast<double>(stats.bytes_read + stats.bytes_written) / stats.bytes_transcoded,
+           static_cast<int>(stats.buffer_bytes >> 10),
+           static_cast<unsigned long long>(stats.num_failed));
+}
+
+}  // namespace
+
+int main()
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 500;
+    server_options.bytes_per_us = 1000;
+    for (int i = 0; i < kOldData + kOldCode; i++) {
+        servers.AddServer(kOldBase + i, server_options);
+    }
+    for (int i = 0; i < kNewData + kNewCode; i++) {
+        servers.AddServer(kNewBase + i, server_options);
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+    CauchyRSCoder old_coder(kOldData, kOldCode);
+    CauchyRSCoder new_coder(kNewData, kNewCode);
+
+    std::vector<char> block(kBlockSize);
+    for (int i = 0; i < kBlockSize; i++) {
+        block[i] = random();
+    }
+    for (int b = 0; b < kNumBlocks; b++) {
+        StripePutter putter(&handle, b, kOldData, kOldData + kOldCode, kOldBase);
+        CauchyRSStreamEncoder encoder(&old_coder, kSliceSize, &putter);
+        encoder.Append(&block[0], kBlockSize);
+        encoder.Finish();
+    }
+
+    GetThenPut(&handle, &new_coder);
+    int num_concurrent[3] = {1, 4, 8};
+    for (int i = 0; i < 3; i++) {
+        Transcode(&handle, &old_coder, &new_coder, true, num_concurrent[i]);
+    }
+    Transcode(&handle, &old_coder, &new_coder, false, 4);
+    servers.Stop();
+    return 0;
+}
@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file block_location_cache.cc
+ * @brief cache of the part servers of blocks, so that reads of hot blocks do
+ *        not ask the meta service every time
+ */
+
+#include "common/block_location_cache.h"
+#include <assert.h>
+#include <sys/time.h>
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+BlockLocationCacheOptions::BlockLocationCacheOptions() {
+    num_shards = 16;
+    max_blocks_per_shard = 4096;
+    ttl_us = 30 * 1000000;
+}
+
+BlockLocationCache::BlockLocationCache(MetaService *meta,
+                                       const BlockLocationCacheOptions &options)
+    : m_meta(meta), m_options(options) {
+    assert(options.num_shards > 0 && options.max_blocks_per_shard > 0);
+    m_shards = new Shard[options.num_shards];
+    for (int i = 0; i < options.num_shards; i++) {
+        m_shards[i].num_hits = 0;
+        m_shards[i].num_expired = 0;
+        m_shards[i].num_invalidated = 0;
+        m_shards[i].num_evicted = 0;
+        m_shards[i].epoch = 0;
+        pthread_mutex_init(&m_shards[i].mutex, NULL);
+    }
+    pthread_mutex_init(&m_mutex, NULL);
+    m_num_lookups = 0;
+    m_num_unknown = 0;
+    m_num_round_trips = 0;
+    m_num_failed_round_trips = 0;
+    m_round_trip_us = 0;
+}
+
+BlockLocationCache::~BlockLocationCache() {
+    for (int i = 0; i < m_options.num_shards; i++) {
+        pthread_mutex_destroy(&m_shards[i].mutex);
+    }
+    delete[] m_shards;
+    pthread_mutex_destroy(&m_mutex);
+}
+
+BlockLocationCache::Shard *BlockLocationCache::_GetShard(int64_t block_id) const {
+    // block ids are allocated in sequence, mix them so that every shard gets
+    // its share of a run of blocks
+    uint64_t hash = static_cast<uint64_t>(block_id) * 0x9e3779b97f4a7c15ULL;
+    return &m_shards[(hash >> 32) % m_options.num_shards];
+}
+
+void BlockLocationCache::_Erase(Shard *shard, std::map<int64_t, Entry>::iterator iter) {
+    shard->lru.erase(iter->second.lru);
+    shard->entries.erase(iter);
+}
+
+bool BlockLocationCache::_Find(int64_t block_id, int64_t now_us, BlockLocation *location,
+                               uint64_t *epoch) {
+    Shard *shard = _GetShard(block_id);
+    bool found = false;
+    pthread_mutex_lock(&shard->mutex);
+    *epoch = shard->epoch;
+    std::map<int64_t, Entry>::iterator iter = shard->entries.find(block_id);
+    if (iter != shard->entries.end()) {
+        if (iter->second.expire_us > now_us) {
+            *location = iter->second.location;
+            shard->lru.splice(shard->lru.begin(), shard->lru, iter->second.lru);
+            shard->num_hits++;
+            found = true;
+        } else {
+            _Erase(shard, iter);
+            shard->num_expired++;
+        }
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return found;
+}
+
+void BlockLocationCache::_Insert(int64_t block_id, const BlockLocation &location, int64_t now_us,
+                                 uint64_t epoch) {
+    Shard *shard = _GetShard(block_id);
+    pthread_mutex_lock(&shard->mutex);
+    if (shard->epoch != epoch) {
+        // the location may have been read before an invalidation of it
+        pthread_mutex_unlock(&shard->mutex);
+        return;
+    }
+    std::map<int64_t, Entry>::iterator iter = shard->entries.find(block_id);
+    if (iter == shard->entries.end()) {
+        if (static_cast<int>(shard->entries.size()) >= m_options.max_blocks_per_shard) {
+            _Erase(shard, shard->entries.find(shard->lru.back()));
+            shard->num_evicted++;
+        }
+        shard->lru.push_front(block_id);
+        iter = shard->entries.insert(std::make_pair(block_id, Entry())).first;
+        iter->second.lru = shard->lru.begin();
+    } else {
+        // a concurrent miss of the same block was faster
+        shard->lru.splice(shard->lru.begin(), shard->lru, iter->second.lru);
+    }
+    iter->second.location = location;
+    iter->second.expire_us = now_us + m_options.ttl_us;
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+int BlockLocationCache::Lookup(int64_t block_id, BlockLocation *location) {
+    std::vector<int64_t> block_ids(1, block_id);
+    std::vector<BlockLocation> locations;
+    int ret = LookupBatch(block_ids, &locations);
+    location->swap(locations[0]);
+    return ret;
+}
+
+int BlockLocationCache::LookupBatch(const std::vector<int64_t> &block_ids,
+                                    std::vector<BlockLocation> *locations) {
+    int64_t now_us = _NowUs();
+    locations->clear();
+    locations->resize(block_ids.size());
+    std::map<int64_t, std::vector<size_t> > misses;  // block to its indexes
+    std::vector<uint64_t> epochs(block_ids.size());
+    for (size_t i = 0; i < block_ids.size(); i++) {
+        if (!_Find(block_ids[i], now_us, &(*locations)[i], &epochs[i])) {
+            misses[block_ids[i]].push_back(i);
+        }
+    }
+
+    int ret = 0;
+    uint64_t num_unknown = 0;
+    int64_t round_trip_us = 0;
+    if (!misses.empty()) {
+        std::vector<int64_t> miss_ids;
+        for (std::map<int64_t, std::vector<size_t> >::const_iterator iter = misses.begin();
+             iter != misses.end(); ++iter) {
+            miss_ids.push_back(iter->first);
+        }
+        std::map<int64_t, BlockLocation> found;
+        int64_t start_us = _NowUs();
+        ret = m_meta->LookupBlocks(miss_ids, &found);
+        now_us = _NowUs();
+        round_trip_us = now_us - start_us;
+        for (std::map<int64_t, std::vector<size_t> >::const_iterator iter = misses.begin();
+             iter != misses.end() && ret == 0; ++iter) {
+            std::map<int64_t, BlockLocation>::const_iterator location = found.find(iter->first);
+            if (location == found.end() || location->second.empty()) {
+                num_unknown += iter->second.size();
+                continue;
+            }
+            _Insert(iter->first, location->second, now_us, epochs[iter->second[0]]);
+            for (size_t i = 0; i < iter->second.size(); i++) {
+                (*locations)[iter->second[i]] = location->second;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_num_lookups += block_ids.size();
+    m_num_unknown += num_unknown;
+    if (!misses.empty()) {
+        m_num_round_trips++;
+        m_round_trip_us += round_trip_us;
+        if (ret != 0) {
+            m_num_failed_round_trips++;
+        }
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return (ret == 0 && num_unknown == 0) ? 0 : -1;
+}
+
+void BlockLocationCache::Invalidate(int64_t block_id) {
+    Shard *shard = _GetShard(block_id);
+    pthread_mutex_lock(&shard->mutex);
+    shard->epoch++;
+    std::map<int64_t, Entry>::iterator iter = shard->entries.find(block_id);
+    if (iter != shard->entries.end()) {
+        _Erase(shard, iter);
+        shard->num_invalidated++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void BlockLocationCache::InvalidateServer(int64_t server_addr) {
+    for (int i = 0; i < m_options.num_shards; i++) {
+        Shard *shard = &m_shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        shard->epoch++;
+        std::map<int64_t, Entry>::iterator iter = shard->entries.begin();
+        while (iter != shard->entries.end()) {
+            std::map<int64_t, Entry>::iterator next = iter;
+            ++next;
+            const BlockLocation &location = iter->second.location;
+            for (BlockLocation::const_iterator part = location.begin();
+                 part != location.end(); ++part) {
+                if (part->second == server_addr) {
+                    _Erase(shard, iter);
+                    shard->num_invalidated++;
+                    break;
+                }
+            }
+            iter = next;
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
+void BlockLocationCache::GetStats(BlockLocationCacheStats *stats) const {
+    stats->num_hits = 0;
+    stats->num_expired = 0;
+    stats->num_invalidated = 0;
+    stats->num_evicted = 0;
+    for (int i = 0; i < m_options.num_shards; i++) {
+        Shard *shard = &m_shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        stats->num_hits += shard->num_hits;
+        stats->num_expired += shard->num_expired;
+        stats->num_invalidated += shard->num_invalidated;
+        stats->num_evicted += shard->num_evicted;
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    pthread_mutex_lock(&m_mutex);
+    stats->num_lookups = m_num_lookups;
+    stats->num_unknown = m_num_unknown;
+    stats->num_round_trips = m_num_round_trips;
+    stats->num_failed_round_trips = m_num_failed_round_trips;
+    stats->round_trip_us = m_round_trip_us;
+    pthread_mutex_unlock(&m_mutex);
+    // without the cache every block would take a round trip of its own
+    stats->saved_us = 0;
+    if (stats->num_round_trips > 0) {
+        stats->saved_us = static_cast<int64_t>(stats->num_lookups - stats->num_round_trips) *
+                          stats->round_trip_us / static_cast<int64_t>(stats->num_round_trips);
+    }
+}
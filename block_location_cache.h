@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/block_location_cache.h
+ * @brief cache of the part servers of blocks, so that reads of hot blocks do
+ *        not ask the meta service every time
+ */
+
+#ifndef INF_DS_RBS_COMMON_BLOCK_LOCATION_CACHE_H_
+#define INF_DS_RBS_COMMON_BLOCK_LOCATION_CACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <vector>
+
+/**
+ * @brief part index to data server of a block, as in PartsRequest
+ */
+typedef std::map<int, int64_t> BlockLocation;
+
+/**
+ * @brief where the locations of blocks come from, the meta handle of the
+ *        client. LocalMetaService stands in for it in tests.
+ */
+class MetaService {
+public:
+    virtual ~MetaService() {}
+
+    /**
+     * @brief look the blocks up in one round trip, may be called by many
+     *        threads at once
+     *
+     * @param locations Set to the location of every known block, unknown
+     *                  blocks are left out
+     * @return 0 on success, -1 if the meta service can not be reached
+     */
+    virtual int LookupBlocks(const std::vector<int64_t> &block_ids,
+                             std::map<int64_t, BlockLocation> *locations) = 0;
+};
+
+struct BlockLocationCacheOptions {
+    BlockLocationCacheOptions();
+
+    int num_shards;             ///< each with its own lock
+    int max_blocks_per_shard;   ///< least recently used blocks go beyond
+    int ttl_us;                 ///< a location is looked up again this late
+};
+
+struct BlockLocationCacheStats {
+    uint64_t num_lookups;       ///< blocks looked up, one per block of a batch
+    uint64_t num_hits;
+    uint64_t num_expired;       ///< misses of blocks cached too long ago
+    uint64_t num_unknown;       ///< blocks the meta service does not know
+    uint64_t num_invalidated;   ///< blocks dropped by Invalidate*
+    uint64_t num_evicted;       ///< blocks dropped for space
+    uint64_t num_round_trips;   ///< to the meta service
+    uint64_t num_failed_round_trips;
+    int64_t round_trip_us;      ///< total time of the round trips
+    int64_t saved_us;           ///< estimate: lookups not sent times the
+                                ///< mean round trip
+};
+
+/**
+ * @brief Caches block locations in shards picked by block id, each with its
+ *        own lock and LRU list, so that readers of different blocks rarely
+ *        contend. A cached location is used until ttl_us after it was looked
+ *        up, or until it is invalidated: a read that fails on a server of the
+ *        location should Invalidate the block, or InvalidateServer when the
+ *        server is known to be down, so that the next read asks the meta
+ *        service where the parts went.
+ *
+ *        The misses of a batch lookup are sent to the meta service in one
+ *        round trip. Concurrent misses of the same block are not merged,
+ *        each asks the meta service. A location is not cached if its shard
+ *        had an invalidation during the round trip, as it may be the one
+ *        invalidated.
+ */
+class BlockLocationCache {
+public:
+    /**
+     * @param meta  Meta service asked on misses, not owned
+     */
+    BlockLocationCache(MetaService *meta, const BlockLocationCacheOptions &options);
+
+    ~BlockLocationCache();
+
+    /**
+     * @brief location of a block, from the cache or the meta service
+     *
+     * @return 0 on success, -1 if the block is unknown or the meta service
+     *         can not be reached
+     */
+    int Lookup(int64_t block_id, BlockLocation *location);
+
+    /**
+     * @brief locations of many blocks, the misses in one round trip
+     *
+     * @param locations Resized to the blocks, the location of an unknown
+     *                  block is left empty
+     * @return 0 if every block was found, -1 otherwise
+     */
+    int LookupBatch(const std::vector<int64_t> &block_ids, std::vector<BlockLocation> *locations);
+
+    /**
+     * @brief drop the cached location of a block
+     */
+    void Invalidate(int64_t block_id);
+
+    /**
+     * @brief drop the cached location of every block with a part on the
+     *        server, walking all the shards
+     */
+    void InvalidateServer(int64_t server_addr);
+
+    void GetStats(BlockLocationCacheStats *stats) const;
+
+private:
+    struct Entry {
+        BlockLocation location;
+        int64_t expire_us;
+        std::list<int64_t>::iterator lru;   ///< in the list of the shard
+    };
+
+    struct Shard {
+        std::map<int64_t, Entry> entries;
+        std::list<int64_t> lru;             ///< most recently used first
+        uint64_t num_hits;
+        uint64_t num_expired;
+        uint64_t num_invalidated;
+        uint64_t num_evicted;
+        uint64_t epoch;                     ///< bumped by every invalidation
+        pthread_mutex_t mutex;              ///< protects the members above
+    };
+
+    Shard *_GetShard(int64_t block_id) const;
+
+    /**
+     * @brief copy out the location if cached and fresh, drop it if stale
+     *
+     * @param epoch Set to the epoch of the shard, to give _Insert
+     */
+    bool _Find(int64_t block_id, int64_t now_us, BlockLocation *location, uint64_t *epoch);
+
+    /**
+     * @brief cache a location looked up, unless the shard was invalidated
+     *        since epoch was taken by _Find
+     */
+    void _Insert(int64_t block_id, const BlockLocation &location, int64_t now_us,
+                 uint64_t epoch);
+
+    /**
+     * @brief drop an entry, shard->mutex is held
+     */
+    static void _Erase(Shard *shard, std::map<int64_t, Entry>::iterator iter);
+
+    MetaService *m_meta;
+    BlockLocationCacheOptions m_options;
+    Shard *m_shards;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    uint64_t m_num_lookups;
+    uint64_t m_num_unknown;
+    uint64_t m_num_round_trips;
+    uint64_t m_num_failed_round_trips;
+    int64_t m_round_trip_us;
+};
+
+#endif  // INF_DS_RBS_COMMON_BLOCK_LOCATION_CACHE_H_
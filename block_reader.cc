@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file block_reader.cc
+ * @brief read handle of one block, which detects sequential reads and
+ *        prefetches the stripes ahead of them
+ */
+
+#include "common/block_reader.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "common/cauchy_rs_stream_encoder.h"
+
+BlockReaderOptions::BlockReaderOptions() {
+    slice_size = 4 * kCodingUnitSize;
+    max_window = 8;
+    max_cached_sets = 10;       // the window and the stripes of a read
+}
+
+BlockReader::BlockReader(CauchyRSCoder *coder,
+                         PartHandle *handle,
+                         int64_t block_id,
+                         const std::map<int, int64_t> &server_addrs,
+                         int64_t block_size,
+                         const BlockReaderOptions &options)
+    : m_coder(coder),
+      m_handle(handle),
+      m_block_id(block_id),
+      m_server_addrs(server_addrs),
+      m_block_size(block_size),
+      m_options(options),
+      m_num_data_parts(coder->num_data_parts()),
+      m_pool(coder->num_data_parts(), coder->num_code_parts(), options.slice_size,
+             options.max_cached_sets, false),
+      m_next_offset(0) {
+    assert(options.slice_size > 0 && options.slice_size % kCodingUnitSize == 0);
+    assert(options.max_window >= 0);
+    assert(block_size >= 0);
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_window = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+BlockReader::~BlockReader() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_stripes.empty()) {
+        _Drop(m_stripes.begin()->second);
+    }
+    while (!m_in_flight.empty()) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void BlockReader::_Copy(char *const *slices, int slice_size, int slice_offset,
+                        int offset, int length, char *data) const {
+    while (length > 0) {
+        int part_index = offset / slice_size;
+        int in_slice = offset % slice_size;
+        int size = std::min(slice_size - in_slice, length);
+        memcpy(data, slices[part_index] + (in_slice - slice_offset), size);
+        data += size;
+        offset += size;
+        length -= size;
+    }
+}
+
+BlockReader::CachedStripe *BlockReader::_Fetch(int64_t index) {
+    StripeBuffers *buffers = m_pool.Acquire();
+    if (buffers == NULL) {
+        return NULL;
+    }
+    CachedStripe *stripe = new CachedStripe;
+    stripe->index = index;
+    stripe->buffers = buffers;
+    stripe->done = false;
+    stripe->status = 0;
+    stripe->used = false;
+    stripe->dropped = false;
+    StripeGetRequest *get = &stripe->get;
+    get->block_id = m_block_id;
+    get->coder = m_coder;
+    get->server_addrs = m_server_addrs;
+    get->offset = index * m_options.slice_size;
+    get->length = CauchyRSStreamEncoder::StripeSliceSize(m_num_data_parts, m_options.slice_size,
+                                                         m_block_size, index);
+    get->data_ptrs = buffers->data_ptrs;
+    get->coding_ptrs = buffers->coding_ptrs;
+    get->callback = this;
+    m_stripes[index] = stripe;
+    m_in_flight[get] = stripe;
+
+    // a read failing at once completes on this thread
+    pthread_mutex_unlock(&m_mutex);
+    int ret = m_handle->GetStripe(get);
+    pthread_mutex_lock(&m_mutex);
+    if (ret != 0) {
+        m_in_flight.erase(get);
+        stripe->done = true;
+        stripe->status = -1;
+    }
+    return stripe;
+}
+
+void BlockReader::OnStripeDone(StripeGetRequest *request) {
+    pthread_mutex_lock(&m_mutex);
+    std::map<StripeGetRequest *, CachedStripe *>::iterator iter = m_in_flight.find(request);
+    assert(iter != m_in_flight.end());
+    CachedStripe *stripe = iter->second;
+    m_in_flight.erase(iter);
+    stripe->done = true;
+    stripe->status = request->status();
+    if (stripe->dropped) {
+        _Free(stripe);
+    }
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int BlockReader::_Wait(CachedStripe *stripe) {
+    while (!stripe->done) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    return stripe->status;
+}
+
+void BlockReader::_Drop(CachedStripe *stripe) {
+    m_stripes.erase(stripe->index);
+    if (!stripe->used) {
+        m_stats.num_wasted_prefetches++;
+    }
+    stripe->dropped = true;
+    if (stripe->done) {
+        _Free(stripe);
+    }
+}
+
+void BlockReader::_Free(CachedStripe *stripe) {
+    m_pool.Release(stripe->buffers);
+    delete stripe;
+}
+
+int BlockReader::_ReadDirect(int64_t index, int offset, int length, char *data) {
+    // the units covering the range in its part, or whole slices if it spans
+    // parts
+    int slice_size = CauchyRSStreamEncoder::StripeSliceSize(m_num_data_parts,
+                                                            m_options.slice_size,
+                                                            m_block_size, index);
+    int begin = 0;
+    int end = slice_size;
+    if (offset / slice_size == (offset + length - 1) / slice_size) {
+        begin = offset % slice_size / kCodingUnitSize * kCodingUnitSize;
+        end = offset % slice_size + length;
+        end = (end + kCodingUnitSize - 1) / kCodingUnitSize * kCodingUnitSize;
+    }
+    int num_parts = m_num_data_parts + m_coder->num_code_parts();
+    char *ptrs[num_parts];
+    for (int i = 0; i < num_parts; i++) {
+        ptrs[i] = new char[end - begin];
+    }
+    StripeGetRequest request;
+    request.block_id = m_block_id;
+    request.coder = m_coder;
+    request.server_addrs = m_server_addrs;
+    request.offset = index * m_options.slice_size + begin;
+    request.length = end - begin;
+    request.data_ptrs = ptrs;
+    request.coding_ptrs = ptrs + m_num_data_parts;
+    int status = m_handle->GetStripe(&request);
+    if (status == 0) {
+        request.Wait();
+        status = request.status();
+    }
+    if (status == 0) {
+        _Copy(ptrs, slice_size, begin, offset, length, data);
+    }
+    for (int i = 0; i < num_parts; i++) {
+        delete[] ptrs[i];
+    }
+    return status;
+}
+
+int BlockReader::Read(int64_t offset, int length, char *data) {
+    if (offset < 0 || length <= 0 || offset + length > m_block_size) {
+        return -1;
+    }
+    int64_t stripe_size = static_cast<int64_t>(m_num_data_parts) * m_options.slice_size;
+    int64_t first = offset / stripe_size;
+    int64_t last = (offset + length - 1) / stripe_size;
+    bool sequential = (offset == m_next_offset);
+    m_next_offset = offset + length;
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_reads++;
+    if (sequential) {
+        m_stats.num_sequential_reads++;
+        m_window = std::min(std::max(2 * m_window, 1), m_options.max_window);
+    } else {
+        // the scan moved away, what it prefetched is of no use
+        m_window = 0;
+        while (!m_stripes.empty()) {
+            _Drop(m_stripes.begin()->second);
+        }
+    }
+    for (int64_t i = first; i <= last; i++) {
+        std::map<int64_t, CachedStripe *>::iterator iter = m_stripes.find(i);
+        if (iter != m_stripes.end()) {
+            m_stats.num_stripe_hits++;
+            if (!iter->second->done) {
+                m_stats.num_stripe_waits++;
+            }
+            continue;
+        }
+        m_stats.num_stripe_misses++;
+        if (sequential) {
+            _Fetch(i);
+        }
+    }
+    // the stripes ahead are read while this read waits for its own
+    int64_t num_stripes = CauchyRSStreamEncoder::NumStripes(m_num_data_parts,
+                                                            m_options.slice_size, m_block_size);
+    int64_t ahead = std::min(last + m_window, num_stripes - 1);
+    for (int64_t i = last + 1; i <= ahead; i++) {
+        if (m_stripes.find(i) == m_stripes.end()) {
+            if (_Fetch(i) == NULL) {
+                break;
+            }
+            m_stats.num_prefetches++;
+        }
+    }
+
+    int status = 0;
+    for (int64_t i = first; i <= last && status == 0; i++) {
+        int begin = static_cast<int>(std::max(offset, i * stripe_size) - i * stripe_size);
+        int end = static_cast<int>(std::min(offset + length, (i + 1) * stripe_size) - i * stripe_size);
+        char *dst = data + (i * stripe_size + begin - offset);
+        std::map<int64_t, CachedStripe *>::iterator iter = m_stripes.find(i);
+        if (iter == m_stripes.end()) {
+            pthread_mutex_unlock(&m_mutex);
+            status = _ReadDirect(i, begin, end - begin, dst);
+            pthread_mutex_lock(&m_mutex);
+            continue;
+        }
+        CachedStripe *stripe = iter->second;
+        stripe->used = true;
+        status = _Wait(stripe);
+        if (status != 0) {
+            // read it again next time
+            _Drop(stripe);
+            continue;
+        }
+        // only this thread drops stripes, the stripe stays while unlocked
+        pthread_mutex_unlock(&m_mutex);
+        _Copy(stripe->buffers->data_ptrs, stripe->get.length, 0, begin, end - begin, dst);
+        pthread_mutex_lock(&m_mutex);
+    }
+    // stripes the scan went past are not read again
+    while (!m_stripes.empty() && m_stripes.begin()->first < m_next_offset / stripe_size) {
+        _Drop(m_stripes.begin()->second);
+    }
+    if (status == 0) {
+        m_stats.bytes_read += length;
+    } else {
+        m_stats.num_failed_gets++;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return status;
+}
+
+void BlockReader::GetStats(BlockReaderStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    stats->window = m_window;
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/block_reader.h
+ * @brief read handle of one block, which detects sequential reads and
+ *        prefetches the stripes ahead of them
+ */
+
+#ifndef INF_DS_RBS_COMMON_BLOCK_READER_H_
+#define INF_DS_RBS_COMMON_BLOCK_READER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include "common/cauchy_rscode.h"
+#include "common/part_handle.h"
+#include "common/stripe_buffer_pool.h"
+
+struct BlockReaderOptions {
+    BlockReaderOptions();
+
+    int slice_size;             ///< of the CauchyRSStreamEncoder the block was
+                                ///< put with, a multiple of kCodingUnitSize
+    int max_window;             ///< stripes prefetched ahead at most, 0 for none
+    int max_cached_sets;        ///< of the stripe buffer pool
+};
+
+struct BlockReaderStats {
+    uint64_t num_reads;
+    uint64_t num_sequential_reads;  ///< reads starting where the last ended
+    uint64_t num_stripe_hits;       ///< stripes of reads found prefetched
+    uint64_t num_stripe_waits;      ///< of which still being read
+    uint64_t num_stripe_misses;     ///< stripes of reads fetched on demand
+    uint64_t num_prefetches;        ///< stripes prefetched
+    uint64_t num_wasted_prefetches; ///< prefetched stripes dropped unread
+    uint64_t num_failed_gets;
+    int64_t bytes_read;             ///< returned by Read
+    int window;                     ///< current prefetch window
+};
+
+/**
+ * @brief Reads ranges of a block laid out by CauchyRSStreamEncoder, stripe
+ *        by stripe through GetStripe, so lost parts are decoded.
+ *
+ *        A read starting where the last one ended is sequential. The stripes
+ *        of a sequential read are fetched whole and kept in buffers of a
+ *        StripeBufferPool, and the window of stripes after it is prefetched
+ *        without waiting. The window starts at one stripe and doubles on
+ *        every sequential read up to max_window, so a scan soon has enough
+ *        stripes in flight to hide the latency of the parts. A read anywhere
+ *        else resets the window, drops the prefetched stripes and fetches
+ *        only the coding units it covers.
+ *
+ *        Read must not be called concurrently, use one reader per thread.
+ */
+class BlockReader : public StripeGetCallback {
+public:
+    /**
+     * @param coder         Coder of the block profile, not owned
+     * @param handle        Used to read the stripes, not owned
+     * @param server_addrs  Part index, 0 to k+m-1, to data server
+     * @param block_size    Bytes of data of the block
+     */
+    BlockReader(CauchyRSCoder *coder,
+                PartHandle *handle,
+                int64_t block_id,
+                const std::map<int, int64_t> &server_addrs,
+                int64_t block_size,
+                const BlockReaderOptions &options);
+
+    /**
+     * @brief wait for the prefetches in flight
+     */
+    ~BlockReader();
+
+    /**
+     * @brief read [offset, offset + length) of the block into data
+     *
+     * @return 0 on success, -1 if the range is outside the block or a stripe
+     *         of it can not be read
+     */
+    int Read(int64_t offset, int length, char *data);
+
+    void GetStats(BlockReaderStats *stats) const;
+
+    virtual void OnStripeDone(StripeGetRequest *request);
+
+private:
+    struct CachedStripe {
+        int64_t index;
+        StripeBuffers *buffers;
+        StripeGetRequest get;
+        bool done;
+        int status;                 ///< of get, once done
+        bool used;                  ///< by a read
+        bool dropped;               ///< released once done
+    };
+
+    /**
+     * @brief start reading a whole stripe into the cache, m_mutex is held and
+     *        released while the reads are sent
+     *
+     * @return the stripe, NULL if no buffers can be allocated
+     */
+    CachedStripe *_Fetch(int64_t index);
+
+    /**
+     * @brief wait for a cached stripe, m_mutex is held
+     *
+     * @return its status
+     */
+    int _Wait(CachedStripe *stripe);
+
+    /**
+     * @brief release a stripe now or once it is read, m_mutex is held
+     */
+    void _Drop(CachedStripe *stripe);
+
+    void _Free(CachedStripe *stripe);
+
+    /**
+     * @brief read the coding units of one stripe covering a range, uncached
+     */
+    int _ReadDirect(int64_t index, int offset, int length, char *data);
+
+    /**
+     * @brief copy a range of a stripe from the buffers of the slices
+     */
+    void _Copy(char *const *slices, int slice_size, int slice_offset,
+               int offset, int length, char *data) const;
+
+    CauchyRSCoder *m_coder;
+    PartHandle *m_handle;
+    int64_t m_block_id;
+    std::map<int, int64_t> m_server_addrs;
+    int64_t m_block_size;
+    BlockReaderOptions m_options;
+    int m_num_data_parts;
+    StripeBufferPool m_pool;
+    int64_t m_next_offset;          ///< where a sequential read starts
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    pthread_cond_t m_cond;                  ///< signaled when a stripe is read
+    int m_window;
+    std::map<int64_t, CachedStripe *> m_stripes;            ///< by index
+    std::map<StripeGetRequest *, CachedStripe *> m_in_flight;
+    BlockReaderStats m_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_BLOCK_READER_H_
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file cauchy_rs_stream_decoder.cc
+ * @brief incremental Cauchy Reed-Solomon decoder fed with survivor parts
+ *        piece by piece as they arrive
+ */
+
+#include "common/cauchy_rs_stream_decoder.h"
+#include <string.h>
+#include "common/mem_xor.h"
+
+CauchyRSStreamDecoder::CauchyRSStreamDecoder(CauchyRSCoder *coder,
+                                             bool *erased,
+                                             char **data_ptrs,
+                                             char **coding_ptrs,
+                                             int size) {
+    assert(coder != NULL);
+    assert(erased != NULL);
+    assert(size > 0 && size % kCodingUnitSize == 0);
+
+    int num_total_parts = coder->m_num_data_parts + coder->m_num_code_parts;
+    int rowid_to_partidx[num_total_parts]; // NOLINT
+    int num_erased_data_parts = 0;
+    int num_erased_code_parts = 0;
+    m_num_data_parts = coder->m_num_data_parts;
+    m_num_total_parts = num_total_parts;
+    m_num_units = size / kCodingUnitSize;
+    m_partidx_to_rowid = new int[num_total_parts];
+    coder->_MapDecodeRows(erased, rowid_to_partidx, m_partidx_to_rowid,
+                          &num_erased_data_parts, &num_erased_code_parts);
+    m_num_rows = num_erased_data_parts + num_erased_code_parts;
+    m_num_done_units = (m_num_rows == 0) ? m_num_units : 0;
+
+    m_outputs = new char*[m_num_rows + 1];
+    for (int i = 0; i < m_num_rows; i++) {
+        int part_index = rowid_to_partidx[m_num_data_parts + i];
+        m_outputs[i] = (part_index < m_num_data_parts) ? data_ptrs[part_index]
+                        : coding_ptrs[part_index - m_num_data_parts];
+    }
+
+    // transpose the decoding bitmatrix: for every survivor packet (column),
+    // list the erased packets (rows) it is xored into
+    int num_columns = m_num_data_parts * kWordBits;
+    m_column_begin = new int[num_columns + 1];
+    m_column_packets = NULL;
+    if (m_num_rows > 0) {
+        char *decoding_bit_matrix = coder->_GenerateDecodeBitMatrix(rowid_to_partidx,
+                                                                    m_partidx_to_rowid,
+                                                                    num_erased_data_parts,
+                                                                    num_erased_code_parts);
+        int num_ones = 0;
+        for (int i = 0; i < m_num_rows * kWordBits * num_columns; i++) {
+            num_ones += decoding_bit_matrix[i];
+        }
+        m_column_packets = new int[num_ones + 1];
+        int index = 0;
+        for (int c = 0; c < num_columns; c++) {
+            m_column_begin[c] = index;
+            for (int r = 0; r < m_num_rows * kWordBits; r++) {
+                if (decoding_bit_matrix[r * num_columns + c]) {
+                    m_column_packets[index++] = r;
+                }
+            }
+        }
+        m_column_begin[num_columns] = index;
+        delete[] decoding_bit_matrix;
+    }
+
+    m_fed = new char[m_num_units * num_columns];
+    memset(m_fed, 0, m_num_units * num_columns);
+    m_unit_fed_count = new int[m_num_units];
+    memset(m_unit_fed_count, 0, m_num_units * sizeof(int)); // NOLINT
+}
+
+CauchyRSStreamDecoder::~CauchyRSStreamDecoder() {
+    delete[] m_partidx_to_rowid;
+    delete[] m_outputs;
+    delete[] m_column_begin;
+    delete[] m_column_packets;
+    delete[] m_fed;
+    delete[] m_unit_fed_count;
+}
+
+int CauchyRSStreamDecoder::Feed(int part_index, int offset, const char *data, int size) {
+    if (part_index < 0 || part_index >= m_num_total_parts) {
+        return -1;
+    }
+    if (m_num_rows == 0) {
+        return 1;
+    }
+    if (!NeedPart(part_index) || data == NULL || offset < 0 || size < 0
+        || offset % kPacketSize != 0 || size % kPacketSize != 0
+        || offset + size > m_num_units * kCodingUnitSize) {
+        return -1;
+    }
+
+    // packet p of the part is column (row * kWordBits + p % kWordBits) of unit
+    // p / kWordBits, m_fed is indexed by unit * num_columns + column
+    int num_columns = m_num_data_parts * kWordBits;
+    int column_base = m_partidx_to_rowid[part_index] * kWordBits;
+    int first_packet = offset / kPacketSize;
+    int num_packets = size / kPacketSize;
+    for (int p = first_packet; p < first_packet + num_packets; p++) {
+        if (m_fed[p / kWordBits * num_columns + column_base + p % kWordBits]) {
+            return -1;
+        }
+    }
+
+    for (int p = first_packet; p < first_packet + num_packets; p++, data += kPacketSize) {
+        int unit = p / kWordBits;
+        int column = column_base + p % kWordBits;
+        int unit_offset = unit * kCodingUnitSize;
+        if (m_unit_fed_count[unit] == 0) {
+            for (int i = 0; i < m_num_rows; i++) {
+                memset(m_outputs[i] + unit_offset, 0, kCodingUnitSize);
+            }
+        }
+
+        for (int i = m_column_begin[column]; i < m_column_begin[column + 1]; i++) {
+            int row = m_column_packets[i];
+            char *dst = m_outputs[row / kWordBits] + unit_offset
+                        + (row % kWordBits) * kPacketSize;
+            MemXor(data, dst, dst, kPacketSize);
+        }
+
+        m_fed[unit * num_columns + column] = 1;
+        if (++m_unit_fed_count[unit] == num_columns) {
+            m_num_done_units++;
+        }
+    }
+    return IsDone() ? 1 : 0;
+}
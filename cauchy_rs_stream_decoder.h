@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/cauchy_rs_stream_decoder.h
+ * @brief incremental Cauchy Reed-Solomon decoder fed with survivor parts
+ *        piece by piece as they arrive
+ */
+
+#ifndef INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_DECODER_H_
+#define INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_DECODER_H_
+
+#include "common/cauchy_rscode.h"
+
+/**
+ * @brief Streaming decoder for one erasure pattern of one stripe.
+ *
+ * Every packet of a survivor part is xored into the erased packets it
+ * contributes to as soon as it is fed, so decoding overlaps with the arrival
+ * of the remaining pieces and survivors never have to be buffered. The
+ * decoder is not thread safe, Feed must be serialized by the caller.
+ */
+class CauchyRSStreamDecoder {
+public:
+    /**
+     * @param coder         Coder of the stripe, must outlive the decoder
+     * @param erased        Same as CauchyRSCoder::Decode. If more than k parts
+     *                      survive, the ones Decode would use are needed,
+     *                      see NeedPart
+     * @param data_ptrs     Array of num_data_parts pointers, entries of erased
+     *                      data parts receive the decoded data
+     * @param coding_ptrs   Array of num_code_parts pointers, entries of erased
+     *                      coding parts receive the decoded coding data
+     * @param size          Size of every part in bytes, a multiple of kCodingUnitSize
+     */
+    CauchyRSStreamDecoder(CauchyRSCoder *coder, bool *erased,
+                          char **data_ptrs, char **coding_ptrs, int size);
+
+    ~CauchyRSStreamDecoder();
+
+    /**
+     * @brief feed bytes [offset, offset + size) of a survivor part
+     *
+     * @param part_index    Index of the part, 0 to k+m-1
+     * @param offset        Offset in the part, a multiple of kPacketSize
+     * @param data          Bytes of the part, only read during the call
+     * @param size          Number of bytes, a multiple of kPacketSize
+     * @return 1 if every erased part is decoded now, 0 if more pieces are
+     *         needed, -1 if the part is out of 0 to k+m-1 or not needed, the
+     *         range is invalid or some packet of it has been fed already.
+     *         Nothing is applied on -1.
+     */
+    int Feed(int part_index, int offset, const char *data, int size);
+
+    /**
+     * @brief whether every erased part is decoded
+     */
+    bool IsDone() const {
+        return m_num_done_units == m_num_units;
+    }
+
+    /**
+     * @brief whether the erased parts of coding unit [unit * kCodingUnitSize,
+     *        (unit + 1) * kCodingUnitSize) are decoded, before IsDone
+     */
+    bool IsUnitDone(int unit) const {
+        return m_num_rows == 0 || m_unit_fed_count[unit] == m_num_data_parts * kWordBits;
+    }
+
+    /**
+     * @brief whether the decoder needs pieces of the part, false for an index
+     *        out of 0 to k+m-1
+     */
+    bool NeedPart(int part_index) const {
+        if (part_index < 0 || part_index >= m_num_total_parts) {
+            return false;
+        }
+        return m_num_rows > 0 && m_partidx_to_rowid[part_index] >= 0
+            && m_partidx_to_rowid[part_index] < m_num_data_parts;
+    }
+
+private:
+    int m_num_data_parts;       ///< number of data parts
+    int m_num_total_parts;      ///< number of data and coding parts
+    int m_num_rows;             ///< number of erased parts to decode
+    int m_num_units;            ///< number of coding units in a part
+    int m_num_done_units;       ///< number of decoded coding units
+    int *m_partidx_to_rowid;    ///< part index to decoding matrix row
+    char **m_outputs;           ///< erased part buffers, in decoding matrix row order
+    int *m_column_begin;        ///< destination packets of survivor packet (column) c are
+    int *m_column_packets;      ///< m_column_packets[m_column_begin[c]..m_column_begin[c+1])
+    char *m_fed;                ///< whether survivor packet has been fed, per coding unit
+    int *m_unit_fed_count;      ///< number of fed survivor packets, per coding unit
+};
+
+#endif  // INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_DECODER_H_
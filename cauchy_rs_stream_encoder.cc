@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file cauchy_rs_stream_encoder.cc
+ * @brief incremental Cauchy Reed-Solomon encoder fed with the bytes of a
+ *        block as they are read, emitting the parts stripe by stripe
+ */
+
+#include "common/cauchy_rs_stream_encoder.h"
+#include <string.h>
+
+CauchyRSStreamEncoder::CauchyRSStreamEncoder(CauchyRSCoder *coder,
+                                             int slice_size,
+                                             StripeListener *listener) {
+    assert(coder != NULL);
+    assert(listener != NULL);
+    assert(slice_size > 0 && slice_size % kCodingUnitSize == 0);
+
+    m_coder = coder;
+    m_listener = listener;
+    m_num_data_parts = coder->m_num_data_parts;
+    m_num_code_parts = coder->m_num_code_parts;
+    m_slice_size = slice_size;
+    m_filled = 0;
+    m_part_offset = 0;
+    m_stripe_buf = new char[m_num_data_parts * slice_size];
+    m_coding_buf = new char[m_num_code_parts * slice_size];
+}
+
+CauchyRSStreamEncoder::~CauchyRSStreamEncoder() {
+    delete[] m_stripe_buf;
+    delete[] m_coding_buf;
+}
+
+void CauchyRSStreamEncoder::_EmitStripe(char **data_ptrs, int size) {
+    char *coding_ptrs[m_num_code_parts];
+    for (int i = 0; i < m_num_code_parts; i++) {
+        coding_ptrs[i] = m_coding_buf + i * m_slice_size;
+    }
+    m_coder->Encode(data_ptrs, coding_ptrs, size);
+    m_listener->OnStripe(m_part_offset, data_ptrs, coding_ptrs, size);
+    m_part_offset += size;
+}
+
+void CauchyRSStreamEncoder::Append(const char *data, int size) {
+    assert(data != NULL || size == 0);
+
+    int stripe_size = m_num_data_parts * m_slice_size;
+    char *data_ptrs[m_num_data_parts];
+    while (size > 0) {
+        if (m_filled == 0 && size >= stripe_size) {
+            // the stripe is contiguous in the caller buffer, Encode only reads the data parts
+            for (int i = 0; i < m_num_data_parts; i++) {
+                data_ptrs[i] = const_cast<char *>(data) + i * m_slice_size;
+            }
+            _EmitStripe(data_ptrs, m_slice_size);
+            data += stripe_size;
+            size -= stripe_size;
+            continue;
+        }
+
+        int len = stripe_size - m_filled;
+        if (len > size) {
+            len = size;
+        }
+        memcpy(m_stripe_buf + m_filled, data, len);
+        m_filled += len;
+        data += len;
+        size -= len;
+        if (m_filled == stripe_size) {
+            for (int i = 0; i < m_num_data_parts; i++) {
+                data_ptrs[i] = m_stripe_buf + i * m_slice_size;
+            }
+            _EmitStripe(data_ptrs, m_slice_size);
+            m_filled = 0;
+        }
+    }
+}
+
+int64_t CauchyRSStreamEncoder::NumStripes(int num_data_parts, int slice_size,
+                                          int64_t block_size) {
+    int64_t stripe_size = static_cast<int64_t>(num_data_parts) * slice_size;
+    return (block_size + stripe_size - 1) / stripe_size;
+}
+
+int CauchyRSStreamEncoder::StripeSliceSize(int num_data_parts, int slice_size,
+                                           int64_t block_size, int64_t index) {
+    int64_t stripe_size = static_cast<int64_t>(num_data_parts) * slice_size;
+    int64_t remaining = block_size - index * stripe_size;
+    if (remaining >= stripe_size) {
+        return slice_size;
+    }
+    // the fewest coding units that hold the last stripe
+    int64_t last_slice_size = (remaining + num_data_parts - 1) / num_data_parts;
+    return (last_slice_size + kCodingUnitSize - 1) / kCodingUnitSize * kCodingUnitSize;
+}
+
+void CauchyRSStreamEncoder::Finish() {
+    if (m_filled == 0) {
+        return;
+    }
+
+    // the last stripe is laid out with slices of the coding units it needs
+    int slice_size = StripeSliceSize(m_num_data_parts, m_slice_size, m_filled, 0);
+
+    // move slices back to front, every slice moves to a higher address
+    char *data_ptrs[m_num_data_parts];
+    for (int i = m_num_data_parts - 1; i >= 0; i--) {
+        data_ptrs[i] = m_stripe_buf + i * m_slice_size;
+        int begin = i * slice_size;
+        int end = begin + slice_size;
+        if (begin > m_filled) {
+            begin = m_filled;
+        }
+        if (end > m_filled) {
+            end = m_filled;
+        }
+        memmove(data_ptrs[i], m_stripe_buf + begin, end - begin);
+        memset(data_ptrs[i] + end - begin, 0, slice_size - (end - begin));
+    }
+    _EmitStripe(data_ptrs, slice_size);
+    m_filled = 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/cauchy_rs_stream_encoder.h
+ * @brief incremental Cauchy Reed-Solomon encoder fed with the bytes of a
+ *        block as they are read, emitting the parts stripe by stripe
+ */
+
+#ifndef INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_ENCODER_H_
+#define INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_ENCODER_H_
+
+#include <stdint.h>
+#include "common/cauchy_rscode.h"
+
+/**
+ * @brief receives the stripes emitted by CauchyRSStreamEncoder
+ */
+class StripeListener {
+public:
+    virtual ~StripeListener() {}
+
+    /**
+     * @brief bytes [part_offset, part_offset + size) of every part are ready.
+     *        The buffers are only valid during the call.
+     *
+     * @param part_offset   Offset of the slices in their parts
+     * @param data_ptrs     Array of num_data_parts data slices
+     * @param coding_ptrs   Array of num_code_parts coding slices
+     * @param size          Size of every slice in bytes, a multiple of kCodingUnitSize
+     */
+    virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs,
+                          int size) = 0;
+};
+
+/**
+ * @brief Streaming encoder for one block.
+ *
+ * The block is laid out in stripes of k * slice_size bytes: bytes
+ * [j * slice_size, (j + 1) * slice_size) of stripe s are bytes
+ * [s * slice_size, (s + 1) * slice_size) of data part j. As soon as a stripe
+ * is complete its coding slices are computed and the whole stripe is handed
+ * to the listener, so the parts can be put while the rest of the block is
+ * still being read. The last stripe is laid out the same way with the
+ * smallest slice size of whole coding units that holds it, zero padded.
+ * Not thread safe.
+ */
+class CauchyRSStreamEncoder {
+public:
+    /**
+     * @param coder         Coder of the block, must outlive the encoder
+     * @param slice_size    Bytes of every part per stripe, a multiple of kCodingUnitSize
+     * @param listener      Receives the stripes, must outlive the encoder
+     */
+    CauchyRSStreamEncoder(CauchyRSCoder *coder, int slice_size, StripeListener *listener);
+
+    ~CauchyRSStreamEncoder();
+
+    /**
+     * @brief append bytes of the block, emitting every stripe they complete.
+     *        Whole stripes at a stripe boundary are encoded in place without
+     *        being copied.
+     */
+    void Append(const char *data, int size);
+
+    /**
+     * @brief emit the last, partial stripe if any. Nothing may be appended
+     *        afterwards.
+     */
+    void Finish();
+
+    /**
+     * @brief number of bytes of every part emitted so far
+     */
+    int64_t part_size() const {
+        return m_part_offset;
+    }
+
+    /**
+     * @brief number of stripes a block of block_size bytes is laid out in
+     */
+    static int64_t NumStripes(int num_data_parts, int slice_size, int64_t block_size);
+
+    /**
+     * @brief bytes of every part in stripe index of a block, slice_size but
+     *        in a last, partial stripe
+     */
+    static int StripeSliceSize(int num_data_parts, int slice_size, int64_t block_size,
+                               int64_t index);
+
+private:
+    void _EmitStripe(char **data_ptrs, int size);
+
+    CauchyRSCoder *m_coder;         ///< coder of the block
+    StripeListener *m_listener;     ///< receives the stripes
+    int m_num_data_parts;           ///< number of data parts
+    int m_num_code_parts;           ///< number of coding parts
+    int m_slice_size;               ///< bytes of every part per stripe
+    int m_filled;                   ///< bytes of the current stripe appended
+    int64_t m_part_offset;          ///< offset of the current stripe in the parts
+    char *m_stripe_buf;             ///< data slices of the current stripe
+    char *m_coding_buf;             ///< coding slices of the current stripe
+};
+
+#endif  // INF_DS_RBS_COMMON_CAUCHY_RS_STREAM_ENCODER_H_
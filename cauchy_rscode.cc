@@ -6,23 +6,14 @@
  */
 
 #include "common/cauchy_rscode.h"
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
+#include "common/cauchy_xy_table.h"
+#include "common/crc32c.h"
+#include "common/mem_xor.h"
 
 
-static inline void MemXor(const char* src1,  // source buffer 1
-                        const char *src2,  // source buffer 2
-                        char *dst,         // Xor src1 and src2 (dst = src1 ^ src2)
-                        int size) {        // buffer size
-    const int64_t *l1 = (const int64_t *)src1;
-    const int64_t *l2 = (const int64_t *)src2;
-    int64_t *l3 = reinterpret_cast<int64_t *>(dst);
-
-    for (int count = 0; count < size; count += sizeof(l3[0]), l1++, l2++, l3++) {
-        *l3 = ((*l1)  ^ (*l2));
-    }
-}
-
 void CauchyRSCoder::_FreeSchedule(int **schedule) {
     int i = 0;
     for ( ; schedule[i][0] >= 0; i++)
@@ -74,14 +65,37 @@ int CauchyRSCoder::_CountCauchyOnes(int num) {
     return ones_count;
 }
 
+/**
+ * @brief find the X/Y sets generated by cauchy_xy_search_tool for (k, m),
+ *        return NULL if the profile is not in the table
+ */
+static const CauchyXYEntry *_FindCauchyXYEntry(int num_data_parts, int num_code_parts) {
+    for (int i = 0; i < kCauchyXYTableSize; i++) {
+        if (kCauchyXYTable[i].num_data_parts == num_data_parts
+            && kCauchyXYTable[i].num_code_parts == num_code_parts) {
+            return &kCauchyXYTable[i];
+        }
+    }
+    return NULL;
+}
+
 int *CauchyRSCoder::_GenerateEncodeMatrix() {
-    // generate original cauchy coding matrix
+    // generate cauchy coding matrix M[i, j] = 1 / (X[i] ^ Y[j]), use the
+    // searched X/Y sets with the fewest bitmatrix ones if asked and the
+    // profile is in the table, otherwise X = {0..m-1}, Y = {m..m+k-1}
+    const CauchyXYEntry *entry = NULL;
+    if (m_matrix_id == kSearchedMatrix) {
+        entry = _FindCauchyXYEntry(m_num_data_parts, m_num_code_parts);
+    }
     int *matrix = new int[sizeof(int) * m_num_data_parts * m_num_code_parts]; // NOLINT
     int index = 0, tmp = 0;
+    int x = 0, y = 0;
     for (int i = 0; i < m_num_code_parts; i++) {
         for (int j = 0; j < m_num_data_parts; j++) {
             index = i * m_num_data_parts + j;
-            matrix[index] = m_galois_operator->Divide(1, (i ^ (m_num_code_parts + j)));
+            x = (entry != NULL) ? entry->x[i] : i;
+            y = (entry != NULL) ? entry->y[j] : (m_num_code_parts + j);
+            matrix[index] = m_galois_operator->Divide(1, (x ^ y));
         }
     }
 
@@ -316,14 +330,299 @@ void CauchyRSCoder::_Init() {
     m_encoding_schedule = _BitMatrixToSchedule(m_num_data_parts,
                                                 m_num_code_parts, m_encoding_bit_matrix);
 
+    // encoding computes all coding parts in one pass per coding unit, the
+    // schedule stays for Verify and the reference paths
+    if (m_num_code_parts >= 2) {
+        int num_rows = m_num_code_parts * kWordBits;
+        m_encoding_plan.row_begin = new int[num_rows + 1];
+        m_encoding_plan.row_packets = new int[num_rows * (m_num_data_parts * kWordBits + 1)];
+        _PlanCombine(m_encoding_bit_matrix, m_num_code_parts, &m_encoding_plan);
+    }
+
     delete[] coding_matrix;
 }
 
+void CauchyRSCoder::_PlanCombine(const char *bit_matrix, int num_rows, CombinePlan *plan) {
+    // as the schedule does, an output packet may start from an output packet
+    // planned before it and xor in the differing source packets only
+    int num_columns = m_num_data_parts * kWordBits;
+    plan->num_rows = num_rows * kWordBits;
+    int num_row_packets = 0;
+    for (int row = 0; row < plan->num_rows; row++) {
+        const char *row_bits = bit_matrix + row * num_columns;
+        int best_count = 0;
+        for (int j = 0; j < num_columns; j++) {
+            best_count += row_bits[j];
+        }
+        int from_row = -1;
+        for (int prev = 0; prev < row; prev++) {
+            const char *prev_bits = bit_matrix + prev * num_columns;
+            int count = 1;
+            for (int j = 0; j < num_columns; j++) {
+                count += (row_bits[j] ^ prev_bits[j]);
+            }
+            if (count < best_count) {
+                best_count = count;
+                from_row = prev;
+            }
+        }
+
+        plan->row_begin[row] = num_row_packets;
+        if (from_row != -1) {
+            plan->row_packets[num_row_packets++] = num_columns + from_row;
+        }
+        for (int j = 0; j < num_columns; j++) {
+            int bit = row_bits[j];
+            if (from_row != -1) {
+                bit ^= bit_matrix[from_row * num_columns + j];
+            }
+            if (bit) {
+                plan->row_packets[num_row_packets++] = j;
+            }
+        }
+    }
+    plan->row_begin[plan->num_rows] = num_row_packets;
+}
+
+static inline void _InitPacketCursor(PacketCursor *cursor, const struct iovec *iov, int iovcnt) {
+    cursor->iov = iov;
+    cursor->iovcnt = iovcnt;
+    cursor->index = 0;
+    cursor->offset = 0;
+    while (cursor->index < cursor->iovcnt && cursor->iov[cursor->index].iov_len == 0) {
+        cursor->index++;
+    }
+}
+
+static inline char *_NextPacket(PacketCursor *cursor) {
+    assert(cursor->index < cursor->iovcnt);
+    const struct iovec &segment = cursor->iov[cursor->index];
+    assert(segment.iov_len % kPacketSize == 0);
+    char *packet = static_cast<char *>(segment.iov_base) + cursor->offset;
+    cursor->offset += kPacketSize;
+    if (cursor->offset >= segment.iov_len) {
+        cursor->offset = 0;
+        do {
+            cursor->index++;
+        } while (cursor->index < cursor->iovcnt && cursor->iov[cursor->index].iov_len == 0);
+    }
+    return packet;
+}
+
+static const int kCombineBlockSize = 4 * kXorVectorSize;
+
+/**
+ * @brief run a combine plan on the packet table of one coding unit. Every
+ *        output packet is accumulated in registers kCombineBlockSize bytes at
+ *        a time and stored once, instead of being read and written back for
+ *        each source packet as the schedule does. If crcs is not NULL, the
+ *        CRC32C of every output packet is taken block by block right after
+ *        the block is stored, while it is still in L1, with crc_extend of
+ *        Crc32cResolveExtend.
+ */
+static void _CombineUnit(const int *row_begin,
+                         const int *row_packets,
+                         int num_rows,
+                         int num_src_packets,
+                         char **packets,
+                         uint32_t *crcs,
+                         Crc32cExtendFunc crc_extend) {
+    for (int row = 0; row < num_rows; row++) {
+        char *dst = packets[num_src_packets + row];
+        uint32_t crc = 0;
+        for (int offset = 0; offset < kPacketSize; offset += kCombineBlockSize) {
+            XorVector acc0 = XorVectorZero();
+            XorVector acc1 = XorVectorZero();
+            XorVector acc2 = XorVectorZero();
+            XorVector acc3 = XorVectorZero();
+            for (int i = row_begin[row]; i < row_begin[row + 1]; i++) {
+                const char *src = packets[row_packets[i]] + offset;
+                acc0 = XorVectorXor(acc0, XorVectorLoad(src));
+                acc1 = XorVectorXor(acc1, XorVectorLoad(src + kXorVectorSize));
+                acc2 = XorVectorXor(acc2, XorVectorLoad(src + 2 * kXorVectorSize));
+                acc3 = XorVectorXor(acc3, XorVectorLoad(src + 3 * kXorVectorSize));
+            }
+            XorVectorStore(dst + offset, acc0);
+            XorVectorStore(dst + offset + kXorVectorSize, acc1);
+            XorVectorStore(dst + offset + 2 * kXorVectorSize, acc2);
+            XorVectorStore(dst + offset + 3 * kXorVectorSize, acc3);
+            if (crcs != NULL) {
+                crc = Crc32cExtendWith(crc_extend, crc, dst + offset, kCombineBlockSize);
+            }
+        }
+        if (crcs != NULL) {
+            crcs[num_src_packets + row] = crc;
+        }
+    }
+}
+
+/**
+ * @brief run a schedule on the packet table of one coding unit
+ */
+static void _DoScheduleUnit(int **schedule, char **packets) {
+    for (int i = 0; schedule[i][0] >= 0; i++) {
+        char *src = packets[schedule[i][0] * kWordBits + schedule[i][1]];
+        char *dst = packets[schedule[i][2] * kWordBits + schedule[i][3]];
+        if (schedule[i][4]) {
+            MemXor(src, dst, dst, kPacketSize);
+        } else {
+            memcpy(dst, src, kPacketSize);
+        }
+    }
+}
+
+void CauchyRSCoder::_RunUnit(char **packets,
+                             int **schedule,
+                             const CombinePlan *plan,
+                             int xor_row,
+                             uint32_t *crcs) {
+    // the data packets are checksummed before they are combined, so the
+    // combine reads them from cache instead of memory. The CRC function is
+    // picked once for the unit, not for each block the combine checksums.
+    Crc32cExtendFunc crc_extend = NULL;
+    if (crcs != NULL) {
+        assert(schedule == NULL);
+        crc_extend = Crc32cResolveExtend();
+        for (int i = 0; i < m_num_data_parts * kWordBits; i++) {
+            crcs[i] = Crc32cExtendWith(crc_extend, 0, packets[i], kPacketSize);
+        }
+    }
+    if (xor_row >= 0) {
+        const char *srcs[m_num_data_parts];
+        for (int j = 0; j < kWordBits; j++) {
+            for (int i = 0; i < m_num_data_parts; i++) {
+                srcs[i] = packets[i * kWordBits + j];
+            }
+            char *dst = packets[xor_row * kWordBits + j];
+            MemXorMulti(srcs, m_num_data_parts, dst, kPacketSize);
+            if (crcs != NULL) {
+                crcs[xor_row * kWordBits + j] = Crc32cExtendWith(crc_extend, 0, dst,
+                                                                 kPacketSize);
+            }
+        }
+    } else if (plan != NULL) {
+        _CombineUnit(plan->row_begin, plan->row_packets, plan->num_rows,
+                     m_num_data_parts * kWordBits, packets, crcs, crc_extend);
+    } else {
+        _DoScheduleUnit(schedule, packets);
+    }
+}
+
+void CauchyRSCoder::_ExecuteUnits(PacketCursor *cursors,
+                                  int num_rows,
+                                  int size,
+                                  int **schedule,
+                                  const CombinePlan *plan,
+                                  int xor_row,
+                                  uint32_t *checksums,
+                                  DecodeScratch *scratch) {
+    char **packets = scratch->m_packets;
+    uint32_t *crcs = scratch->m_crcs;
+    int num_part_packets = size / kPacketSize;
+    for (int count = 0; count < size; count += kCodingUnitSize) {
+        for (int i = 0; i < num_rows; i++) {
+            for (int j = 0; j < kWordBits; j++) {
+                packets[i * kWordBits + j] = _NextPacket(&cursors[i]);
+            }
+        }
+        if (checksums == NULL) {
+            _RunUnit(packets, schedule, plan, xor_row, NULL);
+            continue;
+        }
+        _RunUnit(packets, schedule, plan, xor_row, crcs);
+        int first_packet = count / kPacketSize;
+        for (int i = 0; i < num_rows; i++) {
+            memcpy(checksums + i * num_part_packets + first_packet, crcs + i * kWordBits,
+                   kWordBits * sizeof(uint32_t));
+        }
+    }
+}
+
+void CauchyRSCoder::_EncodeParts(PacketCursor *cursors, int size, uint32_t *checksums,
+                                 DecodeScratch *scratch) {
+    // the only coding row of m == 1 is all one
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    if (m_num_code_parts == 1) {
+        _ExecuteUnits(cursors, num_total_parts, size, NULL, NULL, m_num_data_parts, checksums,
+                      scratch);
+    } else {
+        _ExecuteUnits(cursors, num_total_parts, size, NULL, &m_encoding_plan, -1, checksums,
+                      scratch);
+    }
+}
+
 void CauchyRSCoder::Encode(char **data_ptrs, char **coding_ptrs, int size) {
+    Encode(data_ptrs, coding_ptrs, size, NULL);
+}
+
+void CauchyRSCoder::Encode(char **data_ptrs, char **coding_ptrs, int size,
+                           uint32_t *packet_checksums) {
     assert(size > 0);
     assert(data_ptrs != NULL);
     assert(coding_ptrs != NULL);
 
+    // every part is one segment
+    DecodeScratch *scratch = _GetScratch();
+    struct iovec *iov = scratch->m_iov;
+    PacketCursor *cursors = scratch->m_part_cursors;
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    for (int i = 0; i < num_total_parts; i++) {
+        iov[i].iov_base = (i < m_num_data_parts) ? data_ptrs[i]
+                            : coding_ptrs[i - m_num_data_parts];
+        iov[i].iov_len = size;
+        _InitPacketCursor(&cursors[i], &iov[i], 1);
+    }
+    _EncodeParts(cursors, size, packet_checksums, scratch);
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::Encode(const PartSegments *data_parts,
+                           const PartSegments *coding_parts,
+                           int size) {
+    assert(size > 0);
+    assert(data_parts != NULL);
+    assert(coding_parts != NULL);
+
+    DecodeScratch *scratch = _GetScratch();
+    PacketCursor *cursors = scratch->m_part_cursors;
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    for (int i = 0; i < num_total_parts; i++) {
+        const PartSegments &part = (i < m_num_data_parts) ? data_parts[i]
+                                    : coding_parts[i - m_num_data_parts];
+        _InitPacketCursor(&cursors[i], part.iov, part.iovcnt);
+    }
+    _EncodeParts(cursors, size, NULL, scratch);
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::EncodeBatch(const EncodeStripe *stripes, int num_stripes) {
+    assert(stripes != NULL);
+    assert(num_stripes >= 0);
+
+    // the packet tables are filled straight from the stripes, without the
+    // per call setup of Encode
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    const CombinePlan *plan = (m_num_code_parts == 1) ? NULL : &m_encoding_plan;
+    int xor_row = (m_num_code_parts == 1) ? m_num_data_parts : -1;
+    DecodeScratch *scratch = _GetScratch();
+    char **packets = scratch->m_packets;
+    for (int s = 0; s < num_stripes; s++) {
+        assert(stripes[s].size > 0 && stripes[s].size % kCodingUnitSize == 0);
+        for (int offset = 0; offset < stripes[s].size; offset += kCodingUnitSize) {
+            for (int i = 0; i < num_total_parts; i++) {
+                char *ptr = (i < m_num_data_parts) ? stripes[s].data_ptrs[i]
+                            : stripes[s].coding_ptrs[i - m_num_data_parts];
+                for (int j = 0; j < kWordBits; j++) {
+                    packets[i * kWordBits + j] = ptr + offset + j * kPacketSize;
+                }
+            }
+            _RunUnit(packets, NULL, plan, xor_row, NULL);
+        }
+    }
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::_EncodeWithSchedule(char **data_ptrs, char **coding_ptrs, int size) {
     char *ptrs[m_num_data_parts + m_num_code_parts];
     for (int i = 0; i < m_num_data_parts; i++) {
         ptrs[i] = const_cast<char*>(data_ptrs[i]);
@@ -336,6 +635,200 @@ void CauchyRSCoder::Encode(char **data_ptrs, char **coding_ptrs, int size) {
     _DoScheduleOperations(m_encoding_schedule, ptrs, size);
 }
 
+void CauchyRSCoder::UpdateParity(int data_index,
+                                 const char *delta_ptr,
+                                 int offset,
+                                 int len,
+                                 char **coding_ptrs) {
+    assert(data_index >= 0 && data_index < m_num_data_parts);
+    assert(delta_ptr != NULL);
+    assert(coding_ptrs != NULL);
+    assert(offset >= 0 && offset % sizeof(int64_t) == 0); // NOLINT
+    assert(len >= 0 && len % sizeof(int64_t) == 0); // NOLINT
+
+    // the delta of data packet (unit, bit) only touches coding packets (unit, *)
+    // whose bitmatrix row has a one in column data_index * kWordBits + bit
+    int num_bits_per_row = m_num_data_parts * kWordBits;
+    int end = offset + len;
+    while (offset < end) {
+        int unit_offset = offset / kCodingUnitSize * kCodingUnitSize;
+        int bit = (offset - unit_offset) / kPacketSize;
+        int packet_offset = offset % kPacketSize;
+        int size = kPacketSize - packet_offset;
+        if (size > end - offset) {
+            size = end - offset;
+        }
+
+        const char *matrix_iter = m_encoding_bit_matrix + data_index * kWordBits + bit;
+        for (int i = 0; i < m_num_code_parts; i++) {
+            for (int j = 0; j < kWordBits; j++) {
+                if (*matrix_iter) {
+                    char *dst = coding_ptrs[i] + unit_offset + j * kPacketSize + packet_offset;
+                    MemXor(delta_ptr, dst, dst, size);
+                }
+                matrix_iter += num_bits_per_row;
+            }
+        }
+
+        delta_ptr += size;
+        offset += size;
+    }
+}
+
+int CauchyRSCoder::_VerifyUnits(char **data_ptrs,
+                                char **coding_ptrs,
+                                int begin_unit,
+                                int end_unit,
+                                int *bad_part,
+                                volatile int *first_bad_unit) {
+    // parity of one coding unit is recomputed into scratch, so the memory
+    // needed does not depend on the part size, with the combine plan Encode
+    // runs
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    const CombinePlan *plan = (m_num_code_parts == 1) ? NULL : &m_encoding_plan;
+    int xor_row = (m_num_code_parts == 1) ? m_num_data_parts : -1;
+    char *scratch = new char[m_num_code_parts * kCodingUnitSize];
+    char **packets = new char *[num_total_parts * kWordBits];
+    for (int i = m_num_data_parts; i < num_total_parts; i++) {
+        for (int j = 0; j < kWordBits; j++) {
+            packets[i * kWordBits + j] = scratch + (i - m_num_data_parts) * kCodingUnitSize
+                                         + j * kPacketSize;
+        }
+    }
+    int result = -1;
+    *bad_part = -1;
+    for (int unit = begin_unit; unit < end_unit; unit++) {
+        int found = *first_bad_unit;
+        if (found != -1 && found < unit) {
+            break;
+        }
+
+        int offset = unit * kCodingUnitSize;
+        for (int i = 0; i < m_num_data_parts; i++) {
+            for (int j = 0; j < kWordBits; j++) {
+                packets[i * kWordBits + j] = data_ptrs[i] + offset + j * kPacketSize;
+            }
+        }
+        _RunUnit(packets, NULL, plan, xor_row, NULL);
+
+        for (int i = 0; i < m_num_code_parts; i++) {
+            if (memcmp(scratch + i * kCodingUnitSize, coding_ptrs[i] + offset,
+                       kCodingUnitSize) != 0) {
+                *bad_part = i;
+                break;
+            }
+        }
+        if (*bad_part != -1) {
+            result = unit;
+            // publish the mismatch, keep the smallest unit among all threads
+            found = *first_bad_unit;
+            while ((found == -1 || found > unit)
+                   && !__sync_bool_compare_and_swap(first_bad_unit, found, unit)) {
+                found = *first_bad_unit;
+            }
+            break;
+        }
+    }
+
+    delete[] packets;
+    delete[] scratch;
+    return result;
+}
+
+bool CauchyRSCoder::Verify(char **data_ptrs,
+                           char **coding_ptrs,
+                           int size,
+                           int *bad_unit,
+                           int *bad_part) {
+    return ParallelVerify(data_ptrs, coding_ptrs, size, 1, bad_unit, bad_part);
+}
+
+struct VerifyTask {
+    CauchyRSCoder *coder;
+    char **data_ptrs;
+    char **coding_ptrs;
+    int begin_unit;
+    int end_unit;
+    volatile int *first_bad_unit;
+    int bad_unit;
+    int bad_part;
+};
+
+void *CauchyRSCoder::_VerifyThread(void *arg) {
+    VerifyTask *task = static_cast<VerifyTask *>(arg);
+    task->bad_unit = task->coder->_VerifyUnits(task->data_ptrs, task->coding_ptrs,
+                                               task->begin_unit, task->end_unit,
+                                               &task->bad_part, task->first_bad_unit);
+    return NULL;
+}
+
+bool CauchyRSCoder::ParallelVerify(char **data_ptrs,
+                                   char **coding_ptrs,
+                                   int size,
+                                   int num_threads,
+                                   int *bad_unit,
+                                   int *bad_part) {
+    assert(size > 0 && size % kCodingUnitSize == 0);
+    assert(data_ptrs != NULL);
+    assert(coding_ptrs != NULL);
+    assert(num_threads > 0);
+
+    int num_units = size / kCodingUnitSize;
+    if (num_threads > num_units) {
+        num_threads = num_units;
+    }
+
+    volatile int first_bad_unit = -1;
+    VerifyTask tasks[num_threads];
+    pthread_t threads[num_threads];
+    int units_per_thread = (num_units + num_threads - 1) / num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        tasks[i].coder = this;
+        tasks[i].data_ptrs = data_ptrs;
+        tasks[i].coding_ptrs = coding_ptrs;
+        tasks[i].begin_unit = i * units_per_thread;
+        tasks[i].end_unit = (i + 1) * units_per_thread;
+        if (tasks[i].end_unit > num_units) {
+            tasks[i].end_unit = num_units;
+        }
+        tasks[i].first_bad_unit = &first_bad_unit;
+        tasks[i].bad_unit = -1;
+        tasks[i].bad_part = -1;
+    }
+
+    // the calling thread verifies the first range itself, and any range
+    // whose thread can not be started
+    bool started[num_threads];
+    for (int i = 1; i < num_threads; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, _VerifyThread, &tasks[i]) == 0);
+    }
+    _VerifyThread(&tasks[0]);
+    for (int i = 1; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            _VerifyThread(&tasks[i]);
+        }
+    }
+
+    int result_unit = -1;
+    int result_part = -1;
+    for (int i = 0; i < num_threads; i++) {
+        if (tasks[i].bad_unit != -1) {
+            result_unit = tasks[i].bad_unit;
+            result_part = tasks[i].bad_part;
+            break;
+        }
+    }
+    if (bad_unit != NULL) {
+        *bad_unit = result_unit;
+    }
+    if (bad_part != NULL) {
+        *bad_part = result_part;
+    }
+    return result_unit == -1;
+}
+
 static inline void _InvertBitMatrix(char *matrix, char *inverse, int num_rows) {
     int num_cols = num_rows;
 
@@ -390,95 +883,96 @@ static inline void _InvertBitMatrix(char *matrix, char *inverse, int num_rows) {
     }
 }
 
-void CauchyRSCoder::Decode(bool *erased,
-                            char **data_ptrs,
-                            char **coding_ptrs,
-                            int size) {
-    assert(size > 0);
-    assert(data_ptrs != NULL);
-    assert(coding_ptrs != NULL);
-    assert(erased != NULL);
-
-    int num_total_parts = m_num_data_parts + m_num_code_parts;
-    int good_parts_count = 0;
-    for (int i = 0; i < num_total_parts; i++) {
-        if (!erased[i]) {
-           good_parts_count++;
-        }
-    }
-
-    assert(good_parts_count >= m_num_data_parts);
-
-    // f there is no erased parts, do nothing
-    if (good_parts_count == m_num_data_parts + m_num_code_parts) {
-        return;
-    }
-
-
-    /* Preapre, set up ptrs.  It will be as follows:
+void CauchyRSCoder::_MapDecodeRows(bool *erased,
+                                   int *rowid_to_partidx,
+                                   int *partidx_to_rowid,
+                                   int *num_erased_data_parts,
+                                   int *num_erased_code_parts) {
+    /* Rows are laid out as follows:
 
-       - If data drive i has not eraseded, then ptrs[i] = data_ptrs[i].
-       - If data drive i has eraseded, then ptrs[i] = coding_ptrs[j], where j is the
+       - If data drive i has not eraseded, then row i is data drive i.
+       - If data drive i has eraseded, then row i is coding drive j, where j is the
             lowest unused non-eraseded coding drive.
-       - Elements num_data_parts to num_data_parts+num_erased_data_pars-1 are data_ptrs[]
-         of the eraseded data drives.
-       - Elements num_data_parts+num_erased_data_pars to num_data_parts+num_erased_data_pars
-         +num_erased_code_parts-1 are coding_ptrs[] of the eraseded data drives.
+       - Rows num_data_parts to num_data_parts+num_erased_data_pars-1 are the
+         eraseded data drives.
+       - Rows num_data_parts+num_erased_data_pars to num_data_parts+num_erased_data_pars
+         +num_erased_code_parts-1 are the eraseded coding drives.
 
        The array rowid_to_partidx used to map matrix row id to part index;
        The array partidx_to_rowid used to map part index to matrix row id;
      */
-    char *ptrs[num_total_parts];
-    int rowid_to_partidx[num_total_parts]; // NOLINT
-    int partidx_to_rowid[num_total_parts]; // NOLINT
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
     int good_code_part_index = m_num_data_parts;
     int erased_part_index = m_num_data_parts;
-    int num_erased_data_parts = 0;
-    int num_erased_code_parts = 0;
+    *num_erased_data_parts = 0;
+    *num_erased_code_parts = 0;
 
+    for (int i = 0; i < num_total_parts; i++) {
+        partidx_to_rowid[i] = -1;
+    }
     for (int i = 0; i < m_num_data_parts; i++) {
         if (!erased[i]) {
-            ptrs[i] = data_ptrs[i];
             rowid_to_partidx[i] = i;
             partidx_to_rowid[i] = i;
         } else {
             while (erased[good_code_part_index]) good_code_part_index++;
-            ptrs[i] = coding_ptrs[good_code_part_index - m_num_data_parts];
             rowid_to_partidx[i] = good_code_part_index;
             partidx_to_rowid[good_code_part_index] = i;
             good_code_part_index++;
 
-            ptrs[erased_part_index] = data_ptrs[i];
             rowid_to_partidx[erased_part_index] = i;
             partidx_to_rowid[i] = erased_part_index;
             erased_part_index++;
-            num_erased_data_parts++;
+            (*num_erased_data_parts)++;
         }
     }
     for (int i = m_num_data_parts; i < num_total_parts; i++) {
         if (erased[i]) {
-            ptrs[erased_part_index] = coding_ptrs[i - m_num_data_parts];
             rowid_to_partidx[erased_part_index] = i;
             partidx_to_rowid[i] = erased_part_index;
             erased_part_index++;
-            num_erased_code_parts++;
+            (*num_erased_code_parts)++;
         }
     }
+}
+
+char *CauchyRSCoder::_GenerateDecodeBitMatrix(const int *rowid_to_partidx,
+                                              const int *partidx_to_rowid,
+                                              int num_erased_data_parts,
+                                              int num_erased_code_parts) {
+    char *decoding_bit_matrix = new char[m_num_data_parts * kWordBits * kWordBits
+                                    * (num_erased_data_parts + num_erased_code_parts)];
+    char *tmp_bit_matrix = NULL;
+    char *inverse_bit_matrix = NULL;
+    if (num_erased_data_parts > 0) {
+        tmp_bit_matrix = new char[m_num_data_parts * m_num_data_parts * kWordBits * kWordBits];
+        inverse_bit_matrix = new char[m_num_data_parts * m_num_data_parts
+                                      * kWordBits * kWordBits];
+    }
+    _GenerateDecodeBitMatrix(rowid_to_partidx, partidx_to_rowid, num_erased_data_parts,
+                             num_erased_code_parts, decoding_bit_matrix, tmp_bit_matrix,
+                             inverse_bit_matrix);
+    delete[] tmp_bit_matrix;
+    delete[] inverse_bit_matrix;
+    return decoding_bit_matrix;
+}
 
+void CauchyRSCoder::_GenerateDecodeBitMatrix(const int *rowid_to_partidx,
+                                             const int *partidx_to_rowid,
+                                             int num_erased_data_parts,
+                                             int num_erased_code_parts,
+                                             char *decoding_bit_matrix,
+                                             char *tmp_bit_matrix,
+                                             char *inverse_bit_matrix) {
     /* Now, we're going to create one decoding matrix which is going to
      * decode erased parts. This matrix has kWordBits * kWordBits
      * * (num_erased_data+num_erased_code) * num_data_parts rows
      */
 
-    char *decoding_bit_matrix = new char[m_num_data_parts * kWordBits * kWordBits
-                                    * (num_erased_data_parts + num_erased_code_parts)];
-
     /* First, if any data drives have eraseded, then initialize the first
      * num_erased_data_parts*kWordBits rows of the decoding matrix from the
      * standard decoding * matrix inversion */
     if (num_erased_data_parts > 0) {
-        char *tmp_bit_matrix = new char[m_num_data_parts * m_num_data_parts
-                                        * kWordBits * kWordBits];
         char *iter = tmp_bit_matrix;
         for (int i = 0; i < m_num_data_parts; i++) {
             if (rowid_to_partidx[i] == i) {
@@ -495,8 +989,6 @@ void CauchyRSCoder::Decode(bool *erased,
             iter += (m_num_data_parts * kWordBits * kWordBits);
         }
 
-        char *inverse_bit_matrix = new char[m_num_data_parts * m_num_data_parts
-                                            * kWordBits * kWordBits];
         _InvertBitMatrix(tmp_bit_matrix, inverse_bit_matrix,
                         m_num_data_parts * kWordBits);
 
@@ -507,9 +999,6 @@ void CauchyRSCoder::Decode(bool *erased,
                     sizeof(char) * m_num_data_parts * kWordBits * kWordBits); // NOLINT
             iter += m_num_data_parts*kWordBits*kWordBits;
         }
-
-        delete[] tmp_bit_matrix;
-        delete[] inverse_bit_matrix;
     }
 
     /* Next, here comes the hard part.  For each coding node that needs
@@ -564,6 +1053,259 @@ void CauchyRSCoder::Decode(bool *erased,
             }
         }
     }
+}
+
+DecodeScratch::DecodeScratch(int num_data_parts, int num_code_parts) {
+    assert(num_data_parts > 0);
+    assert(num_code_parts > 0);
+
+    int num_total_parts = num_data_parts + num_code_parts;
+    int num_columns = num_data_parts * kWordBits;
+    int num_rows = num_code_parts * kWordBits;
+    m_iov = new struct iovec[num_total_parts];
+    m_part_cursors = new PacketCursor[num_total_parts];
+    m_cursors = new PacketCursor[num_total_parts];
+    m_packets = new char *[num_total_parts * kWordBits];
+    m_crcs = new uint32_t[num_total_parts * kWordBits];
+    m_rowid_to_partidx = new int[num_total_parts];
+    m_partidx_to_rowid = new int[num_total_parts];
+    m_decoding_bit_matrix = new char[num_rows * num_columns];
+    m_tmp_bit_matrix = new char[num_columns * num_columns];
+    m_inverse_bit_matrix = new char[num_columns * num_columns];
+    m_row_begin = new int[num_rows + 1];
+    m_row_packets = new int[num_rows * (num_columns + 1)];
+    m_owner = NULL;
+    m_next = NULL;
+}
+
+DecodeScratch::~DecodeScratch() {
+    delete[] m_iov;
+    delete[] m_part_cursors;
+    delete[] m_cursors;
+    delete[] m_packets;
+    delete[] m_crcs;
+    delete[] m_rowid_to_partidx;
+    delete[] m_partidx_to_rowid;
+    delete[] m_decoding_bit_matrix;
+    delete[] m_tmp_bit_matrix;
+    delete[] m_inverse_bit_matrix;
+    delete[] m_row_begin;
+    delete[] m_row_packets;
+}
+
+DecodeScratch *CauchyRSCoder::_GetScratch() {
+    DecodeScratch *scratch = NULL;
+    if (m_has_scratch_key) {
+        scratch = static_cast<DecodeScratch *>(pthread_getspecific(m_scratch_key));
+        if (scratch != NULL) {
+            return scratch;
+        }
+    }
+    scratch = new DecodeScratch(m_num_data_parts, m_num_code_parts);
+    if (!m_has_scratch_key || pthread_setspecific(m_scratch_key, scratch) != 0) {
+        return scratch;
+    }
+    scratch->m_owner = this;
+    pthread_mutex_lock(&m_scratch_mutex);
+    scratch->m_next = m_thread_scratches;
+    m_thread_scratches = scratch;
+    pthread_mutex_unlock(&m_scratch_mutex);
+    return scratch;
+}
+
+void CauchyRSCoder::_PutScratch(DecodeScratch *scratch) {
+    if (scratch->m_owner == NULL) {
+        delete scratch;
+    }
+}
+
+void CauchyRSCoder::_ReleaseThreadScratch(void *arg) {
+    // the thread exits, unlink its scratch from the coder and free it
+    DecodeScratch *scratch = static_cast<DecodeScratch *>(arg);
+    CauchyRSCoder *coder = scratch->m_owner;
+    pthread_mutex_lock(&coder->m_scratch_mutex);
+    DecodeScratch **link = &coder->m_thread_scratches;
+    while (*link != scratch) {
+        link = &(*link)->m_next;
+    }
+    *link = scratch->m_next;
+    pthread_mutex_unlock(&coder->m_scratch_mutex);
+    delete scratch;
+}
+
+bool CauchyRSCoder::XorDecodable(const bool *erased) const {
+    int num_erased_data_parts = 0;
+    for (int i = 0; i < m_num_data_parts; i++) {
+        if (erased[i]) {
+            num_erased_data_parts++;
+        }
+    }
+    return num_erased_data_parts == 1 && !erased[m_num_data_parts];
+}
+
+void CauchyRSCoder::_DecodeParts(bool *erased,
+                                 PacketCursor *part_cursors,
+                                 int size,
+                                 DecodeScratch *scratch,
+                                 bool data_only) {
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    int good_parts_count = 0;
+    for (int i = 0; i < num_total_parts; i++) {
+        if (!erased[i]) {
+           good_parts_count++;
+        }
+    }
+
+    assert(good_parts_count >= m_num_data_parts);
+
+    // f there is no erased parts, do nothing
+    if (good_parts_count == m_num_data_parts + m_num_code_parts) {
+        return;
+    }
+
+    // Preapre, set up cursors, cursors[i] is the part of matrix row i
+    PacketCursor *cursors = scratch->m_cursors;
+    int *rowid_to_partidx = scratch->m_rowid_to_partidx;
+    int *partidx_to_rowid = scratch->m_partidx_to_rowid;
+    int num_erased_data_parts = 0;
+    int num_erased_code_parts = 0;
+    _MapDecodeRows(erased, rowid_to_partidx, partidx_to_rowid,
+                   &num_erased_data_parts, &num_erased_code_parts);
+    if (data_only) {
+        // the rows of the erased coding parts come last, they are dropped
+        num_erased_code_parts = 0;
+        if (num_erased_data_parts == 0) {
+            return;
+        }
+    }
+    int num_rows = m_num_data_parts + num_erased_data_parts + num_erased_code_parts;
+    for (int i = 0; i < num_rows; i++) {
+        cursors[i] = part_cursors[rowid_to_partidx[i]];
+    }
+
+    // only one data part lost and coding part 0 alive: the first row of the
+    // coding matrix is all one, so coding part 0 is the xor of the data parts
+    // and the lost part is the xor of the others, no matrix work is needed.
+    // _MapDecodeRows has put coding part 0 in the row of the lost part.
+    if (XorDecodable(erased) && num_erased_code_parts == 0) {
+        _ExecuteUnits(cursors, num_rows, size, NULL, NULL, m_num_data_parts, NULL, scratch);
+        return;
+    }
+
+    // compute all erased parts in one pass, the plan lives in the scratch
+    // unlike a schedule which allocates every operation
+    _GenerateDecodeBitMatrix(rowid_to_partidx, partidx_to_rowid,
+                             num_erased_data_parts, num_erased_code_parts,
+                             scratch->m_decoding_bit_matrix, scratch->m_tmp_bit_matrix,
+                             scratch->m_inverse_bit_matrix);
+    CombinePlan plan;
+    plan.row_begin = scratch->m_row_begin;
+    plan.row_packets = scratch->m_row_packets;
+    _PlanCombine(scratch->m_decoding_bit_matrix, num_erased_data_parts + num_erased_code_parts,
+                 &plan);
+    _ExecuteUnits(cursors, num_rows, size, NULL, &plan, -1, NULL, scratch);
+}
+
+void CauchyRSCoder::Decode(bool *erased,
+                            char **data_ptrs,
+                            char **coding_ptrs,
+                            int size) {
+    DecodeScratch *scratch = _GetScratch();
+    Decode(erased, data_ptrs, coding_ptrs, size, scratch);
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::Decode(bool *erased,
+                           char **data_ptrs,
+                           char **coding_ptrs,
+                           int size,
+                           DecodeScratch *scratch) {
+    assert(size > 0);
+    assert(data_ptrs != NULL);
+    assert(coding_ptrs != NULL);
+    assert(erased != NULL);
+    assert(scratch != NULL);
+
+    // every part is one segment
+    struct iovec *iov = scratch->m_iov;
+    PacketCursor *cursors = scratch->m_part_cursors;
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    for (int i = 0; i < num_total_parts; i++) {
+        iov[i].iov_base = (i < m_num_data_parts) ? data_ptrs[i]
+                            : coding_ptrs[i - m_num_data_parts];
+        iov[i].iov_len = size;
+        _InitPacketCursor(&cursors[i], &iov[i], 1);
+    }
+    _DecodeParts(erased, cursors, size, scratch, false);
+}
+
+void CauchyRSCoder::Decode(bool *erased,
+                           const PartSegments *data_parts,
+                           const PartSegments *coding_parts,
+                           int size) {
+    assert(size > 0);
+    assert(data_parts != NULL);
+    assert(coding_parts != NULL);
+    assert(erased != NULL);
+
+    DecodeScratch *scratch = _GetScratch();
+    PacketCursor *cursors = scratch->m_part_cursors;
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    for (int i = 0; i < num_total_parts; i++) {
+        const PartSegments &part = (i < m_num_data_parts) ? data_parts[i]
+                                    : coding_parts[i - m_num_data_parts];
+        _InitPacketCursor(&cursors[i], part.iov, part.iovcnt);
+    }
+    _DecodeParts(erased, cursors, size, scratch, false);
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::DecodeData(bool *erased,
+                               char **data_ptrs,
+                               char **coding_ptrs,
+                               int size) {
+    assert(size > 0);
+    assert(data_ptrs != NULL);
+    assert(coding_ptrs != NULL);
+    assert(erased != NULL);
+
+    DecodeScratch *scratch = _GetScratch();
+    struct iovec *iov = scratch->m_iov;
+    PacketCursor *cursors = scratch->m_part_cursors;
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    for (int i = 0; i < num_total_parts; i++) {
+        iov[i].iov_base = (i < m_num_data_parts) ? data_ptrs[i]
+                            : coding_ptrs[i - m_num_data_parts];
+        iov[i].iov_len = size;
+        _InitPacketCursor(&cursors[i], &iov[i], 1);
+    }
+    _DecodeParts(erased, cursors, size, scratch, true);
+    _PutScratch(scratch);
+}
+
+void CauchyRSCoder::_DecodeWithSchedule(bool *erased,
+                                        char **data_ptrs,
+                                        char **coding_ptrs,
+                                        int size) {
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+
+    // Preapre, set up ptrs, ptrs[i] is the part of matrix row i
+    char *ptrs[num_total_parts];
+    int rowid_to_partidx[num_total_parts]; // NOLINT
+    int partidx_to_rowid[num_total_parts]; // NOLINT
+    int num_erased_data_parts = 0;
+    int num_erased_code_parts = 0;
+    _MapDecodeRows(erased, rowid_to_partidx, partidx_to_rowid,
+                   &num_erased_data_parts, &num_erased_code_parts);
+    for (int i = 0; i < m_num_data_parts + num_erased_data_parts + num_erased_code_parts; i++) {
+        int part_index = rowid_to_partidx[i];
+        ptrs[i] = (part_index < m_num_data_parts) ? data_ptrs[part_index]
+                    : coding_ptrs[part_index - m_num_data_parts];
+    }
+
+    char *decoding_bit_matrix = _GenerateDecodeBitMatrix(rowid_to_partidx, partidx_to_rowid,
+                                                         num_erased_data_parts,
+                                                         num_erased_code_parts);
 
     // Generate decoding schedule
     int **decoding_schedule = _BitMatrixToSchedule(m_num_data_parts,
@@ -577,5 +1319,82 @@ void CauchyRSCoder::Decode(bool *erased,
     _FreeSchedule(decoding_schedule);
 }
 
+int CauchyRSCoder::GetRepairCoefficients(bool *erased,
+                                         int target_part,
+                                         int survivor_part,
+                                         unsigned char *masks) {
+    assert(erased != NULL);
+    assert(masks != NULL);
+
+    int num_total_parts = m_num_data_parts + m_num_code_parts;
+    if (target_part < 0 || target_part >= num_total_parts || !erased[target_part]
+        || survivor_part < 0 || survivor_part >= num_total_parts) {
+        return -1;
+    }
+
+    int rowid_to_partidx[num_total_parts]; // NOLINT
+    int partidx_to_rowid[num_total_parts]; // NOLINT
+    int num_erased_data_parts = 0;
+    int num_erased_code_parts = 0;
+    _MapDecodeRows(erased, rowid_to_partidx, partidx_to_rowid,
+                   &num_erased_data_parts, &num_erased_code_parts);
+    int column = partidx_to_rowid[survivor_part];
+    if (column < 0 || column >= m_num_data_parts) {
+        return -1;
+    }
+
+    char *decoding_bit_matrix = _GenerateDecodeBitMatrix(rowid_to_partidx, partidx_to_rowid,
+                                                         num_erased_data_parts,
+                                                         num_erased_code_parts);
+    int num_bits_per_row = m_num_data_parts * kWordBits;
+    char *matrix_iter = decoding_bit_matrix
+                        + (partidx_to_rowid[target_part] - m_num_data_parts) * kWordBits
+                        * num_bits_per_row + column * kWordBits;
+    for (int r = 0; r < kWordBits; r++) {
+        masks[r] = 0;
+        for (int c = 0; c < kWordBits; c++) {
+            if (matrix_iter[c]) {
+                masks[r] |= (1 << c);
+            }
+        }
+        matrix_iter += num_bits_per_row;
+    }
+
+    delete[] decoding_bit_matrix;
+    return 0;
+}
+
+void CauchyRSCoder::RepairContribution(const unsigned char *masks,
+                                       const char *survivor_ptr,
+                                       char *contribution_ptr,
+                                       int size,
+                                       bool accumulate) {
+    assert(masks != NULL);
+    assert(survivor_ptr != NULL);
+    assert(contribution_ptr != NULL);
+    assert(size > 0 && size % kCodingUnitSize == 0);
+
+    for (int count = 0; count < size; count += kCodingUnitSize) {
+        for (int r = 0; r < kWordBits; r++) {
+            char *dst = contribution_ptr + count + r * kPacketSize;
+            bool copied = accumulate;
+            for (int c = 0; c < kWordBits; c++) {
+                if (masks[r] & (1 << c)) {
+                    const char *src = survivor_ptr + count + c * kPacketSize;
+                    if (copied) {
+                        MemXor(src, dst, dst, kPacketSize);
+                    } else {
+                        memcpy(dst, src, kPacketSize);
+                        copied = true;
+                    }
+                }
+            }
+            if (!copied) {
+                memset(dst, 0, kPacketSize);
+            }
+        }
+    }
+}
+
 }
 }
@@ -4,42 +4,157 @@
  * @brief Cauchy Reed-Solomon encoding and decoding library
  */
 
+#ifndef INF_DS_RBS_COMMON_CAUCHY_RSCODE_H_
+#define INF_DS_RBS_COMMON_CAUCHY_RSCODE_H_
+
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <linux/futex.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include "common/galois.h"
 
 static const int kPacketSize = 4096;
 static const int kWordBits = 8;
 static const int kCodingUnitSize = kPacketSize * kWordBits;
 
+/**
+ * @brief the Cauchy matrix of a coder. The parity of one matrix does not
+ *        decode with another, so the id is kept with the blocks encoded.
+ */
+enum CauchyMatrixId {
+    kJerasureMatrix = 0,    ///< X = {0..m-1}, Y = {m..m+k-1}, as Jerasure
+    kSearchedMatrix = 1,    ///< X/Y of cauchy_xy_table.h with fewer bitmatrix
+                            ///< ones, the Jerasure matrix for (k, m) not there
+};
+
+/**
+ * @brief a part given as a list of segments, e.g. a chain of network buffers,
+ *        instead of one contiguous buffer. Every segment length must be a
+ *        multiple of kPacketSize.
+ */
+struct PartSegments {
+    const struct iovec *iov;
+    int iovcnt;
+};
+
+/**
+ * @brief walks the segments of a part packet by packet
+ */
+struct PacketCursor {
+    const struct iovec *iov;
+    int iovcnt;
+    int index;              ///< current segment
+    size_t offset;          ///< offset of the next packet in the current segment
+};
+
+/**
+ * @brief the parts of one stripe of a batch
+ */
+struct EncodeStripe {
+    char **data_ptrs;       ///< num_data_parts pointers to data
+    char **coding_ptrs;     ///< num_code_parts pointers to coding data
+    int size;               ///< size of every part, a multiple of kCodingUnitSize
+};
+
+class CauchyRSCoder;
+
+/**
+ * @brief preallocated memory of one Decode call, so that decoding makes no
+ *        heap allocation. Sized from (k, m), it serves one Decode at a time.
+ *        Encode borrows its packet tables from the scratch of the thread.
+ */
+class DecodeScratch {
+    friend class CauchyRSCoder;
+
+public:
+    DecodeScratch(int num_data_parts, int num_code_parts);
+
+    ~DecodeScratch();
+
+private:
+    struct iovec *m_iov;                ///< one segment per part given as a buffer
+    PacketCursor *m_part_cursors;       ///< part cursors in part order
+    PacketCursor *m_cursors;            ///< part cursors in decoding matrix row order
+    char **m_packets;                   ///< packet table of one coding unit
+    uint32_t *m_crcs;                   ///< checksums of the packet table
+    int *m_rowid_to_partidx;            ///< see CauchyRSCoder::_MapDecodeRows
+    int *m_partidx_to_rowid;            ///< see CauchyRSCoder::_MapDecodeRows
+    char *m_decoding_bit_matrix;        ///< m * 8 rows of k * 8 columns
+    char *m_tmp_bit_matrix;             ///< survivor bitmatrix, k * 8 square
+    char *m_inverse_bit_matrix;         ///< inverse of the survivor bitmatrix
+    int *m_row_begin;                   ///< combine plan of the erased packets
+    int *m_row_packets;
+    CauchyRSCoder *m_owner;             ///< coder of a per thread scratch, NULL
+                                        ///< for one freed after the call
+    DecodeScratch *m_next;              ///< next per thread scratch of the coder
+};
+
 /**
  * @brief Cauchy Reed-Solomon encoding and decoding library
  */
 class CauchyRSCoder {
+    friend class CauchyRSStreamDecoder;
+    friend class CauchyRSStreamEncoder;
+
 public:
-    CauchyRSCoder(int num_data_parts, int num_code_parts) {
+    CauchyRSCoder(int num_data_parts, int num_code_parts,
+                  CauchyMatrixId matrix_id = kJerasureMatrix) {
         assert(num_data_parts > 0);
         assert(num_code_parts > 0);
 
         m_num_data_parts = num_data_parts;
         m_num_code_parts = num_code_parts;
+        m_matrix_id = matrix_id;
         m_galois_operator = new GaloisOperator;
         m_encoding_schedule = NULL;
         m_encoding_bit_matrix = NULL;
+        m_encoding_plan.num_rows = 0;
+        m_encoding_plan.row_begin = NULL;
+        m_encoding_plan.row_packets = NULL;
+        m_thread_scratches = NULL;
+        // out of keys every call allocates its scratch
+        m_has_scratch_key = (pthread_key_create(&m_scratch_key, _ReleaseThreadScratch) == 0);
+        pthread_mutex_init(&m_scratch_mutex, NULL);
 
         _Init();
     }
 
     ~CauchyRSCoder() {
+        if (m_has_scratch_key) {
+            pthread_key_delete(m_scratch_key);
+        }
+        while (m_thread_scratches != NULL) {
+            DecodeScratch *scratch = m_thread_scratches;
+            m_thread_scratches = scratch->m_next;
+            delete scratch;
+        }
+        pthread_mutex_destroy(&m_scratch_mutex);
         delete m_galois_operator;
         delete[] m_encoding_bit_matrix;
+        delete[] m_encoding_plan.row_begin;
+        delete[] m_encoding_plan.row_packets;
         _FreeSchedule(m_encoding_schedule);
     }
 
+    int num_data_parts() const {
+        return m_num_data_parts;
+    }
+
+    int num_code_parts() const {
+        return m_num_code_parts;
+    }
+
+    CauchyMatrixId matrix_id() const {
+        return m_matrix_id;
+    }
+
     /**
-     * @brief encoding data_parts_n data parts into code_parts_n coding parts
+     * @brief encoding data_parts_n data parts into code_parts_n coding parts.
+     *        m == 1 is a k-way xor, other profiles compute all coding parts
+     *        in one pass per coding unit
      *
      * @param data_ptrs     Array of num_data_parts pointers to data
      * @param coding_ptrs   Array of num_code_parts pointers to coding data
@@ -48,7 +163,39 @@ public:
     void Encode(char **data_ptrs, char **coding_ptrs, int size);
 
     /**
-     * @brief This function recover from any <=m parts failure
+     * @brief same as Encode, also computing the CRC32C of every 4 KB packet of
+     *        the data and coding parts in the same pass over the parts, which
+     *        saves checksumming them in a second sweep
+     *
+     * @param packet_checksums  (num_data_parts + num_code_parts) * (size /
+     *                          kPacketSize) checksums, the one of packet j of
+     *                          part i (coding parts after data parts) at
+     *                          i * (size / kPacketSize) + j
+     */
+    void Encode(char **data_ptrs, char **coding_ptrs, int size, uint32_t *packet_checksums);
+
+    /**
+     * @brief same as Encode, every part is a list of segments which are
+     *        read and written in place, without copying to contiguous buffers
+     *
+     * @param data_parts    Array of num_data_parts segment lists of data
+     * @param coding_parts  Array of num_code_parts segment lists of coding data
+     * @param size          Size of every part in bytes.
+     */
+    void Encode(const PartSegments *data_parts, const PartSegments *coding_parts, int size);
+
+    /**
+     * @brief encode many small stripes, e.g. one per object, in one call
+     */
+    void EncodeBatch(const EncodeStripe *stripes, int num_stripes);
+
+    /**
+     * @brief This function recover from any <=m parts failure. A single
+     *        lost data part with coding part 0 alive is recovered by xoring
+     *        the other parts, without any matrix work. Otherwise the erased
+     *        parts are computed in one pass over the survivors. The memory
+     *        needed comes from a DecodeScratch of the calling thread,
+     *        allocated on its first Decode with this coder.
      *
      * @param erased Array of indicators which point out whether the device has
      *               been erased. The index of array range frome 0 to k+m-1.
@@ -61,7 +208,198 @@ public:
      */
     void Decode(bool *erased, char **data_ptrs, char **coding_ptrs, int size);
 
+    /**
+     * @brief same as Decode with memory from a caller provided scratch built
+     *        for the same (k, m)
+     */
+    void Decode(bool *erased, char **data_ptrs, char **coding_ptrs, int size,
+                DecodeScratch *scratch);
+
+    /**
+     * @brief same as Decode, every part is a list of segments which are
+     *        read and written in place, without copying to contiguous buffers
+     */
+    void Decode(bool *erased, const PartSegments *data_parts, const PartSegments *coding_parts,
+                int size);
+
+    /**
+     * @brief same as Decode, but only the erased data parts are rebuilt and
+     *        the erased coding parts are left alone, for a reader which marks
+     *        the parity parts it did not read as erased
+     */
+    void DecodeData(bool *erased, char **data_ptrs, char **coding_ptrs, int size);
+
+    /**
+     * @brief whether DecodeData rebuilds the erased data parts as the xor of
+     *        the other parts: exactly one data part and not coding part 0
+     *        is erased
+     */
+    bool XorDecodable(const bool *erased) const;
+
+    /**
+     * @brief apply a small overwrite of one data part to the coding parts
+     *        without reading the other data parts. Since the code is linear,
+     *        new parity = old parity ^ (coefficients of the data part * delta)
+     *
+     * @param data_index    Index of the overwritten data part, 0 to k-1
+     * @param delta_ptr     old data ^ new data of the overwritten range
+     * @param offset        Offset of the range in the data part in bytes,
+     *                      must be a multiple of 8
+     * @param len           Length of the range in bytes, must be a multiple of 8
+     * @param coding_ptrs   Array of num_code_parts pointers to coding data, the
+     *                      same range of every coding part is updated in place
+     */
+    void UpdateParity(int data_index, const char *delta_ptr, int offset, int len,
+                      char **coding_ptrs);
+
+    /**
+     * @brief check the coding parts against the data parts without allocating
+     *        parity buffers of size bytes: parity is recomputed one coding unit
+     *        at a time into a small scratch buffer and compared while in cache
+     *
+     * @param data_ptrs     Array of num_data_parts pointers to data
+     * @param coding_ptrs   Array of num_code_parts pointers to coding data
+     * @param size          Size of every part in bytes, a multiple of kCodingUnitSize
+     * @param bad_unit      If not NULL, set to the index of the first mismatching
+     *                      coding unit, or -1 if all coding units match
+     * @param bad_part      If not NULL, set to the index in coding_ptrs of the first
+     *                      mismatching coding part in that unit, or -1
+     * @return true if all coding parts match the data parts
+     */
+    bool Verify(char **data_ptrs, char **coding_ptrs, int size,
+                int *bad_unit, int *bad_part);
+
+    /**
+     * @brief same as Verify, coding units are split among num_threads threads,
+     *        for background scrubbers. The reported mismatch is still the
+     *        first one in the parts.
+     */
+    bool ParallelVerify(char **data_ptrs, char **coding_ptrs, int size, int num_threads,
+                        int *bad_unit, int *bad_part);
+
+    /**
+     * @brief get the coefficients of one survivor in the repair of one erased
+     *        part, for repair pipelining: every node of a chain xors its own
+     *        RepairContribution into the partial sum received from the
+     *        previous node and forwards it, the last node yields the target
+     *
+     * @param erased        Same as Decode, the survivors are the k parts Decode
+     *                      would use, mark extra parts erased to choose others
+     * @param target_part   Index of the erased part to repair, 0 to k+m-1
+     * @param survivor_part Index of the survivor part, 0 to k+m-1
+     * @param masks         Array of kWordBits masks, bit c of masks[r] tells
+     *                      whether packet c of the survivor is xored into
+     *                      packet r of the target in every coding unit
+     * @return 0 on success, -1 if target_part is not erased or survivor_part
+     *         is not one of the survivors
+     */
+    int GetRepairCoefficients(bool *erased, int target_part, int survivor_part,
+                              unsigned char *masks);
+
+    /**
+     * @brief compute the contribution of a survivor to the repaired part
+     *
+     * @param masks             Coefficients from GetRepairCoefficients
+     * @param survivor_ptr      Survivor data, starting at a coding unit boundary
+     * @param contribution_ptr  Output, same range of the repaired part
+     * @param size              Size in bytes, a multiple of kCodingUnitSize
+     * @param accumulate        If true, xor into contribution_ptr instead of
+     *                          overwriting it
+     */
+    void RepairContribution(const unsigned char *masks, const char *survivor_ptr,
+                            char *contribution_ptr, int size, bool accumulate);
+
 private:
+    /**
+     * @brief verify coding units [begin_unit, end_unit), stop early once a thread
+     *        has found a mismatch before the current unit
+     * @return index of the first mismatching unit or -1, *bad_part is set as well
+     */
+    int _VerifyUnits(char **data_ptrs, char **coding_ptrs, int begin_unit, int end_unit,
+                     int *bad_part, volatile int *first_bad_unit);
+
+    static void *_VerifyThread(void *arg);
+
+    /**
+     * @brief plain schedule encoding over contiguous parts, the reference the
+     *        dedicated paths are tested and benchmarked against
+     */
+    void _EncodeWithSchedule(char **data_ptrs, char **coding_ptrs, int size);
+
+    /**
+     * @brief plain schedule decoding over contiguous parts: invert the bitmatrix
+     *        of the survivors and run the decoding schedule, the reference the
+     *        dedicated paths are tested and benchmarked against
+     */
+    void _DecodeWithSchedule(bool *erased, char **data_ptrs, char **coding_ptrs, int size);
+
+    /**
+     * @brief output packets of a combine pass: output packet r, the packet
+     *        r of the unit packet table after the sources, is the xor of
+     *        packets row_packets[row_begin[r]..row_begin[r + 1]) of the table
+     */
+    struct CombinePlan {
+        int num_rows;
+        int *row_begin;
+        int *row_packets;
+    };
+
+    /**
+     * @brief plan a combine pass from a bitmatrix of num_rows row blocks over
+     *        num_data_parts column blocks, an output packet may start from an
+     *        output packet planned before it if that needs fewer xors
+     */
+    void _PlanCombine(const char *bit_matrix, int num_rows, CombinePlan *plan);
+
+    /**
+     * @brief the DecodeScratch of the calling thread, or a new one if it
+     *        can not be kept per thread, to give back to _PutScratch
+     */
+    DecodeScratch *_GetScratch();
+
+    /**
+     * @brief free a scratch of _GetScratch which is not kept per thread
+     */
+    static void _PutScratch(DecodeScratch *scratch);
+
+    static void _ReleaseThreadScratch(void *arg);
+
+    /**
+     * @brief encode parts given by cursors, data parts first, checksums as
+     *        the packet_checksums of Encode or NULL
+     */
+    void _EncodeParts(PacketCursor *cursors, int size, uint32_t *checksums,
+                      DecodeScratch *scratch);
+
+    /**
+     * @brief decode parts given by cursors, data parts first, the erased
+     *        coding parts too unless data_only
+     */
+    void _DecodeParts(bool *erased, PacketCursor *cursors, int size, DecodeScratch *scratch,
+                      bool data_only);
+
+    /**
+     * @brief for every coding unit, gather the packets of num_rows parts from
+     *        cursors into a table (packet b of row i at i * kWordBits + b) and
+     *        run one of: a schedule, a combine plan, or if xor_row >= 0 the
+     *        xor of rows 0 to num_data_parts-1 into row xor_row. Unless
+     *        checksums is NULL, the CRC32C of packet j of row i goes to
+     *        checksums[i * (size / kPacketSize) + j]. The tables are those
+     *        of scratch.
+     */
+    void _ExecuteUnits(PacketCursor *cursors, int num_rows, int size, int **schedule,
+                       const CombinePlan *plan, int xor_row, uint32_t *checksums,
+                       DecodeScratch *scratch);
+
+    /**
+     * @brief run a schedule, a combine plan, or the xor into xor_row on the
+     *        packet table of one coding unit. Unless crcs is NULL, the CRC32C
+     *        of every packet goes to crcs in packet table order, which is not
+     *        supported with a schedule.
+     */
+    void _RunUnit(char **packets, int **schedule, const CombinePlan *plan, int xor_row,
+                  uint32_t *crcs);
+
     void _Init();
 
     /**
@@ -71,7 +409,9 @@ private:
     int _CountCauchyOnes(int num);
 
     /**
-     * @brief generate cauchy encoding matrix and improve it
+     * @brief generate cauchy encoding matrix and improve it, X/Y sets come
+     *        from cauchy_xy_table.h for kSearchedMatrix when the (k, m)
+     *        profile is listed there
      */
     int *_GenerateEncodeMatrix();
 
@@ -100,9 +440,41 @@ private:
 
     void _FreeSchedule(int **schedule);
 
+    /**
+     * @brief map decoding matrix rows to parts: rows 0 to k-1 are the survivors
+     *        used for decoding, the following rows are the erased data parts
+     *        and then the erased coding parts. Parts without a row map to -1.
+     */
+    void _MapDecodeRows(bool *erased, int *rowid_to_partidx, int *partidx_to_rowid,
+                        int *num_erased_data_parts, int *num_erased_code_parts);
+
+    /**
+     * @brief generate the bitmatrix which computes every erased part from the
+     *        k survivor rows given by _MapDecodeRows
+     */
+    char *_GenerateDecodeBitMatrix(const int *rowid_to_partidx, const int *partidx_to_rowid,
+                                   int num_erased_data_parts, int num_erased_code_parts);
+
+    /**
+     * @brief same as above into decoding_bit_matrix, tmp_bit_matrix and
+     *        inverse_bit_matrix are work memory of (k * 8)^2 bytes each
+     */
+    void _GenerateDecodeBitMatrix(const int *rowid_to_partidx, const int *partidx_to_rowid,
+                                  int num_erased_data_parts, int num_erased_code_parts,
+                                  char *decoding_bit_matrix, char *tmp_bit_matrix,
+                                  char *inverse_bit_matrix);
+
     int m_num_data_parts;          ///< number of data parts
     int m_num_code_parts;          ///< number of coding parts
+    CauchyMatrixId m_matrix_id;    ///< matrix the parity is encoded with
     GaloisOperator  *m_galois_operator;  ///< galois filed operator
     char *m_encoding_bit_matrix;            ///< bit matrix used in encoding/decoding
     int **m_encoding_schedule;     ///< coding schedule used for encoding
+    CombinePlan m_encoding_plan;   ///< combine plan used for encoding when m >= 2
+    pthread_key_t m_scratch_key;   ///< DecodeScratch of the calling thread
+    bool m_has_scratch_key;        ///< whether m_scratch_key was created
+    pthread_mutex_t m_scratch_mutex;    ///< protects m_thread_scratches
+    DecodeScratch *m_thread_scratches;  ///< every per thread DecodeScratch
 };
+
+#endif  // INF_DS_RBS_COMMON_CAUCHY_RSCODE_H_
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file cauchy_xy_search_tool.cc
+ * @brief offline search for Cauchy X/Y sets whose improved coding matrix has
+ *        the fewest ones in its bitmatrix representation, the result is
+ *        written as cauchy_xy_table.h and picked up by CauchyRSCoder
+ *        for kSearchedMatrix
+ *
+ * Usage: cauchy_xy_search_tool [restarts] > cauchy_xy_table.h
+ */
+
+extern "C" {
+#include "common/jerasure_galois.h"
+#include "common/jerasure_cauchy.h"
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int kWordBits = 8;
+static const int kFieldSize = 1 << kWordBits;
+static const int kMinDataParts = 2;
+static const int kMaxDataParts = 16;
+static const int kMinCodeParts = 2;
+static const int kMaxCodeParts = 4;
+static const int kDefaultRestarts = 32;
+
+/**
+ * @brief number of ones in the bitmatrix of the coding matrix built from X/Y
+ *        after the same improvement CauchyRSCoder applies
+ */
+static int CountMatrixOnes(int k, int m, int *x, int *y) {
+    int *matrix = cauchy_xy_coding_matrix(k, m, kWordBits, x, y);
+    cauchy_improve_coding_matrix(k, m, kWordBits, matrix);
+    int ones_count = 0;
+    for (int i = 0; i < k * m; i++) {
+        ones_count += cauchy_n_ones(matrix[i], kWordBits);
+    }
+    free(matrix);
+    return ones_count;
+}
+
+/**
+ * @brief hill climbing from the given X/Y: replace one element of X or Y by an
+ *        unused field element while that lowers the ones count.
+ *        X[0] stays 0, since xoring every element of X and Y by the same
+ *        constant yields the same matrix.
+ */
+static int Climb(int k, int m, int *x, int *y) {
+    bool used[kFieldSize];
+    memset(used, 0, sizeof(used));
+    for (int i = 0; i < m; i++) used[x[i]] = true;
+    for (int j = 0; j < k; j++) used[y[j]] = true;
+
+    int best = CountMatrixOnes(k, m, x, y);
+    bool improved = true;
+    while (improved) {
+        improved = false;
+        for (int pos = 1; pos < m + k; pos++) {
+            int *slot = (pos < m) ? &x[pos] : &y[pos - m];
+            int old_value = *slot;
+            for (int value = 1; value < kFieldSize; value++) {
+                if (used[value]) {
+                    continue;
+                }
+                *slot = value;
+                int ones_count = CountMatrixOnes(k, m, x, y);
+                if (ones_count < best) {
+                    used[old_value] = false;
+                    used[value] = true;
+                    old_value = value;
+                    best = ones_count;
+                    improved = true;
+                }
+            }
+            *slot = old_value;
+        }
+    }
+    return best;
+}
+
+static void RandomSets(int k, int m, int *x, int *y) {
+    bool used[kFieldSize];
+    memset(used, 0, sizeof(used));
+    x[0] = 0;
+    used[0] = true;
+    for (int pos = 1; pos < m + k; pos++) {
+        int value = 0;
+        do {
+            value = 1 + rand() % (kFieldSize - 1); // NOLINT
+        } while (used[value]);
+        used[value] = true;
+        if (pos < m) {
+            x[pos] = value;
+        } else {
+            y[pos - m] = value;
+        }
+    }
+}
+
+static void PrintArray(const int *array, int size, int width) {
+    printf("{");
+    for (int i = 0; i < width; i++) {
+        printf("%s%d", i == 0 ? " " : ", ", i < size ? array[i] : 0);
+    }
+    printf(" }");
+}
+
+int main(int argc, char **argv) {
+    int restarts = (argc > 1) ? atoi(argv[1]) : kDefaultRestarts;
+    srand(20150105);
+
+    printf("/**\n");
+    printf(" * Copyright (c) 2015, The Authors. All rights reserved.\n");
+    printf(" * @file cauchy_xy_table.h\n");
+    printf(" * @brief Cauchy X/Y sets with minimal bitmatrix ones, per (k, m).\n");
+    printf(" *        Generated by cauchy_xy_search_tool (%d restarts), do not edit.\n",
+           restarts);
+    printf(" */\n\n");
+    printf("#ifndef INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_\n");
+    printf("#define INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_\n\n");
+    printf("static const int kMaxXYTableDataParts = %d;\n", kMaxDataParts);
+    printf("static const int kMaxXYTableCodeParts = %d;\n\n", kMaxCodeParts);
+    printf("struct CauchyXYEntry {\n");
+    printf("    int num_data_parts;\n");
+    printf("    int num_code_parts;\n");
+    printf("    int default_ones;     ///< ones of X = {0..m-1}, Y = {m..m+k-1}\n");
+    printf("    int ones;             ///< ones of the X/Y below\n");
+    printf("    int x[kMaxXYTableCodeParts];\n");
+    printf("    int y[kMaxXYTableDataParts];\n");
+    printf("};\n\n");
+    printf("static const CauchyXYEntry kCauchyXYTable[] = {\n");
+
+    int x[kMaxCodeParts];
+    int y[kMaxDataParts];
+    int best_x[kMaxCodeParts];
+    int best_y[kMaxDataParts];
+    for (int k = kMinDataParts; k <= kMaxDataParts; k++) {
+        for (int m = kMinCodeParts; m <= kMaxCodeParts; m++) {
+            for (int i = 0; i < m; i++) x[i] = i;
+            for (int j = 0; j < k; j++) y[j] = m + j;
+            int default_ones = CountMatrixOnes(k, m, x, y);
+
+            int best = Climb(k, m, x, y);
+            memcpy(best_x, x, sizeof(x));
+            memcpy(best_y, y, sizeof(y));
+            for (int r = 0; r < restarts; r++) {
+                RandomSets(k, m, x, y);
+                int ones_count = Climb(k, m, x, y);
+                if (ones_count < best) {
+                    best = ones_count;
+                    memcpy(best_x, x, sizeof(x));
+                    memcpy(best_y, y, sizeof(y));
+                }
+            }
+            fprintf(stderr, "k=%d m=%d default=%d best=%d\n", k, m, default_ones, best);
+            if (best >= default_ones) {
+                continue;
+            }
+
+            printf("    { %d, %d, %d, %d, ", k, m, default_ones, best);
+            PrintArray(best_x, m, kMaxCodeParts);
+            printf(",\n      ");
+            PrintArray(best_y, k, kMaxDataParts);
+            printf(" },\n");
+        }
+    }
+
+    printf("};\n\n");
+    printf("static const int kCauchyXYTableSize =\n");
+    printf("    sizeof(kCauchyXYTable) / sizeof(kCauchyXYTable[0]);\n\n");
+    printf("#endif  // INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_\n");
+    return 0;
+}
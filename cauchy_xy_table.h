@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file cauchy_xy_table.h
+ * @brief Cauchy X/Y sets with minimal bitmatrix ones, per (k, m).
+ *        Generated by cauchy_xy_search_tool (32 restarts), do not edit.
+ */
+
+#ifndef INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_
+#define INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_
+
+static const int kMaxXYTableDataParts = 16;
+static const int kMaxXYTableCodeParts = 4;
+
+struct CauchyXYEntry {
+    int num_data_parts;
+    int num_code_parts;
+    int default_ones;     ///< ones of X = {0..m-1}, Y = {m..m+k-1}
+    int ones;             ///< ones of the X/Y below
+    int x[kMaxXYTableCodeParts];
+    int y[kMaxXYTableDataParts];
+};
+
+static const CauchyXYEntry kCauchyXYTable[] = {
+    { 2, 2, 42, 35, { 0, 140, 0, 0 },
+      { 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 3, 83, 54, { 0, 10, 47, 0 },
+      { 3, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 2, 4, 117, 76, { 0, 61, 109, 67 },
+      { 4, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 2, 82, 54, { 0, 247, 0, 0 },
+      { 2, 185, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 3, 149, 98, { 0, 225, 120, 0 },
+      { 127, 166, 125, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 3, 4, 215, 139, { 0, 102, 120, 108 },
+      { 90, 161, 246, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 4, 2, 115, 76, { 0, 156, 0, 0 },
+      { 7, 138, 27, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 4, 3, 197, 135, { 0, 58, 236, 0 },
+      { 142, 123, 138, 153, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 4, 4, 315, 201, { 0, 181, 211, 5 },
+      { 126, 167, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 5, 2, 153, 98, { 0, 109, 0, 0 },
+      { 94, 10, 4, 5, 6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 5, 3, 283, 174, { 0, 156, 241, 0 },
+      { 138, 4, 77, 5, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 5, 4, 404, 264, { 0, 136, 57, 114 },
+      { 124, 44, 108, 67, 217, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 6, 2, 185, 123, { 0, 241, 0, 0 },
+      { 14, 2, 4, 175, 58, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 6, 3, 362, 223, { 0, 160, 3, 0 },
+      { 25, 46, 29, 28, 248, 204, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 6, 4, 499, 329, { 0, 156, 192, 44 },
+      { 78, 222, 220, 175, 20, 163, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 7, 2, 238, 149, { 0, 241, 0, 0 },
+      { 14, 2, 4, 195, 55, 7, 73, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 7, 3, 422, 271, { 0, 54, 237, 0 },
+      { 156, 214, 202, 80, 204, 217, 44, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 7, 4, 592, 404, { 0, 36, 51, 195 },
+      { 215, 53, 114, 169, 182, 171, 147, 0, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 8, 2, 272, 175, { 0, 246, 0, 0 },
+      { 1, 141, 2, 239, 149, 7, 169, 170, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 8, 3, 487, 320, { 0, 69, 173, 0 },
+      { 16, 36, 107, 229, 171, 38, 167, 192, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 8, 4, 691, 477, { 0, 153, 101, 180 },
+      { 207, 91, 192, 231, 251, 123, 183, 190, 0, 0, 0, 0, 0, 0, 0, 0 } },
+    { 9, 2, 315, 202, { 0, 109, 0, 0 },
+      { 2, 112, 119, 120, 161, 72, 17, 198, 10, 0, 0, 0, 0, 0, 0, 0 } },
+    { 9, 3, 564, 371, { 0, 110, 198, 0 },
+      { 77, 4, 68, 195, 253, 128, 54, 146, 155, 0, 0, 0, 0, 0, 0, 0 } },
+    { 9, 4, 794, 550, { 0, 145, 8, 11 },
+      { 74, 178, 142, 147, 233, 194, 230, 96, 77, 0, 0, 0, 0, 0, 0, 0 } },
+    { 10, 2, 354, 229, { 0, 241, 0, 0 },
+      { 14, 2, 4, 175, 58, 7, 195, 232, 10, 6, 0, 0, 0, 0, 0, 0 } },
+    { 10, 3, 617, 422, { 0, 96, 118, 0 },
+      { 165, 7, 148, 243, 232, 143, 204, 4, 33, 85, 0, 0, 0, 0, 0, 0 } },
+    { 10, 4, 888, 625, { 0, 142, 42, 79 },
+      { 117, 5, 49, 66, 157, 224, 213, 33, 112, 51, 0, 0, 0, 0, 0, 0 } },
+    { 11, 2, 389, 256, { 0, 212, 0, 0 },
+      { 169, 36, 4, 70, 19, 215, 249, 22, 139, 11, 198, 0, 0, 0, 0, 0 } },
+    { 11, 3, 683, 473, { 0, 225, 185, 0 },
+      { 85, 209, 159, 144, 143, 167, 99, 70, 198, 49, 82, 0, 0, 0, 0, 0 } },
+    { 11, 4, 1002, 699, { 0, 137, 213, 48 },
+      { 156, 229, 207, 7, 231, 209, 224, 118, 33, 132, 1, 0, 0, 0, 0, 0 } },
+    { 12, 2, 424, 284, { 0, 246, 0, 0 },
+      { 1, 141, 2, 239, 217, 7, 5, 149, 3, 9, 169, 29, 0, 0, 0, 0 } },
+    { 12, 3, 765, 525, { 0, 43, 198, 0 },
+      { 106, 205, 142, 143, 96, 15, 127, 150, 208, 131, 2, 226, 0, 0, 0, 0 } },
+    { 12, 4, 1087, 775, { 0, 186, 87, 76 },
+      { 40, 116, 213, 246, 14, 241, 137, 86, 222, 162, 236, 238, 0, 0, 0, 0 } },
+    { 13, 2, 468, 312, { 0, 91, 0, 0 },
+      { 2, 52, 148, 42, 227, 19, 22, 67, 80, 31, 12, 34, 14, 0, 0, 0 } },
+    { 13, 3, 818, 576, { 0, 228, 200, 0 },
+      { 141, 100, 8, 131, 179, 95, 91, 126, 6, 11, 78, 154, 71, 0, 0, 0 } },
+    { 13, 4, 1204, 860, { 0, 19, 198, 166 },
+      { 73, 25, 178, 143, 7, 237, 117, 158, 84, 208, 193, 34, 201, 0, 0, 0 } },
+    { 14, 2, 494, 340, { 0, 91, 0, 0 },
+      { 2, 52, 148, 42, 227, 19, 22, 67, 80, 31, 12, 34, 14, 69, 0, 0 } },
+    { 14, 3, 900, 629, { 0, 180, 29, 0 },
+      { 228, 28, 184, 118, 61, 80, 150, 49, 56, 205, 248, 27, 21, 55, 0, 0 } },
+    { 14, 4, 1288, 964, { 0, 65, 27, 145 },
+      { 85, 176, 233, 59, 193, 67, 96, 41, 109, 234, 134, 172, 46, 48, 0, 0 } },
+    { 15, 2, 542, 368, { 0, 168, 0, 0 },
+      { 44, 244, 3, 136, 246, 7, 177, 254, 10, 11, 26, 35, 69, 15, 111, 0 } },
+    { 15, 3, 953, 681, { 0, 241, 32, 0 },
+      { 171, 209, 156, 22, 137, 25, 133, 62, 188, 144, 199, 102, 123, 231, 215, 0 } },
+    { 15, 4, 1387, 1017, { 0, 36, 244, 149 },
+      { 222, 179, 97, 4, 57, 134, 93, 45, 94, 180, 60, 81, 184, 121, 126, 0 } },
+    { 16, 2, 578, 396, { 0, 168, 0, 0 },
+      { 44, 244, 3, 136, 246, 7, 177, 254, 10, 11, 26, 35, 69, 15, 111, 135 } },
+    { 16, 3, 1017, 738, { 0, 4, 59, 0 },
+      { 31, 184, 162, 223, 9, 209, 115, 141, 253, 34, 127, 23, 178, 123, 71, 92 } },
+    { 16, 4, 1497, 1107, { 0, 106, 203, 210 },
+      { 188, 144, 85, 28, 107, 127, 89, 138, 200, 67, 22, 181, 243, 54, 128, 82 } },
+};
+
+static const int kCauchyXYTableSize =
+    sizeof(kCauchyXYTable) / sizeof(kCauchyXYTable[0]);
+
+#endif  // INF_DS_RBS_COMMON_CAUCHY_XY_TABLE_H_
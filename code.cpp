@@ -36,35 +36,58 @@ struct PartRequest {
 
 int RSClient::Get(GetRequest* request) {
     //1 check request parameter
-    //2 split the data buffer into several parts, where a part belongs to one replica
-    //3 query meta handle to get block replicas location
-    //4 query part handle to get parts data
+    //2 split the data buffer into several parts, where a part belongs to one replica,
+    //  part buffers for degraded reads are acquired from the StripeBufferPool of
+    //  the block profile and released when the request finishes
+    //3 query meta handle to get block replicas location through the
+    //  BlockLocationCache, the blocks of a multi-block read in one
+    //  LookupBatch; a part failed on its server Invalidate()s the block
+    //4 query part handle to get parts data; with the hedged read mode,
+    //  part_handle_->GetStripe() reads k + x parts of the stripe range and
+    //  keeps the first k to arrive, see StripeGetRequest
+    //5 lost parts of a plain read are decoded by a CodingJob on the
+    //  AsyncCoder, and the request finishes in its callback so the I/O
+    //  thread never runs the decoding.
+    //  a GetStripe read decodes the lost parts itself and keeps the rows it
+    //  decoded in the DecodedUnitCache of the part handle while the server
+    //  is down.
+    //scans go through a BlockReader per file handle instead, which detects
+    //sequential Gets and prefetches the stripes ahead into its buffer pool
 }
 
 int PartHandle::GetParts(PartsRequest* request) {
-    //for each todo parts do GetPart();
+    //implemented in part_handle.cc: for each todo parts do GetPart() of its
+    //own range; StripePacker::Get uses it to read only the packets that
+    //cover a packed object
 }
 
 int RSClient::Put(PutRequest* request) {
     //1 check request parameter
-    //2 encode request on code handle
-    //2 make PartsRequest from request
-    //3 part_handle_->PutParts(request);
-    //4 time and conditional wait
+    //2 feed request data to a CauchyRSStreamEncoder as it is read
+    //3 on every stripe it emits, make PartsRequest of the stripe slices
+    //  and part_handle_->PutParts(request), so parts are put while the
+    //  rest of the block is still being encoded
+    //4 Finish() the encoder, time and conditional wait for all stripes
+    //objects below max_object_size go to the StripePacker instead, which
+    //packs them into shared stripes and returns where each one is
 }
 
 int PartHandle::PutParts(PartsRequest* request) {
-    //for each todo parts to make PartRequest and TryPutPart()
+    //implemented in part_handle.cc: for each todo parts make a PartRequest,
+    //queue it to its server and send what the server window allows
 }
 
 int PartHandle::TryPutPart() {
-    //control max running put part request
-    //do PutPart() : it is implemented in the data server
+    //control max running put part request: an AIMD window per server on
+    //the put latency, see part_handle.h
+    //do PutPart() through the PartTransport : it is implemented in the data
+    //server, LocalPartServer stands in for it in tests and FilePartStore
+    //on local disks
 }
 
 int PartHandle::OnFinishPutPart() {
-    if all done, FinishRequest
-    else TryPutPart();
+    //PartHandle::OnPartDone: update the window, TryPutPart(), and if all
+    //done, FinishRequest
 }
 
   int degrade_read_off = Floor(todo_slice.off);
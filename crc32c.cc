@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file crc32c.cc
+ * @brief table driven CRC32C, and the crc32 instruction picked at run time
+ */
+
+#include "common/crc32c.h"
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define CRC32C_HAS_HARDWARE_PATH 1
+#endif
+
+static const uint32_t kCrc32cPolynomial = 0x82f63b78;   // reflected 0x1edc6f41
+
+static uint32_t g_crc32c_table[256];
+static pthread_once_t g_crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static Crc32cExtendFunc g_crc32c_extend = NULL;
+static pthread_once_t g_crc32c_extend_once = PTHREAD_ONCE_INIT;
+
+static void _InitCrc32cTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+        }
+        g_crc32c_table[i] = crc;
+    }
+}
+
+uint32_t Crc32cExtendTable(uint32_t crc, const char *data, size_t size) {
+    pthread_once(&g_crc32c_table_once, _InitCrc32cTable);
+    const unsigned char *iter = reinterpret_cast<const unsigned char *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = g_crc32c_table[(crc ^ iter[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool Crc32cHasHardware() {
+#if defined(CRC32C_HAS_HARDWARE_PATH)
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#else
+    return false;
+#endif
+}
+
+#if defined(CRC32C_HAS_HARDWARE_PATH)
+__attribute__((target("sse4.2")))
+uint32_t Crc32cExtendHardware(uint32_t crc, const char *data, size_t size) {
+    uint64_t state = ~crc & 0xffffffffULL;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t state32 = static_cast<uint32_t>(state);
+    for (; size > 0; size--, data++) {
+        state32 = _mm_crc32_u8(state32, static_cast<unsigned char>(*data));
+    }
+    return ~state32;
+}
+#else
+uint32_t Crc32cExtendHardware(uint32_t crc, const char *data, size_t size) {
+    return Crc32cExtendTable(crc, data, size);
+}
+#endif
+
+static void _InitCrc32cExtend() {
+    g_crc32c_extend = Crc32cHasHardware() ? Crc32cExtendHardware : Crc32cExtendTable;
+}
+
+Crc32cExtendFunc Crc32cResolveExtend() {
+    pthread_once(&g_crc32c_extend_once, _InitCrc32cExtend);
+    return g_crc32c_extend;
+}
+
+uint32_t Crc32cExtendDispatch(uint32_t crc, const char *data, size_t size) {
+    return Crc32cResolveExtend()(crc, data, size);
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/crc32c.h
+ * @brief CRC32C (Castagnoli) checksum of part packets, with the SSE4.2 crc32
+ *        instruction when the CPU has it and a table otherwise. Built for
+ *        SSE4.2 the instruction is inlined, else it is picked at run time.
+ */
+
+#ifndef INF_DS_RBS_COMMON_CRC32C_H_
+#define INF_DS_RBS_COMMON_CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+typedef uint32_t (*Crc32cExtendFunc)(uint32_t crc, const char *data, size_t size);
+
+/**
+ * @brief table driven Crc32cExtend, for CPUs without SSE4.2
+ */
+uint32_t Crc32cExtendTable(uint32_t crc, const char *data, size_t size);
+
+/**
+ * @brief whether the CPU has the SSE4.2 crc32 instruction
+ */
+bool Crc32cHasHardware();
+
+/**
+ * @brief Crc32cExtend with the crc32 instruction, only to call if
+ *        Crc32cHasHardware
+ */
+uint32_t Crc32cExtendHardware(uint32_t crc, const char *data, size_t size);
+
+/**
+ * @brief Crc32cExtendHardware or Crc32cExtendTable as the CPU has SSE4.2, for
+ *        builds without it
+ */
+uint32_t Crc32cExtendDispatch(uint32_t crc, const char *data, size_t size);
+
+/**
+ * @brief the function Crc32cExtendDispatch calls, for a loop over small
+ *        chunks to pick once instead of on every chunk
+ */
+Crc32cExtendFunc Crc32cResolveExtend();
+
+/**
+ * @brief the CRC32C of data appended to the data of crc
+ *
+ * @param crc   CRC32C of the data before, 0 to start
+ */
+static inline uint32_t Crc32cExtend(uint32_t crc, const char *data, size_t size) {
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    uint64_t state = ~crc & 0xffffffffULL;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+    }
+    uint32_t state32 = static_cast<uint32_t>(state);
+    for (; size > 0; size--, data++) {
+        state32 = _mm_crc32_u8(state32, static_cast<unsigned char>(*data));
+    }
+    return ~state32;
+#else
+    return Crc32cExtendDispatch(crc, data, size);
+#endif
+}
+
+/**
+ * @brief Crc32cExtend through extend, of Crc32cResolveExtend, which is not
+ *        called when built for SSE4.2 as the instruction is inlined then
+ */
+static inline uint32_t Crc32cExtendWith(Crc32cExtendFunc extend, uint32_t crc,
+                                        const char *data, size_t size) {
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    (void)extend;
+    return Crc32cExtend(crc, data, size);
+#else
+    return extend(crc, data, size);
+#endif
+}
+
+static inline uint32_t Crc32c(const char *data, size_t size) {
+    return Crc32cExtend(0, data, size);
+}
+
+#endif  // INF_DS_RBS_COMMON_CRC32C_H_
@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file decoded_unit_cache.cc
+ * @brief cache of the data of stripes rebuilt by degraded reads, so that
+ *        popular blocks of a lost server are not decoded on every read
+ */
+
+#include "common/decoded_unit_cache.h"
+#include <assert.h>
+#include <string.h>
+#include "common/cauchy_rscode.h"
+
+DecodedUnitCache::DecodedUnitCache(int64_t capacity_bytes)
+    : m_capacity_bytes(capacity_bytes) {
+    assert(capacity_bytes >= 0);
+    pthread_mutex_init(&m_mutex, NULL);
+    memset(&m_stats, 0, sizeof(m_stats));
+    memset(m_generations, 0, sizeof(m_generations));
+}
+
+DecodedUnitCache::~DecodedUnitCache() {
+    for (std::map<Key, Entry>::iterator iter = m_entries.begin();
+         iter != m_entries.end(); ++iter) {
+        delete[] iter->second.data;
+    }
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void DecodedUnitCache::_Erase(std::map<Key, Entry>::iterator iter) {
+    m_stats.bytes_cached -= iter->second.size;
+    delete[] iter->second.data;
+    m_lru.erase(iter->second.lru);
+    m_entries.erase(iter);
+}
+
+bool DecodedUnitCache::Lookup(int64_t block_id, int64_t unit, int num_data_parts,
+                              char *const *data_ptrs, int offset) {
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_lookups++;
+    std::map<Key, Entry>::iterator iter = m_entries.find(Key(block_id, unit));
+    if (iter == m_entries.end() || iter->second.size != num_data_parts * kCodingUnitSize) {
+        m_stats.num_misses++;
+        pthread_mutex_unlock(&m_mutex);
+        return false;
+    }
+    for (int i = 0; i < num_data_parts; i++) {
+        memcpy(data_ptrs[i] + offset, iter->second.data + i * kCodingUnitSize, kCodingUnitSize);
+    }
+    m_lru.splice(m_lru.begin(), m_lru, iter->second.lru);
+    m_stats.num_hits++;
+    m_stats.bytes_saved += iter->second.size;
+    pthread_mutex_unlock(&m_mutex);
+    return true;
+}
+
+uint64_t DecodedUnitCache::BlockGeneration(int64_t block_id) const {
+    pthread_mutex_lock(&m_mutex);
+    uint64_t generation = m_generations[_GenerationSlot(block_id)];
+    pthread_mutex_unlock(&m_mutex);
+    return generation;
+}
+
+void DecodedUnitCache::Insert(int64_t block_id, int64_t unit, int num_data_parts,
+                              char *const *data_ptrs, int offset, uint64_t generation) {
+    int size = num_data_parts * kCodingUnitSize;
+    if (size > m_capacity_bytes) {
+        return;
+    }
+    // copied before taking the lock, hits of other rows go on meanwhile
+    char *data = new char[size];
+    for (int i = 0; i < num_data_parts; i++) {
+        memcpy(data + i * kCodingUnitSize, data_ptrs[i] + offset, kCodingUnitSize);
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    if (m_generations[_GenerationSlot(block_id)] != generation) {
+        // a put or repair of the block ran meanwhile, the row may mix parts
+        // of both sides
+        m_stats.num_stale++;
+        pthread_mutex_unlock(&m_mutex);
+        delete[] data;
+        return;
+    }
+    Key key(block_id, unit);
+    std::map<Key, Entry>::iterator iter = m_entries.find(key);
+    if (iter != m_entries.end()) {
+        _Erase(iter);
+    }
+    while (m_stats.bytes_cached + size > m_capacity_bytes) {
+        _Erase(m_entries.find(m_lru.back()));
+        m_stats.num_evictions++;
+    }
+    m_lru.push_front(key);
+    Entry &entry = m_entries[key];
+    entry.data = data;
+    entry.size = size;
+    entry.lru = m_lru.begin();
+    m_stats.bytes_cached += size;
+    m_stats.num_insertions++;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void DecodedUnitCache::InvalidateBlock(int64_t block_id) {
+    pthread_mutex_lock(&m_mutex);
+    m_generations[_GenerationSlot(block_id)]++;
+    std::map<Key, Entry>::iterator iter = m_entries.lower_bound(Key(block_id, 0));
+    while (iter != m_entries.end() && iter->first.first == block_id) {
+        std::map<Key, Entry>::iterator next = iter;
+        ++next;
+        _Erase(iter);
+        m_stats.num_invalidations++;
+        iter = next;
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void DecodedUnitCache::GetStats(DecodedUnitCacheStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/decoded_unit_cache.h
+ * @brief cache of the data of stripes rebuilt by degraded reads, so that
+ *        popular blocks of a lost server are not decoded on every read
+ */
+
+#ifndef INF_DS_RBS_COMMON_DECODED_UNIT_CACHE_H_
+#define INF_DS_RBS_COMMON_DECODED_UNIT_CACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <list>
+#include <map>
+#include <utility>
+
+struct DecodedUnitCacheStats {
+    uint64_t num_lookups;
+    uint64_t num_hits;
+    uint64_t num_misses;
+    uint64_t num_insertions;
+    uint64_t num_evictions;         ///< units dropped for space
+    uint64_t num_invalidations;     ///< units dropped by InvalidateBlock
+    uint64_t num_stale;             ///< insertions dropped, the block was
+                                    ///< invalidated since its parts were read
+    int64_t bytes_cached;
+    int64_t bytes_saved;            ///< returned by hits instead of being read
+                                    ///< and decoded again
+};
+
+/**
+ * @brief LRU cache of coding unit rows of blocks, keyed by block id and unit
+ *        index: unit u of a block holds bytes [u * kCodingUnitSize,
+ *        (u + 1) * kCodingUnitSize) of each of its k data parts. It is bounded
+ *        by the bytes of the rows it holds.
+ *
+ *        PartHandle admits the rows of degraded stripe reads only, the reads
+ *        that had to decode, and serves a later stripe read whose rows are
+ *        all cached without reading a part. A block repaired, or put again,
+ *        must be invalidated so that its rows are read from the parts, when
+ *        the put starts and again when it completes. A row decoded from parts
+ *        read across an invalidation is not admitted, see BlockGeneration.
+ */
+class DecodedUnitCache {
+public:
+    /**
+     * @param capacity_bytes    Rows are evicted beyond this many bytes
+     */
+    explicit DecodedUnitCache(int64_t capacity_bytes);
+
+    ~DecodedUnitCache();
+
+    /**
+     * @brief copy a cached row out, data part i to data_ptrs[i] + offset
+     *
+     * @return false if the row is not cached
+     */
+    bool Lookup(int64_t block_id, int64_t unit, int num_data_parts,
+                char *const *data_ptrs, int offset);
+
+    /**
+     * @brief taken before the parts of a row to insert are read, it moves
+     *        whenever the block, or another sharing its slot, is invalidated
+     */
+    uint64_t BlockGeneration(int64_t block_id) const;
+
+    /**
+     * @brief copy a row in, from data_ptrs[i] + offset for data part i
+     *
+     * @param generation    BlockGeneration before the parts were read, the row
+     *                      is dropped if the block was invalidated since
+     */
+    void Insert(int64_t block_id, int64_t unit, int num_data_parts,
+                char *const *data_ptrs, int offset, uint64_t generation);
+
+    /**
+     * @brief drop every row of the block and move its generation
+     */
+    void InvalidateBlock(int64_t block_id);
+
+    void GetStats(DecodedUnitCacheStats *stats) const;
+
+private:
+    typedef std::pair<int64_t, int64_t> Key;    ///< block id and unit
+
+    static const int kNumGenerations = 1024;    ///< slots of block generations
+
+    struct Entry {
+        char *data;                 ///< the units of the data parts in order
+        int size;
+        std::list<Key>::iterator lru;
+    };
+
+    /**
+     * @brief drop an entry, m_mutex is held
+     */
+    void _Erase(std::map<Key, Entry>::iterator iter);
+
+    static int _GenerationSlot(int64_t block_id) {
+        return static_cast<int>(static_cast<uint64_t>(block_id) % kNumGenerations);
+    }
+
+    int64_t m_capacity_bytes;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    std::map<Key, Entry> m_entries;         ///< ordered, a block is a range
+    std::list<Key> m_lru;                   ///< most recently used first
+    uint64_t m_generations[kNumGenerations];    ///< by _GenerationSlot, blocks
+                                                ///< share slots to bound memory
+    DecodedUnitCacheStats m_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_DECODED_UNIT_CACHE_H_
@@ -0,0 +1,671 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file file_part_store.cc
+ * @brief data server stand-in storing parts as local files, written and read
+ *        with io_uring and O_DIRECT, or with a thread pool where the kernel
+ *        has no io_uring
+ */
+
+#include "common/file_part_store.h"
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+#ifdef __NR_io_uring_setup
+static int _IoUringSetup(unsigned int entries, struct io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int _IoUringEnter(int fd, unsigned int to_submit, unsigned int min_complete,
+                         unsigned int flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                    flags, NULL, 0));
+}
+
+static int _IoUringRegister(int fd, unsigned int opcode, void *arg, unsigned int num_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, num_args));
+}
+#else
+static int _IoUringSetup(unsigned int, struct io_uring_params *) {
+    errno = ENOSYS;
+    return -1;
+}
+
+static int _IoUringEnter(int, unsigned int, unsigned int, unsigned int) {
+    errno = ENOSYS;
+    return -1;
+}
+
+static int _IoUringRegister(int, unsigned int, void *, unsigned int) {
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+/**
+ * @brief read or write the whole iov at offset
+ *
+ * @return bytes moved, less than asked only at the end of file, or -errno
+ */
+static int64_t _DoIo(int fd, bool is_get, const struct iovec &iov, int64_t offset) {
+    char *buf = static_cast<char *>(iov.iov_base);
+    size_t done = 0;
+    while (done < iov.iov_len) {
+        ssize_t ret = is_get ? pread(fd, buf + done, iov.iov_len - done, offset + done)
+                             : pwrite(fd, buf + done, iov.iov_len - done, offset + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            break;
+        }
+        done += ret;
+    }
+    return static_cast<int64_t>(done);
+}
+
+FilePartStoreOptions::FilePartStoreOptions() {
+    use_io_uring = true;
+    use_direct_io = true;
+    queue_depth = 64;
+    num_bounce_buffers = 8;
+    bounce_buffer_size = 1024 * 1024;
+    num_threads = 4;
+}
+
+void LatencyHistogram::Add(int64_t latency_us) {
+    int bucket = 0;
+    while (bucket < kLatencyBuckets - 1 && (latency_us >> (bucket + 1)) > 0) {
+        bucket++;
+    }
+    buckets[bucket]++;
+}
+
+int64_t LatencyHistogram::Percentile(double percentile) const {
+    uint64_t total = 0;
+    for (int i = 0; i < kLatencyBuckets; i++) {
+        total += buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    double target = total * percentile / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < kLatencyBuckets; i++) {
+        count += buckets[i];
+        if (count >= target && count > 0) {
+            return static_cast<int64_t>(1) << (i + 1);
+        }
+    }
+    return static_cast<int64_t>(1) << kLatencyBuckets;
+}
+
+FilePartStore::FilePartStore(const FilePartStoreOptions &options)
+    : m_options(options),
+      m_bounce_region(NULL),
+      m_use_ring(false),
+      m_registered_buffers(false),
+      m_pool(NULL),
+      m_num_pool_threads(0),
+      m_num_in_ring(0),
+      m_num_unsubmitted(0),
+      m_submitting(false),
+      m_stop_queued(false),
+      m_stop_reaped(false),
+      m_running(false),
+      m_stopping(false),
+      m_start_us(0) {
+    assert(options.queue_depth > 0);
+    assert(options.num_bounce_buffers >= 0);
+    assert(options.bounce_buffer_size % kDirectIoAlignment == 0);
+    assert(options.num_threads > 0);
+    memset(&m_ring, 0, sizeof(m_ring));
+    m_ring.fd = -1;
+    memset(&m_stats, 0, sizeof(m_stats));
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_has_work, NULL);
+    pthread_cond_init(&m_work_done, NULL);
+}
+
+FilePartStore::~FilePartStore() {
+    Stop();
+    _DestroyRing();
+    delete[] m_pool;
+    free(m_bounce_region);
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_has_work);
+    pthread_cond_destroy(&m_work_done);
+}
+
+int FilePartStore::_SetupRing() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // one more entry for the nop of Stop
+    int fd = _IoUringSetup(m_options.queue_depth + 1, &params);
+    if (fd < 0) {
+        return -1;
+    }
+    m_ring.fd = fd;
+    m_ring.entries = params.sq_entries;
+    m_ring.sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_ring.cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map && m_ring.cq_map_size > m_ring.sq_map_size) {
+        m_ring.sq_map_size = m_ring.cq_map_size;
+    }
+    void *sq_map = mmap(NULL, m_ring.sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED) {
+        _DestroyRing();
+        return -1;
+    }
+    m_ring.sq_map = sq_map;
+    void *cq_map = sq_map;
+    if (!single_map) {
+        cq_map = mmap(NULL, m_ring.cq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_map == MAP_FAILED) {
+            _DestroyRing();
+            return -1;
+        }
+        m_ring.cq_map = cq_map;
+    }
+    m_ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, m_ring.sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        _DestroyRing();
+        return -1;
+    }
+    m_ring.sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sq_map);
+    m_ring.sq_head = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+    m_ring.sq_tail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+    m_ring.sq_mask = reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+    m_ring.sq_array = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_map);
+    m_ring.cq_head = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+    m_ring.cq_tail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+    m_ring.cq_mask = reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+    m_ring.cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    if (m_bounce_region != NULL) {
+        // may exceed RLIMIT_MEMLOCK, the bounce buffers are then used unregistered
+        struct iovec iovs[m_options.num_bounce_buffers];
+        for (int i = 0; i < m_options.num_bounce_buffers; i++) {
+            iovs[i].iov_base = m_bounce_region + static_cast<size_t>(i) * m_options.bounce_buffer_size;
+            iovs[i].iov_len = m_options.bounce_buffer_size;
+        }
+        m_registered_buffers = (_IoUringRegister(fd, IORING_REGISTER_BUFFERS, iovs,
+                                                 m_options.num_bounce_buffers) == 0);
+    }
+    return 0;
+}
+
+void FilePartStore::_DestroyRing() {
+    if (m_ring.sqes != NULL) {
+        munmap(m_ring.sqes, m_ring.sqes_size);
+    }
+    if (m_ring.cq_map != NULL) {
+        munmap(m_ring.cq_map, m_ring.cq_map_size);
+    }
+    if (m_ring.sq_map != NULL) {
+        munmap(m_ring.sq_map, m_ring.sq_map_size);
+    }
+    if (m_ring.fd >= 0) {
+        close(m_ring.fd);
+    }
+    memset(&m_ring, 0, sizeof(m_ring));
+    m_ring.fd = -1;
+    m_registered_buffers = false;
+}
+
+int FilePartStore::Start() {
+    assert(!m_running && !m_stopping);
+    if (m_options.num_bounce_buffers > 0) {
+        void *region = NULL;
+        size_t size = static_cast<size_t>(m_options.num_bounce_buffers) *
+                      m_options.bounce_buffer_size;
+        if (posix_memalign(&region, kDirectIoAlignment, size) != 0) {
+            return -1;
+        }
+        m_bounce_region = static_cast<char *>(region);
+        for (int i = 0; i < m_options.num_bounce_buffers; i++) {
+            m_free_bounces.push_back(i);
+        }
+    }
+
+    if (m_options.use_io_uring && _SetupRing() == 0) {
+        if (pthread_create(&m_reaper, NULL, _ReaperThread, this) == 0) {
+            m_use_ring = true;
+        } else {
+            _DestroyRing();
+        }
+    }
+    if (!m_use_ring) {
+        m_pool = new pthread_t[m_options.num_threads];
+        for (int i = 0; i < m_options.num_threads; i++) {
+            if (pthread_create(&m_pool[m_num_pool_threads], NULL, _PoolThread, this) == 0) {
+                m_num_pool_threads++;
+            }
+        }
+        if (m_num_pool_threads == 0) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_running = true;
+    m_start_us = _NowUs();
+    m_stats.io_uring = m_use_ring;
+    m_stats.registered_buffers = m_registered_buffers;
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+void FilePartStore::Stop() {
+    pthread_mutex_lock(&m_mutex);
+    if (!m_running || m_stopping) {
+        pthread_mutex_unlock(&m_mutex);
+        return;
+    }
+    m_stopping = true;
+    pthread_cond_broadcast(&m_has_work);
+    pthread_mutex_unlock(&m_mutex);
+
+    if (m_use_ring) {
+        _SubmitPending();
+        pthread_join(m_reaper, NULL);
+        _DestroyRing();
+    } else {
+        for (int i = 0; i < m_num_pool_threads; i++) {
+            pthread_join(m_pool[i], NULL);
+        }
+        m_num_pool_threads = 0;
+    }
+}
+
+int FilePartStore::AddServer(int64_t server_addr, const std::string &dir) {
+    pthread_mutex_lock(&m_mutex);
+    bool added = m_dirs.insert(std::make_pair(server_addr, dir)).second;
+    pthread_mutex_unlock(&m_mutex);
+    return added ? 0 : -1;
+}
+
+void FilePartStore::PutPart(PartRequest *request, PartTransportCallback *callback) {
+    _Enqueue(request, callback, false);
+}
+
+void FilePartStore::GetPart(PartRequest *request, PartTransportCallback *callback) {
+    _Enqueue(request, callback, true);
+}
+
+void FilePartStore::_Enqueue(PartRequest *request,
+                             PartTransportCallback *callback,
+                             bool is_get) {
+    const Part &part = request->part;
+    pthread_mutex_lock(&m_mutex);
+    std::map<int64_t, std::string>::const_iterator iter = m_dirs.find(request->server_addr);
+    bool usable = (iter != m_dirs.end() && m_running && !m_stopping);
+    std::string path;
+    if (usable) {
+        char name[64];
+        snprintf(name, sizeof(name), "/%lld_%d",
+                 static_cast<long long>(request->block_id), request->part_index);
+        path = iter->second + name;
+    }
+    pthread_mutex_unlock(&m_mutex);
+
+    int fd = -1;
+    bool direct = false;
+    bool bounced = false;
+    bool fits = false;
+    char *own_buffer = NULL;
+    if (usable) {
+        direct = m_options.use_direct_io && part.length > 0 &&
+                 part.offset % kDirectIoAlignment == 0 &&
+                 part.length % kDirectIoAlignment == 0;
+        fits = (part.length <= m_options.bounce_buffer_size &&
+                m_options.num_bounce_buffers > 0);
+        if (!is_get && direct && reinterpret_cast<uintptr_t>(part.data) % kDirectIoAlignment != 0) {
+            bounced = fits;
+            direct = bounced;
+        }
+        int flags = is_get ? O_RDONLY : (O_WRONLY | O_CREAT);
+        fd = open(path.c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+        if (fd < 0 && direct && errno == EINVAL) {
+            // the file system has no O_DIRECT
+            direct = false;
+            bounced = false;
+            fd = open(path.c_str(), flags, 0644);
+        }
+    }
+    if (fd >= 0 && is_get) {
+        // a read never writes the part buffer itself, so that a canceled
+        // one can be dropped without waiting for its I/O. Decided once the
+        // file is open, as O_DIRECT may have been refused.
+        bounced = direct && fits;
+        void *buffer = NULL;
+        if (!bounced && posix_memalign(&buffer, kDirectIoAlignment,
+                                       std::max(part.length, 1)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        own_buffer = static_cast<char *>(buffer);
+    }
+    if (fd < 0) {
+        free(own_buffer);
+        pthread_mutex_lock(&m_mutex);
+        m_stats.num_errors++;
+        pthread_mutex_unlock(&m_mutex);
+        callback->OnPartDone(request, -1);
+        return;
+    }
+
+    IoWork *work = new IoWork;
+    work->request = request;
+    work->callback = callback;
+    work->is_get = is_get;
+    work->fd = fd;
+    work->bounced = bounced;
+    work->bounce = -1;
+    work->own_buffer = own_buffer;
+    assert(!is_get || bounced || own_buffer != NULL);
+    work->iov.iov_base = (own_buffer != NULL) ? own_buffer : part.data;
+    work->iov.iov_len = part.length;
+    work->submitted = false;
+    work->copying = false;
+    work->canceled = false;
+    work->start_us = _NowUs();
+
+    pthread_mutex_lock(&m_mutex);
+    if (m_stopping) {
+        pthread_mutex_unlock(&m_mutex);
+        close(fd);
+        free(own_buffer);
+        delete work;
+        callback->OnPartDone(request, -1);
+        return;
+    }
+    m_works[request] = work;
+    m_pending.push_back(work);
+    pthread_cond_signal(&m_has_work);
+    pthread_mutex_unlock(&m_mutex);
+    if (m_use_ring) {
+        _SubmitPending();
+    }
+}
+
+bool FilePartStore::_PrepareWork(IoWork *work) {
+    if (!work->bounced) {
+        return true;
+    }
+    if (m_free_bounces.empty()) {
+        return false;
+    }
+    work->bounce = m_free_bounces.front();
+    m_free_bounces.pop_front();
+    char *buffer = m_bounce_region + static_cast<size_t>(work->bounce) * m_options.bounce_buffer_size;
+    if (!work->is_get) {
+        memcpy(buffer, work->request->part.data, work->request->part.length);
+    }
+    work->iov.iov_base = buffer;
+    m_stats.num_bounced++;
+    return true;
+}
+
+void FilePartStore::_PushSqe(IoWork *work) {
+    unsigned int tail = *m_ring.sq_tail;
+    unsigned int index = tail & *m_ring.sq_mask;
+    struct io_uring_sqe *sqe = &m_ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<uintptr_t>(work);
+    if (work == NULL || work->canceled) {
+        sqe->opcode = IORING_OP_NOP;
+    } else {
+        sqe->fd = work->fd;
+        sqe->off = work->request->part.offset;
+        if (work->bounce >= 0 && m_registered_buffers) {
+            sqe->opcode = work->is_get ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<uintptr_t>(work->iov.iov_base);
+            sqe->len = work->iov.iov_len;
+            sqe->buf_index = work->bounce;
+        } else {
+            sqe->opcode = work->is_get ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = reinterpret_cast<uintptr_t>(&work->iov);
+            sqe->len = 1;
+        }
+        work->submitted = true;
+    }
+    m_ring.sq_array[index] = index;
+    // the entry is visible to the kernel before the tail moves over it
+    __sync_synchronize();
+    *const_cast<volatile unsigned int *>(m_ring.sq_tail) = tail + 1;
+    __sync_synchronize();
+}
+
+void FilePartStore::_SubmitPending() {
+    pthread_mutex_lock(&m_mutex);
+    if (m_submitting) {
+        // the submitting thread takes what was queued meanwhile
+        pthread_mutex_unlock(&m_mutex);
+        return;
+    }
+    m_submitting = true;
+    while (true) {
+        while (!m_pending.empty() && m_num_in_ring < m_options.queue_depth) {
+            IoWork *work = m_pending.front();
+            if (!work->canceled && !_PrepareWork(work)) {
+                break;
+            }
+            m_pending.pop_front();
+            _PushSqe(work);
+            m_num_in_ring++;
+            m_num_unsubmitted++;
+        }
+        if (m_stopping && !m_stop_queued) {
+            _PushSqe(NULL);
+            m_stop_queued = true;
+            m_num_unsubmitted++;
+        }
+        if (m_num_unsubmitted == 0) {
+            break;
+        }
+        int to_submit = m_num_unsubmitted;
+        pthread_mutex_unlock(&m_mutex);
+        int ret = _IoUringEnter(m_ring.fd, to_submit, 0, 0);
+        pthread_mutex_lock(&m_mutex);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // left in the queue for the next submission
+            break;
+        }
+        m_num_unsubmitted -= ret;
+    }
+    m_submitting = false;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void FilePartStore::CancelPart(PartRequest *request) {
+    pthread_mutex_lock(&m_mutex);
+    std::map<PartRequest *, IoWork *>::iterator iter = m_works.find(request);
+    if (iter != m_works.end()) {
+        iter->second->canceled = true;
+    }
+    // a read lands in memory of the store and is dropped when it completes,
+    // only a copy out to the part buffer already started is waited for. The
+    // copy never waits for anything, so this does not block on the I/O even
+    // when called from a completion callback. The work is freed once copied,
+    // so it is looked up again after every wait.
+    while (iter != m_works.end() && iter->second->copying) {
+        pthread_cond_wait(&m_work_done, &m_mutex);
+        iter = m_works.find(request);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void FilePartStore::_CompleteWork(IoWork *work, int64_t result) {
+    PartRequest *request = work->request;
+    pthread_mutex_lock(&m_mutex);
+    if (work->is_get && result > 0 && !work->canceled) {
+        work->copying = true;
+        pthread_mutex_unlock(&m_mutex);
+        memcpy(request->part.data, work->iov.iov_base,
+               std::min(result, static_cast<int64_t>(request->part.length)));
+        pthread_mutex_lock(&m_mutex);
+        work->copying = false;
+        pthread_cond_broadcast(&m_work_done);
+    }
+    if (work->bounce >= 0) {
+        m_free_bounces.push_back(work->bounce);
+        pthread_cond_broadcast(&m_has_work);
+    }
+
+    int status = 0;
+    if (work->canceled) {
+        status = kPartCanceled;
+        m_stats.num_canceled++;
+    } else {
+        if (result < request->part.length) {
+            // an error, or a part shorter than the range
+            status = -1;
+            m_stats.num_errors++;
+        }
+        int64_t latency_us = _NowUs() - work->start_us;
+        if (work->is_get) {
+            m_stats.num_reads++;
+            if (status == 0) {
+                m_stats.bytes_read += request->part.length;
+                m_stats.read_latency.Add(latency_us);
+            }
+        } else {
+            m_stats.num_writes++;
+            if (status == 0) {
+                m_stats.bytes_written += request->part.length;
+                m_stats.write_latency.Add(latency_us);
+            }
+        }
+    }
+    m_works.erase(request);
+    pthread_cond_broadcast(&m_work_done);
+    pthread_mutex_unlock(&m_mutex);
+
+    close(work->fd);
+    free(work->own_buffer);
+    PartTransportCallback *callback = work->callback;
+    delete work;
+    callback->OnPartDone(request, status);
+}
+
+void *FilePartStore::_ReaperThread(void *arg) {
+    static_cast<FilePartStore *>(arg)->_RunReaper();
+    return NULL;
+}
+
+void FilePartStore::_RunReaper() {
+    while (true) {
+        unsigned int head = *m_ring.cq_head;
+        unsigned int tail = *const_cast<volatile unsigned int *>(m_ring.cq_tail);
+        __sync_synchronize();
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &m_ring.cqes[head & *m_ring.cq_mask];
+            IoWork *work = reinterpret_cast<IoWork *>(static_cast<uintptr_t>(cqe->user_data));
+            int64_t result = cqe->res;
+            head++;
+            // the entry may be reused by the kernel once the head moves
+            __sync_synchronize();
+            *const_cast<volatile unsigned int *>(m_ring.cq_head) = head;
+            pthread_mutex_lock(&m_mutex);
+            if (work == NULL) {
+                m_stop_reaped = true;
+            } else {
+                m_num_in_ring--;
+            }
+            pthread_mutex_unlock(&m_mutex);
+            if (work != NULL) {
+                _CompleteWork(work, result);
+            }
+        }
+        // ring slots and bounce buffers were freed
+        _SubmitPending();
+
+        pthread_mutex_lock(&m_mutex);
+        bool done = m_stop_reaped && m_works.empty();
+        pthread_mutex_unlock(&m_mutex);
+        if (done) {
+            break;
+        }
+        if (_IoUringEnter(m_ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            assert(false);
+            break;
+        }
+    }
+}
+
+void *FilePartStore::_PoolThread(void *arg) {
+    static_cast<FilePartStore *>(arg)->_RunPoolThread();
+    return NULL;
+}
+
+void FilePartStore::_RunPoolThread() {
+    while (true) {
+        pthread_mutex_lock(&m_mutex);
+        IoWork *work = NULL;
+        while (true) {
+            if (!m_pending.empty()) {
+                work = m_pending.front();
+                if (work->canceled || _PrepareWork(work)) {
+                    m_pending.pop_front();
+                    break;
+                }
+                work = NULL;
+            } else if (m_stopping) {
+                break;
+            }
+            pthread_cond_wait(&m_has_work, &m_mutex);
+        }
+        if (work == NULL) {
+            pthread_mutex_unlock(&m_mutex);
+            break;
+        }
+        bool canceled = work->canceled;
+        work->submitted = !canceled;
+        pthread_mutex_unlock(&m_mutex);
+
+        int64_t result = 0;
+        if (!canceled) {
+            result = _DoIo(work->fd, work->is_get, work->iov, work->request->part.offset);
+        }
+        _CompleteWork(work, result);
+    }
+}
+
+void FilePartStore::GetStats(FilePartStoreStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    stats->elapsed_us = m_running ? _NowUs() - m_start_us : 0;
+    pthread_mutex_unlock(&m_mutex);
+}
+
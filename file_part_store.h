@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/file_part_store.h
+ * @brief data server stand-in storing parts as local files, written and read
+ *        with io_uring and O_DIRECT, or with a thread pool where the kernel
+ *        has no io_uring
+ */
+
+#ifndef INF_DS_RBS_COMMON_FILE_PART_STORE_H_
+#define INF_DS_RBS_COMMON_FILE_PART_STORE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include "common/part_handle.h"
+
+static const int kLatencyBuckets = 32;
+static const int kDirectIoAlignment = 4096;
+
+struct FilePartStoreOptions {
+    FilePartStoreOptions();
+
+    bool use_io_uring;          ///< else always the thread pool
+    bool use_direct_io;         ///< O_DIRECT for aligned offsets and lengths
+    int queue_depth;            ///< requests in flight in the ring
+    int num_bounce_buffers;     ///< aligned buffers registered with the ring
+    int bounce_buffer_size;     ///< a multiple of kDirectIoAlignment
+    int num_threads;            ///< threads of the fallback
+};
+
+/**
+ * @brief bucket i counts the requests of latency in [2^i, 2^(i+1)) us,
+ *        bucket 0 those under 2 us
+ */
+struct LatencyHistogram {
+    uint64_t buckets[kLatencyBuckets];
+
+    void Add(int64_t latency_us);
+
+    /**
+     * @brief upper bound of the bucket of the given percentile, 0 to 100
+     */
+    int64_t Percentile(double percentile) const;
+};
+
+struct FilePartStoreStats {
+    bool io_uring;              ///< io_uring in use, else the thread pool
+    bool registered_buffers;    ///< bounce buffers registered with the ring
+    uint64_t num_writes;
+    uint64_t num_reads;
+    uint64_t num_errors;
+    uint64_t num_canceled;
+    uint64_t num_bounced;       ///< requests copied through a bounce buffer
+    int64_t bytes_written;
+    int64_t bytes_read;
+    int64_t elapsed_us;         ///< since Start, for IOPS
+    LatencyHistogram write_latency;
+    LatencyHistogram read_latency;
+};
+
+/**
+ * @brief PartTransport storing part i of block b of a server as the file
+ *        <dir>/<b>_<i> of the directory of the server, so the put and get
+ *        paths of PartHandle run end to end against local disks.
+ *
+ *        Requests with offset and length aligned to kDirectIoAlignment use
+ *        O_DIRECT. An aligned part buffer is written in place, an unaligned
+ *        one goes through a bounce buffer registered with the ring; a longer
+ *        one, or an unaligned range, uses the page cache. Reads go to a
+ *        bounce buffer, or an aligned buffer of their own, and are copied out
+ *        to the part buffer, so a canceled read is dropped when it completes
+ *        instead of being waited for.
+ *        Requests queued while a submission is in progress are submitted
+ *        together. Puts are not synced, as replicas and parity stand for
+ *        durability.
+ */
+class FilePartStore : public PartTransport {
+public:
+    explicit FilePartStore(const FilePartStoreOptions &options);
+
+    /**
+     * @brief Stop
+     */
+    virtual ~FilePartStore();
+
+    /**
+     * @brief set up the ring, or start the thread pool if io_uring is off
+     *        or unavailable
+     *
+     * @return 0 on success, -1 if no I/O path can be started
+     */
+    int Start();
+
+    /**
+     * @brief complete the requests submitted and stop, requests submitted
+     *        afterwards fail
+     */
+    void Stop();
+
+    /**
+     * @brief store the parts of server_addr in dir, which must exist
+     *
+     * @return 0 on success, -1 if the address is taken
+     */
+    int AddServer(int64_t server_addr, const std::string &dir);
+
+    virtual void PutPart(PartRequest *request, PartTransportCallback *callback);
+
+    /**
+     * @brief a missing part or one shorter than the range fails with -1
+     */
+    virtual void GetPart(PartRequest *request, PartTransportCallback *callback);
+
+    /**
+     * @brief a request not submitted yet is completed without I/O, a read
+     *        in flight is not copied out; never waits for I/O, so it may be
+     *        called from a completion callback
+     */
+    virtual void CancelPart(PartRequest *request);
+
+    void GetStats(FilePartStoreStats *stats) const;
+
+private:
+    struct IoWork {
+        PartRequest *request;
+        PartTransportCallback *callback;
+        bool is_get;
+        int fd;
+        bool bounced;               ///< O_DIRECT through a bounce buffer
+        int bounce;                 ///< bounce buffer index once taken, else -1
+        char *own_buffer;           ///< aligned buffer of a get not bounced
+        struct iovec iov;           ///< memory the I/O reads or writes
+        bool submitted;             ///< the I/O may be running
+        bool copying;               ///< a get copying out to the part buffer
+        bool canceled;
+        int64_t start_us;
+    };
+
+    /**
+     * @brief io_uring rings mapped from the kernel
+     */
+    struct Ring {
+        int fd;
+        unsigned int entries;
+        unsigned int *sq_head;
+        unsigned int *sq_tail;
+        unsigned int *sq_mask;
+        unsigned int *sq_array;
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int *cq_mask;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+        void *sq_map;
+        size_t sq_map_size;
+        void *cq_map;
+        size_t cq_map_size;
+        size_t sqes_size;
+    };
+
+    int _SetupRing();
+
+    void _DestroyRing();
+
+    void _Enqueue(PartRequest *request, PartTransportCallback *callback, bool is_get);
+
+    /**
+     * @brief choose the file and memory of a request, m_mutex is held
+     *
+     * @return false if the request must wait for a bounce buffer
+     */
+    bool _PrepareWork(IoWork *work);
+
+    /**
+     * @brief put the pending requests that can start in the ring and enter
+     *        them, unless another thread does it already
+     */
+    void _SubmitPending();
+
+    /**
+     * @brief add one entry to the submission queue, m_mutex is held
+     */
+    void _PushSqe(IoWork *work);
+
+    static void *_ReaperThread(void *arg);
+
+    void _RunReaper();
+
+    static void *_PoolThread(void *arg);
+
+    void _RunPoolThread();
+
+    /**
+     * @brief copy out a bounced get, finish a request whose I/O returned
+     *        result and call back, m_mutex is not held
+     */
+    void _CompleteWork(IoWork *work, int64_t result);
+
+    FilePartStoreOptions m_options;
+    std::map<int64_t, std::string> m_dirs;  ///< by server address
+
+    char *m_bounce_region;                  ///< every bounce buffer
+    std::deque<int> m_free_bounces;
+
+    Ring m_ring;
+    bool m_use_ring;
+    bool m_registered_buffers;
+    pthread_t m_reaper;
+    pthread_t *m_pool;
+    int m_num_pool_threads;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    pthread_cond_t m_has_work;              ///< signaled for the pool threads
+    pthread_cond_t m_work_done;             ///< signaled when a get is copied out
+                                            ///< or a work completes
+    std::deque<IoWork *> m_pending;         ///< not submitted yet
+    std::map<PartRequest *, IoWork *> m_works;  ///< every request not completed
+    int m_num_in_ring;                      ///< submitted and not reaped
+    int m_num_unsubmitted;                  ///< in the queue, not entered
+    bool m_submitting;                      ///< a thread is entering the ring
+    bool m_stop_queued;                     ///< the nop waking the reaper to stop
+    bool m_stop_reaped;
+    bool m_running;
+    bool m_stopping;
+    int64_t m_start_us;
+    FilePartStoreStats m_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_FILE_PART_STORE_H_
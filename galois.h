@@ -5,6 +5,9 @@
  * @date 2014-12-29
  */
 
+#ifndef INF_DS_RBS_COMMON_GALOIS_H_
+#define INF_DS_RBS_COMMON_GALOIS_H_
+
 #include <sys/syscall.h>
 #include <linux/futex.h>
 #include <sys/time.h>
@@ -43,3 +46,5 @@ private:
     int *m_mul_table;    /**< used to accelerate multiply on GF(2^8)*/
     int *m_div_table;    /**< used to accelerate divide on GF(2^8)*/
 };
+
+#endif  // INF_DS_RBS_COMMON_GALOIS_H_
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file local_meta_service.cc
+ * @brief in-process stand-in for the meta service, a MetaService with a
+ *        round trip time, to test and measure BlockLocationCache locally
+ */
+
+#include "common/local_meta_service.h"
+#include <assert.h>
+#include <unistd.h>
+
+LocalMetaService::LocalMetaService(int round_trip_us, int us_per_block)
+    : m_round_trip_us(round_trip_us), m_us_per_block(us_per_block) {
+    assert(round_trip_us >= 0 && us_per_block >= 0);
+    pthread_mutex_init(&m_mutex, NULL);
+    m_failing = false;
+    m_num_lookups = 0;
+}
+
+LocalMetaService::~LocalMetaService() {
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void LocalMetaService::SetLocation(int64_t block_id, const BlockLocation &location) {
+    pthread_mutex_lock(&m_mutex);
+    m_locations[block_id] = location;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void LocalMetaService::RemoveBlock(int64_t block_id) {
+    pthread_mutex_lock(&m_mutex);
+    m_locations.erase(block_id);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void LocalMetaService::SetFailing(bool failing) {
+    pthread_mutex_lock(&m_mutex);
+    m_failing = failing;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int LocalMetaService::LookupBlocks(const std::vector<int64_t> &block_ids,
+                                   std::map<int64_t, BlockLocation> *locations) {
+    int64_t latency_us = m_round_trip_us + static_cast<int64_t>(m_us_per_block) * block_ids.size();
+    if (latency_us > 0) {
+        usleep(latency_us);
+    }
+    pthread_mutex_lock(&m_mutex);
+    m_num_lookups++;
+    if (m_failing) {
+        pthread_mutex_unlock(&m_mutex);
+        return -1;
+    }
+    for (size_t i = 0; i < block_ids.size(); i++) {
+        std::map<int64_t, BlockLocation>::const_iterator iter = m_locations.find(block_ids[i]);
+        if (iter != m_locations.end()) {
+            (*locations)[block_ids[i]] = iter->second;
+        }
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+uint64_t LocalMetaService::num_lookups() const {
+    pthread_mutex_lock(&m_mutex);
+    uint64_t num = m_num_lookups;
+    pthread_mutex_unlock(&m_mutex);
+    return num;
+}
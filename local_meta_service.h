@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/local_meta_service.h
+ * @brief in-process stand-in for the meta service, a MetaService with a
+ *        round trip time, to test and measure BlockLocationCache locally
+ */
+
+#ifndef INF_DS_RBS_COMMON_LOCAL_META_SERVICE_H_
+#define INF_DS_RBS_COMMON_LOCAL_META_SERVICE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "common/block_location_cache.h"
+
+/**
+ * @brief Block locations kept in memory. Every LookupBlocks sleeps
+ *        round_trip_us plus us_per_block for each block, as a meta server
+ *        answering a batch would, and may be made to fail.
+ */
+class LocalMetaService : public MetaService {
+public:
+    LocalMetaService(int round_trip_us, int us_per_block);
+
+    virtual ~LocalMetaService();
+
+    /**
+     * @brief add or move a block
+     */
+    void SetLocation(int64_t block_id, const BlockLocation &location);
+
+    void RemoveBlock(int64_t block_id);
+
+    /**
+     * @brief let every lookup fail with -1 from now on, or not
+     */
+    void SetFailing(bool failing);
+
+    virtual int LookupBlocks(const std::vector<int64_t> &block_ids,
+                             std::map<int64_t, BlockLocation> *locations);
+
+    /**
+     * @brief LookupBlocks calls so far
+     */
+    uint64_t num_lookups() const;
+
+private:
+    int m_round_trip_us;
+    int m_us_per_block;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    std::map<int64_t, BlockLocation> m_locations;
+    bool m_failing;
+    uint64_t m_num_lookups;
+};
+
+#endif  // INF_DS_RBS_COMMON_LOCAL_META_SERVICE_H_
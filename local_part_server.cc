@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file local_part_server.cc
+ * @brief in-process stand-in for the data servers, a PartTransport with a
+ *        service time model, to test and measure PartHandle locally
+ */
+
+#include "common/local_part_server.h"
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+LocalPartServerOptions::LocalPartServerOptions() {
+    num_workers = 4;
+    base_latency_us = 200;
+    bytes_per_us = 1000;
+    keep_data = true;
+}
+
+LocalPartServer::LocalPartServer() {
+    pthread_mutex_init(&m_mutex, NULL);
+}
+
+LocalPartServer::~LocalPartServer() {
+    Stop();
+    for (std::map<int64_t, Server *>::iterator iter = m_servers.begin();
+         iter != m_servers.end(); ++iter) {
+        Server *server = iter->second;
+        delete[] server->workers;
+        pthread_mutex_destroy(&server->mutex);
+        pthread_cond_destroy(&server->has_work);
+        delete server;
+    }
+    pthread_mutex_destroy(&m_mutex);
+}
+
+int LocalPartServer::AddServer(int64_t server_addr, const LocalPartServerOptions &options) {
+    assert(options.num_workers > 0);
+    assert(options.base_latency_us >= 0);
+    assert(options.bytes_per_us >= 0);
+
+    pthread_mutex_lock(&m_mutex);
+    if (m_servers.find(server_addr) != m_servers.end()) {
+        pthread_mutex_unlock(&m_mutex);
+        return -1;
+    }
+    Server *server = new Server;
+    server->owner = this;
+    server->options = options;
+    server->workers = new pthread_t[options.num_workers];
+    server->num_started = 0;
+    server->failing = false;
+    server->extra_latency_us = 0;
+    server->stopping = false;
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->has_work, NULL);
+    for (int i = 0; i < options.num_workers; i++) {
+        if (pthread_create(&server->workers[server->num_started], NULL,
+                           _WorkerThread, server) == 0) {
+            server->num_started++;
+        }
+    }
+    // kept even without workers, so that Stop and the destructor clean it
+    m_servers[server_addr] = server;
+    pthread_mutex_unlock(&m_mutex);
+    return (server->num_started > 0) ? 0 : -1;
+}
+
+LocalPartServer::Server *LocalPartServer::_FindServer(int64_t server_addr) const {
+    pthread_mutex_lock(&m_mutex);
+    std::map<int64_t, Server *>::const_iterator iter = m_servers.find(server_addr);
+    Server *server = (iter != m_servers.end()) ? iter->second : NULL;
+    pthread_mutex_unlock(&m_mutex);
+    return server;
+}
+
+void LocalPartServer::SetFailing(int64_t server_addr, bool failing) {
+    Server *server = _FindServer(server_addr);
+    if (server != NULL) {
+        pthread_mutex_lock(&server->mutex);
+        server->failing = failing;
+        pthread_mutex_unlock(&server->mutex);
+    }
+}
+
+void LocalPartServer::SetExtraLatency(int64_t server_addr, int extra_latency_us) {
+    Server *server = _FindServer(server_addr);
+    if (server != NULL) {
+        pthread_mutex_lock(&server->mutex);
+        server->extra_latency_us = extra_latency_us;
+        pthread_mutex_unlock(&server->mutex);
+    }
+}
+
+void LocalPartServer::Stop() {
+    // the workers call back into PartHandle, which may call CancelPart and
+    // so take m_mutex, they are joined without it
+    std::vector<std::pair<Server *, int> > stopped;
+    pthread_mutex_lock(&m_mutex);
+    for (std::map<int64_t, Server *>::iterator iter = m_servers.begin();
+         iter != m_servers.end(); ++iter) {
+        Server *server = iter->second;
+        pthread_mutex_lock(&server->mutex);
+        server->stopping = true;
+        pthread_cond_broadcast(&server->has_work);
+        // a Stop called meanwhile does not join them again
+        stopped.push_back(std::make_pair(server, server->num_started));
+        server->num_started = 0;
+        pthread_mutex_unlock(&server->mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+
+    // servers are only freed by the destructor
+    for (size_t s = 0; s < stopped.size(); s++) {
+        for (int i = 0; i < stopped[s].second; i++) {
+            pthread_join(stopped[s].first->workers[i], NULL);
+        }
+    }
+}
+
+void LocalPartServer::PutPart(PartRequest *request, PartTransportCallback *callback) {
+    _Enqueue(request, callback);
+}
+
+void LocalPartServer::GetPart(PartRequest *request, PartTransportCallback *callback) {
+    _Enqueue(request, callback);
+}
+
+void LocalPartServer::CancelPart(PartRequest *request) {
+    Server *server = _FindServer(request->server_addr);
+    if (server == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->mutex);
+    if (server->in_service.find(request) != server->in_service.end()) {
+        server->canceled.insert(request);
+    } else {
+        // moved ahead of the others, it is not served
+        for (std::deque<Work>::iterator iter = server->queue.begin();
+             iter != server->queue.end(); ++iter) {
+            if (iter->request == request) {
+                Work work = *iter;
+                work.canceled = true;
+                server->queue.erase(iter);
+                server->queue.push_front(work);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+}
+
+void LocalPartServer::_Enqueue(PartRequest *request, PartTransportCallback *callback) {
+    Server *server = _FindServer(request->server_addr);
+    if (server == NULL) {
+        callback->OnPartDone(request, -1);
+        return;
+    }
+    pthread_mutex_lock(&server->mutex);
+    if (server->stopping || server->num_started == 0) {
+        pthread_mutex_unlock(&server->mutex);
+        callback->OnPartDone(request, -1);
+        return;
+    }
+    Work work;
+    work.request = request;
+    work.callback = callback;
+    work.canceled = false;
+    server->queue.push_back(work);
+    pthread_cond_signal(&server->has_work);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+bool LocalPartServer::ReadPart(int64_t server_addr,
+                               int64_t block_id,
+                               int part_index,
+                               std::string *data) const {
+    Server *server = _FindServer(server_addr);
+    if (server == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&server->mutex);
+    std::map<std::pair<int64_t, int>, std::string>::const_iterator iter =
+        server->parts.find(std::make_pair(block_id, part_index));
+    bool found = (iter != server->parts.end());
+    if (found) {
+        *data = iter->second;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return found;
+}
+
+void *LocalPartServer::_WorkerThread(void *arg) {
+    Server *server = static_cast<Server *>(arg);
+    server->owner->_RunWorker(server);
+    return NULL;
+}
+
+int LocalPartServer::_Serve(Server *server, PartRequest *request) {
+    // a part is stored whole at its offset, as the data server does
+    std::pair<int64_t, int> key(request->block_id, request->part_index);
+    size_t end = static_cast<size_t>(request->part.offset) + request->part.length;
+    if (request->type == PartRequest::kGet) {
+        std::map<std::pair<int64_t, int>, std::string>::const_iterator iter =
+            server->parts.find(key);
+        if (iter == server->parts.end() || iter->second.size() < end) {
+            return -1;
+        }
+        memcpy(request->part.data, iter->second.data() + request->part.offset,
+               request->part.length);
+    } else if (server->options.keep_data) {
+        std::string &stored = server->parts[key];
+        if (stored.size() < end) {
+            stored.resize(end);
+        }
+        stored.replace(request->part.offset, request->part.length,
+                       request->part.data, request->part.length);
+    }
+    return 0;
+}
+
+void LocalPartServer::_RunWorker(Server *server) {
+    while (true) {
+        pthread_mutex_lock(&server->mutex);
+        while (server->queue.empty() && !server->stopping) {
+            pthread_cond_wait(&server->has_work, &server->mutex);
+        }
+        if (server->queue.empty()) {
+            pthread_mutex_unlock(&server->mutex);
+            break;
+        }
+        Work work = server->queue.front();
+        server->queue.pop_front();
+        PartRequest *request = work.request;
+        if (work.canceled) {
+            pthread_mutex_unlock(&server->mutex);
+            work.callback->OnPartDone(request, kPartCanceled);
+            continue;
+        }
+        server->in_service.insert(request);
+        int64_t service_us = server->options.base_latency_us + server->extra_latency_us;
+        pthread_mutex_unlock(&server->mutex);
+
+        if (server->options.bytes_per_us > 0) {
+            service_us += request->part.length / server->options.bytes_per_us;
+        }
+        if (service_us > 0) {
+            usleep(service_us);
+        }
+
+        pthread_mutex_lock(&server->mutex);
+        server->in_service.erase(request);
+        int status = kPartCanceled;
+        if (server->canceled.erase(request) == 0) {
+            status = server->failing ? -1 : _Serve(server, request);
+        }
+        pthread_mutex_unlock(&server->mutex);
+        work.callback->OnPartDone(request, status);
+    }
+}
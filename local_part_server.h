@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/local_part_server.h
+ * @brief in-process stand-in for the data servers, a PartTransport with a
+ *        service time model, to test and measure PartHandle locally
+ */
+
+#ifndef INF_DS_RBS_COMMON_LOCAL_PART_SERVER_H_
+#define INF_DS_RBS_COMMON_LOCAL_PART_SERVER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include "common/part_handle.h"
+
+struct LocalPartServerOptions {
+    LocalPartServerOptions();
+
+    int num_workers;            ///< requests served at the same time
+    int base_latency_us;        ///< service time of every request
+    int bytes_per_us;           ///< plus its length at this rate, 0 for none
+    bool keep_data;             ///< store put parts for ReadPart, off for long
+                                ///< benchmarks
+};
+
+/**
+ * @brief Data servers simulated by threads in the process. Every server
+ *        serves num_workers requests at a time, each taking base_latency_us
+ *        plus the time to move its bytes, and queues the others, so the
+ *        latency seen by the client grows with its load as on a real server.
+ *        Put parts are kept in memory and can be read back, by ReadPart or
+ *        GetPart.
+ */
+class LocalPartServer : public PartTransport {
+public:
+    LocalPartServer();
+
+    /**
+     * @brief Stop
+     */
+    virtual ~LocalPartServer();
+
+    /**
+     * @brief add a server and start its workers
+     *
+     * @return 0 on success, -1 if the address is taken or no worker starts
+     */
+    int AddServer(int64_t server_addr, const LocalPartServerOptions &options);
+
+    /**
+     * @brief let the server fail every request with -1 from now on, or not
+     */
+    void SetFailing(int64_t server_addr, bool failing);
+
+    /**
+     * @brief add extra_latency_us to the service time of every request of the
+     *        server from now on, to play a slow server
+     */
+    void SetExtraLatency(int64_t server_addr, int extra_latency_us);
+
+    /**
+     * @brief serve the requests queued and stop the workers of every server
+     */
+    void Stop();
+
+    /**
+     * @brief requests to an unknown server fail at once, on the calling thread
+     */
+    virtual void PutPart(PartRequest *request, PartTransportCallback *callback);
+
+    /**
+     * @brief a part never put or shorter than the range fails with -1
+     */
+    virtual void GetPart(PartRequest *request, PartTransportCallback *callback);
+
+    /**
+     * @brief a queued request is completed at once by a worker, a request
+     *        being served when its service time is over, without data
+     */
+    virtual void CancelPart(PartRequest *request);
+
+    /**
+     * @brief copy out the data put for a part
+     *
+     * @return false if the part was never put to server_addr
+     */
+    bool ReadPart(int64_t server_addr, int64_t block_id, int part_index, std::string *data) const;
+
+private:
+    struct Work {
+        PartRequest *request;
+        PartTransportCallback *callback;
+        bool canceled;
+    };
+
+    struct Server {
+        LocalPartServer *owner;
+        LocalPartServerOptions options;
+        pthread_t *workers;
+        int num_started;                        ///< workers not joined yet
+        bool failing;
+        int extra_latency_us;
+        bool stopping;
+        std::deque<Work> queue;
+        std::set<PartRequest *> in_service;     ///< requests the workers serve
+        std::set<PartRequest *> canceled;       ///< of which canceled
+        std::map<std::pair<int64_t, int>, std::string> parts;   ///< by block and part
+        mutable pthread_mutex_t mutex;          ///< protects the members above
+        pthread_cond_t has_work;
+    };
+
+    void _Enqueue(PartRequest *request, PartTransportCallback *callback);
+
+    /**
+     * @brief copy a part in or out, server->mutex is held
+     *
+     * @return 0 on success, -1 if a get finds no data
+     */
+    int _Serve(Server *server, PartRequest *request);
+
+    static void *_WorkerThread(void *arg);
+
+    void _RunWorker(Server *server);
+
+    Server *_FindServer(int64_t server_addr) const;
+
+    mutable pthread_mutex_t m_mutex;            ///< protects m_servers
+    std::map<int64_t, Server *> m_servers;
+};
+
+#endif  // INF_DS_RBS_COMMON_LOCAL_PART_SERVER_H_
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file mapped_part_file.cc
+ * @brief part files mapped in memory, so that local rebuild and scrub decode
+ *        and verify the page cache in place instead of copies in heap buffers
+ */
+
+#include "common/mapped_part_file.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedPartFile::MappedPartFile()
+    : m_map(NULL), m_map_size(0), m_data(NULL), m_length(0), m_huge_page(false) {
+}
+
+MappedPartFile::~MappedPartFile() {
+    Unmap();
+}
+
+int MappedPartFile::MapForRead(const char *path, int64_t offset, int length) {
+    assert(offset >= 0 && length > 0);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < offset + length) {
+        // pages past the end of the file would fault with SIGBUS
+        close(fd);
+        return -1;
+    }
+    int ret = _Map(fd, offset, length, false);
+    close(fd);
+    return ret;
+}
+
+int MappedPartFile::MapForWrite(const char *path, int64_t offset, int length) {
+    assert(offset >= 0 && length > 0);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int err = posix_fallocate(fd, offset, length);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        // the file system allocates on write only, only the size is needed
+        struct stat st;
+        err = (fstat(fd, &st) == 0) ? 0 : errno;
+        if (err == 0 && st.st_size < offset + length && ftruncate(fd, offset + length) != 0) {
+            err = errno;
+        }
+    }
+    int ret = (err == 0) ? _Map(fd, offset, length, true) : -1;
+    close(fd);
+    return ret;
+}
+
+int MappedPartFile::_Map(int fd, int64_t offset, int length, bool writable) {
+    Unmap();
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t map_offset = offset / page_size * page_size;
+    size_t map_size = offset + length - map_offset;
+    int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *map = mmap(NULL, map_size, prot, MAP_SHARED, fd, map_offset);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    // Decode streams every part once from the start to the end
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    if (!writable) {
+        madvise(map, map_size, MADV_WILLNEED);
+    }
+    m_huge_page = (madvise(map, map_size, MADV_HUGEPAGE) == 0);
+    m_map = map;
+    m_map_size = map_size;
+    m_data = static_cast<char *>(map) + (offset - map_offset);
+    m_length = length;
+    return 0;
+}
+
+int MappedPartFile::Sync() {
+    if (m_map == NULL) {
+        return -1;
+    }
+    return (msync(m_map, m_map_size, MS_SYNC) == 0) ? 0 : -1;
+}
+
+void MappedPartFile::Unmap() {
+    if (m_map != NULL) {
+        munmap(m_map, m_map_size);
+    }
+    m_map = NULL;
+    m_map_size = 0;
+    m_data = NULL;
+    m_length = 0;
+    m_huge_page = false;
+}
+
+int DecodePartFiles(CauchyRSCoder *coder, bool *erased, const char *const *paths,
+                    int64_t offset, int size) {
+    assert(offset % kPacketSize == 0);
+    assert(size > 0 && size % kCodingUnitSize == 0);
+    int num_data_parts = coder->num_data_parts();
+    int num_parts = num_data_parts + coder->num_code_parts();
+    MappedPartFile files[num_parts];
+    char *ptrs[num_parts];
+
+    // every survivor first, so that no output is created for a stripe which
+    // can not be decoded
+    for (int i = 0; i < num_parts; i++) {
+        if (!erased[i] && files[i].MapForRead(paths[i], offset, size) != 0) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < num_parts; i++) {
+        if (erased[i] && files[i].MapForWrite(paths[i], offset, size) != 0) {
+            return -1;
+        }
+        ptrs[i] = files[i].data();
+    }
+    // the outputs are dirty page cache pages until they are synced, unlike
+    // the O_DIRECT writes of FilePartStore, so a rebuilt part is only
+    // reported once it is on disk
+    coder->Decode(erased, ptrs, ptrs + num_data_parts, size);
+    for (int i = 0; i < num_parts; i++) {
+        if (erased[i] && files[i].Sync() != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
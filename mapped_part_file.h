@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/mapped_part_file.h
+ * @brief part files mapped in memory, so that local rebuild and scrub decode
+ *        and verify the page cache in place instead of copies in heap buffers
+ */
+
+#ifndef INF_DS_RBS_COMMON_MAPPED_PART_FILE_H_
+#define INF_DS_RBS_COMMON_MAPPED_PART_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/cauchy_rscode.h"
+
+/**
+ * @brief a range of a part file mapped shared. The mapping is advised
+ *        sequential and, where the file system backs file mappings with
+ *        transparent huge pages, huge. Truncating the file while it is mapped
+ *        makes access past the new end fault with SIGBUS.
+ */
+class MappedPartFile {
+public:
+    MappedPartFile();
+
+    /**
+     * @brief Unmap
+     */
+    ~MappedPartFile();
+
+    /**
+     * @brief map [offset, offset + length) of an existing file read only
+     *
+     * @return 0 on success, -1 if the file can not be opened or is shorter
+     *         than the range
+     */
+    int MapForRead(const char *path, int64_t offset, int length);
+
+    /**
+     * @brief map [offset, offset + length) of a file read write, the file is
+     *        created and its blocks allocated up to the end of the range, so
+     *        that stores into the mapping do not allocate them one page fault
+     *        at a time
+     *
+     * @return 0 on success, -1 on failure
+     */
+    int MapForWrite(const char *path, int64_t offset, int length);
+
+    /**
+     * @brief write the dirty pages of a write mapping back to the file
+     *
+     * @return 0 on success, -1 on failure
+     */
+    int Sync();
+
+    void Unmap();
+
+    /**
+     * @brief first byte of the range, NULL if nothing is mapped
+     */
+    char *data() const {
+        return m_data;
+    }
+
+    int length() const {
+        return m_length;
+    }
+
+    /**
+     * @brief whether the kernel accepted the huge page advice
+     */
+    bool huge_page() const {
+        return m_huge_page;
+    }
+
+private:
+    /**
+     * @brief map the range of fd, which the mapping does not keep open
+     */
+    int _Map(int fd, int64_t offset, int length, bool writable);
+
+    void *m_map;            ///< mapping, from offset rounded down to a page
+    size_t m_map_size;
+    char *m_data;
+    int m_length;
+    bool m_huge_page;
+};
+
+/**
+ * @brief rebuild erased parts of a stripe from part files: the survivors are
+ *        mapped and given straight to Decode, which writes the erased parts
+ *        straight into their mapped files, created as needed. The survivors
+ *        are never copied to buffers and the output is never copied from
+ *        them, which saves a copy per byte read and per byte written.
+ *
+ * @param coder     Coder of the stripe profile
+ * @param erased    Same as Decode, erased parts are written, others read
+ * @param paths     k + m part file paths, data parts first
+ *        The erased parts are synced to disk before it returns. A media
+ *        error while a mapped survivor is read is not returned: the process
+ *        gets SIGBUS, so callers which must survive bad sectors read the
+ *        survivors with FilePartStore instead.
+ *
+ * @param offset    Offset of the range in every part, a multiple of kPacketSize
+ * @param size      Size of the range, a multiple of kCodingUnitSize
+ * @return 0 on success, -1 if a survivor can not be mapped or an erased part
+ *         can not be created, nothing is decoded then, or an erased part can
+ *         not be synced
+ */
+int DecodePartFiles(CauchyRSCoder *coder, bool *erased, const char *const *paths,
+                    int64_t offset, int size);
+
+#endif  // INF_DS_RBS_COMMON_MAPPED_PART_FILE_H_
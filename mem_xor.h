@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/mem_xor.h
+ * @brief xor of memory buffers shared by the coding kernels
+ */
+
+#ifndef INF_DS_RBS_COMMON_MEM_XOR_H_
+#define INF_DS_RBS_COMMON_MEM_XOR_H_
+
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// XorVector is the widest register available for xor, loads and stores are
+// unaligned since part buffers come from the callers
+#if defined(__AVX2__)
+typedef __m256i XorVector;
+
+static inline XorVector XorVectorLoad(const char *src) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+}
+
+static inline void XorVectorStore(char *dst, XorVector value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), value);
+}
+
+static inline XorVector XorVectorXor(XorVector a, XorVector b) {
+    return _mm256_xor_si256(a, b);
+}
+
+static inline XorVector XorVectorZero() {
+    return _mm256_setzero_si256();
+}
+#elif defined(__SSE2__)
+typedef __m128i XorVector;
+
+static inline XorVector XorVectorLoad(const char *src) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+}
+
+static inline void XorVectorStore(char *dst, XorVector value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), value);
+}
+
+static inline XorVector XorVectorXor(XorVector a, XorVector b) {
+    return _mm_xor_si128(a, b);
+}
+
+static inline XorVector XorVectorZero() {
+    return _mm_setzero_si128();
+}
+#else
+typedef int64_t XorVector;
+
+static inline XorVector XorVectorLoad(const char *src) {
+    return *reinterpret_cast<const int64_t *>(src);
+}
+
+static inline void XorVectorStore(char *dst, XorVector value) {
+    *reinterpret_cast<int64_t *>(dst) = value;
+}
+
+static inline XorVector XorVectorXor(XorVector a, XorVector b) {
+    return a ^ b;
+}
+
+static inline XorVector XorVectorZero() {
+    return 0;
+}
+#endif
+
+static const int kXorVectorSize = sizeof(XorVector);
+
+static inline void MemXor(const char* src1,  // source buffer 1
+                        const char *src2,  // source buffer 2
+                        char *dst,         // Xor src1 and src2 (dst = src1 ^ src2)
+                        int size) {        // buffer size
+    const int64_t *l1 = (const int64_t *)src1;
+    const int64_t *l2 = (const int64_t *)src2;
+    int64_t *l3 = reinterpret_cast<int64_t *>(dst);
+
+    for (int count = 0; count < size; count += sizeof(l3[0]), l1++, l2++, l3++) {
+        *l3 = ((*l1)  ^ (*l2));
+    }
+}
+
+/**
+ * @brief dst = srcs[0] ^ srcs[1] ^ ... ^ srcs[num_srcs - 1] in one pass: every
+ *        vector of dst is reduced in registers from all sources and stored
+ *        once, instead of reading and writing dst num_srcs - 1 times
+ */
+static inline void MemXorMulti(const char **srcs, int num_srcs, char *dst, int size) {
+    int count = 0;
+    for ( ; count + 2 * kXorVectorSize <= size; count += 2 * kXorVectorSize) {
+        XorVector acc0 = XorVectorLoad(srcs[0] + count);
+        XorVector acc1 = XorVectorLoad(srcs[0] + count + kXorVectorSize);
+        for (int i = 1; i < num_srcs; i++) {
+            acc0 = XorVectorXor(acc0, XorVectorLoad(srcs[i] + count));
+            acc1 = XorVectorXor(acc1, XorVectorLoad(srcs[i] + count + kXorVectorSize));
+        }
+        XorVectorStore(dst + count, acc0);
+        XorVectorStore(dst + count + kXorVectorSize, acc1);
+    }
+    for ( ; count < size; count++) {
+        char acc = srcs[0][count];
+        for (int i = 1; i < num_srcs; i++) {
+            acc ^= srcs[i][count];
+        }
+        dst[count] = acc;
+    }
+}
+
+#endif  // INF_DS_RBS_COMMON_MEM_XOR_H_
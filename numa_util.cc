@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file numa_util.cc
+ * @brief NUMA topology, memory placement and thread placement helpers
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "common/numa_util.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief parse a sysfs cpu or node list like "0-3,8-11" into a mask
+ *
+ * @return the highest id listed plus one, 0 if the file can not be read
+ */
+static int _ReadIdList(const char *path, bool *ids, int max_ids) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[4096];
+    char *ret = fgets(line, sizeof(line), file);
+    fclose(file);
+    if (ret == NULL) {
+        return 0;
+    }
+
+    memset(ids, 0, max_ids * sizeof(bool)); // NOLINT
+    int limit = 0;
+    char *iter = line;
+    while (*iter >= '0' && *iter <= '9') {
+        int begin = strtol(iter, &iter, 10);
+        int end = begin;
+        if (*iter == '-') {
+            end = strtol(iter + 1, &iter, 10);
+        }
+        for (int id = begin; id <= end && id < max_ids; id++) {
+            ids[id] = true;
+            limit = id + 1;
+        }
+        if (*iter == ',') {
+            iter++;
+        }
+    }
+    return limit;
+}
+
+int NumaGetNodeCount() {
+    static int node_count = 0;
+    if (node_count == 0) {
+        bool nodes[kMaxNumaNodes];
+        int count = _ReadIdList("/sys/devices/system/node/online", nodes, kMaxNumaNodes);
+        node_count = (count > 0) ? count : 1;
+    }
+    return node_count;
+}
+
+static int g_cpu_nodes[CPU_SETSIZE];           ///< node of every cpu, 0 if unknown
+static pthread_once_t g_cpu_nodes_once = PTHREAD_ONCE_INIT;
+
+static void _ReadCpuNodes() {
+    char path[128];
+    bool cpus[CPU_SETSIZE];
+    for (int node = 0; node < NumaGetNodeCount(); node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        int limit = _ReadIdList(path, cpus, CPU_SETSIZE);
+        for (int cpu = 0; cpu < limit; cpu++) {
+            if (cpus[cpu]) {
+                g_cpu_nodes[cpu] = node;
+            }
+        }
+    }
+}
+
+int NumaGetCurrentNode() {
+    // called on every buffer acquire and release: no system call, sched_getcpu
+    // goes through the vDSO and the cpu to node map is read once
+    if (NumaGetNodeCount() == 1) {
+        return 0;
+    }
+    pthread_once(&g_cpu_nodes_once, _ReadCpuNodes);
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return 0;
+    }
+    return g_cpu_nodes[cpu];
+}
+
+int NumaBindMemory(void *addr, size_t size, int node) {
+    if (NumaGetNodeCount() == 1) {
+        return 0;
+    }
+    if (node < 0 || node >= kMaxNumaNodes) {
+        return -1;
+    }
+    unsigned long mask = 1UL << node; // NOLINT
+    if (syscall(SYS_mbind, addr, size, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int NumaRunOnNode(int node) {
+    if (NumaGetNodeCount() == 1) {
+        return 0;
+    }
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    bool cpus[CPU_SETSIZE];
+    int limit = _ReadIdList(path, cpus, CPU_SETSIZE);
+    if (limit == 0) {
+        return -1;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu = 0; cpu < limit; cpu++) {
+        if (cpus[cpu]) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/numa_util.h
+ * @brief NUMA topology, memory placement and thread placement helpers, read
+ *        from sysfs and done with raw system calls so that no libnuma is
+ *        needed. On a machine without NUMA everything is node 0.
+ */
+
+#ifndef INF_DS_RBS_COMMON_NUMA_UTIL_H_
+#define INF_DS_RBS_COMMON_NUMA_UTIL_H_
+
+#include <stddef.h>
+
+static const int kMaxNumaNodes = 64;
+
+/**
+ * @brief number of NUMA nodes, node ids are 0 to count - 1
+ */
+int NumaGetNodeCount();
+
+/**
+ * @brief node of the cpu the calling thread runs on, 0 if unknown. Cheap
+ *        enough for fast paths, it makes no system call.
+ */
+int NumaGetCurrentNode();
+
+/**
+ * @brief prefer node for the pages of [addr, addr + size) not touched yet,
+ *        addr must be page aligned
+ *
+ * @return 0 on success, -1 on failure
+ */
+int NumaBindMemory(void *addr, size_t size, int node);
+
+/**
+ * @brief restrict the calling thread to the cpus of node
+ *
+ * @return 0 on success, -1 on failure
+ */
+int NumaRunOnNode(int node);
+
+#endif  // INF_DS_RBS_COMMON_NUMA_UTIL_H_
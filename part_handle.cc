@@ -0,0 +1,796 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file part_handle.cc
+ * @brief puts the parts of blocks to the data servers, with a bounded and
+ *        adaptive number of put part requests in flight per server, and
+ *        reads stripes back with degraded and hedged reads
+ */
+
+#include "common/part_handle.h"
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+// the base latency of a server is the minimum over the current and the last
+// epoch of this many puts, so it follows a server that got slower for good
+static const int kBaseLatencyEpoch = 256;
+static const int64_t kNoLatency = 0x7fffffffffffffffLL;
+
+// latency above the tolerance by less than this is timer and scheduling noise
+static const int64_t kLatencySlackUs = 50;
+
+enum PartReadState {
+    kPartIdle,
+    kPartInFlight,
+    kPartArrived,
+    kPartFailed
+};
+
+/**
+ * @brief progress of one GetStripe, referenced by its part reads in flight,
+ *        the threads sending them, its hedge timer and the finishing thread,
+ *        so late completions of canceled reads find it after the request is
+ *        done
+ */
+struct PartGetState {
+    StripeGetRequest *request;
+    int num_data_parts;
+    int num_total_parts;
+    uint64_t cache_generation;      ///< of the block in the decoded cache
+    int refs;
+    bool finished;
+    int finish_status;              ///< once finished
+    int num_unlocked_calls;         ///< GetPart or CancelPart calls made without
+                                    ///< m_get_mutex, the stripe is decoded once
+                                    ///< it is finished and none is left
+    int num_arrived;
+    int num_in_flight;
+    PartReadState *part_states;     ///< per part index
+    PartRequest **in_flight;        ///< per part index, the read in flight
+    PartRequest **reads;            ///< per part index, the read made, freed
+                                    ///< with the state so it can be canceled
+                                    ///< after m_get_mutex is released
+    bool *sent;                     ///< per part index, given to the transport
+    bool *extra;                    ///< per part index, read as a hedge
+};
+
+static void _DeleteGetState(PartGetState *state) {
+    for (int i = 0; i < state->num_total_parts; i++) {
+        delete state->reads[i];
+    }
+    delete[] state->part_states;
+    delete[] state->in_flight;
+    delete[] state->reads;
+    delete[] state->sent;
+    delete[] state->extra;
+    delete state;
+}
+
+/**
+ * @brief number of parts of state not read yet that have a server
+ */
+static int _NumReadableParts(const PartGetState *state) {
+    int count = 0;
+    for (int i = 0; i < state->num_total_parts; i++) {
+        if (state->part_states[i] == kPartIdle
+            && state->request->server_addrs.find(i) != state->request->server_addrs.end()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+PartsRequest::PartsRequest() {
+    block_id = 0;
+    callback = NULL;
+    m_num_pending = 0;
+    m_status = 0;
+    m_done = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+PartsRequest::~PartsRequest() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void PartsRequest::Wait() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_done) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+StripeGetRequest::StripeGetRequest() {
+    block_id = 0;
+    coder = NULL;
+    offset = 0;
+    length = 0;
+    data_ptrs = NULL;
+    coding_ptrs = NULL;
+    num_extra_parts = 0;
+    hedge_delay_us = 0;
+    callback = NULL;
+    m_status = 0;
+    m_done = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+StripeGetRequest::~StripeGetRequest() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void StripeGetRequest::Wait() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_done) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+PartHandleOptions::PartHandleOptions() {
+    initial_window = 4;
+    min_window = 1;
+    max_window = 64;
+    latency_tolerance = 2.0;
+    decoded_cache = NULL;
+}
+
+PartHandle::PartHandle(PartTransport *transport, const PartHandleOptions &options) {
+    assert(transport != NULL);
+    assert(options.min_window > 0);
+    assert(options.min_window <= options.initial_window);
+    assert(options.initial_window <= options.max_window);
+    assert(options.latency_tolerance >= 1.0);
+
+    m_transport = transport;
+    m_options = options;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_mutex_init(&m_get_mutex, NULL);
+    pthread_cond_init(&m_timer_cond, NULL);
+    m_timer_started = false;
+    m_stopping = false;
+    memset(&m_get_stats, 0, sizeof(m_get_stats));
+}
+
+PartHandle::~PartHandle() {
+    pthread_mutex_lock(&m_get_mutex);
+    m_stopping = true;
+    pthread_cond_signal(&m_timer_cond);
+    pthread_mutex_unlock(&m_get_mutex);
+    if (m_timer_started) {
+        pthread_join(m_timer_thread, NULL);
+    }
+    // timers left are of finished reads
+    for (std::multimap<int64_t, PartGetState *>::iterator iter = m_hedge_timers.begin();
+         iter != m_hedge_timers.end(); ++iter) {
+        assert(iter->second->finished);
+        if (_UnrefGetState(iter->second)) {
+            _DeleteGetState(iter->second);
+        }
+    }
+
+    for (std::map<int64_t, ServerWindow *>::iterator iter = m_servers.begin();
+         iter != m_servers.end(); ++iter) {
+        assert(iter->second->num_in_flight == 0 && iter->second->queue.empty());
+        delete iter->second;
+    }
+    pthread_mutex_destroy(&m_mutex);
+    pthread_mutex_destroy(&m_get_mutex);
+    pthread_cond_destroy(&m_timer_cond);
+}
+
+PartHandle::ServerWindow *PartHandle::_GetServer(int64_t server_addr) {
+    std::map<int64_t, ServerWindow *>::iterator iter = m_servers.find(server_addr);
+    if (iter != m_servers.end()) {
+        return iter->second;
+    }
+    ServerWindow *server = new ServerWindow;
+    server->window = m_options.initial_window;
+    server->num_in_flight = 0;
+    server->last_decrease_us = 0;
+    server->epoch_min_us = kNoLatency;
+    server->last_epoch_min_us = kNoLatency;
+    server->epoch_samples = 0;
+    server->num_done = 0;
+    server->num_failed = 0;
+    server->num_decreases = 0;
+    m_servers[server_addr] = server;
+    return server;
+}
+
+void PartHandle::_TakeSendable(ServerWindow *server, std::deque<PartRequest *> *sendable) {
+    while (server->num_in_flight < static_cast<int>(server->window) && !server->queue.empty()) {
+        sendable->push_back(server->queue.front());
+        server->queue.pop_front();
+        server->num_in_flight++;
+    }
+}
+
+void PartHandle::_TryPutPart(std::deque<PartRequest *> *sendable) {
+    // a transport may complete inline, which takes m_mutex again
+    while (!sendable->empty()) {
+        PartRequest *part_request = sendable->front();
+        sendable->pop_front();
+        part_request->start_us = _NowUs();
+        m_transport->PutPart(part_request, this);
+    }
+}
+
+bool PartHandle::_StartPartsRequest(PartsRequest *request) {
+    assert(request != NULL);
+    if (request->todo_parts.empty()) {
+        return false;
+    }
+    for (std::map<int, Part>::const_iterator iter = request->todo_parts.begin();
+         iter != request->todo_parts.end(); ++iter) {
+        if (request->server_addrs.find(iter->first) == request->server_addrs.end()) {
+            return false;
+        }
+    }
+    request->finish_parts.clear();
+    request->m_num_pending = request->todo_parts.size();
+    request->m_status = 0;
+    request->m_done = false;
+    return true;
+}
+
+int PartHandle::PutParts(PartsRequest *request) {
+    if (!_StartPartsRequest(request)) {
+        return -1;
+    }
+    if (m_options.decoded_cache != NULL) {
+        m_options.decoded_cache->InvalidateBlock(request->block_id);
+    }
+
+    std::deque<PartRequest *> sendable;
+    pthread_mutex_lock(&m_mutex);
+    for (std::map<int, Part>::const_iterator iter = request->todo_parts.begin();
+         iter != request->todo_parts.end(); ++iter) {
+        PartRequest *part_request = new PartRequest;
+        part_request->type = PartRequest::kPut;
+        part_request->block_id = request->block_id;
+        part_request->part_index = iter->first;
+        part_request->server_addr = request->server_addrs[iter->first];
+        part_request->part = iter->second;
+        part_request->parent = request;
+        part_request->get_state = NULL;
+        part_request->start_us = 0;
+
+        ServerWindow *server = _GetServer(part_request->server_addr);
+        server->queue.push_back(part_request);
+        _TakeSendable(server, &sendable);
+    }
+    pthread_mutex_unlock(&m_mutex);
+
+    _TryPutPart(&sendable);
+    return 0;
+}
+
+int PartHandle::GetParts(PartsRequest *request) {
+    if (!_StartPartsRequest(request)) {
+        return -1;
+    }
+    std::deque<PartRequest *> sendable;
+    for (std::map<int, Part>::const_iterator iter = request->todo_parts.begin();
+         iter != request->todo_parts.end(); ++iter) {
+        PartRequest *part_request = new PartRequest;
+        part_request->type = PartRequest::kGet;
+        part_request->block_id = request->block_id;
+        part_request->part_index = iter->first;
+        part_request->server_addr = request->server_addrs[iter->first];
+        part_request->part = iter->second;
+        part_request->parent = request;
+        part_request->get_state = NULL;
+        part_request->start_us = 0;
+        sendable.push_back(part_request);
+    }
+    _SendGets(&sendable);
+    return 0;
+}
+
+void PartHandle::_UpdateWindow(ServerWindow *server,
+                               PartRequest *request,
+                               int status,
+                               int64_t now_us) {
+    int64_t latency_us = now_us - request->start_us;
+    if (status == 0) {
+        if (latency_us < server->epoch_min_us) {
+            server->epoch_min_us = latency_us;
+        }
+        if (++server->epoch_samples == kBaseLatencyEpoch) {
+            server->last_epoch_min_us = server->epoch_min_us;
+            server->epoch_min_us = kNoLatency;
+            server->epoch_samples = 0;
+        }
+    }
+    int64_t base_latency_us = server->epoch_min_us < server->last_epoch_min_us
+                              ? server->epoch_min_us : server->last_epoch_min_us;
+
+    bool slow = (status != 0)
+                || (latency_us > m_options.latency_tolerance * base_latency_us + kLatencySlackUs);
+    if (!slow) {
+        // one more request per window of fast puts
+        server->window += 1.0 / server->window;
+        if (server->window > m_options.max_window) {
+            server->window = m_options.max_window;
+        }
+    } else if (request->start_us > server->last_decrease_us) {
+        // the puts sent before the decrease saw the old window, they do not
+        // decrease again
+        server->window /= 2;
+        if (server->window < m_options.min_window) {
+            server->window = m_options.min_window;
+        }
+        server->last_decrease_us = now_us;
+        server->num_decreases++;
+    }
+}
+
+void PartHandle::OnPartDone(PartRequest *request, int status) {
+    if (request->type == PartRequest::kGet && request->get_state == NULL) {
+        _FinishPart(request, status);
+    } else if (request->type == PartRequest::kGet) {
+        _OnGetPartDone(request, status);
+    } else {
+        _OnPutPartDone(request, status);
+    }
+}
+
+void PartHandle::_OnPutPartDone(PartRequest *request, int status) {
+    int64_t now_us = _NowUs();
+    std::deque<PartRequest *> sendable;
+    pthread_mutex_lock(&m_mutex);
+    ServerWindow *server = m_servers[request->server_addr];
+    server->num_in_flight--;
+    if (status == 0) {
+        server->num_done++;
+    } else {
+        server->num_failed++;
+    }
+    _UpdateWindow(server, request, status, now_us);
+    _TakeSendable(server, &sendable);
+    pthread_mutex_unlock(&m_mutex);
+
+    // refill the window before finishing, the parent may be gone after
+    _TryPutPart(&sendable);
+    _FinishPart(request, status);
+}
+
+void PartHandle::_FinishPart(PartRequest *request, int status) {
+    PartsRequest *parent = request->parent;
+    int part_index = request->part_index;
+    Part part = request->part;
+    bool put = (request->type == PartRequest::kPut);
+    delete request;
+
+    pthread_mutex_lock(&parent->m_mutex);
+    if (status == 0) {
+        parent->finish_parts[part_index] = part;
+    } else if (parent->m_status == 0) {
+        parent->m_status = status;
+    }
+    bool finished = (--parent->m_num_pending == 0);
+    if (finished && put && m_options.decoded_cache != NULL) {
+        // rows decoded from parts read while the put was in flight may mix
+        // old and new data, drop them before the put is seen as done
+        m_options.decoded_cache->InvalidateBlock(parent->block_id);
+    }
+    PartsRequestCallback *callback = parent->callback;
+    if (finished && callback == NULL) {
+        parent->m_done = true;
+        pthread_cond_broadcast(&parent->m_cond);
+    }
+    pthread_mutex_unlock(&parent->m_mutex);
+
+    if (finished && callback != NULL) {
+        parent->m_done = true;
+        callback->OnPartsDone(parent);
+    }
+}
+
+bool PartHandle::GetServerStats(int64_t server_addr, PartServerStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    std::map<int64_t, ServerWindow *>::const_iterator iter = m_servers.find(server_addr);
+    if (iter == m_servers.end()) {
+        pthread_mutex_unlock(&m_mutex);
+        return false;
+    }
+    const ServerWindow *server = iter->second;
+    stats->window = static_cast<int>(server->window);
+    stats->num_in_flight = server->num_in_flight;
+    stats->num_queued = server->queue.size();
+    stats->num_done = server->num_done;
+    stats->num_failed = server->num_failed;
+    stats->num_decreases = server->num_decreases;
+    stats->base_latency_us = server->epoch_min_us < server->last_epoch_min_us
+                             ? server->epoch_min_us : server->last_epoch_min_us;
+    if (stats->base_latency_us == kNoLatency) {
+        stats->base_latency_us = 0;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return true;
+}
+
+bool PartHandle::_UnrefGetState(PartGetState *state) {
+    assert(state->refs > 0);
+    return --state->refs == 0;
+}
+
+int PartHandle::_PickParts(PartGetState *state,
+                           int count,
+                           bool extra,
+                           std::deque<PartRequest *> *sendable) {
+    StripeGetRequest *request = state->request;
+    int num_picked = 0;
+    for (int i = 0; i < state->num_total_parts && num_picked < count; i++) {
+        std::map<int, int64_t>::const_iterator addr = request->server_addrs.find(i);
+        if (state->part_states[i] != kPartIdle || addr == request->server_addrs.end()) {
+            continue;
+        }
+        PartRequest *part_request = new PartRequest;
+        part_request->type = PartRequest::kGet;
+        part_request->block_id = request->block_id;
+        part_request->part_index = i;
+        part_request->server_addr = addr->second;
+        part_request->part.offset = request->offset;
+        part_request->part.length = request->length;
+        part_request->part.data = (i < state->num_data_parts) ? request->data_ptrs[i]
+                                  : request->coding_ptrs[i - state->num_data_parts];
+        part_request->parent = NULL;
+        part_request->get_state = state;
+        part_request->start_us = 0;
+
+        state->part_states[i] = kPartInFlight;
+        state->in_flight[i] = part_request;
+        state->reads[i] = part_request;
+        state->extra[i] = extra;
+        state->num_in_flight++;
+        state->refs++;
+        sendable->push_back(part_request);
+        num_picked++;
+    }
+    return num_picked;
+}
+
+void PartHandle::_SendGets(std::deque<PartRequest *> *sendable) {
+    while (!sendable->empty()) {
+        PartRequest *part_request = sendable->front();
+        sendable->pop_front();
+        part_request->start_us = _NowUs();
+        PartGetState *state = part_request->get_state;
+        if (state == NULL) {
+            m_transport->GetPart(part_request, this);
+            continue;
+        }
+
+        int index = part_request->part_index;
+        pthread_mutex_lock(&m_get_mutex);
+        if (state->finished) {
+            // the stripe is done and its buffers may be gone, never send it
+            pthread_mutex_unlock(&m_get_mutex);
+            _OnGetPartDone(part_request, kPartCanceled);
+            continue;
+        }
+        // the read may complete and drop its reference before GetPart returns
+        state->refs++;
+        state->num_unlocked_calls++;
+        pthread_mutex_unlock(&m_get_mutex);
+
+        m_transport->GetPart(part_request, this);
+
+        // a stripe finished meanwhile skipped this read as not sent, the
+        // sender cancels it, unless it has completed already, and the stripe
+        // is not decoded before
+        pthread_mutex_lock(&m_get_mutex);
+        state->sent[index] = true;
+        bool cancel = state->finished && state->in_flight[index] == part_request;
+        pthread_mutex_unlock(&m_get_mutex);
+        if (cancel) {
+            m_transport->CancelPart(part_request);
+        }
+        _EndUnlockedCall(state);
+    }
+}
+
+void PartHandle::_EndUnlockedCall(PartGetState *state) {
+    pthread_mutex_lock(&m_get_mutex);
+    assert(state->num_unlocked_calls > 0);
+    if (--state->num_unlocked_calls == 0 && state->finished) {
+        pthread_mutex_unlock(&m_get_mutex);
+        // the reference is handed to _FinishGet
+        _FinishGet(state, state->finish_status);
+        return;
+    }
+    bool release = _UnrefGetState(state);
+    pthread_mutex_unlock(&m_get_mutex);
+    if (release) {
+        _DeleteGetState(state);
+    }
+}
+
+int PartHandle::GetStripe(StripeGetRequest *request) {
+    assert(request != NULL && request->coder != NULL);
+    assert(request->length > 0 && request->length % kCodingUnitSize == 0);
+    assert(request->num_extra_parts >= 0);
+
+    int num_data_parts = request->coder->num_data_parts();
+    int num_total_parts = num_data_parts + request->coder->num_code_parts();
+    int num_servers = 0;
+    for (int i = 0; i < num_total_parts; i++) {
+        if (request->server_addrs.find(i) != request->server_addrs.end()) {
+            num_servers++;
+        }
+    }
+    if (num_servers < num_data_parts) {
+        return -1;
+    }
+    if (_GetCached(request)) {
+        pthread_mutex_lock(&m_get_mutex);
+        m_get_stats.num_gets++;
+        m_get_stats.num_cached++;
+        pthread_mutex_unlock(&m_get_mutex);
+        _CompleteGet(request, 0);
+        return 0;
+    }
+
+    PartGetState *state = new PartGetState;
+    state->request = request;
+    state->num_data_parts = num_data_parts;
+    state->num_total_parts = num_total_parts;
+    // taken before any part is read, rows of a block put meanwhile are stale
+    state->cache_generation = (m_options.decoded_cache != NULL)
+                              ? m_options.decoded_cache->BlockGeneration(request->block_id) : 0;
+    state->refs = 1;            // until the reads are sent
+    state->finished = false;
+    state->finish_status = 0;
+    state->num_unlocked_calls = 0;
+    state->num_arrived = 0;
+    state->num_in_flight = 0;
+    state->part_states = new PartReadState[num_total_parts];
+    state->in_flight = new PartRequest *[num_total_parts];
+    state->reads = new PartRequest *[num_total_parts];
+    state->sent = new bool[num_total_parts];
+    state->extra = new bool[num_total_parts];
+    for (int i = 0; i < num_total_parts; i++) {
+        state->part_states[i] = kPartIdle;
+        state->in_flight[i] = NULL;
+        state->reads[i] = NULL;
+        state->sent[i] = false;
+        state->extra[i] = false;
+    }
+    request->m_status = 0;
+    request->m_done = false;
+
+    std::deque<PartRequest *> sendable;
+    pthread_mutex_lock(&m_get_mutex);
+    _PickParts(state, num_data_parts, false, &sendable);
+    if (request->num_extra_parts > 0) {
+        if (request->hedge_delay_us > 0 && !m_timer_started) {
+            m_timer_started = (pthread_create(&m_timer_thread, NULL, _HedgeTimerThread, this) == 0);
+        }
+        if (request->hedge_delay_us > 0 && m_timer_started) {
+            state->refs++;
+            m_hedge_timers.insert(std::make_pair(_NowUs() + request->hedge_delay_us, state));
+            pthread_cond_signal(&m_timer_cond);
+        } else if (_PickParts(state, request->num_extra_parts, true, &sendable) > 0) {
+            // no delay, or no timer thread
+            m_get_stats.num_hedged++;
+        }
+    }
+    bool release = _UnrefGetState(state);
+    pthread_mutex_unlock(&m_get_mutex);
+    assert(!release);
+
+    _SendGets(&sendable);
+    return 0;
+}
+
+void PartHandle::_OnGetPartDone(PartRequest *request, int status) {
+    PartGetState *state = request->get_state;
+    int index = request->part_index;
+
+    std::deque<PartRequest *> sendable;
+    std::vector<PartRequest *> cancels;
+    bool finish = false;
+    int finish_status = 0;
+    pthread_mutex_lock(&m_get_mutex);
+    state->in_flight[index] = NULL;
+    state->num_in_flight--;
+    if (status == kPartCanceled) {
+        m_get_stats.num_canceled++;
+    }
+    if (!state->finished) {
+        if (status == 0) {
+            state->part_states[index] = kPartArrived;
+            finish = (++state->num_arrived == state->num_data_parts);
+        } else {
+            // degraded read: replace the failed part by one not read yet
+            state->part_states[index] = kPartFailed;
+            int missing = state->num_data_parts - state->num_arrived - state->num_in_flight;
+            if (missing > _NumReadableParts(state)) {
+                finish = true;
+                finish_status = -1;
+            } else if (missing > 0) {
+                _PickParts(state, missing, false, &sendable);
+            }
+        }
+    }
+    if (finish) {
+        // the reads left are stragglers, the transport does not write their
+        // buffers once CancelPart returns, so decoding may overwrite them.
+        // Reads not sent yet are canceled by their sender.
+        state->finished = true;
+        state->finish_status = finish_status;
+        state->num_unlocked_calls++;
+        for (int i = 0; i < state->num_total_parts; i++) {
+            if (state->in_flight[i] != NULL && state->sent[i]) {
+                cancels.push_back(state->in_flight[i]);
+            }
+        }
+        // the finishing thread keeps the reference of this read, which also
+        // keeps the reads to cancel allocated, until its cancels end
+    } else if (_UnrefGetState(state)) {
+        pthread_mutex_unlock(&m_get_mutex);
+        _DeleteGetState(state);
+        return;
+    }
+    pthread_mutex_unlock(&m_get_mutex);
+
+    if (finish) {
+        // without m_get_mutex, a transport may take its own locks to cancel
+        for (size_t i = 0; i < cancels.size(); i++) {
+            m_transport->CancelPart(cancels[i]);
+        }
+        _EndUnlockedCall(state);
+    } else {
+        _SendGets(&sendable);
+    }
+}
+
+void PartHandle::_FinishGet(PartGetState *state, int status) {
+    StripeGetRequest *request = state->request;
+    bool decoded = false;
+    bool xor_decoded = false;
+    bool hedge_won = false;
+    if (status == 0) {
+        bool erased[state->num_total_parts];
+        for (int i = 0; i < state->num_total_parts; i++) {
+            erased[i] = (state->part_states[i] != kPartArrived);
+            if (i < state->num_data_parts && erased[i]) {
+                decoded = true;
+            }
+            if (state->extra[i] && !erased[i]) {
+                hedge_won = true;
+            }
+        }
+        if (decoded) {
+            // parity parts not read are erased too, but only the data is
+            // wanted back
+            xor_decoded = request->coder->XorDecodable(erased);
+            request->coder->DecodeData(erased, request->data_ptrs, request->coding_ptrs,
+                                       request->length);
+        }
+    }
+    // only rows that cost a decode are worth the memory
+    DecodedUnitCache *cache = m_options.decoded_cache;
+    if (decoded && cache != NULL && request->offset % kCodingUnitSize == 0) {
+        for (int offset = 0; offset < request->length; offset += kCodingUnitSize) {
+            cache->Insert(request->block_id, (request->offset + offset) / kCodingUnitSize,
+                          state->num_data_parts, request->data_ptrs, offset,
+                          state->cache_generation);
+        }
+    }
+
+    pthread_mutex_lock(&m_get_mutex);
+    m_get_stats.num_gets++;
+    if (status != 0) {
+        m_get_stats.num_failed++;
+    }
+    if (decoded) {
+        m_get_stats.num_decoded++;
+    }
+    if (xor_decoded) {
+        m_get_stats.num_xor_decoded++;
+    }
+    if (hedge_won) {
+        m_get_stats.num_hedge_wins++;
+    }
+    bool release = _UnrefGetState(state);
+    pthread_mutex_unlock(&m_get_mutex);
+    if (release) {
+        _DeleteGetState(state);
+    }
+
+    _CompleteGet(request, status);
+}
+
+bool PartHandle::_GetCached(StripeGetRequest *request) {
+    DecodedUnitCache *cache = m_options.decoded_cache;
+    if (cache == NULL || request->offset % kCodingUnitSize != 0) {
+        return false;
+    }
+    int num_data_parts = request->coder->num_data_parts();
+    for (int offset = 0; offset < request->length; offset += kCodingUnitSize) {
+        if (!cache->Lookup(request->block_id, (request->offset + offset) / kCodingUnitSize,
+                           num_data_parts, request->data_ptrs, offset)) {
+            // the rows copied are read again with the others
+            return false;
+        }
+    }
+    return true;
+}
+
+void PartHandle::_CompleteGet(StripeGetRequest *request, int status) {
+    // the request may be gone once the submitter learns it is done
+    StripeGetCallback *callback = request->callback;
+    if (callback != NULL) {
+        request->m_status = status;
+        request->m_done = true;
+        callback->OnStripeDone(request);
+    } else {
+        pthread_mutex_lock(&request->m_mutex);
+        request->m_status = status;
+        request->m_done = true;
+        pthread_cond_broadcast(&request->m_cond);
+        pthread_mutex_unlock(&request->m_mutex);
+    }
+}
+
+void PartHandle::GetStripeStats(StripeGetStats *stats) const {
+    pthread_mutex_lock(&m_get_mutex);
+    *stats = m_get_stats;
+    pthread_mutex_unlock(&m_get_mutex);
+}
+
+void *PartHandle::_HedgeTimerThread(void *arg) {
+    static_cast<PartHandle *>(arg)->_RunHedgeTimer();
+    return NULL;
+}
+
+void PartHandle::_RunHedgeTimer() {
+    pthread_mutex_lock(&m_get_mutex);
+    while (!m_stopping) {
+        if (m_hedge_timers.empty()) {
+            pthread_cond_wait(&m_timer_cond, &m_get_mutex);
+            continue;
+        }
+        std::multimap<int64_t, PartGetState *>::iterator first = m_hedge_timers.begin();
+        int64_t now_us = _NowUs();
+        if (first->first > now_us) {
+            struct timespec deadline;
+            deadline.tv_sec = first->first / 1000000;
+            deadline.tv_nsec = first->first % 1000000 * 1000;
+            pthread_cond_timedwait(&m_timer_cond, &m_get_mutex, &deadline);
+            continue;
+        }
+
+        // the first k reads are late, read the extra parts
+        PartGetState *state = first->second;
+        m_hedge_timers.erase(first);
+        std::deque<PartRequest *> sendable;
+        if (!state->finished
+            && _PickParts(state, state->request->num_extra_parts, true, &sendable) > 0) {
+            m_get_stats.num_hedged++;
+        }
+        bool release = _UnrefGetState(state);
+        pthread_mutex_unlock(&m_get_mutex);
+        if (release) {
+            _DeleteGetState(state);
+        }
+        _SendGets(&sendable);
+        pthread_mutex_lock(&m_get_mutex);
+    }
+    pthread_mutex_unlock(&m_get_mutex);
+}
@@ -0,0 +1,422 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/part_handle.h
+ * @brief puts the parts of blocks to the data servers, with a bounded and
+ *        adaptive number of put part requests in flight per server, and
+ *        reads stripes back with degraded and hedged reads
+ */
+
+#ifndef INF_DS_RBS_COMMON_PART_HANDLE_H_
+#define INF_DS_RBS_COMMON_PART_HANDLE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include "common/cauchy_rscode.h"
+#include "common/decoded_unit_cache.h"
+
+struct Part {
+    int length;
+    int offset;             ///< offset of data in the part on the server
+    char *data;
+};
+
+class PartsRequest;
+class StripeGetRequest;
+struct PartGetState;
+
+static const int kPartCanceled = -2;   ///< status of a part request canceled
+
+/**
+ * @brief told when a PartsRequest has finished
+ */
+class PartsRequestCallback {
+public:
+    virtual ~PartsRequestCallback() {}
+
+    /**
+     * @brief called once every part is done, the request may be deleted
+     *        from here
+     */
+    virtual void OnPartsDone(PartsRequest *request) = 0;
+};
+
+/**
+ * @brief the parts of one block, each put to or read from its own data
+ *        server. The part data must stay valid until the request is done.
+ *        Without a callback the submitter waits with Wait.
+ */
+class PartsRequest {
+public:
+    PartsRequest();
+
+    ~PartsRequest();
+
+    /**
+     * @brief wait until every part is done
+     */
+    void Wait();
+
+    bool IsDone() const {
+        return m_done;
+    }
+
+    /**
+     * @brief 0 if every part was put or read, else the error of a failed part
+     */
+    int status() const {
+        return m_status;
+    }
+
+    int64_t block_id;
+    std::map<int, int64_t> server_addrs;    ///< part index to data server
+    std::map<int, Part> todo_parts;         ///< part index to part to put or read
+    std::map<int, Part> finish_parts;       ///< parts done, filled as they finish
+    PartsRequestCallback *callback;         ///< NULL to Wait for the request
+
+private:
+    friend class PartHandle;
+
+    int m_num_pending;                      ///< parts not done yet
+    int m_status;
+    volatile bool m_done;
+    pthread_mutex_t m_mutex;                ///< protects the members above
+    pthread_cond_t m_cond;
+};
+
+/**
+ * @brief told when a StripeGetRequest has finished
+ */
+class StripeGetCallback {
+public:
+    virtual ~StripeGetCallback() {}
+
+    /**
+     * @brief called once the data parts are read or decoded, or the read
+     *        failed, the request may be deleted from here
+     */
+    virtual void OnStripeDone(StripeGetRequest *request) = 0;
+};
+
+/**
+ * @brief read of the same range of the k data parts of a stripe. The parts
+ *        are read from their servers, a part of a server failing or missing
+ *        from server_addrs is replaced by a parity part and decoded.
+ *
+ *        With num_extra_parts x > 0, x more parity parts are read
+ *        hedge_delay_us after the first k, or at once with 0, the data comes
+ *        from the first k parts to arrive and the others are canceled, so
+ *        one slow server does not set the latency of the read.
+ */
+class StripeGetRequest {
+public:
+    StripeGetRequest();
+
+    ~StripeGetRequest();
+
+    /**
+     * @brief wait until the request is done
+     */
+    void Wait();
+
+    bool IsDone() const {
+        return m_done;
+    }
+
+    /**
+     * @brief 0 if the data parts were read, -1 if less than k parts could be
+     */
+    int status() const {
+        return m_status;
+    }
+
+    int64_t block_id;
+    CauchyRSCoder *coder;                   ///< coder of the stripe profile
+    std::map<int, int64_t> server_addrs;    ///< part index, 0 to k+m-1, to data server
+    int offset;                             ///< of the range in every part
+    int length;                             ///< a multiple of kCodingUnitSize
+    char **data_ptrs;                       ///< k buffers of length, filled with the range
+    char **coding_ptrs;                     ///< m buffers of length for parity parts
+    int num_extra_parts;                    ///< x parity parts read in addition
+    int hedge_delay_us;                     ///< delay of the extra reads
+    StripeGetCallback *callback;            ///< NULL to Wait for the request
+
+private:
+    friend class PartHandle;
+
+    int m_status;
+    volatile bool m_done;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+};
+
+/**
+ * @brief one part sent to or read from one data server
+ */
+struct PartRequest {
+    enum Type {
+        kPut,
+        kGet
+    };
+
+    Type type;
+    int64_t block_id;
+    int part_index;
+    int64_t server_addr;
+    Part part;              ///< data to put, or buffer of a get
+    PartsRequest *parent;   ///< of a put
+    PartGetState *get_state;    ///< of a get, private to PartHandle
+    int64_t start_us;       ///< when handed to the transport
+};
+
+/**
+ * @brief told when the transport is done with a part request
+ */
+class PartTransportCallback {
+public:
+    virtual ~PartTransportCallback() {}
+
+    /**
+     * @param status    0 on success, kPartCanceled after CancelPart, another
+     *                  negative error otherwise
+     */
+    virtual void OnPartDone(PartRequest *request, int status) = 0;
+};
+
+/**
+ * @brief sends part requests to the data servers, the RPC layer in the
+ *        service, LocalPartServer in tests and benchmarks and FilePartStore
+ *        on local disks
+ */
+class PartTransport {
+public:
+    virtual ~PartTransport() {}
+
+    /**
+     * @brief start putting a part, the completion is given to callback on
+     *        any thread, possibly before PutPart returns
+     */
+    virtual void PutPart(PartRequest *request, PartTransportCallback *callback) = 0;
+
+    /**
+     * @brief start reading part.length bytes at part.offset of a part into
+     *        part.data, completed as PutPart
+     */
+    virtual void GetPart(PartRequest *request, PartTransportCallback *callback) = 0;
+
+    /**
+     * @brief stop a request in flight: once CancelPart returns the transport
+     *        no longer writes part.data. The callback still comes once, with
+     *        kPartCanceled unless the request had already completed, and
+     *        never from within CancelPart. A request whose callback already
+     *        came, but which is not freed yet, is left alone.
+     */
+    virtual void CancelPart(PartRequest *request) = 0;
+};
+
+struct PartHandleOptions {
+    PartHandleOptions();
+
+    int initial_window;         ///< put part requests in flight per server at first
+    int min_window;
+    int max_window;
+    double latency_tolerance;   ///< a put slower than this times the base latency
+                                ///< of the server halves its window
+    DecodedUnitCache *decoded_cache;    ///< rows of degraded stripe reads, not
+                                        ///< owned, NULL for none
+};
+
+struct StripeGetStats {
+    uint64_t num_gets;          ///< stripe reads done
+    uint64_t num_failed;        ///< stripe reads with less than k parts read
+    uint64_t num_decoded;       ///< stripe reads that decoded lost data parts
+    uint64_t num_xor_decoded;   ///< of which the lost part was the xor of the
+                                ///< others
+    uint64_t num_hedged;        ///< stripe reads that sent extra reads
+    uint64_t num_hedge_wins;    ///< of which an extra part was among the first k
+    uint64_t num_canceled;      ///< part reads canceled
+    uint64_t num_cached;        ///< stripe reads served by the decoded cache
+};
+
+struct PartServerStats {
+    int window;                 ///< current limit of requests in flight
+    int num_in_flight;
+    int num_queued;             ///< requests waiting for the window
+    uint64_t num_done;
+    uint64_t num_failed;
+    uint64_t num_decreases;     ///< times the window was halved
+    int64_t base_latency_us;    ///< recent minimum latency of the server
+};
+
+/**
+ * @brief Spreads the parts of PutParts over per server queues and keeps at
+ *        most a window of requests in flight to every server, refilled as
+ *        requests complete. The window follows AIMD on the put latency: it
+ *        grows by one request per window of puts as fast as the base latency
+ *        of the server and is halved, once per window, on a slow or failed
+ *        put, so a loaded server gets fewer requests instead of longer queues.
+ *        Reads of GetStripe and GetParts are latency bound and sent at once.
+ */
+class PartHandle : public PartTransportCallback {
+public:
+    /**
+     * @param transport     Used for every put part request, not owned
+     */
+    PartHandle(PartTransport *transport, const PartHandleOptions &options);
+
+    /**
+     * @brief no request may be in flight, canceled part reads included
+     */
+    ~PartHandle();
+
+    /**
+     * @brief start putting the todo parts of request, the rows of the block
+     *        in the decoded cache are dropped
+     *
+     * @return 0 on success, -1 if the request has no part or a part without
+     *         server address, nothing is put then
+     */
+    int PutParts(PartsRequest *request);
+
+    /**
+     * @brief start reading the todo parts of request, each its own range of
+     *        its part, without decoding: the reads are latency bound and sent
+     *        at once, outside the put windows
+     *
+     * @return 0 on success, -1 as PutParts
+     */
+    int GetParts(PartsRequest *request);
+
+    /**
+     * @brief start reading a stripe range, lost data parts are decoded on
+     *        the thread completing the k-th part read. With a decoded cache, a
+     *        unit aligned range whose rows are all cached is copied from it
+     *        and completes on the calling thread, and the rows of a range
+     *        that was decoded are admitted.
+     *
+     * @return 0 on success, -1 if less than k parts have a server address,
+     *         nothing is read then
+     */
+    int GetStripe(StripeGetRequest *request);
+
+    void GetStripeStats(StripeGetStats *stats) const;
+
+    /**
+     * @return false if no part was put to server_addr yet
+     */
+    bool GetServerStats(int64_t server_addr, PartServerStats *stats) const;
+
+    virtual void OnPartDone(PartRequest *request, int status);
+
+private:
+    struct ServerWindow {
+        double window;
+        int num_in_flight;
+        std::deque<PartRequest *> queue;
+        int64_t last_decrease_us;   ///< puts started until then do not decrease again
+        int64_t epoch_min_us;       ///< minimum latency of the current epoch
+        int64_t last_epoch_min_us;  ///< of the epoch before
+        int epoch_samples;
+        uint64_t num_done;
+        uint64_t num_failed;
+        uint64_t num_decreases;
+    };
+
+    /**
+     * @brief check a PartsRequest and reset its progress
+     *
+     * @return false if it has no part or a part without server address
+     */
+    static bool _StartPartsRequest(PartsRequest *request);
+
+    ServerWindow *_GetServer(int64_t server_addr);
+
+    /**
+     * @brief take the requests allowed by the window of server from its
+     *        queue, m_mutex is held
+     */
+    void _TakeSendable(ServerWindow *server, std::deque<PartRequest *> *sendable);
+
+    /**
+     * @brief send put part requests, m_mutex is not held
+     */
+    void _TryPutPart(std::deque<PartRequest *> *sendable);
+
+    /**
+     * @brief AIMD step of the window of server for a finished put
+     */
+    void _UpdateWindow(ServerWindow *server, PartRequest *request, int status, int64_t now_us);
+
+    void _OnPutPartDone(PartRequest *request, int status);
+
+    /**
+     * @brief account a finished part of a PartsRequest and finish the
+     *        request with its last part
+     */
+    void _FinishPart(PartRequest *request, int status);
+
+    /**
+     * @brief make read requests of up to count parts of state not read yet,
+     *        data parts first, m_get_mutex is held
+     *
+     * @return number of parts picked
+     */
+    int _PickParts(PartGetState *state, int count, bool extra, std::deque<PartRequest *> *sendable);
+
+    void _SendGets(std::deque<PartRequest *> *sendable);
+
+    void _OnGetPartDone(PartRequest *request, int status);
+
+    /**
+     * @brief decode the data parts not read and complete the request
+     */
+    void _FinishGet(PartGetState *state, int status);
+
+    /**
+     * @brief copy the range of request from the decoded cache
+     *
+     * @return false if a row of the range is not cached
+     */
+    bool _GetCached(StripeGetRequest *request);
+
+    /**
+     * @brief tell the submitter, the request may be gone afterwards
+     */
+    static void _CompleteGet(StripeGetRequest *request, int status);
+
+    /**
+     * @brief drop a reference to state, m_get_mutex is held
+     *
+     * @return true if state is to be deleted
+     */
+    bool _UnrefGetState(PartGetState *state);
+
+    /**
+     * @brief end a GetPart or the CancelParts of a finished stripe made
+     *        without m_get_mutex, and drop the reference held for it; the last
+     *        one to end once the stripe is finished decodes it
+     */
+    void _EndUnlockedCall(PartGetState *state);
+
+    static void *_HedgeTimerThread(void *arg);
+
+    void _RunHedgeTimer();
+
+    PartTransport *m_transport;
+    PartHandleOptions m_options;
+
+    mutable pthread_mutex_t m_mutex;            ///< protects m_servers
+    std::map<int64_t, ServerWindow *> m_servers;
+
+    mutable pthread_mutex_t m_get_mutex;        ///< protects the get states and
+                                                ///< the members below
+    pthread_cond_t m_timer_cond;                ///< signaled on a new timer or stop
+    std::multimap<int64_t, PartGetState *> m_hedge_timers;  ///< by deadline
+    pthread_t m_timer_thread;
+    bool m_timer_started;
+    bool m_stopping;
+    StripeGetStats m_get_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_PART_HANDLE_H_
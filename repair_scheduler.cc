@@ -0,0 +1,357 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file repair_scheduler.cc
+ * @brief background rebuild of the parts of lost blocks, riskiest blocks
+ *        first, under a bandwidth cap which yields to foreground traffic
+ */
+
+#include "common/repair_scheduler.h"
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <algorithm>
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static const int64_t kForegroundWindowUs = 1000000;
+
+RepairSchedulerOptions::RepairSchedulerOptions() {
+    num_concurrent = 4;
+    slice_size = 4 * kCodingUnitSize;
+    max_bytes_per_sec = 0;
+    min_bytes_per_sec = 16 << 20;
+    listener = NULL;
+    decoded_cache = NULL;
+}
+
+RepairScheduler::RepairScheduler(CauchyRSCoder *coder, PartHandle *handle,
+                                 const RepairSchedulerOptions &options)
+    : m_coder(coder),
+      m_handle(handle),
+      m_options(options),
+      m_num_parts(coder->num_data_parts() + coder->num_code_parts()) {
+    assert(options.num_concurrent > 0);
+    assert(options.slice_size > 0 && options.slice_size % kCodingUnitSize == 0);
+    assert(options.max_bytes_per_sec >= 0 && options.min_bytes_per_sec > 0);
+    assert(m_num_parts <= 64);
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_stopping = false;
+    m_next_send_us = 0;
+    m_window_start_us = _NowUs();
+    m_window_bytes = 0;
+    m_foreground_bytes_per_sec = 0;
+    m_start_us = 0;
+    memset(&m_progress, 0, sizeof(m_progress));
+}
+
+RepairScheduler::~RepairScheduler() {
+    Stop();
+    for (std::map<uint64_t, RepairSchedule *>::iterator iter = m_schedules.begin();
+         iter != m_schedules.end(); ++iter) {
+        delete iter->second;
+    }
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+int RepairScheduler::Start() {
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = false;
+    for (int i = 0; i < m_options.num_concurrent; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, _WorkerThread, this) == 0) {
+            m_workers.push_back(worker);
+        }
+    }
+    int ret = m_workers.empty() ? -1 : 0;
+    pthread_mutex_unlock(&m_mutex);
+    return ret;
+}
+
+void RepairScheduler::Stop() {
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = true;
+    pthread_cond_broadcast(&m_cond);
+    std::vector<pthread_t> workers;
+    workers.swap(m_workers);
+    pthread_mutex_unlock(&m_mutex);
+    for (size_t i = 0; i < workers.size(); i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+int64_t RepairScheduler::_Cost(const LostBlock &block) const {
+    int num_survivors = m_coder->num_data_parts();
+    return static_cast<int64_t>(num_survivors + block.target_addrs.size()) * block.part_size;
+}
+
+int RepairScheduler::AddBlock(const LostBlock &block) {
+    if (block.part_size <= 0 || block.part_size % kCodingUnitSize != 0) {
+        return -1;
+    }
+    uint64_t pattern = 0;
+    int num_lost = 0;
+    for (int i = 0; i < m_num_parts; i++) {
+        if (block.server_addrs.find(i) != block.server_addrs.end()) {
+            continue;
+        }
+        if (block.target_addrs.find(i) == block.target_addrs.end()) {
+            return -1;
+        }
+        pattern |= 1ULL << i;
+        num_lost++;
+    }
+    if (num_lost == 0 || num_lost > m_coder->num_code_parts()
+        || static_cast<int>(block.target_addrs.size()) != num_lost) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_queues[m_coder->num_code_parts() - num_lost][pattern].push_back(block);
+    m_progress.num_blocks++;
+    m_progress.num_queued++;
+    m_progress.bytes_left += _Cost(block);
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+void RepairScheduler::WaitIdle() {
+    pthread_mutex_lock(&m_mutex);
+    while (m_progress.num_queued > 0 || m_progress.num_in_flight > 0) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void RepairScheduler::ReportForeground(int64_t bytes) {
+    pthread_mutex_lock(&m_mutex);
+    m_window_bytes += bytes;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+const RepairScheduler::RepairSchedule *RepairScheduler::_GetSchedule(uint64_t pattern) {
+    std::map<uint64_t, RepairSchedule *>::iterator iter = m_schedules.find(pattern);
+    if (iter != m_schedules.end()) {
+        m_progress.num_schedule_hits++;
+        return iter->second;
+    }
+    RepairSchedule *schedule = new RepairSchedule;
+    bool erased[m_num_parts];
+    for (int i = 0; i < m_num_parts; i++) {
+        erased[i] = ((pattern >> i) & 1) != 0;
+        if (erased[i]) {
+            schedule->targets.push_back(i);
+        }
+    }
+    // the survivors are the parts Decode would use, the first target tells
+    unsigned char masks[kWordBits];
+    for (int i = 0; i < m_num_parts; i++) {
+        if (!erased[i] && m_coder->GetRepairCoefficients(erased, schedule->targets[0], i, masks) == 0) {
+            schedule->survivors.push_back(i);
+        }
+    }
+    assert(static_cast<int>(schedule->survivors.size()) == m_coder->num_data_parts());
+    schedule->masks.resize(schedule->targets.size() * schedule->survivors.size() * kWordBits);
+    for (size_t t = 0; t < schedule->targets.size(); t++) {
+        for (size_t s = 0; s < schedule->survivors.size(); s++) {
+            // every target has the same survivors, found above
+            m_coder->GetRepairCoefficients(
+                erased, schedule->targets[t], schedule->survivors[s],
+                &schedule->masks[(t * schedule->survivors.size() + s) * kWordBits]);
+        }
+    }
+    m_schedules[pattern] = schedule;
+    m_progress.num_patterns++;
+    return schedule;
+}
+
+void RepairScheduler::_Throttle(int64_t bytes) {
+    if (m_options.max_bytes_per_sec == 0) {
+        return;
+    }
+    pthread_mutex_lock(&m_mutex);
+    int64_t now_us = _NowUs();
+    if (now_us - m_window_start_us >= kForegroundWindowUs) {
+        m_foreground_bytes_per_sec = m_window_bytes * 1000000 / (now_us - m_window_start_us);
+        m_window_start_us = now_us;
+        m_window_bytes = 0;
+    }
+    int64_t rate = std::max(m_options.max_bytes_per_sec - m_foreground_bytes_per_sec,
+                            m_options.min_bytes_per_sec);
+    // the repair bytes go out back to back at the rate left
+    int64_t send_us = std::max(now_us, m_next_send_us);
+    m_next_send_us = send_us + bytes * 1000000 / rate;
+    while (!m_stopping && send_us > _NowUs()) {
+        struct timespec deadline;
+        deadline.tv_sec = send_us / 1000000;
+        deadline.tv_nsec = send_us % 1000000 * 1000;
+        pthread_cond_timedwait(&m_cond, &m_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+PartsRequest *RepairScheduler::_StartRead(const LostBlock &block,
+                                          const RepairSchedule *schedule,
+                                          int offset, int length, char *buffer) {
+    size_t num_survivors = schedule->survivors.size();
+    _Throttle(static_cast<int64_t>(num_survivors + schedule->targets.size()) * length);
+    PartsRequest *get = new PartsRequest;
+    get->block_id = block.block_id;
+    get->server_addrs = block.server_addrs;
+    for (size_t s = 0; s < num_survivors; s++) {
+        Part part;
+        part.offset = offset;
+        part.length = length;
+        part.data = buffer + s * length;
+        get->todo_parts[schedule->survivors[s]] = part;
+    }
+    if (m_handle->GetParts(get) != 0) {
+        delete get;
+        return NULL;
+    }
+    return get;
+}
+
+int RepairScheduler::_Repair(const LostBlock &block, const RepairSchedule *schedule) {
+    size_t num_survivors = schedule->survivors.size();
+    size_t num_targets = schedule->targets.size();
+    int slice_size = std::min(m_options.slice_size, block.part_size);
+    // two slices of the survivors, one read while the other is used
+    std::vector<char> buffer((2 * num_survivors + num_targets) * slice_size);
+    char *survivors[2] = {&buffer[0], &buffer[num_survivors * slice_size]};
+    char *targets = &buffer[2 * num_survivors * slice_size];
+
+    int current = 0;
+    PartsRequest *get = _StartRead(block, schedule, 0, slice_size, survivors[current]);
+    int status = (get != NULL) ? 0 : -1;
+    for (int offset = 0; status == 0 && offset < block.part_size; offset += slice_size) {
+        int length = std::min(slice_size, block.part_size - offset);
+        get->Wait();
+        status = get->status();
+        delete get;
+        get = NULL;
+        if (status != 0) {
+            break;
+        }
+        int next = offset + length;
+        if (next < block.part_size) {
+            get = _StartRead(block, schedule, next, std::min(slice_size, block.part_size - next),
+                             survivors[1 - current]);
+            if (get == NULL) {
+                status = -1;
+                break;
+            }
+        }
+
+        PartsRequest put;
+        put.block_id = block.block_id;
+        put.server_addrs = block.target_addrs;
+        for (size_t t = 0; t < num_targets; t++) {
+            char *target = targets + t * length;
+            for (size_t s = 0; s < num_survivors; s++) {
+                m_coder->RepairContribution(&schedule->masks[(t * num_survivors + s) * kWordBits],
+                                            survivors[current] + s * length, target, length,
+                                            s > 0);
+            }
+            Part part;
+            part.offset = offset;
+            part.length = length;
+            part.data = target;
+            put.todo_parts[schedule->targets[t]] = part;
+        }
+        status = m_handle->PutParts(&put);
+        if (status == 0) {
+            put.Wait();
+            status = put.status();
+        }
+        current = 1 - current;
+    }
+    if (get != NULL) {
+        // read ahead of a slice whose put failed
+        get->Wait();
+        delete get;
+    }
+    return status;
+}
+
+void *RepairScheduler::_WorkerThread(void *arg) {
+    static_cast<RepairScheduler *>(arg)->_RunWorker();
+    return NULL;
+}
+
+void RepairScheduler::_RunWorker() {
+    pthread_mutex_lock(&m_mutex);
+    while (true) {
+        while (!m_stopping && m_queues.empty()) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        if (m_stopping) {
+            break;
+        }
+        // the first block of the fewest parity parts left
+        std::map<int, PatternQueues>::iterator level = m_queues.begin();
+        PatternQueues::iterator queue = level->second.begin();
+        uint64_t pattern = queue->first;
+        LostBlock block = queue->second.front();
+        queue->second.pop_front();
+        if (queue->second.empty()) {
+            level->second.erase(queue);
+            if (level->second.empty()) {
+                m_queues.erase(level);
+            }
+        }
+        m_progress.num_queued--;
+        m_progress.num_in_flight++;
+        if (m_start_us == 0) {
+            m_start_us = _NowUs();
+        }
+        // the schedule is never freed before the scheduler
+        const RepairSchedule *schedule = _GetSchedule(pattern);
+        pthread_mutex_unlock(&m_mutex);
+
+        int64_t cost = _Cost(block);
+        int status = _Repair(block, schedule);
+        if (status == 0 && m_options.decoded_cache != NULL) {
+            m_options.decoded_cache->InvalidateBlock(block.block_id);
+        }
+        if (m_options.listener != NULL) {
+            m_options.listener->OnBlockRepaired(block, status);
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        m_progress.num_in_flight--;
+        m_progress.bytes_left -= cost;
+        if (status == 0) {
+            m_progress.num_repaired++;
+            m_progress.bytes_read += static_cast<int64_t>(schedule->survivors.size())
+                                     * block.part_size;
+            m_progress.bytes_written += static_cast<int64_t>(schedule->targets.size())
+                                        * block.part_size;
+        } else {
+            m_progress.num_failed++;
+        }
+        pthread_cond_broadcast(&m_cond);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void RepairScheduler::GetProgress(RepairProgress *progress) const {
+    pthread_mutex_lock(&m_mutex);
+    *progress = m_progress;
+    progress->foreground_bytes_per_sec = m_foreground_bytes_per_sec;
+    progress->elapsed_us = (m_start_us == 0) ? 0 : _NowUs() - m_start_us;
+    int64_t bytes_done = m_progress.bytes_read + m_progress.bytes_written;
+    progress->eta_us = -1;
+    if (bytes_done > 0 && progress->elapsed_us > 0) {
+        progress->eta_us = static_cast<int64_t>(
+            static_cast<double>(progress->bytes_left) * progress->elapsed_us / bytes_done);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/repair_scheduler.h
+ * @brief background rebuild of the parts of lost blocks, riskiest blocks
+ *        first, under a bandwidth cap which yields to foreground traffic
+ */
+
+#ifndef INF_DS_RBS_COMMON_REPAIR_SCHEDULER_H_
+#define INF_DS_RBS_COMMON_REPAIR_SCHEDULER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include "common/cauchy_rscode.h"
+#include "common/decoded_unit_cache.h"
+#include "common/part_handle.h"
+
+/**
+ * @brief a block with lost parts
+ */
+struct LostBlock {
+    int64_t block_id;
+    std::map<int, int64_t> server_addrs;    ///< surviving part index to data server
+    std::map<int, int64_t> target_addrs;    ///< lost part index to the server
+                                            ///< to rebuild it on
+    int part_size;                          ///< a multiple of kCodingUnitSize
+};
+
+/**
+ * @brief told of every block repaired or failed, e.g. to update its location
+ */
+class RepairListener {
+public:
+    virtual ~RepairListener() {}
+
+    /**
+     * @param status    0 if the lost parts are put to their targets, -1 if a
+     *                  survivor could not be read or a part not put
+     */
+    virtual void OnBlockRepaired(const LostBlock &block, int status) = 0;
+};
+
+struct RepairSchedulerOptions {
+    RepairSchedulerOptions();
+
+    int num_concurrent;         ///< blocks rebuilt at the same time
+    int slice_size;             ///< bytes of every part read, rebuilt and put
+                                ///< at a time, a multiple of kCodingUnitSize
+    int64_t max_bytes_per_sec;  ///< read and written by repair and foreground
+                                ///< traffic together, 0 for no cap
+    int64_t min_bytes_per_sec;  ///< left to repair whatever the foreground
+    RepairListener *listener;   ///< not owned, NULL for none
+    DecodedUnitCache *decoded_cache;    ///< its rows of a repaired block are
+                                        ///< dropped, not owned, NULL for none
+};
+
+struct RepairProgress {
+    uint64_t num_blocks;        ///< added
+    uint64_t num_repaired;
+    uint64_t num_failed;
+    uint64_t num_queued;
+    int num_in_flight;
+    uint64_t num_patterns;      ///< repair schedules computed
+    uint64_t num_schedule_hits; ///< blocks repaired with a schedule computed before
+    int64_t bytes_read;
+    int64_t bytes_written;
+    int64_t bytes_left;         ///< to read and write for the blocks not done
+    int64_t elapsed_us;         ///< since the first block was started
+    int64_t eta_us;             ///< bytes_left at the rate so far, -1 if unknown
+    int64_t foreground_bytes_per_sec;
+};
+
+/**
+ * @brief Rebuilds lost parts on worker threads through a PartHandle: the k
+ *        survivors Decode would use are read with GetParts, every lost part
+ *        is computed as the sum of the RepairContribution of the survivors
+ *        and put to its target with PutParts. Parts go slice_size bytes at a
+ *        time, the next slice of the survivors read while the current one is
+ *        rebuilt and put, so a worker holds 2 k + m slices whatever the part
+ *        size.
+ *
+ *        Blocks are queued by the number of parity parts they have left,
+ *        fewest first, and within that by erasure pattern. The coefficients
+ *        of a pattern, found by GetRepairCoefficients, are computed once and
+ *        shared by every block of the pattern, so that a disk loss of
+ *        thousands of blocks with few patterns inverts few matrices. A worker
+ *        takes one block at a time, so that a block queued with fewer
+ *        parity parts left goes next whatever was queued before it.
+ *
+ *        The bytes read and written are paced slice by slice to the cap less
+ *        the foreground rate reported by ReportForeground over the last
+ *        second, but never below min_bytes_per_sec.
+ */
+class RepairScheduler {
+public:
+    /**
+     * @param coder     Coder of the block profile, not owned
+     * @param handle    Used to read survivors and put rebuilt parts, not owned
+     */
+    RepairScheduler(CauchyRSCoder *coder, PartHandle *handle,
+                    const RepairSchedulerOptions &options);
+
+    /**
+     * @brief Stop
+     */
+    ~RepairScheduler();
+
+    /**
+     * @brief start the workers
+     *
+     * @return 0 on success, -1 if no worker starts
+     */
+    int Start();
+
+    /**
+     * @brief finish the blocks being rebuilt and stop the workers, the blocks
+     *        still queued stay queued
+     */
+    void Stop();
+
+    /**
+     * @brief queue a block
+     *
+     * @return 0 on success, -1 if no part or more than m parts are lost, a
+     *         lost part has no target or the part size is invalid
+     */
+    int AddBlock(const LostBlock &block);
+
+    /**
+     * @brief wait until no block is queued or being rebuilt
+     */
+    void WaitIdle();
+
+    /**
+     * @brief count bytes of foreground traffic against the cap
+     */
+    void ReportForeground(int64_t bytes);
+
+    void GetProgress(RepairProgress *progress) const;
+
+private:
+    /**
+     * @brief coefficients of every survivor in every lost part of a pattern
+     */
+    struct RepairSchedule {
+        std::vector<int> survivors;
+        std::vector<int> targets;
+        std::vector<unsigned char> masks;   ///< kWordBits per target and survivor
+    };
+
+    typedef std::map<uint64_t, std::deque<LostBlock> > PatternQueues;
+
+    static void *_WorkerThread(void *arg);
+
+    void _RunWorker();
+
+    /**
+     * @brief the schedule of a pattern, computed on first use, m_mutex is held
+     */
+    const RepairSchedule *_GetSchedule(uint64_t pattern);
+
+    /**
+     * @brief read the survivors and put the lost parts of one block, slice
+     *        by slice
+     */
+    int _Repair(const LostBlock &block, const RepairSchedule *schedule);
+
+    /**
+     * @brief pace a slice and start reading the survivors of it, survivor s
+     *        to buffer + s * length
+     *
+     * @return the request, NULL if it could not be sent
+     */
+    PartsRequest *_StartRead(const LostBlock &block, const RepairSchedule *schedule,
+                             int offset, int length, char *buffer);
+
+    /**
+     * @brief wait until bytes may be moved under the cap, or Stop, after
+     *        which the blocks being rebuilt finish unpaced
+     */
+    void _Throttle(int64_t bytes);
+
+    /**
+     * @brief bytes read and written to repair a block
+     */
+    int64_t _Cost(const LostBlock &block) const;
+
+    CauchyRSCoder *m_coder;
+    PartHandle *m_handle;
+    RepairSchedulerOptions m_options;
+    int m_num_parts;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    pthread_cond_t m_cond;                  ///< signaled on a block queued or
+                                            ///< done and on stop
+    std::map<int, PatternQueues> m_queues;  ///< by parity parts left
+    std::map<uint64_t, RepairSchedule *> m_schedules;   ///< by pattern
+    std::vector<pthread_t> m_workers;
+    bool m_stopping;
+    int64_t m_next_send_us;                 ///< pacing of the repair bytes
+    int64_t m_window_start_us;              ///< of the foreground rate
+    int64_t m_window_bytes;
+    int64_t m_foreground_bytes_per_sec;     ///< of the last full window
+    int64_t m_start_us;                     ///< of the first block, 0 before
+    RepairProgress m_progress;
+};
+
+#endif  // INF_DS_RBS_COMMON_REPAIR_SCHEDULER_H_
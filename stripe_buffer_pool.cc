@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file stripe_buffer_pool.cc
+ * @brief pool of aligned, optionally huge page backed, part buffer sets for
+ *        the k + m parts of a stripe
+ */
+
+#include "common/stripe_buffer_pool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "common/numa_util.h"
+
+static const size_t kHugePageSize = 2 << 20;
+static const int kThreadCacheSets = 2;
+
+// same offsets of different parts are apart by a multiple of 4 KB plus this
+// skew, so the coding kernels walking all parts in step do not keep hitting
+// the same L1 sets
+static const size_t kPartSkew = 4 * kStripeBufferAlignment;
+
+StripeBufferPool::StripeBufferPool(int num_data_parts,
+                                   int num_code_parts,
+                                   int part_size,
+                                   int max_cached_sets,
+                                   bool use_huge_pages) {
+    assert(num_data_parts > 0);
+    assert(num_code_parts > 0);
+    assert(part_size > 0);
+    assert(max_cached_sets >= 0);
+
+    m_num_data_parts = num_data_parts;
+    m_num_code_parts = num_code_parts;
+    m_part_size = part_size;
+    m_part_stride = (part_size + 4095) / 4096 * 4096 + kPartSkew;
+    m_max_cached_sets = max_cached_sets;
+    m_use_huge_pages = use_huge_pages;
+
+    pthread_key_create(&m_thread_key, _ReleaseThreadCache);
+    pthread_mutex_init(&m_mutex, NULL);
+    m_num_nodes = NumaGetNodeCount();
+    m_free_lists = new StripeBuffers*[m_num_nodes];
+    for (int i = 0; i < m_num_nodes; i++) {
+        m_free_lists[i] = NULL;
+    }
+    m_thread_caches = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+StripeBufferPool::~StripeBufferPool() {
+    pthread_key_delete(m_thread_key);
+    while (m_thread_caches != NULL) {
+        ThreadCache *cache = m_thread_caches;
+        m_thread_caches = cache->next;
+        while (cache->head != NULL) {
+            StripeBuffers *buffers = cache->head;
+            cache->head = buffers->next;
+            _FreeSet(buffers);
+        }
+        delete cache;
+    }
+    for (int i = 0; i < m_num_nodes; i++) {
+        while (m_free_lists[i] != NULL) {
+            StripeBuffers *buffers = m_free_lists[i];
+            m_free_lists[i] = buffers->next;
+            _FreeSet(buffers);
+        }
+    }
+    delete[] m_free_lists;
+    pthread_mutex_destroy(&m_mutex);
+}
+
+StripeBuffers *StripeBufferPool::_AllocateSet(int node) {
+    // regions are mapped rather than taken from malloc, so they can be bound
+    // to the node before their pages are touched
+    int num_parts = m_num_data_parts + m_num_code_parts;
+    size_t size = m_part_stride * num_parts;
+    bool huge_page = false;
+    void *addr = MAP_FAILED;
+    if (m_use_huge_pages) {
+        size = (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge_page = (addr != MAP_FAILED);
+    }
+    if (addr == MAP_FAILED) {
+        // no reserved huge pages, ask for transparent ones
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            return NULL;
+        }
+        if (m_use_huge_pages) {
+            madvise(addr, size, MADV_HUGEPAGE);
+        }
+    }
+    NumaBindMemory(addr, size, node);
+    char *region = static_cast<char *>(addr);
+
+    StripeBuffers *buffers = new StripeBuffers;
+    buffers->data_ptrs = new char*[num_parts];
+    buffers->coding_ptrs = buffers->data_ptrs + m_num_data_parts;
+    for (int i = 0; i < num_parts; i++) {
+        buffers->data_ptrs[i] = region + i * m_part_stride;
+    }
+    buffers->region = region;
+    buffers->region_size = size;
+    buffers->huge_page = huge_page;
+    buffers->node = node;
+    buffers->next = NULL;
+
+    __sync_fetch_and_add(&m_stats.num_allocations, 1);
+    __sync_fetch_and_add(&m_stats.num_sets, 1);
+    if (huge_page) {
+        __sync_fetch_and_add(&m_stats.num_huge_page_sets, 1);
+    }
+    return buffers;
+}
+
+void StripeBufferPool::_FreeSet(StripeBuffers *buffers) {
+    munmap(buffers->region, buffers->region_size);
+    if (buffers->huge_page) {
+        __sync_fetch_and_sub(&m_stats.num_huge_page_sets, 1);
+    }
+    __sync_fetch_and_sub(&m_stats.num_sets, 1);
+    delete[] buffers->data_ptrs;
+    delete buffers;
+}
+
+StripeBufferPool::ThreadCache *StripeBufferPool::_GetThreadCache() {
+    ThreadCache *cache = static_cast<ThreadCache *>(pthread_getspecific(m_thread_key));
+    if (cache == NULL) {
+        cache = new ThreadCache;
+        cache->pool = this;
+        cache->head = NULL;
+        cache->count = 0;
+        pthread_mutex_lock(&m_mutex);
+        cache->next = m_thread_caches;
+        m_thread_caches = cache;
+        pthread_mutex_unlock(&m_mutex);
+        pthread_setspecific(m_thread_key, cache);
+    }
+    return cache;
+}
+
+void StripeBufferPool::_ReleaseThreadCache(void *arg) {
+    // the thread exits, hand its sets to the shared free list up to its
+    // limit. The cache itself stays in m_thread_caches and is deleted with
+    // the pool.
+    ThreadCache *cache = static_cast<ThreadCache *>(arg);
+    StripeBufferPool *pool = cache->pool;
+    StripeBuffers *to_free = NULL;
+    pthread_mutex_lock(&pool->m_mutex);
+    while (cache->head != NULL) {
+        StripeBuffers *buffers = cache->head;
+        cache->head = buffers->next;
+        if (pool->m_stats.num_cached_sets < pool->m_max_cached_sets) {
+            buffers->next = pool->m_free_lists[buffers->node];
+            pool->m_free_lists[buffers->node] = buffers;
+            __sync_fetch_and_add(&pool->m_stats.num_cached_sets, 1);
+        } else {
+            buffers->next = to_free;
+            to_free = buffers;
+        }
+    }
+    cache->count = 0;
+    pthread_mutex_unlock(&pool->m_mutex);
+    while (to_free != NULL) {
+        StripeBuffers *buffers = to_free;
+        to_free = buffers->next;
+        pool->_FreeSet(buffers);
+    }
+}
+
+StripeBuffers *StripeBufferPool::Acquire() {
+    return Acquire(NumaGetCurrentNode());
+}
+
+StripeBuffers *StripeBufferPool::Acquire(int node) {
+    assert(node >= 0 && node < m_num_nodes);
+    __sync_fetch_and_add(&m_stats.num_acquires, 1);
+
+    // the thread cache may hold sets of another node if the thread moved
+    StripeBuffers *buffers = NULL;
+    ThreadCache *cache = _GetThreadCache();
+    for (StripeBuffers **link = &cache->head; *link != NULL; link = &(*link)->next) {
+        if ((*link)->node == node) {
+            buffers = *link;
+            *link = buffers->next;
+            cache->count--;
+            __sync_fetch_and_add(&m_stats.num_thread_hits, 1);
+            break;
+        }
+    }
+
+    if (buffers == NULL) {
+        pthread_mutex_lock(&m_mutex);
+        buffers = m_free_lists[node];
+        if (buffers != NULL) {
+            m_free_lists[node] = buffers->next;
+            __sync_fetch_and_sub(&m_stats.num_cached_sets, 1);
+        }
+        pthread_mutex_unlock(&m_mutex);
+        if (buffers != NULL) {
+            __sync_fetch_and_add(&m_stats.num_pool_hits, 1);
+        } else {
+            buffers = _AllocateSet(node);
+        }
+    }
+
+    if (buffers == NULL) {
+        // out of memory on the node, a remote set is better than none
+        pthread_mutex_lock(&m_mutex);
+        for (int i = 0; i < m_num_nodes && buffers == NULL; i++) {
+            buffers = m_free_lists[i];
+            if (buffers != NULL) {
+                m_free_lists[i] = buffers->next;
+                __sync_fetch_and_sub(&m_stats.num_cached_sets, 1);
+            }
+        }
+        pthread_mutex_unlock(&m_mutex);
+        if (buffers == NULL) {
+            return NULL;
+        }
+        __sync_fetch_and_add(&m_stats.num_node_misses, 1);
+    }
+
+    buffers->next = NULL;
+    __sync_fetch_and_add(&m_stats.num_in_use_sets, 1);
+    return buffers;
+}
+
+void StripeBufferPool::Release(StripeBuffers *buffers) {
+    assert(buffers != NULL);
+    __sync_fetch_and_sub(&m_stats.num_in_use_sets, 1);
+
+    // only sets of the node the thread runs on are worth caching for it
+    ThreadCache *cache = _GetThreadCache();
+    if (cache->count < kThreadCacheSets && buffers->node == NumaGetCurrentNode()) {
+        buffers->next = cache->head;
+        cache->head = buffers;
+        cache->count++;
+        return;
+    }
+
+    bool cached = false;
+    pthread_mutex_lock(&m_mutex);
+    if (m_stats.num_cached_sets < m_max_cached_sets) {
+        buffers->next = m_free_lists[buffers->node];
+        m_free_lists[buffers->node] = buffers;
+        __sync_fetch_and_add(&m_stats.num_cached_sets, 1);
+        cached = true;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    if (!cached) {
+        _FreeSet(buffers);
+    }
+}
+
+void StripeBufferPool::GetStats(StripeBufferPoolStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
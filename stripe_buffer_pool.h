@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/stripe_buffer_pool.h
+ * @brief pool of aligned, optionally huge page backed, part buffer sets for
+ *        the k + m parts of a stripe
+ */
+
+#ifndef INF_DS_RBS_COMMON_STRIPE_BUFFER_POOL_H_
+#define INF_DS_RBS_COMMON_STRIPE_BUFFER_POOL_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief the part buffers of one stripe, every buffer is aligned to
+ *        kStripeBufferAlignment
+ */
+struct StripeBuffers {
+    char **data_ptrs;       ///< num_data_parts buffers of part_size bytes
+    char **coding_ptrs;     ///< num_code_parts buffers of part_size bytes
+
+    char *region;           ///< memory of all parts, owned by the pool
+    size_t region_size;     ///< size of region
+    bool huge_page;         ///< whether region is a huge page mapping
+    int node;               ///< NUMA node region is placed on
+    StripeBuffers *next;    ///< next in a free list
+};
+
+struct StripeBufferPoolStats {
+    uint64_t num_acquires;          ///< Acquire calls
+    uint64_t num_thread_hits;       ///< Acquire served by the thread cache
+    uint64_t num_pool_hits;         ///< Acquire served by the shared free list
+    uint64_t num_allocations;       ///< Acquire that allocated a new set
+    int64_t num_sets;               ///< sets allocated and not yet freed
+    int64_t num_in_use_sets;        ///< sets acquired and not yet released
+    int64_t num_cached_sets;        ///< sets in the shared free lists
+    int64_t num_huge_page_sets;     ///< sets backed by huge pages
+    uint64_t num_node_misses;       ///< Acquire served by a set of another node
+};
+
+static const int kStripeBufferAlignment = 64;
+
+/**
+ * @brief Pool of stripe buffer sets of one (k, m, part size).
+ *
+ * Every set is placed on one NUMA node, the node of the thread receiving the
+ * parts by default. Released sets go to a small cache of the releasing thread
+ * first, at most 2 sets, and to the shared free list of their node after, at
+ * most max_cached_sets sets over all nodes, so the common acquire/release
+ * cycle of a thread takes no lock. Sets above the limits are freed, the sets
+ * of an exiting thread too. The pool must outlive every thread using it.
+ */
+class StripeBufferPool {
+public:
+    /**
+     * @param num_data_parts    Number of data parts
+     * @param num_code_parts    Number of coding parts
+     * @param part_size         Size of every part buffer in bytes
+     * @param max_cached_sets   Maximum number of sets in the shared free list
+     * @param use_huge_pages    Back every set with 2 MB huge pages, falls back
+     *                          to transparent huge pages then to normal pages
+     */
+    StripeBufferPool(int num_data_parts, int num_code_parts, int part_size,
+                     int max_cached_sets, bool use_huge_pages);
+
+    ~StripeBufferPool();
+
+    /**
+     * @brief get a set of part buffers on the node of the calling thread,
+     *        the content is undefined
+     *
+     * @return the set, or NULL if memory can not be allocated
+     */
+    StripeBuffers *Acquire();
+
+    /**
+     * @brief same as Acquire on the given node, a cached set of another node
+     *        is only used if no memory can be allocated on it
+     */
+    StripeBuffers *Acquire(int node);
+
+    /**
+     * @brief give back a set got from Acquire of this pool
+     */
+    void Release(StripeBuffers *buffers);
+
+    void GetStats(StripeBufferPoolStats *stats) const;
+
+private:
+    /**
+     * @brief sets cached by one thread
+     */
+    struct ThreadCache {
+        StripeBufferPool *pool;
+        StripeBuffers *head;
+        int count;
+        ThreadCache *next;      ///< next in m_thread_caches
+    };
+
+    ThreadCache *_GetThreadCache();
+
+    static void _ReleaseThreadCache(void *arg);
+
+    StripeBuffers *_AllocateSet(int node);
+
+    void _FreeSet(StripeBuffers *buffers);
+
+    int m_num_data_parts;           ///< number of data parts
+    int m_num_code_parts;           ///< number of coding parts
+    int m_part_size;                ///< size of every part buffer
+    size_t m_part_stride;           ///< distance of two part buffers in a region
+    int m_max_cached_sets;          ///< limit of the shared free list
+    bool m_use_huge_pages;          ///< whether to back sets with huge pages
+
+    pthread_key_t m_thread_key;     ///< ThreadCache of the calling thread
+    int m_num_nodes;                ///< number of NUMA nodes
+    mutable pthread_mutex_t m_mutex;    ///< protects the lists below
+    StripeBuffers **m_free_lists;   ///< shared free list of every node
+    ThreadCache *m_thread_caches;   ///< every thread cache created
+
+    StripeBufferPoolStats m_stats;  ///< updated with atomic builtins
+};
+
+#endif  // INF_DS_RBS_COMMON_STRIPE_BUFFER_POOL_H_
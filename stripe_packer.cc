@@ -0,0 +1,424 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file stripe_packer.cc
+ * @brief packs small objects into shared stripes, so that they are erasure
+ *        coded without padding every object to whole coding units
+ */
+
+#include "common/stripe_packer.h"
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <algorithm>
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static inline int _FloorPacket(int offset) {
+    return offset / kPacketSize * kPacketSize;
+}
+
+static inline int _CeilPacket(int offset) {
+    return (offset + kPacketSize - 1) / kPacketSize * kPacketSize;
+}
+
+static inline int _FloorUnit(int offset) {
+    return offset / kCodingUnitSize * kCodingUnitSize;
+}
+
+static inline int _CeilUnit(int offset) {
+    return (offset + kCodingUnitSize - 1) / kCodingUnitSize * kCodingUnitSize;
+}
+
+SmallPutRequest::SmallPutRequest() {
+    data = NULL;
+    length = 0;
+    callback = NULL;
+    memset(&location, 0, sizeof(location));
+    m_status = 0;
+    m_done = false;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+}
+
+SmallPutRequest::~SmallPutRequest() {
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void SmallPutRequest::Wait() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_done) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+StripePackerOptions::StripePackerOptions() {
+    part_size = 4 * kCodingUnitSize;
+    max_object_size = 2 * kCodingUnitSize;
+    max_delay_us = 2000;
+    first_stripe_id = 0;
+    max_cached_sets = 4;
+}
+
+StripePacker::StripePacker(CauchyRSCoder *coder,
+                           PartHandle *handle,
+                           const std::map<int, int64_t> &server_addrs,
+                           const StripePackerOptions &options)
+    : m_coder(coder),
+      m_handle(handle),
+      m_server_addrs(server_addrs),
+      m_options(options),
+      m_num_data_parts(coder->num_data_parts()),
+      m_capacity(coder->num_data_parts() * options.part_size),
+      m_pool(coder->num_data_parts(), coder->num_code_parts(), options.part_size,
+             options.max_cached_sets, false) {
+    assert(options.part_size > 0 && options.part_size % kCodingUnitSize == 0);
+    assert(options.max_object_size > 0 && options.max_object_size <= m_capacity);
+    assert(options.max_delay_us >= 0);
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_open = NULL;
+    m_deadline_us = 0;
+    m_next_stripe_id = options.first_stripe_id;
+    m_stopping = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_timer_started = (pthread_create(&m_timer, NULL, _TimerThread, this) == 0);
+}
+
+StripePacker::~StripePacker() {
+    Flush();
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = true;
+    pthread_cond_broadcast(&m_cond);
+    while (!m_in_flight.empty()) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+    if (m_timer_started) {
+        pthread_join(m_timer, NULL);
+    }
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+void StripePacker::GetPieces(const ObjectLocation &location,
+                             int num_data_parts,
+                             std::vector<PackedPiece> *pieces) {
+    pieces->clear();
+    int offset = location.offset;
+    int end = location.offset + location.length;
+    while (offset < end) {
+        int chunk = offset / kCodingUnitSize;
+        int in_chunk = offset % kCodingUnitSize;
+        PackedPiece piece;
+        piece.part_index = chunk % num_data_parts;
+        piece.part_offset = chunk / num_data_parts * kCodingUnitSize + in_chunk;
+        piece.length = std::min(kCodingUnitSize - in_chunk, end - offset);
+        piece.object_offset = offset - location.offset;
+        pieces->push_back(piece);
+        offset += piece.length;
+    }
+}
+
+void StripePacker::_Scatter(PackedStripe *stripe, int offset, const char *src, int length) {
+    ObjectLocation location;
+    location.stripe_id = stripe->stripe_id;
+    location.offset = offset;
+    location.length = length;
+    std::vector<PackedPiece> pieces;
+    GetPieces(location, m_num_data_parts, &pieces);
+    for (size_t i = 0; i < pieces.size(); i++) {
+        char *dst = stripe->buffers->data_ptrs[pieces[i].part_index] + pieces[i].part_offset;
+        if (src != NULL) {
+            memcpy(dst, src + pieces[i].object_offset, pieces[i].length);
+        } else {
+            memset(dst, 0, pieces[i].length);
+        }
+    }
+}
+
+int StripePacker::Put(SmallPutRequest *request) {
+    assert(request != NULL);
+    if (request->length <= 0 || request->length > m_options.max_object_size) {
+        return -1;
+    }
+    request->m_status = 0;
+    request->m_done = false;
+
+    PackedStripe *sealed = NULL;
+    pthread_mutex_lock(&m_mutex);
+    if (m_open != NULL && m_open->used + request->length > m_capacity) {
+        sealed = _Seal(true);
+    }
+    if (m_open == NULL) {
+        StripeBuffers *buffers = m_pool.Acquire();
+        if (buffers == NULL) {
+            pthread_mutex_unlock(&m_mutex);
+            if (sealed != NULL) {
+                _PutStripe(sealed);
+            }
+            return -1;
+        }
+        m_open = new PackedStripe;
+        m_open->stripe_id = m_next_stripe_id++;
+        m_open->buffers = buffers;
+        m_open->used = 0;
+        m_open->full = false;
+        m_deadline_us = _NowUs() + m_options.max_delay_us;
+        pthread_cond_broadcast(&m_cond);
+    }
+    request->location.stripe_id = m_open->stripe_id;
+    request->location.offset = m_open->used;
+    request->location.length = request->length;
+    _Scatter(m_open, m_open->used, request->data, request->length);
+    m_open->used += request->length;
+    m_open->objects.push_back(request);
+    m_stats.num_objects++;
+    m_stats.object_bytes += request->length;
+    PackedStripe *full = NULL;
+    if (m_open->used == m_capacity) {
+        full = _Seal(true);
+    }
+    pthread_mutex_unlock(&m_mutex);
+
+    if (sealed != NULL) {
+        _PutStripe(sealed);
+    }
+    if (full != NULL) {
+        _PutStripe(full);
+    }
+    return 0;
+}
+
+void StripePacker::Flush() {
+    pthread_mutex_lock(&m_mutex);
+    PackedStripe *sealed = _Seal(false);
+    pthread_mutex_unlock(&m_mutex);
+    if (sealed != NULL) {
+        _PutStripe(sealed);
+    }
+}
+
+StripePacker::PackedStripe *StripePacker::_Seal(bool full) {
+    PackedStripe *stripe = m_open;
+    if (stripe != NULL) {
+        stripe->full = full;
+        m_open = NULL;
+        m_in_flight[&stripe->put] = stripe;
+    }
+    return stripe;
+}
+
+void StripePacker::_PutStripe(PackedStripe *stripe) {
+    // cut after the last row of chunks holding data, and zero its tail
+    int row_size = m_num_data_parts * kCodingUnitSize;
+    int num_rows = (stripe->used + row_size - 1) / row_size;
+    int part_size = num_rows * kCodingUnitSize;
+    _Scatter(stripe, stripe->used, NULL, num_rows * row_size - stripe->used);
+    m_coder->Encode(stripe->buffers->data_ptrs, stripe->buffers->coding_ptrs, part_size);
+
+    PartsRequest *put = &stripe->put;
+    put->block_id = stripe->stripe_id;
+    put->server_addrs = m_server_addrs;
+    put->callback = this;
+    int num_parts = m_num_data_parts + m_coder->num_code_parts();
+    for (int i = 0; i < num_parts; i++) {
+        Part part;
+        part.length = part_size;
+        part.offset = 0;
+        part.data = stripe->buffers->data_ptrs[i];
+        put->todo_parts[i] = part;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_stripes++;
+    if (stripe->full) {
+        m_stats.num_full_stripes++;
+    }
+    m_stats.stripe_bytes += static_cast<int64_t>(part_size) * m_num_data_parts;
+    pthread_mutex_unlock(&m_mutex);
+
+    if (m_handle->PutParts(put) != 0) {
+        // a part without server, the objects fail as on a failed put
+        _FinishStripe(stripe, -1);
+    }
+}
+
+void StripePacker::OnPartsDone(PartsRequest *request) {
+    pthread_mutex_lock(&m_mutex);
+    PackedStripe *stripe = m_in_flight[request];
+    pthread_mutex_unlock(&m_mutex);
+    _FinishStripe(stripe, request->status());
+}
+
+void StripePacker::_FinishStripe(PackedStripe *stripe, int status) {
+    for (size_t i = 0; i < stripe->objects.size(); i++) {
+        SmallPutRequest *object = stripe->objects[i];
+        pthread_mutex_lock(&object->m_mutex);
+        object->m_status = status;
+        SmallPutCallback *callback = object->callback;
+        if (callback == NULL) {
+            object->m_done = true;
+            pthread_cond_broadcast(&object->m_cond);
+        }
+        pthread_mutex_unlock(&object->m_mutex);
+        if (callback != NULL) {
+            object->m_done = true;
+            callback->OnSmallPutDone(object);
+        }
+    }
+    m_pool.Release(stripe->buffers);
+
+    pthread_mutex_lock(&m_mutex);
+    if (status != 0) {
+        m_stats.num_failed_stripes++;
+    }
+    m_in_flight.erase(&stripe->put);
+    delete stripe;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int StripePacker::Get(const ObjectLocation &location, char *data) {
+    assert(location.length > 0);
+    std::vector<PackedPiece> pieces;
+    GetPieces(location, m_num_data_parts, &pieces);
+
+    // the pieces of an object in one part are contiguous there, one read of
+    // their covering packets per part
+    std::map<int, std::pair<int, int> > ranges;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        int begin = _FloorPacket(pieces[i].part_offset);
+        int end = _CeilPacket(pieces[i].part_offset + pieces[i].length);
+        std::map<int, std::pair<int, int> >::iterator iter = ranges.find(pieces[i].part_index);
+        if (iter == ranges.end()) {
+            ranges[pieces[i].part_index] = std::make_pair(begin, end);
+        } else {
+            iter->second.first = std::min(iter->second.first, begin);
+            iter->second.second = std::max(iter->second.second, end);
+        }
+    }
+    PartsRequest get;
+    get.block_id = location.stripe_id;
+    get.server_addrs = m_server_addrs;
+    for (std::map<int, std::pair<int, int> >::iterator iter = ranges.begin();
+         iter != ranges.end(); ++iter) {
+        Part part;
+        part.offset = iter->second.first;
+        part.length = iter->second.second - iter->second.first;
+        part.data = new char[part.length];
+        get.todo_parts[iter->first] = part;
+    }
+
+    int status = m_handle->GetParts(&get);
+    if (status == 0) {
+        get.Wait();
+        status = get.status();
+    }
+    if (status == 0) {
+        for (size_t i = 0; i < pieces.size(); i++) {
+            const Part &part = get.todo_parts[pieces[i].part_index];
+            memcpy(data + pieces[i].object_offset,
+                   part.data + (pieces[i].part_offset - part.offset), pieces[i].length);
+        }
+    }
+    for (std::map<int, Part>::iterator iter = get.todo_parts.begin();
+         iter != get.todo_parts.end(); ++iter) {
+        delete[] iter->second.data;
+    }
+    bool degraded = (status != 0);
+    if (degraded) {
+        status = _GetDegraded(location, pieces, data);
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_gets++;
+    if (degraded && status == 0) {
+        m_stats.num_degraded_gets++;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return status;
+}
+
+int StripePacker::_GetDegraded(const ObjectLocation &location,
+                               const std::vector<PackedPiece> &pieces,
+                               char *data) {
+    int begin = pieces[0].part_offset;
+    int end = 0;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        begin = std::min(begin, pieces[i].part_offset);
+        end = std::max(end, pieces[i].part_offset + pieces[i].length);
+    }
+    begin = _FloorUnit(begin);
+    end = _CeilUnit(end);
+
+    int num_parts = m_num_data_parts + m_coder->num_code_parts();
+    char *ptrs[num_parts];
+    for (int i = 0; i < num_parts; i++) {
+        ptrs[i] = new char[end - begin];
+    }
+    StripeGetRequest request;
+    request.block_id = location.stripe_id;
+    request.coder = m_coder;
+    request.server_addrs = m_server_addrs;
+    request.offset = begin;
+    request.length = end - begin;
+    request.data_ptrs = ptrs;
+    request.coding_ptrs = ptrs + m_num_data_parts;
+    int status = m_handle->GetStripe(&request);
+    if (status == 0) {
+        request.Wait();
+        status = request.status();
+    }
+    if (status == 0) {
+        for (size_t i = 0; i < pieces.size(); i++) {
+            memcpy(data + pieces[i].object_offset,
+                   ptrs[pieces[i].part_index] + (pieces[i].part_offset - begin),
+                   pieces[i].length);
+        }
+    }
+    for (int i = 0; i < num_parts; i++) {
+        delete[] ptrs[i];
+    }
+    return status;
+}
+
+void StripePacker::GetStats(StripePackerStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void *StripePacker::_TimerThread(void *arg) {
+    static_cast<StripePacker *>(arg)->_RunTimer();
+    return NULL;
+}
+
+void StripePacker::_RunTimer() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_stopping) {
+        if (m_open == NULL) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+            continue;
+        }
+        if (m_deadline_us > _NowUs()) {
+            struct timespec deadline;
+            deadline.tv_sec = m_deadline_us / 1000000;
+            deadline.tv_nsec = m_deadline_us % 1000000 * 1000;
+            pthread_cond_timedwait(&m_cond, &m_mutex, &deadline);
+            continue;
+        }
+        // the open stripe waited long enough for more objects
+        PackedStripe *sealed = _Seal(false);
+        pthread_mutex_unlock(&m_mutex);
+        _PutStripe(sealed);
+        pthread_mutex_lock(&m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,247 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/stripe_packer.h
+ * @brief packs small objects into shared stripes, so that they are erasure
+ *        coded without padding every object to whole coding units
+ */
+
+#ifndef INF_DS_RBS_COMMON_STRIPE_PACKER_H_
+#define INF_DS_RBS_COMMON_STRIPE_PACKER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "common/cauchy_rscode.h"
+#include "common/part_handle.h"
+#include "common/stripe_buffer_pool.h"
+
+/**
+ * @brief where a packed object is: a range of the data of a stripe, the
+ *        concatenation of its data parts in packing order
+ */
+struct ObjectLocation {
+    int64_t stripe_id;      ///< block id of the stripe
+    int offset;             ///< in the data of the stripe
+    int length;
+};
+
+/**
+ * @brief a piece of an object stored in one data part
+ */
+struct PackedPiece {
+    int part_index;
+    int part_offset;        ///< of the piece in the part
+    int length;
+    int object_offset;      ///< of the piece in the object
+};
+
+class SmallPutRequest;
+
+/**
+ * @brief told when a SmallPutRequest has finished
+ */
+class SmallPutCallback {
+public:
+    virtual ~SmallPutCallback() {}
+
+    /**
+     * @brief called once the stripe of the object is put or failed, the
+     *        request may be deleted from here
+     */
+    virtual void OnSmallPutDone(SmallPutRequest *request) = 0;
+};
+
+/**
+ * @brief put of one small object. The data is copied by Put, location is
+ *        set once the request is done. Without a callback the submitter
+ *        waits with Wait.
+ */
+class SmallPutRequest {
+public:
+    SmallPutRequest();
+
+    ~SmallPutRequest();
+
+    /**
+     * @brief wait until the stripe of the object is put
+     */
+    void Wait();
+
+    bool IsDone() const {
+        return m_done;
+    }
+
+    /**
+     * @brief 0 if the stripe of the object was put, else the error of a part
+     */
+    int status() const {
+        return m_status;
+    }
+
+    const char *data;
+    int length;
+    SmallPutCallback *callback;     ///< NULL to Wait for the request
+    ObjectLocation location;        ///< set by Put
+
+private:
+    friend class StripePacker;
+
+    int m_status;
+    volatile bool m_done;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+};
+
+struct StripePackerOptions {
+    StripePackerOptions();
+
+    int part_size;              ///< largest part, a multiple of kCodingUnitSize
+    int max_object_size;        ///< larger objects are put as blocks of their own
+    int max_delay_us;           ///< an open stripe is put at most this late
+    int64_t first_stripe_id;    ///< stripes take ids from here up
+    int max_cached_sets;        ///< of the stripe buffer pool
+};
+
+struct StripePackerStats {
+    uint64_t num_objects;       ///< objects packed
+    uint64_t num_stripes;       ///< stripes put
+    uint64_t num_full_stripes;  ///< of which put once full
+    uint64_t num_failed_stripes;
+    int64_t object_bytes;       ///< data of the objects packed
+    int64_t stripe_bytes;       ///< data part bytes of the stripes put
+    uint64_t num_gets;
+    uint64_t num_degraded_gets; ///< gets that read the stripe range and decoded
+};
+
+/**
+ * @brief Accumulates small objects in an open stripe and puts it, encoded,
+ *        once it is full or max_delay_us after its first object, whichever
+ *        comes first.
+ *
+ *        The data of a stripe is laid out in kCodingUnitSize chunks dealt
+ *        round robin over the k data parts: chunk c goes to part c % k at
+ *        offset (c / k) * kCodingUnitSize. A stripe put early is cut after
+ *        its last row of chunks, so its padding is below one row of k units
+ *        however few objects it holds, and an object of up to a unit is in
+ *        at most two parts. Get reads only the packets covering an object.
+ *
+ *        Every stripe goes to the same servers, the placement of the packer.
+ */
+class StripePacker : public PartsRequestCallback {
+public:
+    /**
+     * @param coder         Coder of the stripe profile, not owned
+     * @param handle        Used to put and read the stripes, not owned
+     * @param server_addrs  Part index, 0 to k+m-1, to data server
+     */
+    StripePacker(CauchyRSCoder *coder,
+                 PartHandle *handle,
+                 const std::map<int, int64_t> &server_addrs,
+                 const StripePackerOptions &options);
+
+    /**
+     * @brief put the open stripe and wait for the stripes in flight, no Put
+     *        may run concurrently
+     */
+    ~StripePacker();
+
+    /**
+     * @brief copy the object into the open stripe
+     *
+     * @return 0 on success, -1 if the object is empty or larger than
+     *         max_object_size, or no stripe buffers can be allocated
+     */
+    int Put(SmallPutRequest *request);
+
+    /**
+     * @brief put the open stripe now
+     */
+    void Flush();
+
+    /**
+     * @brief read a packed object into data, waiting for the reads. A piece
+     *        that can not be read is decoded from the same range of the
+     *        other parts.
+     *
+     * @return 0 on success, -1 if the object can not be read or decoded
+     */
+    int Get(const ObjectLocation &location, char *data);
+
+    /**
+     * @brief the pieces of an object in the data parts, in object order
+     */
+    static void GetPieces(const ObjectLocation &location,
+                          int num_data_parts,
+                          std::vector<PackedPiece> *pieces);
+
+    void GetStats(StripePackerStats *stats) const;
+
+    virtual void OnPartsDone(PartsRequest *request);
+
+private:
+    struct PackedStripe {
+        int64_t stripe_id;
+        StripeBuffers *buffers;
+        int used;                           ///< bytes packed
+        bool full;
+        std::vector<SmallPutRequest *> objects;
+        PartsRequest put;
+    };
+
+    /**
+     * @brief copy length bytes of src to offset of the data of stripe, or
+     *        zeros if src is NULL
+     */
+    void _Scatter(PackedStripe *stripe, int offset, const char *src, int length);
+
+    /**
+     * @brief close the open stripe, m_mutex is held
+     *
+     * @return the stripe to put, NULL if none is open
+     */
+    PackedStripe *_Seal(bool full);
+
+    /**
+     * @brief encode and put a sealed stripe, m_mutex is not held
+     */
+    void _PutStripe(PackedStripe *stripe);
+
+    /**
+     * @brief complete the objects of a stripe put and free it
+     */
+    void _FinishStripe(PackedStripe *stripe, int status);
+
+    /**
+     * @brief Get through GetStripe of the coding units covering the pieces
+     */
+    int _GetDegraded(const ObjectLocation &location,
+                     const std::vector<PackedPiece> &pieces,
+                     char *data);
+
+    static void *_TimerThread(void *arg);
+
+    void _RunTimer();
+
+    CauchyRSCoder *m_coder;
+    PartHandle *m_handle;
+    std::map<int, int64_t> m_server_addrs;
+    StripePackerOptions m_options;
+    int m_num_data_parts;
+    int m_capacity;                         ///< data bytes of a full stripe
+    StripeBufferPool m_pool;
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    pthread_cond_t m_cond;                  ///< signaled on a new open stripe,
+                                            ///< a stripe done or stop
+    PackedStripe *m_open;
+    int64_t m_deadline_us;                  ///< of the open stripe
+    int64_t m_next_stripe_id;
+    std::map<PartsRequest *, PackedStripe *> m_in_flight;  ///< sealed, by put
+    pthread_t m_timer;
+    bool m_timer_started;
+    bool m_stopping;
+    StripePackerStats m_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_STRIPE_PACKER_H_
@@ -0,0 +1,168 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/async_coder.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+class CountingCallback : public CodingJobCallback {
+public:
+    CountingCallback() : m_num_done(0) {}
+
+    virtual void OnJobDone(CodingJob *job) {
+        EXPECT_TRUE(job->IsDone());
+        EXPECT_GE(job->run_us(), 0);
+        __sync_fetch_and_add(&m_num_done, 1);
+    }
+
+    volatile int m_num_done;
+};
+
+TEST(TestAsyncCoder, EncodeAndDecode)
+{
+    const int k = 8;
+    const int m = 4;
+    const int size = 4 * kCodingUnitSize;
+    const int num_jobs = 32;
+    CauchyRSCoder coder(k, m);
+    AsyncCoder async_coder(4, 8);
+    ASSERT_EQ(async_coder.Start(), 0);
+
+    char *ptrs[num_jobs][k + m];
+    char *expected[num_jobs][k + m];
+    CodingJob jobs[num_jobs];
+    CountingCallback callback;
+    for (int t = 0; t < num_jobs; t++) {
+        for (int i = 0; i < k + m; i++) {
+            ptrs[t][i] = new char[size];
+            expected[t][i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    ptrs[t][i][j] = random();
+                }
+                memcpy(expected[t][i], ptrs[t][i], size);
+            }
+        }
+        coder.Encode(expected[t], expected[t] + k, size);
+
+        jobs[t].type = CodingJob::kEncode;
+        jobs[t].coder = &coder;
+        jobs[t].data_ptrs = ptrs[t];
+        jobs[t].coding_ptrs = ptrs[t] + k;
+        jobs[t].size = size;
+        jobs[t].callback = &callback;
+        ASSERT_EQ(async_coder.Submit(&jobs[t]), 0);
+    }
+    while (callback.m_num_done < num_jobs) {
+        usleep(1000);
+    }
+    for (int t = 0; t < num_jobs; t++) {
+        for (int i = k; i < k + m; i++) {
+            ASSERT_EQ(memcmp(ptrs[t][i], expected[t][i], size), 0);
+        }
+    }
+
+    // decode jobs waited for without a callback
+    bool erased[k + m];
+    memset(erased, 0, sizeof(erased));
+    erased[1] = true;
+    erased[k + 2] = true;
+    for (int t = 0; t < num_jobs; t++) {
+        bzero(ptrs[t][1], size);
+        bzero(ptrs[t][k + 2], size);
+        jobs[t].type = CodingJob::kDecode;
+        jobs[t].erased = erased;
+        jobs[t].callback = NULL;
+        ASSERT_EQ(async_coder.Submit(&jobs[t]), 0);
+    }
+    for (int t = 0; t < num_jobs; t++) {
+        jobs[t].Wait();
+        for (int i = 0; i < k + m; i++) {
+            ASSERT_EQ(memcmp(ptrs[t][i], expected[t][i], size), 0);
+        }
+    }
+
+    AsyncCoderStats stats;
+    async_coder.GetStats(&stats);
+    EXPECT_EQ(stats.num_submitted, 2u * num_jobs);
+    EXPECT_EQ(stats.num_completed, 2u * num_jobs);
+    EXPECT_EQ(stats.num_pending, 0);
+    EXPECT_GE(stats.max_run_us, 0);
+
+    // every job is accounted to the node it ran on
+    ASSERT_GE(async_coder.num_nodes(), 1);
+    uint64_t num_node_completed = 0;
+    int64_t num_node_bytes = 0;
+    for (int node = 0; node < async_coder.num_nodes(); node++) {
+        AsyncCoderNodeStats node_stats;
+        async_coder.GetNodeStats(node, &node_stats);
+        num_node_completed += node_stats.num_completed;
+        num_node_bytes += node_stats.num_bytes;
+    }
+    EXPECT_EQ(num_node_completed, stats.num_completed);
+    EXPECT_EQ(num_node_bytes, 2LL * num_jobs * k * size);
+
+    async_coder.Stop();
+    EXPECT_EQ(async_coder.Submit(&jobs[0]), -1);
+    for (int t = 0; t < num_jobs; t++) {
+        for (int i = 0; i < k + m; i++) {
+            delete[] ptrs[t][i];
+            delete[] expected[t][i];
+        }
+    }
+}
+
+TEST(TestAsyncCoder, BoundedQueue)
+{
+    const int size = kCodingUnitSize;
+    CauchyRSCoder coder(4, 2);
+    char *ptrs[4][6];
+    CodingJob jobs[4];
+    for (int t = 0; t < 4; t++) {
+        for (int i = 0; i < 6; i++) {
+            ptrs[t][i] = new char[size];
+            memset(ptrs[t][i], t + i, size);
+        }
+        jobs[t].coder = &coder;
+        jobs[t].data_ptrs = ptrs[t];
+        jobs[t].coding_ptrs = ptrs[t] + 4;
+        jobs[t].size = size;
+    }
+
+    // not started yet: jobs stay pending and the third one is refused
+    AsyncCoder async_coder(2, 2);
+    ASSERT_EQ(async_coder.TrySubmit(&jobs[0]), 0);
+    ASSERT_EQ(async_coder.TrySubmit(&jobs[1]), 0);
+    ASSERT_EQ(async_coder.TrySubmit(&jobs[2]), -1);
+    AsyncCoderStats stats;
+    async_coder.GetStats(&stats);
+    EXPECT_EQ(stats.num_pending, 2);
+    EXPECT_EQ(stats.num_rejected, 1u);
+
+    ASSERT_EQ(async_coder.Start(), 0);
+    jobs[0].Wait();
+    jobs[1].Wait();
+    ASSERT_EQ(async_coder.Submit(&jobs[2]), 0);
+    ASSERT_EQ(async_coder.Submit(&jobs[3]), 0);
+    jobs[2].Wait();
+    jobs[3].Wait();
+    async_coder.GetStats(&stats);
+    EXPECT_EQ(stats.num_completed, 4u);
+    for (int t = 0; t < 4; t++) {
+        for (int i = 0; i < 6; i++) {
+            delete[] ptrs[t][i];
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,270 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/block_location_cache.h"
+#include "common/local_meta_service.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// parts 0 to 5 of block b on servers b to b + 5
+BlockLocation MakeLocation(int64_t block_id)
+{
+    BlockLocation location;
+    for (int i = 0; i < 6; i++) {
+        location[i] = block_id + i;
+    }
+    return location;
+}
+
+TEST(TestBlockLocationCache, Lookup)
+{
+    LocalMetaService meta(0, 0);
+    for (int64_t b = 0; b < 100; b++) {
+        meta.SetLocation(b, MakeLocation(b));
+    }
+    BlockLocationCache cache(&meta, BlockLocationCacheOptions());
+
+    BlockLocation location;
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(7));
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(7));
+    EXPECT_EQ(meta.num_lookups(), 1u);
+
+    // an unknown block is not cached
+    EXPECT_EQ(cache.Lookup(1000, &location), -1);
+    EXPECT_TRUE(location.empty());
+    EXPECT_EQ(cache.Lookup(1000, &location), -1);
+    EXPECT_EQ(meta.num_lookups(), 3u);
+
+    // a moved block is found again once invalidated
+    meta.SetLocation(7, MakeLocation(50));
+    cache.Invalidate(7);
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(50));
+
+    // as are the blocks of a failed server
+    ASSERT_EQ(cache.Lookup(8, &location), 0);
+    ASSERT_EQ(cache.Lookup(9, &location), 0);
+    cache.InvalidateServer(9);
+    ASSERT_EQ(meta.num_lookups(), 6u);
+    ASSERT_EQ(cache.Lookup(9, &location), 0);
+    ASSERT_EQ(cache.Lookup(8, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 8u);
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 8u);
+
+    // a failed meta service fails the misses only
+    meta.SetFailing(true);
+    EXPECT_EQ(cache.Lookup(8, &location), 0);
+    EXPECT_EQ(cache.Lookup(10, &location), -1);
+
+    BlockLocationCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_lookups, 12u);
+    EXPECT_EQ(stats.num_hits, 3u);
+    EXPECT_EQ(stats.num_unknown, 2u);
+    EXPECT_EQ(stats.num_invalidated, 3u);
+    EXPECT_EQ(stats.num_round_trips, 9u);
+    EXPECT_EQ(stats.num_failed_round_trips, 1u);
+}
+
+// a meta service whose block moves while it is looked up: the location is
+// read, then the block is moved and invalidated before it is returned
+class MovingMetaService : public MetaService {
+public:
+    MovingMetaService() : cache(NULL), server_down(false), m_meta(0, 0) {}
+
+    virtual int LookupBlocks(const std::vector<int64_t> &block_ids,
+                             std::map<int64_t, BlockLocation> *locations) {
+        int ret = m_meta.LookupBlocks(block_ids, locations);
+        for (size_t i = 0; i < block_ids.size(); i++) {
+            m_meta.SetLocation(block_ids[i], MakeLocation(block_ids[i] + 50));
+            if (server_down) {
+                cache->InvalidateServer(block_ids[i]);
+            } else {
+                cache->Invalidate(block_ids[i]);
+            }
+        }
+        return ret;
+    }
+
+    void SetLocation(int64_t block_id, const BlockLocation &location) {
+        m_meta.SetLocation(block_id, location);
+    }
+
+    uint64_t num_lookups() const {
+        return m_meta.num_lookups();
+    }
+
+    BlockLocationCache *cache;
+    bool server_down;
+
+private:
+    LocalMetaService m_meta;
+};
+
+TEST(TestBlockLocationCache, InvalidateDuringLookup)
+{
+    MovingMetaService meta;
+    meta.SetLocation(7, MakeLocation(7));
+    BlockLocationCache cache(&meta, BlockLocationCacheOptions());
+    meta.cache = &cache;
+
+    // the old location is returned but not cached, the next lookup finds the
+    // new one
+    BlockLocation location;
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(7));
+    ASSERT_EQ(cache.Lookup(7, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(57));
+    EXPECT_EQ(meta.num_lookups(), 2u);
+
+    // as with a server invalidated
+    meta.server_down = true;
+    meta.SetLocation(8, MakeLocation(8));
+    ASSERT_EQ(cache.Lookup(8, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(8));
+    ASSERT_EQ(cache.Lookup(8, &location), 0);
+    EXPECT_TRUE(location == MakeLocation(58));
+    EXPECT_EQ(meta.num_lookups(), 4u);
+}
+
+TEST(TestBlockLocationCache, LookupBatch)
+{
+    LocalMetaService meta(1000, 0);
+    for (int64_t b = 0; b < 100; b++) {
+        meta.SetLocation(b, MakeLocation(b));
+    }
+    BlockLocationCache cache(&meta, BlockLocationCacheOptions());
+
+    // the misses of a batch take one round trip, duplicates included
+    std::vector<int64_t> block_ids;
+    for (int64_t b = 0; b < 40; b++) {
+        block_ids.push_back(b);
+    }
+    block_ids.push_back(3);
+    std::vector<BlockLocation> locations;
+    ASSERT_EQ(cache.LookupBatch(block_ids, &locations), 0);
+    ASSERT_EQ(locations.size(), block_ids.size());
+    for (size_t i = 0; i < block_ids.size(); i++) {
+        EXPECT_TRUE(locations[i] == MakeLocation(block_ids[i]));
+    }
+    EXPECT_EQ(meta.num_lookups(), 1u);
+
+    // a batch of cached and new blocks asks for the new ones
+    block_ids.push_back(500);
+    block_ids.push_back(50);
+    ASSERT_EQ(cache.LookupBatch(block_ids, &locations), -1);
+    EXPECT_TRUE(locations[block_ids.size() - 2].empty());
+    EXPECT_TRUE(locations.back() == MakeLocation(50));
+    EXPECT_EQ(meta.num_lookups(), 2u);
+
+    BlockLocationCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_lookups, 84u);
+    EXPECT_EQ(stats.num_hits, 41u);
+    EXPECT_EQ(stats.num_round_trips, 2u);
+    EXPECT_GE(stats.round_trip_us, 2000);
+    EXPECT_GE(stats.saved_us, 82 * 1000);
+}
+
+TEST(TestBlockLocationCache, ExpireEvict)
+{
+    LocalMetaService meta(0, 0);
+    for (int64_t b = 0; b < 100; b++) {
+        meta.SetLocation(b, MakeLocation(b));
+    }
+    BlockLocationCacheOptions options;
+    options.num_shards = 1;
+    options.max_blocks_per_shard = 4;
+    options.ttl_us = 20000;
+    BlockLocationCache cache(&meta, options);
+
+    BlockLocation location;
+    for (int64_t b = 0; b < 4; b++) {
+        ASSERT_EQ(cache.Lookup(b, &location), 0);
+    }
+    // block 0 is used again, 1 is the least recently used
+    ASSERT_EQ(cache.Lookup(0, &location), 0);
+    ASSERT_EQ(cache.Lookup(4, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 5u);
+    ASSERT_EQ(cache.Lookup(0, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 5u);
+    ASSERT_EQ(cache.Lookup(1, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 6u);
+
+    usleep(30000);
+    ASSERT_EQ(cache.Lookup(0, &location), 0);
+    ASSERT_EQ(meta.num_lookups(), 7u);
+
+    BlockLocationCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_evicted, 2u);
+    EXPECT_EQ(stats.num_expired, 1u);
+}
+
+struct ReaderArgs {
+    BlockLocationCache *cache;
+    int num_errors;
+};
+
+void *ReaderThread(void *arg)
+{
+    ReaderArgs *args = static_cast<ReaderArgs *>(arg);
+    BlockLocation location;
+    for (int i = 0; i < 20000; i++) {
+        int64_t block_id = random() % 64;
+        if (args->cache->Lookup(block_id, &location) != 0 || location != MakeLocation(block_id)) {
+            args->num_errors++;
+        }
+        if (i % 1000 == 0) {
+            args->cache->Invalidate(block_id);
+        }
+    }
+    return NULL;
+}
+
+TEST(TestBlockLocationCache, Threads)
+{
+    LocalMetaService meta(0, 0);
+    for (int64_t b = 0; b < 64; b++) {
+        meta.SetLocation(b, MakeLocation(b));
+    }
+    BlockLocationCacheOptions options;
+    options.num_shards = 4;
+    BlockLocationCache cache(&meta, options);
+
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    ReaderArgs args[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        args[i].cache = &cache;
+        args[i].num_errors = 0;
+        ASSERT_EQ(pthread_create(&threads[i], NULL, ReaderThread, &args[i]), 0);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ(args[i].num_errors, 0);
+    }
+    BlockLocationCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_lookups, static_cast<uint64_t>(num_threads * 20000));
+    EXPECT_EQ(stats.num_hits + stats.num_round_trips, stats.num_lookups);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/block_reader.h"
+#include "common/cauchy_rs_stream_encoder.h"
+#include "common/test_part_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int kDataParts = 4;
+const int kCodeParts = 2;
+const int kSliceSize = 2 * kCodingUnitSize;
+
+// puts every stripe of the encoder, part i to server i
+class StripePutter : public StripeListener {
+public:
+    StripePutter(PartServerFixture *fixture, int64_t block_id)
+        : m_fixture(fixture), m_block_id(block_id) {}
+
+    virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs, int size) {
+        char *ptrs[kDataParts + kCodeParts];
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            ptrs[i] = (i < kDataParts) ? data_ptrs[i] : coding_ptrs[i - kDataParts];
+        }
+        m_fixture->PutParts(m_block_id, ptrs, kDataParts + kCodeParts, part_offset, size, 0);
+    }
+
+private:
+    PartServerFixture *m_fixture;
+    int64_t m_block_id;
+};
+
+// a block of 10 and a half stripes
+class BlockFixture : public PartServerFixture {
+public:
+    BlockFixture()
+        : PartServerFixture(100), m_coder(kDataParts, kCodeParts),
+          m_data(21 * kDataParts * kSliceSize / 2 + 100) {
+        AddServers(0, kDataParts + kCodeParts);
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            m_server_addrs[i] = i;
+        }
+        for (size_t i = 0; i < m_data.size(); i++) {
+            m_data[i] = random();
+        }
+        StripePutter putter(this, 1);
+        CauchyRSStreamEncoder encoder(&m_coder, kSliceSize, &putter);
+        encoder.Append(&m_data[0], m_data.size());
+        encoder.Finish();
+    }
+
+    // read the block from start to end in reads of length
+    void Scan(BlockReader *reader, int length) {
+        std::vector<char> buf(length);
+        for (size_t offset = 0; offset < m_data.size(); offset += length) {
+            int size = std::min(static_cast<size_t>(length), m_data.size() - offset);
+            ASSERT_EQ(reader->Read(offset, size, &buf[0]), 0);
+            ASSERT_EQ(memcmp(&buf[0], &m_data[offset], size), 0);
+        }
+    }
+
+    CauchyRSCoder m_coder;
+    std::map<int, int64_t> m_server_addrs;
+    std::vector<char> m_data;
+};
+
+TEST(TestBlockReader, Sequential)
+{
+    BlockFixture block;
+    BlockReaderOptions options;
+    options.slice_size = kSliceSize;
+    options.max_window = 4;
+    BlockReader reader(&block.m_coder, block.m_handle, 1, block.m_server_addrs,
+                       block.m_data.size(), options);
+    block.Scan(&reader, 10000);
+
+    // only the first stripe is read on demand
+    BlockReaderStats stats;
+    reader.GetStats(&stats);
+    EXPECT_EQ(stats.num_sequential_reads, stats.num_reads);
+    EXPECT_EQ(stats.num_stripe_misses, 1u);
+    EXPECT_EQ(stats.num_prefetches, 10u);
+    EXPECT_EQ(stats.num_wasted_prefetches, 0u);
+    EXPECT_EQ(stats.bytes_read, static_cast<int64_t>(block.m_data.size()));
+    EXPECT_EQ(stats.window, 4);
+
+    // reads of many stripes at once
+    BlockReader large(&block.m_coder, block.m_handle, 1, block.m_server_addrs,
+                      block.m_data.size(), options);
+    block.Scan(&large, 3 * kDataParts * kSliceSize + 1000);
+}
+
+TEST(TestBlockReader, Random)
+{
+    BlockFixture block;
+    BlockReaderOptions options;
+    options.slice_size = kSliceSize;
+    BlockReader reader(&block.m_coder, block.m_handle, 1, block.m_server_addrs,
+                       block.m_data.size(), options);
+
+    std::vector<char> buf(3 * kSliceSize);
+    for (int i = 0; i < 50; i++) {
+        int length = 1 + random() % buf.size();
+        int64_t offset = random() % (block.m_data.size() - length) + 1;
+        ASSERT_EQ(reader.Read(offset, length, &buf[0]), 0);
+        ASSERT_EQ(memcmp(&buf[0], &block.m_data[offset], length), 0);
+    }
+    BlockReaderStats stats;
+    reader.GetStats(&stats);
+    EXPECT_EQ(stats.num_sequential_reads, 0u);
+    EXPECT_EQ(stats.num_prefetches, 0u);
+    EXPECT_EQ(stats.num_stripe_hits, 0u);
+    EXPECT_EQ(stats.window, 0);
+
+    // a scan starting after a random read prefetches, one jumping away
+    // drops what it prefetched
+    ASSERT_EQ(reader.Read(0, 100, &buf[0]), 0);
+    ASSERT_EQ(reader.Read(100, 100, &buf[0]), 0);
+    ASSERT_EQ(reader.Read(200, 100, &buf[0]), 0);
+    ASSERT_EQ(reader.Read(block.m_data.size() - 100, 100, &buf[0]), 0);
+    reader.GetStats(&stats);
+    EXPECT_EQ(stats.num_prefetches, 2u);
+    EXPECT_EQ(stats.num_wasted_prefetches, 2u);
+    EXPECT_EQ(memcmp(&buf[0], &block.m_data[block.m_data.size() - 100], 100), 0);
+
+    // outside the block
+    EXPECT_EQ(reader.Read(block.m_data.size() - 10, 11, &buf[0]), -1);
+    EXPECT_EQ(reader.Read(-1, 10, &buf[0]), -1);
+}
+
+TEST(TestBlockReader, Degraded)
+{
+    BlockFixture block;
+    block.m_servers.SetFailing(0, true);
+    block.m_servers.SetFailing(kDataParts, true);
+    BlockReaderOptions options;
+    options.slice_size = kSliceSize;
+    BlockReader reader(&block.m_coder, block.m_handle, 1, block.m_server_addrs,
+                       block.m_data.size(), options);
+    block.Scan(&reader, 64 << 10);
+
+    // a stripe that can not be read fails its read only
+    block.m_servers.SetFailing(1, true);
+    BlockReader failing(&block.m_coder, block.m_handle, 1, block.m_server_addrs,
+                        block.m_data.size(), options);
+    char buf[100];
+    EXPECT_EQ(failing.Read(0, sizeof(buf), buf), -1);
+    block.m_servers.SetFailing(1, false);
+    EXPECT_EQ(failing.Read(0, sizeof(buf), buf), 0);
+    EXPECT_EQ(memcmp(buf, &block.m_data[0], sizeof(buf)), 0);
+    BlockReaderStats stats;
+    failing.GetStats(&stats);
+    EXPECT_EQ(stats.num_failed_gets, 1u);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/cauchy_rs_stream_decoder.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct Piece {
+    int part;
+    int offset;
+    int len;
+};
+
+TEST(TestCauchyRSStreamDecoder, FeedInAnyOrder)
+{
+    const int size = 1 << 20;
+    CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
+    char *data_ptrs[8];
+    char *code_ptrs[4];
+    char *out_data_ptrs[8];
+    char *out_code_ptrs[4];
+    for (int i = 0; i < 8; i++) {
+        data_ptrs[i] = new char[size];
+        out_data_ptrs[i] = new char[size];
+        for (int j = 0; j < size; j++) {
+            data_ptrs[i][j] = random();
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        code_ptrs[i] = new char[size];
+        out_code_ptrs[i] = new char[size];
+    }
+    coder->Encode(data_ptrs, code_ptrs, size);
+
+    int patterns[][4] = { { 3, -1, -1, -1 }, { 0, 9, -1, -1 }, { 1, 2, 5, 11 },
+                          { 8, 9, 10, 11 }, { 0, 1, 2, 3 } };
+    for (int t = 0; t < 5; t++) {
+        bool erased[12];
+        memset(erased, 0, sizeof(erased));
+        for (int i = 0; i < 4 && patterns[t][i] >= 0; i++) {
+            erased[patterns[t][i]] = true;
+        }
+        for (int i = 0; i < 8; i++) memset(out_data_ptrs[i], 0xcc, size);
+        for (int i = 0; i < 4; i++) memset(out_code_ptrs[i], 0xcc, size);
+
+        CauchyRSStreamDecoder decoder(coder, erased, out_data_ptrs, out_code_ptrs, size);
+        ASSERT_FALSE(decoder.IsDone());
+
+        // every needed part in pieces of 1 to 16 packets, in random order
+        std::vector<Piece> pieces;
+        int num_needed_parts = 0;
+        for (int part = 0; part < 12; part++) {
+            if (!decoder.NeedPart(part)) {
+                continue;
+            }
+            ASSERT_FALSE(erased[part]);
+            num_needed_parts++;
+            for (int offset = 0; offset < size; ) {
+                Piece piece = { part, offset, kPacketSize * (1 + static_cast<int>(random() % 16)) };
+                if (piece.len > size - offset) {
+                    piece.len = size - offset;
+                }
+                pieces.push_back(piece);
+                offset += piece.len;
+            }
+        }
+        ASSERT_EQ(8, num_needed_parts);
+        for (size_t i = pieces.size() - 1; i > 0; i--) {
+            std::swap(pieces[i], pieces[random() % (i + 1)]);
+        }
+
+        for (size_t i = 0; i < pieces.size(); i++) {
+            const Piece &piece = pieces[i];
+            const char *src = (piece.part < 8) ? data_ptrs[piece.part] : code_ptrs[piece.part - 8];
+            ASSERT_EQ(i + 1 == pieces.size() ? 1 : 0,
+                      decoder.Feed(piece.part, piece.offset, src + piece.offset, piece.len));
+            // a piece fed twice is rejected
+            ASSERT_EQ(-1, decoder.Feed(piece.part, piece.offset, src + piece.offset, piece.len));
+        }
+        ASSERT_TRUE(decoder.IsDone());
+
+        for (int i = 0; i < 8; i++) {
+            if (erased[i]) {
+                ASSERT_EQ(memcmp(data_ptrs[i], out_data_ptrs[i], size), 0);
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            if (erased[i + 8]) {
+                ASSERT_EQ(memcmp(code_ptrs[i], out_code_ptrs[i], size), 0);
+            }
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        delete[] data_ptrs[i];
+        delete[] out_data_ptrs[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        delete[] code_ptrs[i];
+        delete[] out_code_ptrs[i];
+    }
+    delete coder;
+}
+
+TEST(TestCauchyRSStreamDecoder, InvalidFeed)
+{
+    const int size = 4 * kCodingUnitSize;
+    CauchyRSCoder coder(4, 2);
+    char *data_ptrs[4];
+    char *code_ptrs[2];
+    for (int i = 0; i < 4; i++) data_ptrs[i] = new char[size];
+    for (int i = 0; i < 2; i++) code_ptrs[i] = new char[size];
+
+    // data part 1 is erased, coding part 4 replaces it and coding part 5 is unused
+    bool erased[6] = { false, true, false, false, false, false };
+    CauchyRSStreamDecoder decoder(&coder, erased, data_ptrs, code_ptrs, size);
+    ASSERT_TRUE(decoder.NeedPart(0));
+    ASSERT_FALSE(decoder.NeedPart(1));
+    ASSERT_TRUE(decoder.NeedPart(4));
+    ASSERT_FALSE(decoder.NeedPart(5));
+    ASSERT_FALSE(decoder.NeedPart(-1));
+    ASSERT_FALSE(decoder.NeedPart(6));
+    ASSERT_EQ(-1, decoder.Feed(1, 0, data_ptrs[0], kPacketSize));
+    ASSERT_EQ(-1, decoder.Feed(5, 0, data_ptrs[0], kPacketSize));
+    ASSERT_EQ(-1, decoder.Feed(-1, 0, data_ptrs[0], kPacketSize));
+    ASSERT_EQ(-1, decoder.Feed(6, 0, data_ptrs[0], kPacketSize));
+    ASSERT_EQ(-1, decoder.Feed(0, 100, data_ptrs[0], kPacketSize));
+    ASSERT_EQ(-1, decoder.Feed(0, 0, data_ptrs[0], 100));
+    ASSERT_EQ(-1, decoder.Feed(0, size - kPacketSize, data_ptrs[0], 2 * kPacketSize));
+    ASSERT_FALSE(decoder.IsUnitDone(0));
+
+    // no erasure, nothing to wait for
+    bool none_erased[6] = { false, false, false, false, false, false };
+    CauchyRSStreamDecoder noop(&coder, none_erased, data_ptrs, code_ptrs, size);
+    ASSERT_TRUE(noop.IsDone());
+    ASSERT_EQ(-1, noop.Feed(6, 0, data_ptrs[0], kPacketSize));
+
+    for (int i = 0; i < 4; i++) delete[] data_ptrs[i];
+    for (int i = 0; i < 2; i++) delete[] code_ptrs[i];
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/cauchy_rs_stream_encoder.h"
+
+#include <string.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// collects the emitted stripes into whole parts
+class PartCollector : public StripeListener {
+public:
+    PartCollector(int num_data_parts, int num_code_parts, int max_size)
+        : m_num_data_parts(num_data_parts), m_num_code_parts(num_code_parts),
+          m_num_stripes(0) {
+        for (int i = 0; i < num_data_parts + num_code_parts; i++) {
+            m_parts.push_back(new char[max_size]);
+        }
+    }
+
+    ~PartCollector() {
+        for (size_t i = 0; i < m_parts.size(); i++) {
+            delete[] m_parts[i];
+        }
+    }
+
+    virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs, int size) {
+        for (int i = 0; i < m_num_data_parts; i++) {
+            memcpy(m_parts[i] + part_offset, data_ptrs[i], size);
+        }
+        for (int i = 0; i < m_num_code_parts; i++) {
+            memcpy(m_parts[m_num_data_parts + i] + part_offset, coding_ptrs[i], size);
+        }
+        m_num_stripes++;
+    }
+
+    int m_num_data_parts;
+    int m_num_code_parts;
+    int m_num_stripes;
+    std::vector<char *> m_parts;
+};
+
+TEST(TestCauchyRSStreamEncoder, AppendInChunks)
+{
+    const int k = 8;
+    const int m = 4;
+    const int slice_size = 2 * kCodingUnitSize;
+    const int stripe_size = k * slice_size;
+    CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+
+    // whole stripes, and a last stripe of one and of several coding units
+    int block_sizes[] = { 4 * stripe_size, 3 * stripe_size + 1000,
+                          2 * stripe_size + stripe_size - kPacketSize };
+    for (int t = 0; t < 3; t++) {
+        int block_size = block_sizes[t];
+        char *block = new char[block_size];
+        for (int i = 0; i < block_size; i++) {
+            block[i] = random();
+        }
+
+        PartCollector collector(k, m, (block_size / stripe_size + 1) * slice_size);
+        CauchyRSStreamEncoder encoder(coder, slice_size, &collector);
+        for (int offset = 0; offset < block_size;) {
+            // chunks from a few bytes to more than a stripe
+            int len = (random() % 2) ? random() % 5000 : random() % (stripe_size + stripe_size / 2);
+            if (len > block_size - offset) {
+                len = block_size - offset;
+            }
+            encoder.Append(block + offset, len);
+            offset += len;
+        }
+        encoder.Finish();
+
+        int num_stripes = (block_size + stripe_size - 1) / stripe_size;
+        int last_size = block_size - (num_stripes - 1) * stripe_size;
+        int last_slice_size = ((last_size + k - 1) / k + kCodingUnitSize - 1)
+                                / kCodingUnitSize * kCodingUnitSize;
+        ASSERT_EQ(collector.m_num_stripes, num_stripes);
+        ASSERT_EQ(encoder.part_size(), (num_stripes - 1) * slice_size + last_slice_size);
+        ASSERT_EQ(CauchyRSStreamEncoder::NumStripes(k, slice_size, block_size), num_stripes);
+        ASSERT_EQ(CauchyRSStreamEncoder::StripeSliceSize(k, slice_size, block_size, 0),
+                  (num_stripes == 1) ? last_slice_size : slice_size);
+        ASSERT_EQ(CauchyRSStreamEncoder::StripeSliceSize(k, slice_size, block_size,
+                                                         num_stripes - 1), last_slice_size);
+
+        // every stripe equals the encoding of its slices of the block
+        char *data_ptrs[k];
+        char *code_ptrs[m];
+        for (int i = 0; i < k; i++) {
+            data_ptrs[i] = new char[slice_size];
+        }
+        for (int i = 0; i < m; i++) {
+            code_ptrs[i] = new char[slice_size];
+        }
+        for (int s = 0; s < num_stripes; s++) {
+            int size = (s == num_stripes - 1) ? last_slice_size : slice_size;
+            int stripe_begin = s * stripe_size;
+            for (int i = 0; i < k; i++) {
+                memset(data_ptrs[i], 0, size);
+                int begin = stripe_begin + i * size;
+                int len = block_size - begin;
+                if (len > size) {
+                    len = size;
+                }
+                if (len > 0) {
+                    memcpy(data_ptrs[i], block + begin, len);
+                }
+            }
+            coder->Encode(data_ptrs, code_ptrs, size);
+            for (int i = 0; i < k; i++) {
+                ASSERT_EQ(memcmp(collector.m_parts[i] + s * slice_size, data_ptrs[i], size), 0);
+            }
+            for (int i = 0; i < m; i++) {
+                ASSERT_EQ(memcmp(collector.m_parts[k + i] + s * slice_size, code_ptrs[i], size), 0);
+            }
+        }
+
+        for (int i = 0; i < k; i++) {
+            delete[] data_ptrs[i];
+        }
+        for (int i = 0; i < m; i++) {
+            delete[] code_ptrs[i];
+        }
+        delete[] block;
+    }
+    delete coder;
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
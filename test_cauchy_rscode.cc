@@ -5,17 +5,78 @@ extern "C" {
 #include "common/jerasure_cauchy.h"
 }
 
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
 #include "common/cauchy_rscode.h"
+#include "common/cauchy_xy_table.h"
+#include "common/crc32c.h"
 
 #include "gtest/gtest.h"
 
+// every operator new of the test binary is counted, to check Decode makes no
+// heap allocation
+static volatile int g_num_allocations = 0;
+
+void *operator new(size_t size)
+{
+    __sync_fetch_and_add(&g_num_allocations, 1);
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) throw()
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) throw()
+{
+    free(ptr);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void *ptr, size_t) throw()
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) throw()
+{
+    free(ptr);
+}
+#endif
+
 namespace {
 
+// jerasure coding matrix built from the same X/Y sets CauchyRSCoder uses
+int *JerasureCodingMatrix(int k, int m, CauchyMatrixId matrix_id)
+{
+    for (int i = 0; i < kCauchyXYTableSize && matrix_id == kSearchedMatrix; i++) {
+        if (kCauchyXYTable[i].num_data_parts == k && kCauchyXYTable[i].num_code_parts == m) {
+            int *matrix = cauchy_xy_coding_matrix(k, m, 8,
+                    const_cast<int *>(kCauchyXYTable[i].x), const_cast<int *>(kCauchyXYTable[i].y));
+            cauchy_improve_coding_matrix(k, m, 8, matrix);
+            return matrix;
+        }
+    }
+    return cauchy_good_general_coding_matrix(k, m, 8);
+}
+
 TEST(TestCauchyRSCoder, GenerateEncodeMatrix)
 {
     CauchyRSCoder *coder =  new CauchyRSCoder(8, 4);
     int *matrix = coder->_GenerateEncodeMatrix();
-    int *jerasure_matrix = cauchy_good_general_coding_matrix(8, 4, 8);
+    int *jerasure_matrix = JerasureCodingMatrix(8, 4, kJerasureMatrix);
     for (int i = 0; i < 8 * 4; i++) {
         ASSERT_EQ(matrix[i], jerasure_matrix[i]);
     }
@@ -45,6 +106,80 @@ TEST(TestCauchyRSCoder, GenerateEncodeMatrix)
     delete coder;
 }
 
+TEST(TestCauchyRSCoder, XYTable)
+{
+    for (int i = 0; i < kCauchyXYTableSize; i++) {
+        int k = kCauchyXYTable[i].num_data_parts;
+        int m = kCauchyXYTable[i].num_code_parts;
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m, kSearchedMatrix);
+        int *matrix = coder->_GenerateEncodeMatrix();
+        int *jerasure_matrix = JerasureCodingMatrix(k, m, kSearchedMatrix);
+        int ones = 0;
+        for (int j = 0; j < k * m; j++) {
+            ASSERT_EQ(matrix[j], jerasure_matrix[j]);
+            ones += cauchy_n_ones(matrix[j], 8);
+        }
+        ASSERT_EQ(kCauchyXYTable[i].ones, ones);
+        ASSERT_LT(kCauchyXYTable[i].ones, kCauchyXYTable[i].default_ones);
+
+        delete[] matrix;
+        free(jerasure_matrix);
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, MatrixId)
+{
+    // parity of stripes put with the Jerasure matrix, a profile of the table
+    const int size = 4 * kCodingUnitSize;
+    std::vector<char> buffer(12 * size);
+    std::vector<char> jerasure_buffer(12 * size);
+    char *parts[12];
+    char *jerasure_parts[12];
+    for (int i = 0; i < 12; i++) {
+        parts[i] = &buffer[i * size];
+        jerasure_parts[i] = &jerasure_buffer[i * size];
+    }
+    for (int i = 0; i < 8 * size; i++) {
+        buffer[i] = jerasure_buffer[i] = random();
+    }
+    int *jerasure_matrix = cauchy_good_general_coding_matrix(8, 4, 8);
+    int *jerasure_bit_matrix = jerasure_matrix_to_bitmatrix(8, 4, 8, jerasure_matrix);
+    int **jerasure_schedule = jerasure_smart_bitmatrix_to_schedule(8, 4, 8, jerasure_bit_matrix);
+    jerasure_schedule_encode(8, 4, 8, jerasure_schedule, jerasure_parts, jerasure_parts + 8,
+            size, kPacketSize);
+
+    // still decodes with the default coder
+    CauchyRSCoder coder(8, 4);
+    ASSERT_EQ(coder.matrix_id(), kJerasureMatrix);
+    bool erased[12] = { false };
+    erased[1] = erased[6] = erased[9] = true;
+    memcpy(parts[8], jerasure_parts[8], 4 * size);
+    memset(parts[1], 0, size);
+    memset(parts[6], 0, size);
+    memset(parts[9], 0, size);
+    coder.Decode(erased, parts, parts + 8, size);
+    for (int i = 0; i < 12; i++) {
+        ASSERT_EQ(memcmp(parts[i], jerasure_parts[i], size), 0);
+    }
+
+    // the searched matrix has other parity, which decodes with its own coder
+    CauchyRSCoder searched_coder(8, 4, kSearchedMatrix);
+    ASSERT_EQ(searched_coder.matrix_id(), kSearchedMatrix);
+    searched_coder.Encode(parts, parts + 8, size);
+    ASSERT_NE(memcmp(parts[8], jerasure_parts[8], 4 * size), 0);
+    std::vector<char> saved(buffer);
+    memset(parts[1], 0, size);
+    memset(parts[6], 0, size);
+    memset(parts[9], 0, size);
+    searched_coder.Decode(erased, parts, parts + 8, size);
+    ASSERT_TRUE(saved == buffer);
+
+    jerasure_free_schedule(jerasure_schedule);
+    free(jerasure_matrix);
+    free(jerasure_bit_matrix);
+}
+
 TEST(TestCauchyRSCoder, TestEncode)
 {
     CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
@@ -62,7 +197,7 @@ TEST(TestCauchyRSCoder, TestEncode)
         code_ptrs[i] = new char[1 << 20];
         jerasure_code_ptrs[i] = new char[1 << 20];
     }
-    int *jerasure_matrix = cauchy_good_general_coding_matrix(8, 4, 8);
+    int *jerasure_matrix = JerasureCodingMatrix(8, 4, kJerasureMatrix);
     int *jerasure_bit_matrix = jerasure_matrix_to_bitmatrix(8, 4, 8, jerasure_matrix);
     int **jerasure_schedule = jerasure_smart_bitmatrix_to_schedule(8, 4, 8, jerasure_bit_matrix);
 
@@ -86,6 +221,597 @@ TEST(TestCauchyRSCoder, TestEncode)
     delete coder;
 }
 
+TEST(TestCauchyRSCoder, UpdateParity)
+{
+    CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
+    char *data_ptrs[8];
+    char *code_ptrs[4];
+    char *updated_code_ptrs[4];
+    for (int i = 0; i < 8; i++) {
+        data_ptrs[i] = new char[1 << 20];
+        for (int j = 0; j < (1 << 20); j++) {
+            data_ptrs[i][j] = random();
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        code_ptrs[i] = new char[1 << 20];
+        updated_code_ptrs[i] = new char[1 << 20];
+    }
+    coder->Encode(data_ptrs, updated_code_ptrs, 1 << 20);
+
+    // one aligned 4 KB packet, a range crossing packets and coding units
+    int ranges[][2] = { { 3 * kPacketSize, kPacketSize },
+                        { kCodingUnitSize - 1000, 3 * kPacketSize + 16 },
+                        { 0, 1 << 20 } };
+    char *delta = new char[1 << 20];
+    for (int r = 0; r < 3; r++) {
+        int data_index = r * 3;
+        int offset = ranges[r][0];
+        int len = ranges[r][1];
+        for (int j = 0; j < len; j++) {
+            char new_byte = random();
+            delta[j] = data_ptrs[data_index][offset + j] ^ new_byte;
+            data_ptrs[data_index][offset + j] = new_byte;
+        }
+
+        coder->UpdateParity(data_index, delta, offset, len, updated_code_ptrs);
+        coder->Encode(data_ptrs, code_ptrs, 1 << 20);
+        for (int i = 0; i < 4; i++) {
+            ASSERT_EQ(memcmp(code_ptrs[i], updated_code_ptrs[i], 1 << 20), 0);
+        }
+    }
+
+    delete[] delta;
+    for (int i = 0; i < 8; i++) {
+        delete[] data_ptrs[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        delete[] code_ptrs[i];
+        delete[] updated_code_ptrs[i];
+    }
+    delete coder;
+}
+
+TEST(TestCauchyRSCoder, Verify)
+{
+    CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
+    char *data_ptrs[8];
+    char *code_ptrs[4];
+    for (int i = 0; i < 8; i++) {
+        data_ptrs[i] = new char[1 << 20];
+        for (int j = 0; j < (1 << 20); j++) {
+            data_ptrs[i][j] = random();
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        code_ptrs[i] = new char[1 << 20];
+    }
+    coder->Encode(data_ptrs, code_ptrs, 1 << 20);
+
+    int bad_unit = 0;
+    int bad_part = 0;
+    ASSERT_TRUE(coder->Verify(data_ptrs, code_ptrs, 1 << 20, &bad_unit, &bad_part));
+    ASSERT_EQ(-1, bad_unit);
+    ASSERT_EQ(-1, bad_part);
+    ASSERT_TRUE(coder->ParallelVerify(data_ptrs, code_ptrs, 1 << 20, 4, &bad_unit, &bad_part));
+    ASSERT_EQ(-1, bad_unit);
+
+    // corrupt coding part 2 in unit 20 and coding part 1 in unit 9
+    code_ptrs[2][20 * kCodingUnitSize + 100] ^= 1;
+    code_ptrs[1][9 * kCodingUnitSize + kCodingUnitSize - 1] ^= 0x80;
+    ASSERT_FALSE(coder->Verify(data_ptrs, code_ptrs, 1 << 20, &bad_unit, &bad_part));
+    ASSERT_EQ(9, bad_unit);
+    ASSERT_EQ(1, bad_part);
+    for (int num_threads = 2; num_threads <= 64; num_threads *= 2) {
+        bad_unit = bad_part = 0;
+        ASSERT_FALSE(coder->ParallelVerify(data_ptrs, code_ptrs, 1 << 20, num_threads,
+                                           &bad_unit, &bad_part));
+        ASSERT_EQ(9, bad_unit);
+        ASSERT_EQ(1, bad_part);
+    }
+
+    // a corrupted data part shows up as a parity mismatch as well
+    code_ptrs[1][9 * kCodingUnitSize + kCodingUnitSize - 1] ^= 0x80;
+    data_ptrs[5][3 * kCodingUnitSize] ^= 1;
+    ASSERT_FALSE(coder->ParallelVerify(data_ptrs, code_ptrs, 1 << 20, 3, &bad_unit, NULL));
+    ASSERT_EQ(3, bad_unit);
+
+    // m == 1 is verified with the xor of the data parts
+    CauchyRSCoder xor_coder(8, 1);
+    xor_coder.Encode(data_ptrs, code_ptrs, 1 << 20);
+    ASSERT_TRUE(xor_coder.Verify(data_ptrs, code_ptrs, 1 << 20, &bad_unit, &bad_part));
+    code_ptrs[0][7 * kCodingUnitSize + 5] ^= 1;
+    ASSERT_FALSE(xor_coder.Verify(data_ptrs, code_ptrs, 1 << 20, &bad_unit, &bad_part));
+    ASSERT_EQ(7, bad_unit);
+    ASSERT_EQ(0, bad_part);
+
+    for (int i = 0; i < 8; i++) {
+        delete[] data_ptrs[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        delete[] code_ptrs[i];
+    }
+    delete coder;
+}
+
+TEST(TestCauchyRSCoder, RepairContribution)
+{
+    const int size = 1 << 20;
+    CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
+    char *data_ptrs[8];
+    char *code_ptrs[4];
+    for (int i = 0; i < 8; i++) {
+        data_ptrs[i] = new char[size];
+        for (int j = 0; j < size; j++) {
+            data_ptrs[i][j] = random();
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        code_ptrs[i] = new char[size];
+    }
+    coder->Encode(data_ptrs, code_ptrs, size);
+
+    // data part 2 and coding part 1 are lost, repair each along a chain
+    bool erased[12];
+    memset(erased, 0, sizeof(erased));
+    erased[2] = true;
+    erased[9] = true;
+    unsigned char masks[kWordBits];
+    ASSERT_EQ(-1, coder->GetRepairCoefficients(erased, 3, 0, masks));
+    ASSERT_EQ(-1, coder->GetRepairCoefficients(erased, 2, 2, masks));
+    ASSERT_EQ(-1, coder->GetRepairCoefficients(erased, 2, 11, masks));
+
+    char *partial = new char[size];
+    int targets[] = { 2, 9 };
+    for (int t = 0; t < 2; t++) {
+        int num_survivors = 0;
+        for (int part = 0; part < 12; part++) {
+            if (coder->GetRepairCoefficients(erased, targets[t], part, masks) != 0) {
+                continue;
+            }
+            const char *src = (part < 8) ? data_ptrs[part] : code_ptrs[part - 8];
+            coder->RepairContribution(masks, src, partial, size, num_survivors > 0);
+            num_survivors++;
+        }
+        ASSERT_EQ(8, num_survivors);
+        const char *expected = (targets[t] < 8) ? data_ptrs[targets[t]]
+                                : code_ptrs[targets[t] - 8];
+        ASSERT_EQ(memcmp(expected, partial, size), 0);
+    }
+
+    delete[] partial;
+    for (int i = 0; i < 8; i++) {
+        delete[] data_ptrs[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        delete[] code_ptrs[i];
+    }
+    delete coder;
+}
+
+TEST(TestCauchyRSCoder, SingleDataPartXorDecode)
+{
+    const int size = 1 << 20;
+    int profiles[][2] = { { 8, 4 }, { 6, 3 }, { 20, 1 } };
+    for (int p = 0; p < 3; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+        char *data_ptrs[k];
+        char *code_ptrs[m];
+        char *xor_ptrs[k];
+        char *schedule_ptrs[k];
+        for (int i = 0; i < k; i++) {
+            data_ptrs[i] = new char[size];
+            xor_ptrs[i] = new char[size];
+            schedule_ptrs[i] = new char[size];
+            for (int j = 0; j < size; j++) {
+                data_ptrs[i][j] = random();
+            }
+            memcpy(xor_ptrs[i], data_ptrs[i], size);
+            memcpy(schedule_ptrs[i], data_ptrs[i], size);
+        }
+        for (int i = 0; i < m; i++) {
+            code_ptrs[i] = new char[size];
+        }
+        coder->Encode(data_ptrs, code_ptrs, size);
+
+        bool erased[k + m];
+        for (int lost = 0; lost < k; lost++) {
+            memset(erased, 0, sizeof(erased));
+            erased[lost] = true;
+            bzero(xor_ptrs[lost], size);
+            bzero(schedule_ptrs[lost], size);
+            coder->Decode(erased, xor_ptrs, code_ptrs, size);
+            coder->_DecodeWithSchedule(erased, schedule_ptrs, code_ptrs, size);
+            ASSERT_EQ(memcmp(data_ptrs[lost], xor_ptrs[lost], size), 0);
+            ASSERT_EQ(memcmp(data_ptrs[lost], schedule_ptrs[lost], size), 0);
+        }
+
+        for (int i = 0; i < k; i++) {
+            delete[] data_ptrs[i];
+            delete[] xor_ptrs[i];
+            delete[] schedule_ptrs[i];
+        }
+        for (int i = 0; i < m; i++) {
+            delete[] code_ptrs[i];
+        }
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, SmallParityKernels)
+{
+    const int size = 1 << 19;
+    int profiles[][2] = { { 4, 1 }, { 10, 1 }, { 4, 2 }, { 8, 2 }, { 14, 2 }, { 20, 2 } };
+    for (int p = 0; p < 6; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+        char *ptrs[k + m];
+        char *schedule_ptrs[k + m];
+        char *erased_ptrs[k + m];
+        for (int i = 0; i < k + m; i++) {
+            ptrs[i] = new char[size];
+            schedule_ptrs[i] = new char[size];
+            erased_ptrs[i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    ptrs[i][j] = random();
+                }
+                memcpy(schedule_ptrs[i], ptrs[i], size);
+            }
+        }
+
+        // the dedicated kernels produce the same coding parts as the schedule
+        coder->Encode(ptrs, ptrs + k, size);
+        coder->_EncodeWithSchedule(schedule_ptrs, schedule_ptrs + k, size);
+        for (int i = k; i < k + m; i++) {
+            ASSERT_EQ(memcmp(ptrs[i], schedule_ptrs[i], size), 0);
+        }
+
+        // every single and double erasure
+        bool erased[k + m];
+        for (int a = 0; a < k + m; a++) {
+            for (int b = a; b < k + m && (b == a || m == 2); b++) {
+                memset(erased, 0, sizeof(erased));
+                erased[a] = true;
+                erased[b] = true;
+                for (int i = 0; i < k + m; i++) {
+                    memcpy(erased_ptrs[i], ptrs[i], size);
+                    memcpy(schedule_ptrs[i], ptrs[i], size);
+                    if (erased[i]) {
+                        bzero(erased_ptrs[i], size);
+                        bzero(schedule_ptrs[i], size);
+                    }
+                }
+                coder->Decode(erased, erased_ptrs, erased_ptrs + k, size);
+                coder->_DecodeWithSchedule(erased, schedule_ptrs, schedule_ptrs + k, size);
+                for (int i = 0; i < k + m; i++) {
+                    ASSERT_EQ(memcmp(ptrs[i], erased_ptrs[i], size), 0);
+                    ASSERT_EQ(memcmp(ptrs[i], schedule_ptrs[i], size), 0);
+                }
+            }
+        }
+
+        for (int i = 0; i < k + m; i++) {
+            delete[] ptrs[i];
+            delete[] schedule_ptrs[i];
+            delete[] erased_ptrs[i];
+        }
+        delete coder;
+    }
+}
+
+// split a part into segments of 0 to 3 packets each, with its own buffers
+void SplitPart(int size, std::vector<struct iovec> *iov)
+{
+    for (int offset = 0; offset < size;) {
+        int len = (random() % 4) * kPacketSize;
+        if (len > size - offset) {
+            len = size - offset;
+        }
+        struct iovec segment;
+        segment.iov_base = new char[len > 0 ? len : 1];
+        segment.iov_len = len;
+        iov->push_back(segment);
+        offset += len;
+    }
+}
+
+void CopyToSegments(const char *buf, const std::vector<struct iovec> &iov)
+{
+    for (size_t i = 0; i < iov.size(); i++) {
+        memcpy(iov[i].iov_base, buf, iov[i].iov_len);
+        buf += iov[i].iov_len;
+    }
+}
+
+void CopyFromSegments(const std::vector<struct iovec> &iov, char *buf)
+{
+    for (size_t i = 0; i < iov.size(); i++) {
+        memcpy(buf, iov[i].iov_base, iov[i].iov_len);
+        buf += iov[i].iov_len;
+    }
+}
+
+TEST(TestCauchyRSCoder, ScatterGather)
+{
+    const int size = 1 << 18;
+    int profiles[][2] = { { 8, 4 }, { 8, 2 }, { 10, 1 } };
+    for (int p = 0; p < 3; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+        char *ptrs[k + m];
+        char *gathered = new char[size];
+        std::vector<struct iovec> iovs[k + m];
+        PartSegments parts[k + m];
+        for (int i = 0; i < k + m; i++) {
+            ptrs[i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    ptrs[i][j] = random();
+                }
+            }
+            SplitPart(size, &iovs[i]);
+            parts[i].iov = &iovs[i][0];
+            parts[i].iovcnt = iovs[i].size();
+            if (i < k) {
+                CopyToSegments(ptrs[i], iovs[i]);
+            }
+        }
+
+        // segmented encoding produces the same coding parts as contiguous encoding
+        coder->Encode(ptrs, ptrs + k, size);
+        coder->Encode(parts, parts + k, size);
+        for (int i = k; i < k + m; i++) {
+            CopyFromSegments(iovs[i], gathered);
+            ASSERT_EQ(memcmp(ptrs[i], gathered, size), 0);
+        }
+
+        // erase m random parts, or a single data part for the xor path
+        for (int round = 0; round < 8; round++) {
+            bool erased[k + m];
+            memset(erased, 0, sizeof(erased));
+            int num_erased = (round == 0) ? 1 : m;
+            for (int n = 0; n < num_erased;) {
+                int index = (round == 0) ? random() % k : random() % (k + m);
+                if (!erased[index]) {
+                    erased[index] = true;
+                    n++;
+                }
+            }
+            for (int i = 0; i < k + m; i++) {
+                CopyToSegments(ptrs[i], iovs[i]);
+                if (erased[i]) {
+                    for (size_t s = 0; s < iovs[i].size(); s++) {
+                        bzero(iovs[i][s].iov_base, iovs[i][s].iov_len);
+                    }
+                }
+            }
+            coder->Decode(erased, parts, parts + k, size);
+            for (int i = 0; i < k + m; i++) {
+                CopyFromSegments(iovs[i], gathered);
+                ASSERT_EQ(memcmp(ptrs[i], gathered, size), 0);
+            }
+        }
+
+        for (int i = 0; i < k + m; i++) {
+            delete[] ptrs[i];
+            for (size_t s = 0; s < iovs[i].size(); s++) {
+                delete[] static_cast<char *>(iovs[i][s].iov_base);
+            }
+        }
+        delete[] gathered;
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, EncodeBatch)
+{
+    int profiles[][2] = { { 10, 1 }, { 8, 2 }, { 8, 4 } };
+    for (int p = 0; p < 3; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+
+        // stripes of one to three coding units
+        const int num_stripes = 10;
+        EncodeStripe stripes[num_stripes];
+        char *expected[num_stripes][k + m];
+        for (int s = 0; s < num_stripes; s++) {
+            stripes[s].size = (1 + random() % 3) * kCodingUnitSize;
+            stripes[s].data_ptrs = new char*[k + m];
+            stripes[s].coding_ptrs = stripes[s].data_ptrs + k;
+            for (int i = 0; i < k + m; i++) {
+                stripes[s].data_ptrs[i] = new char[stripes[s].size];
+                expected[s][i] = new char[stripes[s].size];
+                if (i < k) {
+                    for (int j = 0; j < stripes[s].size; j++) {
+                        stripes[s].data_ptrs[i][j] = random();
+                    }
+                    memcpy(expected[s][i], stripes[s].data_ptrs[i], stripes[s].size);
+                }
+            }
+            coder->Encode(expected[s], expected[s] + k, stripes[s].size);
+        }
+
+        coder->EncodeBatch(stripes, num_stripes);
+        for (int s = 0; s < num_stripes; s++) {
+            for (int i = 0; i < k + m; i++) {
+                ASSERT_EQ(memcmp(stripes[s].data_ptrs[i], expected[s][i], stripes[s].size), 0);
+                delete[] stripes[s].data_ptrs[i];
+                delete[] expected[s][i];
+            }
+            delete[] stripes[s].data_ptrs;
+        }
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, EncodeWithChecksums)
+{
+    const int size = 3 * kCodingUnitSize;
+    const int num_part_packets = size / kPacketSize;
+    int profiles[][2] = { { 10, 1 }, { 8, 2 }, { 8, 4 } };
+    for (int p = 0; p < 3; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+        char *ptrs[k + m];
+        char *expected[k + m];
+        for (int i = 0; i < k + m; i++) {
+            ptrs[i] = new char[size];
+            expected[i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    ptrs[i][j] = random();
+                }
+                memcpy(expected[i], ptrs[i], size);
+            }
+        }
+        coder->Encode(expected, expected + k, size);
+
+        std::vector<uint32_t> checksums((k + m) * num_part_packets);
+        coder->Encode(ptrs, ptrs + k, size, &checksums[0]);
+        for (int i = 0; i < k + m; i++) {
+            ASSERT_EQ(memcmp(ptrs[i], expected[i], size), 0);
+            for (int j = 0; j < num_part_packets; j++) {
+                ASSERT_EQ(checksums[i * num_part_packets + j],
+                          Crc32c(ptrs[i] + j * kPacketSize, kPacketSize));
+            }
+            delete[] ptrs[i];
+            delete[] expected[i];
+        }
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, DecodeWithoutAllocation)
+{
+    const int size = 1 << 18;
+    int profiles[][2] = { { 8, 4 }, { 6, 3 }, { 8, 2 } };
+    for (int p = 0; p < 3; p++) {
+        int k = profiles[p][0];
+        int m = profiles[p][1];
+        CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+        DecodeScratch *scratch = new DecodeScratch(k, m);
+        char *ptrs[k + m];
+        char *erased_ptrs[k + m];
+        for (int i = 0; i < k + m; i++) {
+            ptrs[i] = new char[size];
+            erased_ptrs[i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    ptrs[i][j] = random();
+                }
+            }
+        }
+        coder->Encode(ptrs, ptrs + k, size);
+
+        // xor path, lost data and coding parts, only lost coding parts
+        int patterns[][4] = { { 1, -1, -1, -1 }, { 0, k, -1, -1 }, { 2, 3, k + 1, k + m - 1 },
+                              { k, k + m - 1, -1, -1 } };
+        for (int t = 0; t < 4; t++) {
+            bool erased[k + m];
+            memset(erased, 0, sizeof(erased));
+            for (int i = 0; i < m && i < 4; i++) {
+                if (patterns[t][i] != -1) {
+                    erased[patterns[t][i]] = true;
+                }
+            }
+            for (int use_scratch = 0; use_scratch < 2; use_scratch++) {
+                for (int round = 0; round < 2; round++) {
+                    for (int i = 0; i < k + m; i++) {
+                        memcpy(erased_ptrs[i], ptrs[i], size);
+                        if (erased[i]) {
+                            bzero(erased_ptrs[i], size);
+                        }
+                    }
+
+                    // the first Decode of the thread allocates its scratch
+                    int num_allocations = g_num_allocations;
+                    if (use_scratch) {
+                        coder->Decode(erased, erased_ptrs, erased_ptrs + k, size, scratch);
+                    } else {
+                        coder->Decode(erased, erased_ptrs, erased_ptrs + k, size);
+                    }
+                    if (round > 0 || use_scratch) {
+                        ASSERT_EQ(g_num_allocations, num_allocations);
+                    }
+                    for (int i = 0; i < k + m; i++) {
+                        ASSERT_EQ(memcmp(ptrs[i], erased_ptrs[i], size), 0);
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < k + m; i++) {
+            delete[] ptrs[i];
+            delete[] erased_ptrs[i];
+        }
+        delete scratch;
+        delete coder;
+    }
+}
+
+TEST(TestCauchyRSCoder, DecodeData)
+{
+    const int size = 1 << 18;
+    const int k = 8;
+    const int m = 4;
+    CauchyRSCoder *coder = new CauchyRSCoder(k, m);
+    char *ptrs[k + m];
+    char *erased_ptrs[k + m];
+    for (int i = 0; i < k + m; i++) {
+        ptrs[i] = new char[size];
+        erased_ptrs[i] = new char[size];
+        if (i < k) {
+            for (int j = 0; j < size; j++) {
+                ptrs[i][j] = random();
+            }
+        }
+    }
+    coder->Encode(ptrs, ptrs + k, size);
+
+    // the parity parts not read are erased but left alone, with parity part 0
+    // read a single lost data part is the xor of the others
+    int patterns[][4] = { { 1, k + 1, k + 2, k + 3 }, { 1, 5, k, k + 3 }, { 0, k + 2, -1, -1 } };
+    for (int t = 0; t < 3; t++) {
+        bool erased[k + m];
+        memset(erased, 0, sizeof(erased));
+        for (int i = 0; i < 4; i++) {
+            if (patterns[t][i] != -1) {
+                erased[patterns[t][i]] = true;
+            }
+        }
+        for (int i = 0; i < k + m; i++) {
+            memcpy(erased_ptrs[i], ptrs[i], size);
+            if (erased[i]) {
+                memset(erased_ptrs[i], 0x5a, size);
+            }
+        }
+        EXPECT_EQ(coder->XorDecodable(erased), t != 1);
+        coder->DecodeData(erased, erased_ptrs, erased_ptrs + k, size);
+        for (int i = 0; i < k; i++) {
+            ASSERT_EQ(memcmp(ptrs[i], erased_ptrs[i], size), 0);
+        }
+        for (int i = k; i < k + m; i++) {
+            if (erased[i]) {
+                ASSERT_EQ(erased_ptrs[i][0], 0x5a);
+                ASSERT_EQ(erased_ptrs[i][size - 1], 0x5a);
+            }
+        }
+    }
+
+    for (int i = 0; i < k + m; i++) {
+        delete[] ptrs[i];
+        delete[] erased_ptrs[i];
+    }
+    delete coder;
+}
+
 TEST(TestCauchyRSCoder, TestDecode)
 {
     CauchyRSCoder *coder = new CauchyRSCoder(8, 4);
@@ -0,0 +1,55 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/crc32c.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(TestCrc32c, KnownValues)
+{
+    // check value of the CRC catalogue and vectors of RFC 3720
+    EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283u);
+    char buf[32];
+    memset(buf, 0, sizeof(buf));
+    EXPECT_EQ(Crc32c(buf, sizeof(buf)), 0x8a9136aau);
+    memset(buf, 0xff, sizeof(buf));
+    EXPECT_EQ(Crc32c(buf, sizeof(buf)), 0x62a8ab43u);
+    for (int i = 0; i < 32; i++) {
+        buf[i] = i;
+    }
+    EXPECT_EQ(Crc32c(buf, sizeof(buf)), 0x46dd794eu);
+}
+
+TEST(TestCrc32c, Extend)
+{
+    char buf[4096 + 7];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = random();
+    }
+    uint32_t whole = Crc32c(buf, sizeof(buf));
+    EXPECT_EQ(whole, Crc32cExtendTable(0, buf, sizeof(buf)));
+    for (size_t split = 0; split <= sizeof(buf); split += 509) {
+        EXPECT_EQ(Crc32cExtend(Crc32c(buf, split), buf + split, sizeof(buf) - split), whole);
+    }
+    EXPECT_EQ(Crc32cExtendDispatch(0, buf, sizeof(buf)), whole);
+    EXPECT_EQ(Crc32cResolveExtend()(0, buf, sizeof(buf)), whole);
+    EXPECT_EQ(Crc32cExtendWith(Crc32cResolveExtend(), 0, buf, sizeof(buf)), whole);
+    if (Crc32cHasHardware()) {
+        for (size_t size = 0; size <= 17; size++) {
+            EXPECT_EQ(Crc32cExtendHardware(7, buf + 3, size), Crc32cExtendTable(7, buf + 3, size));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
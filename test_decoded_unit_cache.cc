@@ -0,0 +1,161 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/decoded_unit_cache.h"
+#include "common/cauchy_rscode.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int kDataParts = 3;
+
+// rows of kDataParts units, row r of block b filled with b + r + part
+class Rows {
+public:
+    explicit Rows(int num_units) {
+        for (int i = 0; i < kDataParts; i++) {
+            m_parts[i].resize(num_units * kCodingUnitSize);
+            m_ptrs[i] = &m_parts[i][0];
+        }
+    }
+
+    void Fill(int64_t block_id, int64_t unit, int offset) {
+        for (int i = 0; i < kDataParts; i++) {
+            memset(m_ptrs[i] + offset, static_cast<int>(block_id + unit + i), kCodingUnitSize);
+        }
+    }
+
+    bool Check(int64_t block_id, int64_t unit, int offset) const {
+        for (int i = 0; i < kDataParts; i++) {
+            for (int j = 0; j < kCodingUnitSize; j++) {
+                if (m_ptrs[i][offset + j] != static_cast<char>(block_id + unit + i)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::vector<char> m_parts[kDataParts];
+    char *m_ptrs[kDataParts];
+};
+
+TEST(TestDecodedUnitCache, LookupInsert)
+{
+    const int row_size = kDataParts * kCodingUnitSize;
+    DecodedUnitCache cache(4 * row_size);
+    Rows rows(2);
+
+    EXPECT_FALSE(cache.Lookup(1, 0, kDataParts, rows.m_ptrs, 0));
+    rows.Fill(1, 0, 0);
+    rows.Fill(1, 1, kCodingUnitSize);
+    cache.Insert(1, 0, kDataParts, rows.m_ptrs, 0, cache.BlockGeneration(1));
+    cache.Insert(1, 1, kDataParts, rows.m_ptrs, kCodingUnitSize, cache.BlockGeneration(1));
+
+    Rows out(2);
+    ASSERT_TRUE(cache.Lookup(1, 1, kDataParts, out.m_ptrs, 0));
+    EXPECT_TRUE(out.Check(1, 1, 0));
+    ASSERT_TRUE(cache.Lookup(1, 0, kDataParts, out.m_ptrs, kCodingUnitSize));
+    EXPECT_TRUE(out.Check(1, 0, kCodingUnitSize));
+    // a row of another profile is not returned
+    EXPECT_FALSE(cache.Lookup(1, 0, kDataParts - 1, out.m_ptrs, 0));
+
+    DecodedUnitCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_lookups, 4u);
+    EXPECT_EQ(stats.num_hits, 2u);
+    EXPECT_EQ(stats.num_misses, 2u);
+    EXPECT_EQ(stats.bytes_cached, 2 * row_size);
+    EXPECT_EQ(stats.bytes_saved, 2 * row_size);
+}
+
+TEST(TestDecodedUnitCache, Evict)
+{
+    const int row_size = kDataParts * kCodingUnitSize;
+    DecodedUnitCache cache(3 * row_size);
+    Rows rows(1);
+    for (int64_t unit = 0; unit < 3; unit++) {
+        rows.Fill(7, unit, 0);
+        cache.Insert(7, unit, kDataParts, rows.m_ptrs, 0, cache.BlockGeneration(7));
+    }
+    // unit 0 is used again, 1 is the least recently used
+    ASSERT_TRUE(cache.Lookup(7, 0, kDataParts, rows.m_ptrs, 0));
+    rows.Fill(8, 0, 0);
+    cache.Insert(8, 0, kDataParts, rows.m_ptrs, 0, cache.BlockGeneration(8));
+    EXPECT_FALSE(cache.Lookup(7, 1, kDataParts, rows.m_ptrs, 0));
+    EXPECT_TRUE(cache.Lookup(7, 0, kDataParts, rows.m_ptrs, 0));
+    EXPECT_TRUE(cache.Lookup(7, 2, kDataParts, rows.m_ptrs, 0));
+    EXPECT_TRUE(cache.Lookup(8, 0, kDataParts, rows.m_ptrs, 0));
+    EXPECT_TRUE(rows.Check(8, 0, 0));
+
+    DecodedUnitCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_evictions, 1u);
+    EXPECT_EQ(stats.bytes_cached, 3 * row_size);
+
+    // rows larger than the cache are not admitted
+    DecodedUnitCache small(row_size - 1);
+    small.Insert(7, 0, kDataParts, rows.m_ptrs, 0, small.BlockGeneration(7));
+    small.GetStats(&stats);
+    EXPECT_EQ(stats.num_insertions, 0u);
+}
+
+TEST(TestDecodedUnitCache, InvalidateBlock)
+{
+    DecodedUnitCache cache(64 * kDataParts * kCodingUnitSize);
+    Rows rows(1);
+    for (int64_t block_id = 1; block_id <= 3; block_id++) {
+        for (int64_t unit = 0; unit < 4; unit++) {
+            cache.Insert(block_id, unit, kDataParts, rows.m_ptrs, 0,
+                         cache.BlockGeneration(block_id));
+        }
+    }
+    cache.InvalidateBlock(2);
+    for (int64_t unit = 0; unit < 4; unit++) {
+        EXPECT_TRUE(cache.Lookup(1, unit, kDataParts, rows.m_ptrs, 0));
+        EXPECT_FALSE(cache.Lookup(2, unit, kDataParts, rows.m_ptrs, 0));
+        EXPECT_TRUE(cache.Lookup(3, unit, kDataParts, rows.m_ptrs, 0));
+    }
+    DecodedUnitCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_invalidations, 4u);
+    EXPECT_EQ(stats.bytes_cached, 8 * kDataParts * kCodingUnitSize);
+}
+
+TEST(TestDecodedUnitCache, StaleInsert)
+{
+    DecodedUnitCache cache(64 * kDataParts * kCodingUnitSize);
+    Rows rows(1);
+    rows.Fill(5, 0, 0);
+
+    // parts read before the block was put again
+    uint64_t generation = cache.BlockGeneration(5);
+    cache.InvalidateBlock(5);
+    cache.Insert(5, 0, kDataParts, rows.m_ptrs, 0, generation);
+    EXPECT_FALSE(cache.Lookup(5, 0, kDataParts, rows.m_ptrs, 0));
+    // other blocks are not held back
+    cache.Insert(6, 0, kDataParts, rows.m_ptrs, 0, generation);
+    EXPECT_TRUE(cache.Lookup(6, 0, kDataParts, rows.m_ptrs, 0));
+    cache.Insert(5, 0, kDataParts, rows.m_ptrs, 0, cache.BlockGeneration(5));
+    EXPECT_TRUE(cache.Lookup(5, 0, kDataParts, rows.m_ptrs, 0));
+    EXPECT_TRUE(rows.Check(5, 0, 0));
+
+    DecodedUnitCacheStats stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(stats.num_stale, 1u);
+    EXPECT_EQ(stats.num_insertions, 2u);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,381 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/file_part_store.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// a directory per server under a temporary directory, removed at the end
+class TempDirs {
+public:
+    TempDirs() {
+        char path[] = "/tmp/test_file_part_store.XXXXXX";
+        EXPECT_TRUE(mkdtemp(path) != NULL);
+        m_root = path;
+    }
+
+    ~TempDirs() {
+        std::string command = "rm -rf " + m_root;
+        EXPECT_EQ(system(command.c_str()), 0);
+    }
+
+    std::string Add(int64_t server_addr) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%lld", static_cast<long long>(server_addr));
+        std::string dir = m_root + name;
+        mkdir(dir.c_str(), 0755);
+        return dir;
+    }
+
+    std::string m_root;
+};
+
+// records the status of every request, once
+class StatusCallback : public PartTransportCallback {
+public:
+    StatusCallback() : m_num_done(0) {
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+    }
+
+    ~StatusCallback() {
+        pthread_mutex_destroy(&m_mutex);
+        pthread_cond_destroy(&m_cond);
+    }
+
+    virtual void OnPartDone(PartRequest *request, int status) {
+        pthread_mutex_lock(&m_mutex);
+        EXPECT_TRUE(m_status.find(request) == m_status.end());
+        m_status[request] = status;
+        m_num_done++;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    void WaitFor(int num_done) {
+        pthread_mutex_lock(&m_mutex);
+        while (m_num_done < num_done) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    int Status(PartRequest *request) {
+        pthread_mutex_lock(&m_mutex);
+        int status = m_status[request];
+        pthread_mutex_unlock(&m_mutex);
+        return status;
+    }
+
+    std::map<PartRequest *, int> m_status;
+    int m_num_done;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+};
+
+PartRequest MakeRequest(PartRequest::Type type, int64_t block_id, int offset, int length, char *data)
+{
+    PartRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = type;
+    request.block_id = block_id;
+    request.part_index = 0;
+    request.server_addr = 1;
+    request.part.offset = offset;
+    request.part.length = length;
+    request.part.data = data;
+    return request;
+}
+
+// puts and reads back parts through every I/O path of the store
+void CheckRoundTrip(const FilePartStoreOptions &options)
+{
+    TempDirs dirs;
+    FilePartStore store(options);
+    ASSERT_EQ(store.Start(), 0);
+    ASSERT_EQ(store.AddServer(1, dirs.Add(1)), 0);
+    EXPECT_EQ(store.AddServer(1, dirs.Add(1)), -1);
+
+    const int size = 64 << 10;
+    void *aligned = NULL;
+    ASSERT_EQ(posix_memalign(&aligned, kDirectIoAlignment, 2 * size), 0);
+    char *buffers[3];
+    buffers[0] = static_cast<char *>(aligned);          // in place
+    buffers[1] = new char[size + 1] + 1;                // bounced
+    buffers[2] = new char[size];                        // unaligned range
+    int offsets[3] = {0, 2 * kDirectIoAlignment, 100};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < size; j++) {
+            buffers[i][j] = random();
+        }
+    }
+
+    StatusCallback puts;
+    std::vector<PartRequest> put_requests;
+    for (int i = 0; i < 3; i++) {
+        put_requests.push_back(MakeRequest(PartRequest::kPut, i, offsets[i], size, buffers[i]));
+    }
+    for (int i = 0; i < 3; i++) {
+        store.PutPart(&put_requests[i], &puts);
+    }
+    puts.WaitFor(3);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(puts.Status(&put_requests[i]), 0);
+    }
+
+    char *read = static_cast<char *>(aligned) + size;
+    char *unaligned_read = new char[size + 1];
+    StatusCallback gets;
+    std::vector<PartRequest> get_requests;
+    for (int i = 0; i < 3; i++) {
+        char *data = (i == 1) ? unaligned_read + 1 : read;
+        get_requests.push_back(MakeRequest(PartRequest::kGet, i, offsets[i], size, data));
+        store.GetPart(&get_requests[i], &gets);
+        gets.WaitFor(i + 1);
+        EXPECT_EQ(gets.Status(&get_requests[i]), 0);
+        EXPECT_EQ(memcmp(data, buffers[i], size), 0);
+    }
+
+    // a missing part, or a range past its end, fails
+    get_requests.push_back(MakeRequest(PartRequest::kGet, 3, 0, size, read));
+    get_requests.push_back(MakeRequest(PartRequest::kGet, 0, size, size, read));
+    store.GetPart(&get_requests[3], &gets);
+    store.GetPart(&get_requests[4], &gets);
+    gets.WaitFor(5);
+    EXPECT_EQ(gets.Status(&get_requests[3]), -1);
+    EXPECT_EQ(gets.Status(&get_requests[4]), -1);
+
+    FilePartStoreStats stats;
+    store.GetStats(&stats);
+    EXPECT_EQ(stats.io_uring, options.use_io_uring);
+    EXPECT_EQ(stats.num_writes, 3u);
+    EXPECT_EQ(stats.bytes_written, 3 * size);
+    EXPECT_EQ(stats.bytes_read, 3 * size);
+    EXPECT_EQ(stats.num_errors, 2u);
+    EXPECT_GE(stats.num_bounced, 2u);
+    EXPECT_GT(stats.write_latency.Percentile(50), 0);
+    EXPECT_GE(stats.read_latency.Percentile(99), stats.read_latency.Percentile(50));
+
+    store.Stop();
+    StatusCallback stopped;
+    store.GetPart(&get_requests[0], &stopped);
+    EXPECT_EQ(stopped.Status(&get_requests[0]), -1);
+
+    free(aligned);
+    delete[] (buffers[1] - 1);
+    delete[] buffers[2];
+    delete[] unaligned_read;
+}
+
+TEST(TestFilePartStore, IoUring)
+{
+    CheckRoundTrip(FilePartStoreOptions());
+}
+
+TEST(TestFilePartStore, ThreadPool)
+{
+    FilePartStoreOptions options;
+    options.use_io_uring = false;
+    CheckRoundTrip(options);
+}
+
+TEST(TestFilePartStore, Cancel)
+{
+    // with and without O_DIRECT, bounce buffers in both
+    for (int mode = 0; mode < 4; mode++) {
+        TempDirs dirs;
+        FilePartStoreOptions options;
+        options.use_io_uring = (mode % 2 == 1);
+        options.use_direct_io = (mode < 2);
+        options.queue_depth = 2;
+        options.num_bounce_buffers = 1;
+        options.num_threads = 1;
+        FilePartStore store(options);
+        ASSERT_EQ(store.Start(), 0);
+        store.AddServer(1, dirs.Add(1));
+
+        const int size = 256 << 10;
+        const int num_requests = 32;
+        std::vector<char> data(size + 1);
+        PartRequest put = MakeRequest(PartRequest::kPut, 0, 0, size, &data[1]);
+        StatusCallback puts;
+        store.PutPart(&put, &puts);
+        puts.WaitFor(1);
+        ASSERT_EQ(puts.Status(&put), 0);
+
+        // canceled reads complete once, most without reading, and never
+        // write the part buffer
+        std::vector<char> buffers(num_requests * (size + 1), 0x5a);
+        std::vector<PartRequest> requests;
+        for (int i = 0; i < num_requests; i++) {
+            requests.push_back(MakeRequest(PartRequest::kGet, 0, 0, size, &buffers[i * (size + 1) + 1]));
+        }
+        StatusCallback gets;
+        for (int i = 0; i < num_requests; i++) {
+            store.GetPart(&requests[i], &gets);
+        }
+        for (int i = 0; i < num_requests; i++) {
+            store.CancelPart(&requests[i]);
+        }
+        gets.WaitFor(num_requests);
+        int num_canceled = 0;
+        for (int i = 0; i < num_requests; i++) {
+            int status = gets.Status(&requests[i]);
+            EXPECT_TRUE(status == 0 || status == kPartCanceled);
+            num_canceled += (status == kPartCanceled);
+            if (status == kPartCanceled) {
+                const char *buffer = &buffers[i * (size + 1) + 1];
+                EXPECT_TRUE(buffer[0] == 0x5a && memcmp(buffer, buffer + 1, size - 1) == 0);
+            }
+        }
+        EXPECT_GT(num_canceled, 0);
+        FilePartStoreStats stats;
+        store.GetStats(&stats);
+        EXPECT_EQ(stats.num_canceled, static_cast<uint64_t>(num_canceled));
+    }
+}
+
+// stripe reads through PartHandle, degraded and hedged
+void CheckStripeGet(const FilePartStoreOptions &options)
+{
+    const int k = 4;
+    const int m = 2;
+    const int size = 2 * kCodingUnitSize;
+    TempDirs dirs;
+    FilePartStore store(options);
+    ASSERT_EQ(store.Start(), 0);
+    std::vector<std::string> server_dirs;
+    for (int i = 0; i < k + m; i++) {
+        server_dirs.push_back(dirs.Add(i));
+        store.AddServer(i, server_dirs[i]);
+    }
+    CauchyRSCoder coder(k, m);
+    std::vector<char> parts((k + m) * size);
+    char *ptrs[k + m];
+    for (int i = 0; i < k + m; i++) {
+        ptrs[i] = &parts[i * size];
+    }
+    for (int i = 0; i < k * size; i++) {
+        parts[i] = random();
+    }
+    coder.Encode(ptrs, ptrs + k, size);
+
+    PartHandle *handle = new PartHandle(&store, PartHandleOptions());
+    PartsRequest put;
+    put.block_id = 7;
+    for (int i = 0; i < k + m; i++) {
+        Part part;
+        part.length = size;
+        part.offset = 0;
+        part.data = ptrs[i];
+        put.server_addrs[i] = i;
+        put.todo_parts[i] = part;
+    }
+    ASSERT_EQ(handle->PutParts(&put), 0);
+    put.Wait();
+    ASSERT_EQ(put.status(), 0);
+
+    // a lost part file is decoded from parity
+    std::string lost = server_dirs[1] + "/7_1";
+    ASSERT_EQ(unlink(lost.c_str()), 0);
+    // aligned, so that a store reading in place would write the buffers
+    void *aligned = NULL;
+    ASSERT_EQ(posix_memalign(&aligned, kDirectIoAlignment, (k + m) * size), 0);
+    char *read = static_cast<char *>(aligned);
+    char *read_ptrs[k + m];
+    StripeGetRequest get;
+    for (int i = 0; i < k + m; i++) {
+        read_ptrs[i] = &read[i * size];
+        get.server_addrs[i] = i;
+    }
+    get.block_id = 7;
+    get.coder = &coder;
+    get.offset = 0;
+    get.length = size;
+    get.data_ptrs = read_ptrs;
+    get.coding_ptrs = read_ptrs + k;
+    ASSERT_EQ(handle->GetStripe(&get), 0);
+    get.Wait();
+    EXPECT_EQ(get.status(), 0);
+    EXPECT_EQ(memcmp(read, &parts[0], k * size), 0);
+    StripeGetStats stats;
+    handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_decoded, 1u);
+
+    // the extra reads are sent at once and canceled from the completion of
+    // the k-th read, on the thread of the store
+    for (int i = 0; i < 16; i++) {
+        StripeGetRequest hedged;
+        memset(read, 0, (k + m) * size);
+        hedged.server_addrs = get.server_addrs;
+        hedged.block_id = 7;
+        hedged.coder = &coder;
+        hedged.offset = 0;
+        hedged.length = size;
+        hedged.data_ptrs = read_ptrs;
+        hedged.coding_ptrs = read_ptrs + k;
+        hedged.num_extra_parts = 2;
+        hedged.hedge_delay_us = 0;
+        ASSERT_EQ(handle->GetStripe(&hedged), 0);
+        hedged.Wait();
+        EXPECT_EQ(hedged.status(), 0);
+        EXPECT_EQ(memcmp(read, &parts[0], k * size), 0);
+    }
+    handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_hedged, 16u);
+
+    store.Stop();
+    delete handle;
+    free(aligned);
+}
+
+TEST(TestFilePartStore, StripeGet)
+{
+    CheckStripeGet(FilePartStoreOptions());
+}
+
+TEST(TestFilePartStore, StripeGetThreadPool)
+{
+    FilePartStoreOptions options;
+    options.use_io_uring = false;
+    CheckStripeGet(options);
+}
+
+TEST(TestFilePartStore, LatencyHistogram)
+{
+    LatencyHistogram histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    EXPECT_EQ(histogram.Percentile(50), 0);
+    for (int i = 0; i < 90; i++) {
+        histogram.Add(100);
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.Add(5000);
+    }
+    histogram.Add(1);
+    EXPECT_EQ(histogram.buckets[0], 1u);
+    EXPECT_EQ(histogram.buckets[6], 90u);
+    EXPECT_EQ(histogram.Percentile(50), 128);
+    EXPECT_EQ(histogram.Percentile(99), 8192);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
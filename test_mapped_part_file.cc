@@ -0,0 +1,159 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/mapped_part_file.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+class TempDir {
+public:
+    TempDir() {
+        char path[] = "/tmp/test_mapped_part_file.XXXXXX";
+        EXPECT_TRUE(mkdtemp(path) != NULL);
+        m_path = path;
+    }
+
+    ~TempDir() {
+        std::string command = "rm -rf " + m_path;
+        EXPECT_EQ(system(command.c_str()), 0);
+    }
+
+    std::string File(int index) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/part_%d", index);
+        return m_path + name;
+    }
+
+    std::string m_path;
+};
+
+void WriteFile(const std::string &path, const char *data, size_t size)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, data, size), static_cast<ssize_t>(size));
+    close(fd);
+}
+
+std::string ReadFile(const std::string &path)
+{
+    std::string data;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return data;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        data.append(buf, n);
+    }
+    fclose(file);
+    return data;
+}
+
+TEST(TestMappedPartFile, Map)
+{
+    TempDir dir;
+    std::vector<char> data(3 * kPacketSize);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+    WriteFile(dir.File(0), &data[0], data.size());
+
+    MappedPartFile file;
+    EXPECT_EQ(file.MapForRead(dir.File(1).c_str(), 0, 100), -1);
+    EXPECT_EQ(file.MapForRead(dir.File(0).c_str(), kPacketSize, 3 * kPacketSize), -1);
+    EXPECT_TRUE(file.data() == NULL);
+
+    // a range not starting on a page
+    ASSERT_EQ(file.MapForRead(dir.File(0).c_str(), 100, 2 * kPacketSize), 0);
+    EXPECT_EQ(file.length(), 2 * kPacketSize);
+    EXPECT_EQ(memcmp(file.data(), &data[100], 2 * kPacketSize), 0);
+    file.Unmap();
+    EXPECT_TRUE(file.data() == NULL);
+
+    // a write mapping creates and extends the file
+    MappedPartFile output;
+    ASSERT_EQ(output.MapForWrite(dir.File(2).c_str(), kPacketSize, kPacketSize), 0);
+    memcpy(output.data(), &data[0], kPacketSize);
+    EXPECT_EQ(output.Sync(), 0);
+    std::string written = ReadFile(dir.File(2));
+    ASSERT_EQ(written.size(), static_cast<size_t>(2 * kPacketSize));
+    EXPECT_EQ(memcmp(written.data() + kPacketSize, &data[0], kPacketSize), 0);
+}
+
+TEST(TestMappedPartFile, DecodePartFiles)
+{
+    const int k = 6;
+    const int m = 3;
+    const int size = 2 * kCodingUnitSize;
+    const int offset = kPacketSize;
+    TempDir dir;
+    CauchyRSCoder coder(k, m);
+    std::vector<char> parts((k + m) * (offset + size));
+    char *ptrs[k + m];
+    for (int i = 0; i < k + m; i++) {
+        ptrs[i] = &parts[i * (offset + size)] + offset;
+    }
+    for (int i = 0; i < k; i++) {
+        for (int j = 0; j < offset + size; j++) {
+            parts[i * (offset + size) + j] = random();
+        }
+    }
+    coder.Encode(ptrs, ptrs + k, size);
+
+    std::vector<std::string> paths;
+    const char *path_ptrs[k + m];
+    for (int i = 0; i < k + m; i++) {
+        paths.push_back(dir.File(i));
+        WriteFile(paths[i], ptrs[i] - offset, offset + size);
+    }
+    for (int i = 0; i < k + m; i++) {
+        path_ptrs[i] = paths[i].c_str();
+    }
+
+    // lost files, rebuilt in place at the same offset
+    bool erased[k + m];
+    memset(erased, 0, sizeof(erased));
+    erased[1] = true;
+    erased[4] = true;
+    erased[k + 1] = true;
+    unlink(path_ptrs[1]);
+    unlink(path_ptrs[4]);
+    unlink(path_ptrs[k + 1]);
+    ASSERT_EQ(DecodePartFiles(&coder, erased, path_ptrs, offset, size), 0);
+    int lost[] = { 1, 4, k + 1 };
+    for (int i = 0; i < 3; i++) {
+        std::string rebuilt = ReadFile(paths[lost[i]]);
+        ASSERT_EQ(rebuilt.size(), static_cast<size_t>(offset + size));
+        EXPECT_EQ(memcmp(rebuilt.data() + offset, ptrs[lost[i]], size), 0);
+    }
+
+    // a missing survivor fails before any output is created
+    unlink(path_ptrs[0]);
+    unlink(path_ptrs[1]);
+    memset(erased, 0, sizeof(erased));
+    erased[1] = true;
+    EXPECT_EQ(DecodePartFiles(&coder, erased, path_ptrs, offset, size), -1);
+    EXPECT_NE(access(path_ptrs[1], F_OK), 0);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
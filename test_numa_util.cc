@@ -0,0 +1,44 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/numa_util.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(TestNumaUtil, Topology)
+{
+    int node_count = NumaGetNodeCount();
+    ASSERT_GE(node_count, 1);
+    ASSERT_LE(node_count, kMaxNumaNodes);
+    int node = NumaGetCurrentNode();
+    EXPECT_GE(node, 0);
+    EXPECT_LT(node, node_count);
+}
+
+TEST(TestNumaUtil, Placement)
+{
+    const size_t size = 1 << 20;
+    int node = NumaGetNodeCount() - 1;
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    EXPECT_EQ(NumaBindMemory(addr, size, node), 0);
+    memset(addr, 1, size);
+    munmap(addr, size);
+
+    EXPECT_EQ(NumaRunOnNode(node), 0);
+    if (NumaGetNodeCount() > 1) {
+        EXPECT_EQ(NumaGetCurrentNode(), node);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/test_part_fixture.h
+ * @brief LocalPartServer servers and a PartHandle on them, shared by the
+ *        fixtures of the tests which put and get parts
+ */
+
+#ifndef INF_DS_RBS_COMMON_TEST_PART_FIXTURE_H_
+#define INF_DS_RBS_COMMON_TEST_PART_FIXTURE_H_
+
+#include <stdint.h>
+#include "common/local_part_server.h"
+#include "common/part_handle.h"
+
+#include "gtest/gtest.h"
+
+/**
+ * @brief servers with the service time of base_latency_us, added by the
+ *        fixture, and a PartHandle on them. The servers are stopped before the
+ *        handle is deleted, as canceled reads still come back from them.
+ */
+class PartServerFixture {
+public:
+    explicit PartServerFixture(int base_latency_us,
+                               const PartHandleOptions &options = PartHandleOptions()) {
+        m_server_options.base_latency_us = base_latency_us;
+        m_handle = new PartHandle(&m_servers, options);
+    }
+
+    ~PartServerFixture() {
+        m_servers.Stop();
+        delete m_handle;
+    }
+
+    // servers first_addr to first_addr + num_servers - 1, with m_server_options
+    void AddServers(int64_t first_addr, int num_servers) {
+        for (int i = 0; i < num_servers; i++) {
+            m_servers.AddServer(first_addr + i, m_server_options);
+        }
+    }
+
+    // put bytes [part_offset, part_offset + size) of parts 0 to num_parts - 1
+    // of a block, part i from ptrs[i] to server first_addr + i
+    void PutParts(int64_t block_id, char *const *ptrs, int num_parts, int part_offset,
+                  int size, int64_t first_addr) {
+        PartsRequest put;
+        put.block_id = block_id;
+        for (int i = 0; i < num_parts; i++) {
+            Part part;
+            part.offset = part_offset;
+            part.length = size;
+            part.data = ptrs[i];
+            put.server_addrs[i] = first_addr + i;
+            put.todo_parts[i] = part;
+        }
+        EXPECT_EQ(m_handle->PutParts(&put), 0);
+        put.Wait();
+        EXPECT_EQ(put.status(), 0);
+    }
+
+    LocalPartServerOptions m_server_options;
+    LocalPartServer m_servers;
+    PartHandle *m_handle;
+};
+
+#endif  // INF_DS_RBS_COMMON_TEST_PART_FIXTURE_H_
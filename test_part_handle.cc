@@ -0,0 +1,453 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/part_handle.h"
+#include "common/local_part_server.h"
+#include "common/test_part_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// completes requests only when the test says so
+class ManualTransport : public PartTransport {
+public:
+    virtual void PutPart(PartRequest *request, PartTransportCallback *callback) {
+        m_requests.push_back(request);
+        m_callback = callback;
+    }
+
+    virtual void GetPart(PartRequest *request, PartTransportCallback *callback) {
+        PutPart(request, callback);
+    }
+
+    virtual void CancelPart(PartRequest * /* request */) {
+    }
+
+    void Complete(int status) {
+        PartRequest *request = m_requests.front();
+        m_requests.erase(m_requests.begin());
+        m_callback->OnPartDone(request, status);
+    }
+
+    std::vector<PartRequest *> m_requests;
+    PartTransportCallback *m_callback;
+};
+
+TEST(TestPartHandle, PutParts)
+{
+    const int num_parts = 6;
+    const int num_blocks = 20;
+    const int part_size = 64 << 10;
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 100;
+    for (int i = 0; i < num_parts; i++) {
+        ASSERT_EQ(servers.AddServer(1000 + i, server_options), 0);
+    }
+    PartHandle handle(&servers, PartHandleOptions());
+
+    std::vector<char> data(num_blocks * num_parts * part_size);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+    PartsRequest requests[num_blocks];
+    for (int b = 0; b < num_blocks; b++) {
+        requests[b].block_id = b;
+        for (int i = 0; i < num_parts; i++) {
+            Part part;
+            part.length = part_size;
+            part.offset = 0;
+            part.data = &data[(b * num_parts + i) * part_size];
+            requests[b].server_addrs[i] = 1000 + i;
+            requests[b].todo_parts[i] = part;
+        }
+        ASSERT_EQ(handle.PutParts(&requests[b]), 0);
+    }
+    for (int b = 0; b < num_blocks; b++) {
+        requests[b].Wait();
+        ASSERT_EQ(requests[b].status(), 0);
+        ASSERT_EQ(requests[b].finish_parts.size(), static_cast<size_t>(num_parts));
+        for (int i = 0; i < num_parts; i++) {
+            std::string stored;
+            ASSERT_TRUE(servers.ReadPart(1000 + i, b, i, &stored));
+            ASSERT_EQ(stored.size(), static_cast<size_t>(part_size));
+            ASSERT_EQ(memcmp(stored.data(), &data[(b * num_parts + i) * part_size], part_size), 0);
+        }
+    }
+
+    PartServerStats stats;
+    ASSERT_TRUE(handle.GetServerStats(1000, &stats));
+    EXPECT_EQ(stats.num_done, static_cast<uint64_t>(num_blocks));
+    EXPECT_EQ(stats.num_in_flight, 0);
+    EXPECT_EQ(stats.num_queued, 0);
+    EXPECT_GT(stats.base_latency_us, 0);
+    EXPECT_FALSE(handle.GetServerStats(999, &stats));
+}
+
+TEST(TestPartHandle, Window)
+{
+    ManualTransport transport;
+    PartHandleOptions options;
+    options.initial_window = 2;
+    options.min_window = 1;
+    options.max_window = 4;
+    PartHandle handle(&transport, options);
+
+    char buf[16];
+    PartsRequest requests[20];
+    for (int b = 0; b < 20; b++) {
+        Part part;
+        part.length = sizeof(buf);
+        part.offset = 0;
+        part.data = buf;
+        requests[b].block_id = b;
+        requests[b].server_addrs[0] = 1;
+        requests[b].todo_parts[0] = part;
+        ASSERT_EQ(handle.PutParts(&requests[b]), 0);
+    }
+
+    // only the window is sent, every completion sends the next
+    PartServerStats stats;
+    ASSERT_EQ(transport.m_requests.size(), 2u);
+    handle.GetServerStats(1, &stats);
+    EXPECT_EQ(stats.num_in_flight, 2);
+    EXPECT_EQ(stats.num_queued, 18);
+    transport.Complete(0);
+    EXPECT_TRUE(requests[0].IsDone());
+    EXPECT_EQ(transport.m_requests.size(), 2u);
+
+    // fast puts grow the window up to max_window
+    for (int i = 0; i < 10; i++) {
+        transport.Complete(0);
+    }
+    handle.GetServerStats(1, &stats);
+    EXPECT_EQ(stats.window, 4);
+    EXPECT_EQ(transport.m_requests.size(), 4u);
+
+    // a failure halves it, once for the puts already in flight
+    transport.Complete(-1);
+    transport.Complete(-1);
+    handle.GetServerStats(1, &stats);
+    EXPECT_EQ(stats.window, 2);
+    EXPECT_EQ(stats.num_decreases, 1u);
+    EXPECT_EQ(stats.num_failed, 2u);
+    while (!transport.m_requests.empty()) {
+        transport.Complete(0);
+    }
+    for (int b = 0; b < 20; b++) {
+        ASSERT_TRUE(requests[b].IsDone());
+        EXPECT_EQ(requests[b].status(), (b == 11 || b == 12) ? -1 : 0);
+    }
+}
+
+class CountingCallback : public PartsRequestCallback {
+public:
+    CountingCallback() : m_num_done(0) {}
+
+    virtual void OnPartsDone(PartsRequest *request) {
+        EXPECT_TRUE(request->IsDone());
+        __sync_fetch_and_add(&m_num_done, 1);
+    }
+
+    volatile int m_num_done;
+};
+
+TEST(TestPartHandle, FailedServer)
+{
+    LocalPartServer servers;
+    LocalPartServerOptions server_options;
+    server_options.base_latency_us = 10;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(servers.AddServer(i, server_options), 0);
+    }
+    servers.SetFailing(1, true);
+    PartHandle handle(&servers, PartHandleOptions());
+
+    char buf[4096];
+    memset(buf, 1, sizeof(buf));
+    PartsRequest request;
+    CountingCallback callback;
+    request.callback = &callback;
+    for (int i = 0; i < 4; i++) {
+        Part part;
+        part.length = sizeof(buf);
+        part.offset = 0;
+        part.data = buf;
+        request.todo_parts[i] = part;
+    }
+    request.server_addrs[0] = 0;
+    request.server_addrs[1] = 1;
+    request.server_addrs[2] = 2;
+    // a part without server is refused before anything is put
+    ASSERT_EQ(handle.PutParts(&request), -1);
+
+    // and an unknown server fails the part
+    request.server_addrs[3] = 3;
+    ASSERT_EQ(handle.PutParts(&request), 0);
+    while (callback.m_num_done == 0) {
+        usleep(1000);
+    }
+    EXPECT_EQ(request.status(), -1);
+    EXPECT_EQ(request.finish_parts.size(), 2u);
+    EXPECT_TRUE(request.finish_parts.find(1) == request.finish_parts.end());
+    EXPECT_TRUE(request.finish_parts.find(3) == request.finish_parts.end());
+}
+
+// a stripe of k + m parts put to one server each, part i to server i
+class StripeFixture : public PartServerFixture {
+public:
+    StripeFixture(int k, int m, int size, const PartHandleOptions &options = PartHandleOptions())
+        : PartServerFixture(100, options), m_coder(k, m), m_k(k), m_m(m), m_size(size) {
+        m_server_options.num_workers = 2;
+        AddServers(0, k + m);
+        for (int i = 0; i < k + m; i++) {
+            m_parts[i] = new char[size];
+            if (i < k) {
+                for (int j = 0; j < size; j++) {
+                    m_parts[i][j] = random();
+                }
+            }
+        }
+        m_coder.Encode(m_parts, m_parts + k, size);
+        PutParts(0, m_parts, k + m, 0, size, 0);
+    }
+
+    ~StripeFixture() {
+        for (int i = 0; i < m_k + m_m; i++) {
+            delete[] m_parts[i];
+        }
+    }
+
+    // read [offset, offset + length) of the data parts and check it
+    void Get(int num_extra_parts, int hedge_delay_us, int offset, int length, int expected_status) {
+        char *ptrs[m_k + m_m];
+        StripeGetRequest request;
+        for (int i = 0; i < m_k + m_m; i++) {
+            ptrs[i] = new char[length];
+            request.server_addrs[i] = i;
+        }
+        request.coder = &m_coder;
+        request.offset = offset;
+        request.length = length;
+        request.data_ptrs = ptrs;
+        request.coding_ptrs = ptrs + m_k;
+        request.num_extra_parts = num_extra_parts;
+        request.hedge_delay_us = hedge_delay_us;
+        ASSERT_EQ(m_handle->GetStripe(&request), 0);
+        request.Wait();
+        EXPECT_EQ(request.status(), expected_status);
+        for (int i = 0; i < m_k && expected_status == 0; i++) {
+            EXPECT_EQ(memcmp(ptrs[i], m_parts[i] + offset, length), 0);
+        }
+        for (int i = 0; i < m_k + m_m; i++) {
+            delete[] ptrs[i];
+        }
+    }
+
+    CauchyRSCoder m_coder;
+    int m_k;
+    int m_m;
+    int m_size;
+    char *m_parts[32];
+};
+
+TEST(TestPartHandle, DegradedGet)
+{
+    StripeFixture stripe(6, 3, 4 * kCodingUnitSize);
+    StripeGetStats stats;
+    stripe.Get(0, 0, kCodingUnitSize, 2 * kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_gets, 1u);
+    EXPECT_EQ(stats.num_decoded, 0u);
+
+    // a failed server is replaced by parity part 0, the lost data part is
+    // the xor of the others and the parity parts not read are not decoded
+    stripe.m_servers.SetFailing(1, true);
+    stripe.Get(0, 0, 0, 4 * kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_decoded, 1u);
+    EXPECT_EQ(stats.num_xor_decoded, 1u);
+
+    // as are more
+    stripe.m_servers.SetFailing(4, true);
+    stripe.m_servers.SetFailing(6, true);
+    stripe.Get(0, 0, 0, 4 * kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_decoded, 2u);
+    EXPECT_EQ(stats.num_xor_decoded, 1u);
+
+    // until less than k parts are left
+    stripe.m_servers.SetFailing(7, true);
+    stripe.Get(0, 0, 0, kCodingUnitSize, -1);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_gets, 4u);
+    EXPECT_EQ(stats.num_failed, 1u);
+
+    // a request without k servers is refused
+    StripeGetRequest request;
+    request.coder = &stripe.m_coder;
+    request.length = kCodingUnitSize;
+    request.server_addrs[0] = 0;
+    EXPECT_EQ(stripe.m_handle->GetStripe(&request), -1);
+}
+
+TEST(TestPartHandle, HedgedGet)
+{
+    StripeFixture stripe(6, 3, 2 * kCodingUnitSize);
+    StripeGetStats stats;
+
+    // extra reads sent at once: the first k parts make the data
+    stripe.Get(2, 0, 0, 2 * kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_hedged, 1u);
+
+    // stripes finished while their last reads are still being sent
+    for (int i = 0; i < 32; i++) {
+        stripe.Get(3, 0, 0, 2 * kCodingUnitSize, 0);
+    }
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_hedged, 33u);
+
+    // a slow server is hedged after the delay and its read canceled
+    stripe.m_servers.SetExtraLatency(2, 500000);
+    int64_t start_us = NowUs();
+    stripe.Get(1, 5000, 0, 2 * kCodingUnitSize, 0);
+    EXPECT_LT(NowUs() - start_us, 400000);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_hedged, 34u);
+    EXPECT_GE(stats.num_hedge_wins, 1u);
+    EXPECT_GE(stats.num_decoded, 1u);
+    stripe.m_servers.Stop();
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_GE(stats.num_canceled, 1u);
+}
+
+TEST(TestPartHandle, DecodedCache)
+{
+    DecodedUnitCache cache(64 * kCodingUnitSize);
+    PartHandleOptions options;
+    options.decoded_cache = &cache;
+    StripeFixture stripe(4, 2, 4 * kCodingUnitSize, options);
+    StripeGetStats stats;
+    DecodedUnitCacheStats cache_stats;
+
+    // reads without decoding are not admitted
+    stripe.Get(0, 0, 0, 4 * kCodingUnitSize, 0);
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.num_insertions, 0u);
+
+    // a degraded read is, and serves the rows it decoded
+    stripe.m_servers.SetFailing(1, true);
+    stripe.Get(0, 0, kCodingUnitSize, 2 * kCodingUnitSize, 0);
+    stripe.Get(0, 0, kCodingUnitSize, kCodingUnitSize, 0);
+    stripe.Get(0, 0, 2 * kCodingUnitSize, kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_decoded, 1u);
+    EXPECT_EQ(stats.num_cached, 2u);
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.num_insertions, 2u);
+    EXPECT_EQ(cache_stats.bytes_saved, 2 * 4 * kCodingUnitSize);
+
+    // a range with a row not cached is read whole
+    stripe.Get(0, 0, 0, 2 * kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_decoded, 2u);
+
+    // once the block is repaired its rows are read from the parts
+    stripe.m_servers.SetFailing(1, false);
+    cache.InvalidateBlock(0);
+    stripe.Get(0, 0, kCodingUnitSize, kCodingUnitSize, 0);
+    stripe.m_handle->GetStripeStats(&stats);
+    EXPECT_EQ(stats.num_cached, 2u);
+    EXPECT_EQ(stats.num_decoded, 2u);
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.num_invalidations, 3u);
+    EXPECT_EQ(cache_stats.bytes_cached, 0);
+
+    // rows decoded while a put of the block is in flight are dropped when it
+    // completes
+    stripe.m_servers.SetFailing(1, true);
+    stripe.m_servers.SetExtraLatency(5, 100000);
+    PartsRequest put;
+    put.block_id = 0;
+    put.server_addrs[5] = 5;
+    Part part;
+    part.offset = 0;
+    part.length = stripe.m_size;
+    part.data = stripe.m_parts[5];
+    put.todo_parts[5] = part;
+    ASSERT_EQ(stripe.m_handle->PutParts(&put), 0);
+    stripe.Get(0, 0, 0, kCodingUnitSize, 0);
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.bytes_cached, 4 * kCodingUnitSize);
+    put.Wait();
+    EXPECT_EQ(put.status(), 0);
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.bytes_cached, 0);
+    EXPECT_EQ(cache_stats.num_invalidations, 4u);
+}
+
+TEST(TestPartHandle, GetParts)
+{
+    StripeFixture stripe(4, 2, 2 * kCodingUnitSize);
+
+    // every part reads its own range
+    PartsRequest request;
+    request.block_id = 0;
+    for (int i = 0; i < 6; i++) {
+        request.server_addrs[i] = i;
+    }
+    for (int i = 0; i < 3; i++) {
+        Part part;
+        part.offset = i * kPacketSize;
+        part.length = (i + 1) * kPacketSize;
+        part.data = new char[part.length];
+        request.todo_parts[i] = part;
+    }
+    ASSERT_EQ(stripe.m_handle->GetParts(&request), 0);
+    request.Wait();
+    ASSERT_EQ(request.status(), 0);
+    ASSERT_EQ(request.finish_parts.size(), 3u);
+    for (int i = 0; i < 3; i++) {
+        const Part &part = request.todo_parts[i];
+        EXPECT_EQ(memcmp(part.data, stripe.m_parts[i] + part.offset, part.length), 0);
+    }
+
+    // a failed server fails the request, the other parts are still read
+    stripe.m_servers.SetFailing(1, true);
+    ASSERT_EQ(stripe.m_handle->GetParts(&request), 0);
+    request.Wait();
+    EXPECT_EQ(request.status(), -1);
+    EXPECT_EQ(request.finish_parts.size(), 2u);
+    for (int i = 0; i < 3; i++) {
+        delete[] request.todo_parts[i].data;
+    }
+
+    // a part without server is refused
+    PartsRequest orphan;
+    orphan.todo_parts[0] = Part();
+    EXPECT_EQ(stripe.m_handle->GetParts(&orphan), -1);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
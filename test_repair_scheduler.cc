@@ -0,0 +1,249 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/repair_scheduler.h"
+#include "common/test_part_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int kDataParts = 4;
+const int kCodeParts = 2;
+const int kPartSize = 2 * kCodingUnitSize;
+const int64_t kTarget = 100;    ///< part i is rebuilt on server kTarget + i
+
+int64_t NowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// blocks of k + m parts, part i on server i
+class BlockFixture : public PartServerFixture {
+public:
+    explicit BlockFixture(int num_blocks)
+        : PartServerFixture(50), m_coder(kDataParts, kCodeParts), m_num_blocks(num_blocks) {
+        AddServers(0, kDataParts + kCodeParts);
+        AddServers(kTarget, kDataParts + kCodeParts);
+        m_parts.resize(num_blocks * (kDataParts + kCodeParts));
+        for (int b = 0; b < num_blocks; b++) {
+            char *ptrs[kDataParts + kCodeParts];
+            for (int i = 0; i < kDataParts + kCodeParts; i++) {
+                std::string &part = m_parts[b * (kDataParts + kCodeParts) + i];
+                part.resize(kPartSize);
+                for (int j = 0; j < kPartSize && i < kDataParts; j++) {
+                    part[j] = random();
+                }
+                ptrs[i] = &part[0];
+            }
+            m_coder.Encode(ptrs, ptrs + kDataParts, kPartSize);
+            PutParts(b, ptrs, kDataParts + kCodeParts, 0, kPartSize, 0);
+        }
+    }
+
+    // the block without the parts of lost servers, to be rebuilt on targets
+    LostBlock Lose(int64_t block_id, int lost1, int lost2) {
+        LostBlock block;
+        block.block_id = block_id;
+        block.part_size = kPartSize;
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            if (i == lost1 || i == lost2) {
+                block.target_addrs[i] = kTarget + i;
+            } else {
+                block.server_addrs[i] = i;
+            }
+        }
+        return block;
+    }
+
+    // whether the part rebuilt on its target is the one lost
+    bool Rebuilt(int64_t block_id, int part_index) {
+        std::string stored;
+        return m_servers.ReadPart(kTarget + part_index, block_id, part_index, &stored)
+            && stored == m_parts[block_id * (kDataParts + kCodeParts) + part_index];
+    }
+
+    CauchyRSCoder m_coder;
+    int m_num_blocks;
+    std::vector<std::string> m_parts;
+};
+
+class OrderListener : public RepairListener {
+public:
+    OrderListener() {
+        pthread_mutex_init(&m_mutex, NULL);
+    }
+
+    ~OrderListener() {
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    virtual void OnBlockRepaired(const LostBlock &block, int status) {
+        pthread_mutex_lock(&m_mutex);
+        m_order.push_back(block.block_id);
+        m_status.push_back(status);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    std::vector<int64_t> m_order;
+    std::vector<int> m_status;
+    pthread_mutex_t m_mutex;
+};
+
+TEST(TestRepairScheduler, Repair)
+{
+    BlockFixture blocks(16);
+    OrderListener listener;
+    DecodedUnitCache cache(1 << 20);
+    RepairSchedulerOptions options;
+    options.num_concurrent = 1;
+    options.listener = &listener;
+    options.decoded_cache = &cache;
+    RepairScheduler scheduler(&blocks.m_coder, blocks.m_handle, options);
+
+    // server 1 is lost, and server 4 as well for the last blocks, which go
+    // first; server 5 for a parity part only
+    for (int64_t b = 0; b < 8; b++) {
+        ASSERT_EQ(scheduler.AddBlock(blocks.Lose(b, 1, -1)), 0);
+    }
+    for (int64_t b = 8; b < 12; b++) {
+        ASSERT_EQ(scheduler.AddBlock(blocks.Lose(b, 5, -1)), 0);
+    }
+    for (int64_t b = 12; b < 16; b++) {
+        ASSERT_EQ(scheduler.AddBlock(blocks.Lose(b, 1, 4)), 0);
+    }
+    RepairProgress progress;
+    scheduler.GetProgress(&progress);
+    EXPECT_EQ(progress.num_queued, 16u);
+    EXPECT_EQ(progress.eta_us, -1);
+    std::vector<char> row(kCodingUnitSize);
+    char *row_ptrs[kDataParts] = {&row[0], &row[0], &row[0], &row[0]};
+    cache.Insert(3, 0, kDataParts, row_ptrs, 0, cache.BlockGeneration(3));
+
+    ASSERT_EQ(scheduler.Start(), 0);
+    scheduler.WaitIdle();
+    ASSERT_EQ(listener.m_order.size(), 16u);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_GE(listener.m_order[i], 12);
+    }
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(listener.m_status[i], 0);
+    }
+    for (int64_t b = 0; b < 16; b++) {
+        if (b < 8 || b >= 12) {
+            EXPECT_TRUE(blocks.Rebuilt(b, 1));
+        } else {
+            EXPECT_TRUE(blocks.Rebuilt(b, 5));
+        }
+        if (b >= 12) {
+            EXPECT_TRUE(blocks.Rebuilt(b, 4));
+        }
+    }
+
+    scheduler.GetProgress(&progress);
+    EXPECT_EQ(progress.num_blocks, 16u);
+    EXPECT_EQ(progress.num_repaired, 16u);
+    EXPECT_EQ(progress.num_failed, 0u);
+    EXPECT_EQ(progress.num_queued, 0u);
+    EXPECT_EQ(progress.num_patterns, 3u);
+    EXPECT_EQ(progress.num_schedule_hits, 13u);
+    EXPECT_EQ(progress.bytes_read, 16 * kDataParts * kPartSize);
+    EXPECT_EQ(progress.bytes_written, 20 * kPartSize);
+    EXPECT_EQ(progress.bytes_left, 0);
+    EXPECT_EQ(progress.eta_us, 0);
+    DecodedUnitCacheStats cache_stats;
+    cache.GetStats(&cache_stats);
+    EXPECT_EQ(cache_stats.num_invalidations, 1u);
+}
+
+TEST(TestRepairScheduler, Failed)
+{
+    BlockFixture blocks(2);
+    OrderListener listener;
+    RepairSchedulerOptions options;
+    options.listener = &listener;
+    RepairScheduler scheduler(&blocks.m_coder, blocks.m_handle, options);
+    ASSERT_EQ(scheduler.Start(), 0);
+
+    // a survivor that can not be read fails the block
+    blocks.m_servers.SetFailing(2, true);
+    ASSERT_EQ(scheduler.AddBlock(blocks.Lose(0, 1, -1)), 0);
+    scheduler.WaitIdle();
+    ASSERT_EQ(listener.m_status.size(), 1u);
+    EXPECT_EQ(listener.m_status[0], -1);
+    RepairProgress progress;
+    scheduler.GetProgress(&progress);
+    EXPECT_EQ(progress.num_failed, 1u);
+
+    // blocks that can not be repaired are refused
+    EXPECT_EQ(scheduler.AddBlock(blocks.Lose(1, -1, -1)), -1);
+    LostBlock block = blocks.Lose(1, 0, 1);
+    block.server_addrs.erase(2);
+    block.target_addrs[2] = kTarget + 2;
+    EXPECT_EQ(scheduler.AddBlock(block), -1);
+    block = blocks.Lose(1, 1, -1);
+    block.target_addrs.clear();
+    EXPECT_EQ(scheduler.AddBlock(block), -1);
+    block = blocks.Lose(1, 1, -1);
+    block.part_size = 100;
+    EXPECT_EQ(scheduler.AddBlock(block), -1);
+}
+
+TEST(TestRepairScheduler, Throttle)
+{
+    BlockFixture blocks(10);
+    RepairSchedulerOptions options;
+    options.num_concurrent = 2;
+    options.slice_size = kCodingUnitSize;
+    // 5 parts of a block moved in 10 ms, paced by halves
+    options.max_bytes_per_sec = static_cast<int64_t>(5 * kPartSize) * 100;
+    options.min_bytes_per_sec = options.max_bytes_per_sec;
+    RepairScheduler scheduler(&blocks.m_coder, blocks.m_handle, options);
+    for (int64_t b = 0; b < 10; b++) {
+        ASSERT_EQ(scheduler.AddBlock(blocks.Lose(b, 0, -1)), 0);
+    }
+    int64_t start_us = NowUs();
+    ASSERT_EQ(scheduler.Start(), 0);
+    scheduler.WaitIdle();
+    EXPECT_GE(NowUs() - start_us, 90000);
+    for (int64_t b = 0; b < 10; b++) {
+        EXPECT_TRUE(blocks.Rebuilt(b, 0));
+    }
+
+    // Stop does not wait for the pacing, the blocks started finish and the
+    // others stay queued
+    options.max_bytes_per_sec = 5 * kCodingUnitSize;
+    options.min_bytes_per_sec = options.max_bytes_per_sec;
+    RepairScheduler slow(&blocks.m_coder, blocks.m_handle, options);
+    for (int64_t b = 0; b < 10; b++) {
+        ASSERT_EQ(slow.AddBlock(blocks.Lose(b, 1, -1)), 0);
+    }
+    start_us = NowUs();
+    ASSERT_EQ(slow.Start(), 0);
+    usleep(20000);
+    slow.Stop();
+    EXPECT_LT(NowUs() - start_us, 500000);
+    RepairProgress progress;
+    slow.GetProgress(&progress);
+    EXPECT_EQ(progress.num_in_flight, 0);
+    EXPECT_EQ(progress.num_repaired, 2u);
+    EXPECT_EQ(progress.num_queued, 8u);
+    EXPECT_TRUE(blocks.Rebuilt(0, 1));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
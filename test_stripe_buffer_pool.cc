@@ -0,0 +1,131 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/stripe_buffer_pool.h"
+
+#include <string.h>
+
+#include "common/numa_util.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+void CheckBuffers(StripeBuffers *buffers, int k, int m, int part_size)
+{
+    ASSERT_TRUE(buffers != NULL);
+    for (int i = 0; i < k + m; i++) {
+        char *ptr = (i < k) ? buffers->data_ptrs[i] : buffers->coding_ptrs[i - k];
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % kStripeBufferAlignment, 0u);
+        // every part is writable over its whole size
+        memset(ptr, i, part_size);
+    }
+    for (int i = 0; i < k + m; i++) {
+        char *ptr = (i < k) ? buffers->data_ptrs[i] : buffers->coding_ptrs[i - k];
+        ASSERT_EQ(ptr[0], static_cast<char>(i));
+        ASSERT_EQ(ptr[part_size - 1], static_cast<char>(i));
+    }
+}
+
+TEST(TestStripeBufferPool, NodePlacement)
+{
+    StripeBufferPool pool(4, 2, 1 << 16, 4, false);
+    StripeBufferPoolStats stats;
+    StripeBuffers *buffers = pool.Acquire();
+    ASSERT_TRUE(buffers != NULL);
+    EXPECT_EQ(buffers->node, NumaGetCurrentNode());
+    pool.Release(buffers);
+
+    // a set asked for on a node is placed there
+    int node = NumaGetNodeCount() - 1;
+    buffers = pool.Acquire(node);
+    CheckBuffers(buffers, 4, 2, 1 << 16);
+    EXPECT_EQ(buffers->node, node);
+    pool.Release(buffers);
+    pool.GetStats(&stats);
+    EXPECT_EQ(stats.num_node_misses, 0u);
+}
+
+TEST(TestStripeBufferPool, AcquireRelease)
+{
+    for (int huge = 0; huge < 2; huge++) {
+        StripeBufferPool pool(8, 4, 1 << 20, 2, huge == 1);
+        StripeBufferPoolStats stats;
+
+        // first sets are allocated
+        StripeBuffers *sets[6];
+        for (int i = 0; i < 6; i++) {
+            sets[i] = pool.Acquire();
+            CheckBuffers(sets[i], 8, 4, 1 << 20);
+        }
+        pool.GetStats(&stats);
+        EXPECT_EQ(stats.num_acquires, 6u);
+        EXPECT_EQ(stats.num_allocations, 6u);
+        EXPECT_EQ(stats.num_sets, 6);
+        EXPECT_EQ(stats.num_in_use_sets, 6);
+
+        // 2 go to the thread cache, 2 to the shared list, the others are freed
+        for (int i = 0; i < 6; i++) {
+            pool.Release(sets[i]);
+        }
+        pool.GetStats(&stats);
+        EXPECT_EQ(stats.num_in_use_sets, 0);
+        EXPECT_EQ(stats.num_cached_sets, 2);
+        EXPECT_EQ(stats.num_sets, 4);
+
+        // and are served back without allocating
+        for (int i = 0; i < 5; i++) {
+            sets[i] = pool.Acquire();
+            CheckBuffers(sets[i], 8, 4, 1 << 20);
+        }
+        pool.GetStats(&stats);
+        EXPECT_EQ(stats.num_thread_hits, 2u);
+        EXPECT_EQ(stats.num_pool_hits, 2u);
+        EXPECT_EQ(stats.num_allocations, 7u);
+        EXPECT_EQ(stats.num_cached_sets, 0);
+        for (int i = 0; i < 5; i++) {
+            pool.Release(sets[i]);
+        }
+    }
+}
+
+void *AcquireAndExit(void *arg)
+{
+    StripeBufferPool *pool = static_cast<StripeBufferPool *>(arg);
+    StripeBuffers *buffers = pool->Acquire();
+    pool->Release(buffers);
+    return NULL;
+}
+
+TEST(TestStripeBufferPool, ThreadExit)
+{
+    StripeBufferPool pool(4, 2, 1 << 16, 4, false);
+    pthread_t thread;
+    ASSERT_EQ(pthread_create(&thread, NULL, AcquireAndExit, &pool), 0);
+    pthread_join(thread, NULL);
+
+    // the set cached by the exited thread is in the shared list
+    StripeBufferPoolStats stats;
+    pool.GetStats(&stats);
+    EXPECT_EQ(stats.num_cached_sets, 1);
+    StripeBuffers *buffers = pool.Acquire();
+    pool.GetStats(&stats);
+    EXPECT_EQ(stats.num_pool_hits, 1u);
+    EXPECT_EQ(stats.num_allocations, 1u);
+    pool.Release(buffers);
+
+    // beyond max_cached_sets it is freed
+    StripeBufferPool small(4, 2, 1 << 16, 0, false);
+    ASSERT_EQ(pthread_create(&thread, NULL, AcquireAndExit, &small), 0);
+    pthread_join(thread, NULL);
+    small.GetStats(&stats);
+    EXPECT_EQ(stats.num_cached_sets, 0);
+    EXPECT_EQ(stats.num_sets, 0);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+}
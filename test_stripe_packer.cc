@@ -0,0 +1,226 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/stripe_packer.h"
+#include "common/test_part_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int kDataParts = 4;
+const int kCodeParts = 2;
+
+// k + m servers, part i to server i
+class PackerFixture : public PartServerFixture {
+public:
+    PackerFixture() : PartServerFixture(50), m_coder(kDataParts, kCodeParts) {
+        AddServers(0, kDataParts + kCodeParts);
+        for (int i = 0; i < kDataParts + kCodeParts; i++) {
+            m_server_addrs[i] = i;
+        }
+    }
+
+    CauchyRSCoder m_coder;
+    std::map<int, int64_t> m_server_addrs;
+};
+
+class CountingCallback : public SmallPutCallback {
+public:
+    CountingCallback() : m_num_done(0) {}
+
+    virtual void OnSmallPutDone(SmallPutRequest *request) {
+        EXPECT_TRUE(request->IsDone());
+        EXPECT_EQ(request->status(), 0);
+        __sync_fetch_and_add(&m_num_done, 1);
+    }
+
+    volatile int m_num_done;
+};
+
+TEST(TestStripePacker, GetPieces)
+{
+    std::vector<PackedPiece> pieces;
+    ObjectLocation location;
+    location.stripe_id = 0;
+
+    // within one unit of part 1
+    location.offset = kCodingUnitSize + 100;
+    location.length = 200;
+    StripePacker::GetPieces(location, kDataParts, &pieces);
+    ASSERT_EQ(pieces.size(), 1u);
+    EXPECT_EQ(pieces[0].part_index, 1);
+    EXPECT_EQ(pieces[0].part_offset, 100);
+
+    // across the end of the first row, to part 0 of the next one
+    location.offset = kDataParts * kCodingUnitSize - 10;
+    location.length = kCodingUnitSize;
+    StripePacker::GetPieces(location, kDataParts, &pieces);
+    ASSERT_EQ(pieces.size(), 2u);
+    EXPECT_EQ(pieces[0].part_index, kDataParts - 1);
+    EXPECT_EQ(pieces[0].part_offset, kCodingUnitSize - 10);
+    EXPECT_EQ(pieces[0].length, 10);
+    EXPECT_EQ(pieces[1].part_index, 0);
+    EXPECT_EQ(pieces[1].part_offset, kCodingUnitSize);
+    EXPECT_EQ(pieces[1].length, kCodingUnitSize - 10);
+    EXPECT_EQ(pieces[1].object_offset, 10);
+}
+
+TEST(TestStripePacker, PutGet)
+{
+    PackerFixture fixture;
+    StripePackerOptions options;
+    options.part_size = 2 * kCodingUnitSize;
+    options.max_object_size = kCodingUnitSize;
+    options.max_delay_us = 1000000;
+    options.first_stripe_id = 100;
+    StripePacker packer(&fixture.m_coder, fixture.m_handle, fixture.m_server_addrs, options);
+
+    // enough objects for a few full stripes and an open one
+    const int num_objects = 200;
+    std::vector<std::string> objects(num_objects);
+    SmallPutRequest requests[num_objects];
+    CountingCallback callback;
+    for (int i = 0; i < num_objects; i++) {
+        objects[i].resize(1 + random() % (kCodingUnitSize / 4));
+        for (size_t j = 0; j < objects[i].size(); j++) {
+            objects[i][j] = random();
+        }
+        requests[i].data = objects[i].data();
+        requests[i].length = objects[i].size();
+        requests[i].callback = (i % 2 == 0) ? &callback : NULL;
+        ASSERT_EQ(packer.Put(&requests[i]), 0);
+    }
+    packer.Flush();
+    for (int i = 0; i < num_objects; i++) {
+        if (requests[i].callback == NULL) {
+            requests[i].Wait();
+            ASSERT_EQ(requests[i].status(), 0);
+        }
+    }
+    while (callback.m_num_done < num_objects / 2) {
+        usleep(1000);
+    }
+
+    // objects of a stripe are packed back to back
+    for (int i = 1; i < num_objects; i++) {
+        const ObjectLocation &prev = requests[i - 1].location;
+        const ObjectLocation &location = requests[i].location;
+        if (location.stripe_id == prev.stripe_id) {
+            EXPECT_EQ(location.offset, prev.offset + prev.length);
+        } else {
+            EXPECT_EQ(location.stripe_id, prev.stripe_id + 1);
+            EXPECT_EQ(location.offset, 0);
+        }
+    }
+    EXPECT_EQ(requests[0].location.stripe_id, 100);
+
+    std::vector<char> data(kCodingUnitSize);
+    for (int i = 0; i < num_objects; i++) {
+        ASSERT_EQ(packer.Get(requests[i].location, &data[0]), 0);
+        ASSERT_EQ(memcmp(&data[0], objects[i].data(), objects[i].size()), 0);
+    }
+
+    StripePackerStats stats;
+    packer.GetStats(&stats);
+    EXPECT_EQ(stats.num_objects, static_cast<uint64_t>(num_objects));
+    EXPECT_EQ(stats.num_stripes, static_cast<uint64_t>(requests[num_objects - 1].location.stripe_id - 99));
+    EXPECT_EQ(stats.num_full_stripes + 1, stats.num_stripes);
+    EXPECT_EQ(stats.num_failed_stripes, 0u);
+    EXPECT_GE(stats.stripe_bytes, stats.object_bytes);
+    EXPECT_EQ(stats.num_gets, static_cast<uint64_t>(num_objects));
+    EXPECT_EQ(stats.num_degraded_gets, 0u);
+
+    // empty and oversize objects are refused
+    SmallPutRequest request;
+    EXPECT_EQ(packer.Put(&request), -1);
+    request.data = &data[0];
+    request.length = kCodingUnitSize + 1;
+    EXPECT_EQ(packer.Put(&request), -1);
+}
+
+TEST(TestStripePacker, Delay)
+{
+    PackerFixture fixture;
+    StripePackerOptions options;
+    options.max_delay_us = 20000;
+    StripePacker packer(&fixture.m_coder, fixture.m_handle, fixture.m_server_addrs, options);
+
+    // a lone object is put once the open stripe waited max_delay_us, cut to
+    // one row of units
+    char buf[100];
+    memset(buf, 7, sizeof(buf));
+    SmallPutRequest request;
+    request.data = buf;
+    request.length = sizeof(buf);
+    ASSERT_EQ(packer.Put(&request), 0);
+    request.Wait();
+    ASSERT_EQ(request.status(), 0);
+    std::string stored;
+    ASSERT_TRUE(fixture.m_servers.ReadPart(0, 0, 0, &stored));
+    EXPECT_EQ(stored.size(), static_cast<size_t>(kCodingUnitSize));
+    ASSERT_TRUE(fixture.m_servers.ReadPart(kDataParts, 0, kDataParts, &stored));
+    EXPECT_EQ(stored.size(), static_cast<size_t>(kCodingUnitSize));
+
+    StripePackerStats stats;
+    packer.GetStats(&stats);
+    EXPECT_EQ(stats.num_stripes, 1u);
+    EXPECT_EQ(stats.num_full_stripes, 0u);
+    EXPECT_EQ(stats.stripe_bytes, kDataParts * kCodingUnitSize);
+}
+
+TEST(TestStripePacker, DegradedGet)
+{
+    PackerFixture fixture;
+    StripePackerOptions options;
+    StripePacker packer(&fixture.m_coder, fixture.m_handle, fixture.m_server_addrs, options);
+
+    // an object in parts 0 and 1, around the end of the first unit
+    std::vector<char> object(kCodingUnitSize);
+    for (size_t i = 0; i < object.size(); i++) {
+        object[i] = random();
+    }
+    std::vector<char> pad(kCodingUnitSize / 2, 1);
+    SmallPutRequest first;
+    first.data = &pad[0];
+    first.length = pad.size();
+    ASSERT_EQ(packer.Put(&first), 0);
+    SmallPutRequest second;
+    second.data = &object[0];
+    second.length = object.size();
+    ASSERT_EQ(packer.Put(&second), 0);
+    packer.Flush();
+    second.Wait();
+    ASSERT_EQ(second.status(), 0);
+
+    // a failed data part is decoded from the others
+    fixture.m_servers.SetFailing(1, true);
+    std::vector<char> data(object.size());
+    ASSERT_EQ(packer.Get(second.location, &data[0]), 0);
+    EXPECT_EQ(memcmp(&data[0], &object[0], object.size()), 0);
+    StripePackerStats stats;
+    packer.GetStats(&stats);
+    EXPECT_EQ(stats.num_degraded_gets, 1u);
+
+    // until less than k parts are left
+    fixture.m_servers.SetFailing(4, true);
+    fixture.m_servers.SetFailing(5, true);
+    EXPECT_EQ(packer.Get(second.location, &data[0]), -1);
+    packer.GetStats(&stats);
+    EXPECT_EQ(stats.num_gets, 2u);
+    EXPECT_EQ(stats.num_degraded_gets, 1u);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
@@ -0,0 +1,283 @@
+// Copyright (c) 2015, The Authors. All rights reserved.
+
+#include "common/transcoder.h"
+#include "common/cauchy_rs_stream_encoder.h"
+#include "common/test_part_fixture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int kOldData = 6;
+const int kOldCode = 3;
+const int kNewData = 12;
+const int kNewCode = 4;
+const int64_t kTarget = 100;    ///< new part i is put on server kTarget + i
+
+// the parts of a block laid out by CauchyRSStreamEncoder
+class PartCollector : public StripeListener {
+public:
+    PartCollector(int num_data_parts, int num_code_parts)
+        : m_num_data_parts(num_data_parts), m_parts(num_data_parts + num_code_parts) {}
+
+    virtual void OnStripe(int64_t /* part_offset */, char **data_ptrs, char **coding_ptrs,
+                          int size) {
+        for (int i = 0; i < static_cast<int>(m_parts.size()); i++) {
+            m_parts[i].append(i < m_num_data_parts ? data_ptrs[i]
+                                                   : coding_ptrs[i - m_num_data_parts], size);
+        }
+    }
+
+    int m_num_data_parts;
+    std::vector<std::string> m_parts;
+};
+
+std::vector<std::string> Layout(CauchyRSCoder *coder, int slice_size, const std::string &data)
+{
+    PartCollector collector(coder->num_data_parts(), coder->num_code_parts());
+    CauchyRSStreamEncoder encoder(coder, slice_size, &collector);
+    encoder.Append(data.data(), data.size());
+    encoder.Finish();
+    return collector.m_parts;
+}
+
+// blocks put in the old profile, old part i on server i
+class TranscodeFixture : public PartServerFixture {
+public:
+    TranscodeFixture()
+        : PartServerFixture(50), m_old_coder(kOldData, kOldCode), m_new_coder(kNewData, kNewCode) {
+        AddServers(0, kOldData + kOldCode);
+        AddServers(kTarget, kNewData + kNewCode);
+    }
+
+    TranscodeBlock Put(int64_t block_id, int64_t block_size) {
+        std::string data(block_size, 0);
+        for (int64_t i = 0; i < block_size; i++) {
+            data[i] = random();
+        }
+        m_data[block_id] = data;
+        std::vector<std::string> parts = Layout(&m_old_coder, kCodingUnitSize, data);
+        TranscodeBlock block;
+        block.block_id = block_id;
+        block.block_size = block_size;
+        char *ptrs[kOldData + kOldCode];
+        for (int i = 0; i < kOldData + kOldCode; i++) {
+            ptrs[i] = &parts[i][0];
+            block.old_server_addrs[i] = i;
+        }
+        PutParts(block_id, ptrs, kOldData + kOldCode, 0, parts[0].size(), 0);
+        for (int i = 0; i < kNewData + kNewCode; i++) {
+            block.new_server_addrs[i] = kTarget + i;
+        }
+        return block;
+    }
+
+    // whether the new parts are those of a Put of the block in the new profile
+    bool Transcoded(int64_t block_id, int slice_size) {
+        std::vector<std::string> parts = Layout(&m_new_coder, slice_size, m_data[block_id]);
+        for (int i = 0; i < kNewData + kNewCode; i++) {
+            std::string stored;
+            if (!m_servers.ReadPart(kTarget + i, block_id, i, &stored) || stored != parts[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CauchyRSCoder m_old_coder;
+    CauchyRSCoder m_new_coder;
+    std::map<int64_t, std::string> m_data;
+};
+
+class StatusListener : public TranscodeListener {
+public:
+    StatusListener() {
+        pthread_mutex_init(&m_mutex, NULL);
+    }
+
+    ~StatusListener() {
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    virtual void OnBlockTranscoded(const TranscodeBlock &block, int status) {
+        pthread_mutex_lock(&m_mutex);
+        m_status[block.block_id] = status;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    std::map<int64_t, int> m_status;
+    pthread_mutex_t m_mutex;
+};
+
+TEST(TestTranscoder, Transcode)
+{
+    TranscodeFixture fixture;
+    StatusListener listener;
+    TranscoderOptions options;
+    options.num_concurrent = 2;
+    options.old_slice_size = kCodingUnitSize;
+    options.new_slice_size = 2 * kCodingUnitSize;
+    options.listener = &listener;
+    Transcoder transcoder(&fixture.m_old_coder, &fixture.m_new_coder, fixture.m_handle, options);
+
+    // whole stripes of both profiles, a short last stripe, a block of one
+    // partial stripe
+    int64_t sizes[4] = {24 * kCodingUnitSize, 24 * kCodingUnitSize + 1000, 7 * kCodingUnitSize,
+                        1000};
+    int64_t old_part_bytes = 0;
+    for (int64_t b = 0; b < 4; b++) {
+        ASSERT_EQ(transcoder.AddBlock(fixture.Put(b, sizes[b])), 0);
+        old_part_bytes += Layout(&fixture.m_old_coder, kCodingUnitSize, fixture.m_data[b])[0].size();
+    }
+    TranscodeBlock empty = fixture.Put(9, 1);
+    empty.block_size = 0;
+    EXPECT_EQ(transcoder.AddBlock(empty), -1);
+    ASSERT_EQ(transcoder.Start(), 0);
+    transcoder.WaitIdle();
+
+    for (int64_t b = 0; b < 4; b++) {
+        EXPECT_EQ(listener.m_status[b], 0);
+        EXPECT_TRUE(fixture.Transcoded(b, 2 * kCodingUnitSize));
+    }
+    TranscoderStats stats;
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_blocks, 4u);
+    EXPECT_EQ(stats.num_transcoded, 4u);
+    EXPECT_EQ(stats.num_failed, 0u);
+    EXPECT_EQ(stats.num_corrupt, 0u);
+    EXPECT_EQ(stats.num_stripes, 4u + 5u + 2u + 1u);
+    EXPECT_EQ(stats.num_degraded_stripes, 0u);
+    EXPECT_EQ(stats.bytes_transcoded, sizes[0] + sizes[1] + sizes[2] + sizes[3]);
+    EXPECT_EQ(stats.bytes_read, (kOldData + kOldCode) * old_part_bytes);
+    EXPECT_GE(stats.bytes_written, stats.bytes_transcoded * (kNewData + kNewCode) / kNewData);
+    EXPECT_EQ(stats.buffer_bytes, 2 * (2 * (kOldData + kOldCode) * kCodingUnitSize +
+                                       (kNewData + kNewCode) * 2 * kCodingUnitSize));
+}
+
+TEST(TestTranscoder, Degraded)
+{
+    TranscodeFixture fixture;
+    StatusListener listener;
+    TranscoderOptions options;
+    options.old_slice_size = kCodingUnitSize;
+    options.verify = false;
+    options.listener = &listener;
+    Transcoder transcoder(&fixture.m_old_coder, &fixture.m_new_coder, fixture.m_handle, options);
+    ASSERT_EQ(transcoder.Start(), 0);
+
+    // a lost data part is decoded from the parity, read only then
+    int64_t block_size = 12 * kCodingUnitSize;
+    TranscodeBlock block = fixture.Put(0, block_size);
+    fixture.m_servers.SetFailing(2, true);
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    transcoder.WaitIdle();
+    EXPECT_EQ(listener.m_status[0], 0);
+    EXPECT_TRUE(fixture.Transcoded(0, options.new_slice_size));
+    TranscoderStats stats;
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_stripes, 2u);
+    EXPECT_EQ(stats.num_degraded_stripes, 2u);
+    EXPECT_EQ(stats.bytes_read, 2 * (kOldData - 1 + kOldCode) * kCodingUnitSize);
+
+    // a part without server is lost too, a healthy block reads k parts
+    fixture.m_servers.SetFailing(2, false);
+    block = fixture.Put(1, block_size);
+    block.old_server_addrs.erase(2);
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    block = fixture.Put(2, block_size);
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    transcoder.WaitIdle();
+    EXPECT_TRUE(fixture.Transcoded(1, options.new_slice_size));
+    EXPECT_TRUE(fixture.Transcoded(2, options.new_slice_size));
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_transcoded, 3u);
+    EXPECT_EQ(stats.num_degraded_stripes, 4u);
+    EXPECT_EQ(stats.bytes_read, 4 * (kOldData - 1 + kOldCode) * kCodingUnitSize +
+                                2 * kOldData * kCodingUnitSize);
+
+    // more than m parts lost fail the block
+    block = fixture.Put(3, block_size);
+    for (int i = 0; i < kOldCode; i++) {
+        fixture.m_servers.SetFailing(i, true);
+    }
+    fixture.m_servers.SetFailing(kOldData, true);
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    transcoder.WaitIdle();
+    EXPECT_EQ(listener.m_status[3], -1);
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_failed, 1u);
+    EXPECT_EQ(stats.num_corrupt, 0u);
+}
+
+TEST(TestTranscoder, Corrupt)
+{
+    TranscodeFixture fixture;
+    StatusListener listener;
+    TranscoderOptions options;
+    options.old_slice_size = kCodingUnitSize;
+    options.listener = &listener;
+    Transcoder transcoder(&fixture.m_old_coder, &fixture.m_new_coder, fixture.m_handle, options);
+    ASSERT_EQ(transcoder.Start(), 0);
+
+    // a flipped byte in the second stripe of a data part
+    int64_t block_size = 18 * kCodingUnitSize;
+    TranscodeBlock block = fixture.Put(0, block_size);
+    char flipped = fixture.m_data[0][kOldData * kCodingUnitSize + 3] ^ 1;
+    PartsRequest put;
+    put.block_id = 0;
+    put.server_addrs[0] = 0;
+    Part part;
+    part.offset = kCodingUnitSize + 3;
+    part.length = 1;
+    part.data = &flipped;
+    put.todo_parts[0] = part;
+    fixture.m_handle->PutParts(&put);
+    put.Wait();
+    ASSERT_EQ(put.status(), 0);
+
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    transcoder.WaitIdle();
+    EXPECT_EQ(listener.m_status[0], -1);
+    TranscoderStats stats;
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_failed, 1u);
+    EXPECT_EQ(stats.num_corrupt, 1u);
+    EXPECT_EQ(stats.num_stripes, 2u);
+    EXPECT_EQ(stats.bytes_transcoded, 0);
+
+    // still found with a parity part lost
+    block = fixture.Put(1, block_size);
+    flipped = fixture.m_data[1][kOldData * kCodingUnitSize + 3] ^ 1;
+    PartsRequest reput;
+    reput.block_id = 1;
+    reput.server_addrs[0] = 0;
+    reput.todo_parts[0] = part;
+    fixture.m_handle->PutParts(&reput);
+    reput.Wait();
+    ASSERT_EQ(reput.status(), 0);
+    fixture.m_servers.SetFailing(kOldData + 1, true);
+
+    ASSERT_EQ(transcoder.AddBlock(block), 0);
+    transcoder.WaitIdle();
+    EXPECT_EQ(listener.m_status[1], -1);
+    transcoder.GetStats(&stats);
+    EXPECT_EQ(stats.num_failed, 2u);
+    EXPECT_EQ(stats.num_corrupt, 2u);
+    EXPECT_EQ(stats.num_stripes, 4u);
+    EXPECT_EQ(stats.bytes_transcoded, 0);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    srand(time(NULL));
+    return RUN_ALL_TESTS();
+}
+
+}
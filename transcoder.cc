@@ -0,0 +1,372 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved.
+ * @file transcoder.cc
+ * @brief migration of blocks from one (k, m) profile to another, stripe by
+ *        stripe without holding a whole block in memory
+ */
+
+#include "common/transcoder.h"
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+
+static int64_t _NowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+TranscoderOptions::TranscoderOptions() {
+    num_concurrent = 4;
+    old_slice_size = 4 * kCodingUnitSize;
+    new_slice_size = 4 * kCodingUnitSize;
+    verify = true;
+    listener = NULL;
+}
+
+Transcoder::StripeWriter::StripeWriter(PartHandle *handle, const TranscodeBlock &block,
+                                       int num_data_parts)
+    : status(0), bytes_written(0), m_handle(handle), m_block(block),
+      m_num_data_parts(num_data_parts) {
+}
+
+void Transcoder::StripeWriter::OnStripe(int64_t part_offset, char **data_ptrs,
+                                        char **coding_ptrs, int size) {
+    if (status != 0) {
+        return;
+    }
+    // the buffers are the encoder's, put them before it goes on
+    PartsRequest put;
+    put.block_id = m_block.block_id;
+    put.server_addrs = m_block.new_server_addrs;
+    int num_parts = static_cast<int>(m_block.new_server_addrs.size());
+    for (int i = 0; i < num_parts; i++) {
+        Part part;
+        part.offset = static_cast<int>(part_offset);
+        part.length = size;
+        part.data = (i < m_num_data_parts) ? data_ptrs[i] : coding_ptrs[i - m_num_data_parts];
+        put.todo_parts[i] = part;
+    }
+    status = m_handle->PutParts(&put);
+    if (status == 0) {
+        put.Wait();
+        status = put.status();
+    }
+    if (status == 0) {
+        bytes_written += static_cast<int64_t>(num_parts) * size;
+    }
+}
+
+Transcoder::Transcoder(CauchyRSCoder *old_coder, CauchyRSCoder *new_coder, PartHandle *handle,
+                       const TranscoderOptions &options)
+    : m_old_coder(old_coder),
+      m_new_coder(new_coder),
+      m_handle(handle),
+      m_options(options),
+      m_num_old_parts(old_coder->num_data_parts() + old_coder->num_code_parts()),
+      m_pool(old_coder->num_data_parts(), old_coder->num_code_parts(), options.old_slice_size,
+             2 * options.num_concurrent, false) {
+    assert(options.num_concurrent > 0);
+    assert(options.old_slice_size > 0 && options.old_slice_size % kCodingUnitSize == 0);
+    assert(options.new_slice_size > 0 && options.new_slice_size % kCodingUnitSize == 0);
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+    m_stopping = false;
+    m_num_in_flight = 0;
+    m_start_us = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    int num_new_parts = new_coder->num_data_parts() + new_coder->num_code_parts();
+    // two old stripes being read and worked on, one new stripe being filled
+    m_stats.buffer_bytes = static_cast<int64_t>(options.num_concurrent) *
+                           (2 * m_num_old_parts * options.old_slice_size +
+                            num_new_parts * options.new_slice_size);
+}
+
+Transcoder::~Transcoder() {
+    Stop();
+    pthread_mutex_destroy(&m_mutex);
+    pthread_cond_destroy(&m_cond);
+}
+
+int Transcoder::Start() {
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = false;
+    for (int i = 0; i < m_options.num_concurrent; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, _WorkerThread, this) == 0) {
+            m_workers.push_back(worker);
+        }
+    }
+    int ret = m_workers.empty() ? -1 : 0;
+    pthread_mutex_unlock(&m_mutex);
+    return ret;
+}
+
+void Transcoder::Stop() {
+    pthread_mutex_lock(&m_mutex);
+    m_stopping = true;
+    pthread_cond_broadcast(&m_cond);
+    std::vector<pthread_t> workers;
+    workers.swap(m_workers);
+    pthread_mutex_unlock(&m_mutex);
+    for (size_t i = 0; i < workers.size(); i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+int Transcoder::AddBlock(const TranscodeBlock &block) {
+    if (block.block_size <= 0) {
+        return -1;
+    }
+    int num_old_parts = 0;
+    for (std::map<int, int64_t>::const_iterator iter = block.old_server_addrs.begin();
+         iter != block.old_server_addrs.end(); ++iter) {
+        if (iter->first >= 0 && iter->first < m_num_old_parts) {
+            num_old_parts++;
+        }
+    }
+    if (num_old_parts < m_old_coder->num_data_parts()) {
+        return -1;
+    }
+    int num_new_parts = m_new_coder->num_data_parts() + m_new_coder->num_code_parts();
+    if (static_cast<int>(block.new_server_addrs.size()) != num_new_parts) {
+        return -1;
+    }
+    for (int i = 0; i < num_new_parts; i++) {
+        if (block.new_server_addrs.find(i) == block.new_server_addrs.end()) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_queue.push_back(block);
+    m_stats.num_blocks++;
+    pthread_cond_signal(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+void Transcoder::WaitIdle() {
+    pthread_mutex_lock(&m_mutex);
+    while (!m_queue.empty() || m_num_in_flight > 0) {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+PartsRequest *Transcoder::_StartRead(const TranscodeBlock &block, int64_t index,
+                                     StripeBuffers *buffers) {
+    int num_data_parts = m_old_coder->num_data_parts();
+    int num_read = m_options.verify ? m_num_old_parts : num_data_parts;
+    PartsRequest *get = new PartsRequest;
+    get->block_id = block.block_id;
+    get->server_addrs = block.old_server_addrs;
+    for (int i = 0; i < num_read; i++) {
+        if (block.old_server_addrs.find(i) == block.old_server_addrs.end()) {
+            continue;
+        }
+        Part part;
+        part.offset = static_cast<int>(index * m_options.old_slice_size);
+        part.length = CauchyRSStreamEncoder::StripeSliceSize(num_data_parts,
+                                                             m_options.old_slice_size,
+                                                             block.block_size, index);
+        part.data = (i < num_data_parts) ? buffers->data_ptrs[i]
+                                         : buffers->coding_ptrs[i - num_data_parts];
+        get->todo_parts[i] = part;
+    }
+    if (m_handle->GetParts(get) != 0) {
+        delete get;
+        return NULL;
+    }
+    return get;
+}
+
+int Transcoder::_FinishRead(const TranscodeBlock &block, int64_t index, PartsRequest *get,
+                            StripeBuffers *buffers) {
+    int num_data_parts = m_old_coder->num_data_parts();
+    int slice_size = CauchyRSStreamEncoder::StripeSliceSize(num_data_parts,
+                                                            m_options.old_slice_size,
+                                                            block.block_size, index);
+    get->Wait();
+    bool erased[m_num_old_parts];
+    for (int i = 0; i < m_num_old_parts; i++) {
+        erased[i] = (get->finish_parts.find(i) == get->finish_parts.end());
+    }
+    int64_t bytes_read = static_cast<int64_t>(get->finish_parts.size()) * slice_size;
+    delete get;
+
+    bool data_lost = false;
+    for (int i = 0; i < num_data_parts; i++) {
+        data_lost = data_lost || erased[i];
+    }
+    if (data_lost && !m_options.verify) {
+        // the parity was not read, it is needed to decode
+        PartsRequest parity;
+        parity.block_id = block.block_id;
+        parity.server_addrs = block.old_server_addrs;
+        for (int i = num_data_parts; i < m_num_old_parts; i++) {
+            if (block.old_server_addrs.find(i) == block.old_server_addrs.end()) {
+                continue;
+            }
+            Part part;
+            part.offset = static_cast<int>(index * m_options.old_slice_size);
+            part.length = slice_size;
+            part.data = buffers->coding_ptrs[i - num_data_parts];
+            parity.todo_parts[i] = part;
+        }
+        if (!parity.todo_parts.empty() && m_handle->GetParts(&parity) == 0) {
+            parity.Wait();
+            for (std::map<int, Part>::const_iterator iter = parity.finish_parts.begin();
+                 iter != parity.finish_parts.end(); ++iter) {
+                erased[iter->first] = false;
+            }
+            bytes_read += static_cast<int64_t>(parity.finish_parts.size()) * slice_size;
+        }
+    }
+
+    int num_erased = 0;
+    for (int i = 0; i < m_num_old_parts; i++) {
+        num_erased += erased[i] ? 1 : 0;
+    }
+    int status = 0;
+    bool corrupt = false;
+    if (num_erased > m_old_coder->num_code_parts()) {
+        status = -1;
+    } else if (m_options.verify) {
+        // the lost parity parts are rebuilt from the data too, so Verify
+        // checks the data against the parity parts read beyond the k decoded
+        if (num_erased > 0) {
+            m_old_coder->Decode(erased, buffers->data_ptrs, buffers->coding_ptrs, slice_size);
+        }
+        if (!m_old_coder->Verify(buffers->data_ptrs, buffers->coding_ptrs, slice_size,
+                                 NULL, NULL)) {
+            status = -1;
+            corrupt = true;
+        }
+    } else if (data_lost) {
+        m_old_coder->DecodeData(erased, buffers->data_ptrs, buffers->coding_ptrs, slice_size);
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.num_stripes++;
+    m_stats.bytes_read += bytes_read;
+    if (data_lost && status == 0) {
+        m_stats.num_degraded_stripes++;
+    }
+    if (corrupt) {
+        m_stats.num_corrupt++;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return status;
+}
+
+int Transcoder::_Transcode(const TranscodeBlock &block) {
+    int num_data_parts = m_old_coder->num_data_parts();
+    StripeWriter writer(m_handle, block, m_new_coder->num_data_parts());
+    CauchyRSStreamEncoder encoder(m_new_coder, m_options.new_slice_size, &writer);
+    StripeBuffers *buffers[2];
+    buffers[0] = m_pool.Acquire();
+    buffers[1] = m_pool.Acquire();
+    int status = (buffers[0] != NULL && buffers[1] != NULL) ? 0 : -1;
+
+    int64_t num_stripes = CauchyRSStreamEncoder::NumStripes(num_data_parts,
+                                                            m_options.old_slice_size,
+                                                            block.block_size);
+    int64_t remaining = block.block_size;
+    PartsRequest *get = NULL;
+    if (status == 0) {
+        get = _StartRead(block, 0, buffers[0]);
+        status = (get != NULL) ? 0 : -1;
+    }
+    for (int64_t index = 0; index < num_stripes && status == 0; index++) {
+        // the next stripe is read into the other buffers while this one is
+        // re-encoded and put
+        PartsRequest *next = NULL;
+        if (index + 1 < num_stripes) {
+            next = _StartRead(block, index + 1, buffers[(index + 1) % 2]);
+        }
+        StripeBuffers *stripe = buffers[index % 2];
+        status = _FinishRead(block, index, get, stripe);
+        get = next;
+        if (status == 0) {
+            int slice_size = CauchyRSStreamEncoder::StripeSliceSize(
+                num_data_parts, m_options.old_slice_size, block.block_size, index);
+            for (int i = 0; i < num_data_parts && remaining > 0; i++) {
+                int length = static_cast<int>(std::min<int64_t>(slice_size, remaining));
+                encoder.Append(stripe->data_ptrs[i], length);
+                remaining -= length;
+            }
+            status = writer.status;
+        }
+        if (status == 0 && index + 1 < num_stripes && get == NULL) {
+            status = -1;
+        }
+    }
+    if (get != NULL) {
+        // read ahead of a failed stripe, its buffers can not go back before
+        get->Wait();
+        delete get;
+    }
+    if (status == 0) {
+        encoder.Finish();
+        status = writer.status;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (buffers[i] != NULL) {
+            m_pool.Release(buffers[i]);
+        }
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.bytes_written += writer.bytes_written;
+    pthread_mutex_unlock(&m_mutex);
+    return status;
+}
+
+void *Transcoder::_WorkerThread(void *arg) {
+    static_cast<Transcoder *>(arg)->_RunWorker();
+    return NULL;
+}
+
+void Transcoder::_RunWorker() {
+    pthread_mutex_lock(&m_mutex);
+    while (true) {
+        while (!m_stopping && m_queue.empty()) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        if (m_stopping) {
+            break;
+        }
+        TranscodeBlock block = m_queue.front();
+        m_queue.pop_front();
+        m_num_in_flight++;
+        if (m_start_us == 0) {
+            m_start_us = _NowUs();
+        }
+        pthread_mutex_unlock(&m_mutex);
+
+        int status = _Transcode(block);
+        if (m_options.listener != NULL) {
+            m_options.listener->OnBlockTranscoded(block, status);
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        m_num_in_flight--;
+        if (status == 0) {
+            m_stats.num_transcoded++;
+            m_stats.bytes_transcoded += block.block_size;
+        } else {
+            m_stats.num_failed++;
+        }
+        pthread_cond_broadcast(&m_cond);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void Transcoder::GetStats(TranscoderStats *stats) const {
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    stats->elapsed_us = (m_start_us == 0) ? 0 : _NowUs() - m_start_us;
+    pthread_mutex_unlock(&m_mutex);
+}
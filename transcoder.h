@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2015, The Authors. All rights reserved
+ * @file common/transcoder.h
+ * @brief migration of blocks from one (k, m) profile to another, stripe by
+ *        stripe without holding a whole block in memory
+ */
+
+#ifndef INF_DS_RBS_COMMON_TRANSCODER_H_
+#define INF_DS_RBS_COMMON_TRANSCODER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include "common/cauchy_rs_stream_encoder.h"
+#include "common/cauchy_rscode.h"
+#include "common/part_handle.h"
+#include "common/stripe_buffer_pool.h"
+
+/**
+ * @brief a block to move to the new profile
+ */
+struct TranscodeBlock {
+    int64_t block_id;
+    std::map<int, int64_t> old_server_addrs;    ///< part index, 0 to k+m-1, of the
+                                                ///< old profile to data server,
+                                                ///< lost parts left out
+    std::map<int, int64_t> new_server_addrs;    ///< every part index of the new
+                                                ///< profile to data server
+    int64_t block_size;                         ///< bytes of data of the block
+};
+
+/**
+ * @brief told of every block transcoded or failed, e.g. to switch its
+ *        location and profile in the meta service and delete the old parts
+ */
+class TranscodeListener {
+public:
+    virtual ~TranscodeListener() {}
+
+    /**
+     * @param status    0 if every new part is put, -1 if a stripe could not be
+     *                  read, did not verify, or a new part was not put
+     */
+    virtual void OnBlockTranscoded(const TranscodeBlock &block, int status) = 0;
+};
+
+struct TranscoderOptions {
+    TranscoderOptions();
+
+    int num_concurrent;         ///< blocks transcoded at the same time
+    int old_slice_size;         ///< of the CauchyRSStreamEncoder the blocks were
+                                ///< put with, a multiple of kCodingUnitSize
+    int new_slice_size;         ///< of the stripes of the new profile
+    bool verify;                ///< read the parity of every old stripe too and
+                                ///< check it against the data
+    TranscodeListener *listener;    ///< not owned, NULL for none
+};
+
+struct TranscoderStats {
+    uint64_t num_blocks;        ///< added
+    uint64_t num_transcoded;
+    uint64_t num_failed;
+    uint64_t num_corrupt;       ///< of the failed blocks, with a stripe whose
+                                ///< parity does not match its data
+    uint64_t num_stripes;       ///< old stripes read
+    uint64_t num_degraded_stripes;  ///< with a lost data part, decoded and
+                                    ///< verified only against the parity
+                                    ///< parts read beyond k
+    int64_t bytes_transcoded;   ///< of data of the blocks transcoded
+    int64_t bytes_read;         ///< of old parts
+    int64_t bytes_written;      ///< of new parts
+    int64_t elapsed_us;         ///< since the first block was started
+    int64_t buffer_bytes;       ///< stripe buffers of all the workers, the
+                                ///< memory used whatever the block size
+};
+
+/**
+ * @brief Transcodes blocks laid out by CauchyRSStreamEncoder on worker
+ *        threads, one block per worker at a time. A worker reads the old
+ *        stripes of its block in order with GetParts, one stripe ahead of the
+ *        one it works on. The stripe is decoded when data parts are lost and,
+ *        with verify, checked with Verify against the parity parts read, its
+ *        lost parity parts rebuilt first. Its data is
+ *        appended to a CauchyRSStreamEncoder of the new coder, whose stripes
+ *        are put with PutParts as they are complete. A worker holds two old
+ *        stripes and one new stripe, so the memory is bounded by the slice
+ *        sizes and num_concurrent, not by the blocks.
+ *
+ *        The IO amplification, bytes_read + bytes_written over
+ *        bytes_transcoded, is (k + m) / k + (k' + m') / k' with verify and
+ *        1 + (k' + m') / k' without, as for a Get of the block and a Put of
+ *        it again which hold the whole block, plus the padding of the last
+ *        stripes.
+ */
+class Transcoder {
+public:
+    /**
+     * @param old_coder Coder of the profile the blocks are in, not owned
+     * @param new_coder Coder of the profile to move them to, not owned
+     * @param handle    Used to read the old parts and put the new ones, not owned
+     */
+    Transcoder(CauchyRSCoder *old_coder, CauchyRSCoder *new_coder, PartHandle *handle,
+               const TranscoderOptions &options);
+
+    /**
+     * @brief Stop
+     */
+    ~Transcoder();
+
+    /**
+     * @brief start the workers
+     *
+     * @return 0 on success, -1 if no worker starts
+     */
+    int Start();
+
+    /**
+     * @brief finish the blocks being transcoded and stop the workers, the
+     *        blocks still queued stay queued
+     */
+    void Stop();
+
+    /**
+     * @brief queue a block
+     *
+     * @return 0 on success, -1 if the block is empty, less than k old parts
+     *         have a server or a new part has none
+     */
+    int AddBlock(const TranscodeBlock &block);
+
+    /**
+     * @brief wait until no block is queued or being transcoded
+     */
+    void WaitIdle();
+
+    void GetStats(TranscoderStats *stats) const;
+
+private:
+    /**
+     * @brief puts the stripes of the new profile of one block
+     */
+    class StripeWriter : public StripeListener {
+    public:
+        StripeWriter(PartHandle *handle, const TranscodeBlock &block, int num_data_parts);
+
+        virtual void OnStripe(int64_t part_offset, char **data_ptrs, char **coding_ptrs,
+                              int size);
+
+        int status;                 ///< -1 once a put failed
+        int64_t bytes_written;
+
+    private:
+        PartHandle *m_handle;
+        const TranscodeBlock &m_block;
+        int m_num_data_parts;
+    };
+
+    static void *_WorkerThread(void *arg);
+
+    void _RunWorker();
+
+    int _Transcode(const TranscodeBlock &block);
+
+    /**
+     * @brief start reading an old stripe into buffers
+     *
+     * @return the request, NULL if no part can be read
+     */
+    PartsRequest *_StartRead(const TranscodeBlock &block, int64_t index,
+                             StripeBuffers *buffers);
+
+    /**
+     * @brief wait for an old stripe, read the parity if a data part is lost
+     *        and it was not read, then decode it and, with verify, check it
+     *        against the parity parts read
+     *
+     * @return 0 if the data is in buffers, -1 if less than k parts could be
+     *         read or the parity does not match
+     */
+    int _FinishRead(const TranscodeBlock &block, int64_t index, PartsRequest *get,
+                    StripeBuffers *buffers);
+
+    CauchyRSCoder *m_old_coder;
+    CauchyRSCoder *m_new_coder;
+    PartHandle *m_handle;
+    TranscoderOptions m_options;
+    int m_num_old_parts;
+    StripeBufferPool m_pool;                ///< of old stripes
+
+    mutable pthread_mutex_t m_mutex;        ///< protects the members below
+    pthread_cond_t m_cond;                  ///< signaled on a block queued or
+                                            ///< done and on stop
+    std::deque<TranscodeBlock> m_queue;
+    std::vector<pthread_t> m_workers;
+    bool m_stopping;
+    int m_num_in_flight;
+    int64_t m_start_us;                     ///< of the first block, 0 before
+    TranscoderStats m_stats;
+};
+
+#endif  // INF_DS_RBS_COMMON_TRANSCODER_H_